@@ -0,0 +1,100 @@
+/**
+    @file os_atomic.h
+    @brief Minimal atomic operations and thread local storage
+*/
+#ifndef __OS_ATOMIC__
+#define __OS_ATOMIC__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+    @defgroup OSATOMIC Atomic operations
+    @ingroup OSGLOBALS
+
+    Operations on naturally aligned 32 bits integers and pointers, used by
+    the lock-free rings of the os layer and of the sensor interface.
+    @{
+*/
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+/** Thread local storage qualifier */
+#define OS_TLS                          __declspec(thread)
+// volatile accesses have acquire/release semantics with MSVC
+/** Load with acquire semantics */
+#define OS_ATOMIC_LOAD_ACQ(p)           (*(p))
+/** Store with release semantics */
+#define OS_ATOMIC_STORE_REL(p, v)       (*(p) = (v))
+/** Atomic increment, returns the previous value */
+#define OS_ATOMIC_FETCH_INC(p)          ((uint32_t) _InterlockedIncrement((volatile long *) (p)) - 1)
+/** Atomic add, returns the previous value */
+#define OS_ATOMIC_FETCH_ADD(p, v)       ((uint32_t) _InterlockedExchangeAdd((volatile long *) (p), (long) (v)))
+/** Compare and swap, returns non zero when *p was equal to e and was replaced by v */
+#define OS_ATOMIC_CAS(p, e, v)          (_InterlockedCompareExchange((volatile long *) (p), (long) (v), (long) (e)) == (long) (e))
+/** Full memory barrier */
+#define OS_ATOMIC_FENCE()               _mm_mfence()
+#else
+#define OS_TLS                          __thread
+#define OS_ATOMIC_LOAD_ACQ(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define OS_ATOMIC_STORE_REL(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define OS_ATOMIC_FETCH_INC(p)          __atomic_fetch_add((p), 1, __ATOMIC_ACQ_REL)
+#define OS_ATOMIC_FETCH_ADD(p, v)       __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define OS_ATOMIC_CAS(p, e, v)          __os_atomic_cas32((p), (e), (v))
+#define OS_ATOMIC_FENCE()               __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static __inline int __os_atomic_cas32(volatile uint32_t *p, uint32_t e, uint32_t v)
+{
+    return __atomic_compare_exchange_n(p, &e, v, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+/**
+    Sequence lock. The sequence is odd while the protected data is written.
+    Writers are serialized by the sequence itself, readers never block them:
+    they copy the data and check the sequence did not change meanwhile.
+*/
+static __inline void os_atomic_seq_write_begin(volatile uint32_t *seq)
+{
+    uint32_t cur;
+
+    do
+    {
+        cur = OS_ATOMIC_LOAD_ACQ(seq);
+    } while ((cur & 1) || !OS_ATOMIC_CAS(seq, cur, cur + 1));
+}
+
+/** Ends a write started by os_atomic_seq_write_begin() */
+static __inline void os_atomic_seq_write_end(volatile uint32_t *seq)
+{
+    OS_ATOMIC_STORE_REL(seq, *seq + 1);
+}
+
+/** Starts a read, waits for the writer in progress (if any) and returns the sequence */
+static __inline uint32_t os_atomic_seq_read_begin(volatile uint32_t *seq)
+{
+    uint32_t cur;
+
+    while ((cur = OS_ATOMIC_LOAD_ACQ(seq)) & 1)
+        ;
+
+    return cur;
+}
+
+/** Ends a read, returns non zero when the data was written meanwhile (copy it again) */
+static __inline int os_atomic_seq_read_retry(volatile uint32_t *seq, uint32_t start)
+{
+    OS_ATOMIC_FENCE();
+
+    return OS_ATOMIC_LOAD_ACQ(seq) != start;
+}
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  __OS_ATOMIC__ */
@@ -1,84 +1,196 @@
-#include <windows.h>
-#include <stdint.h>
-#include "os_kernel.h"
-#include "os_util.h"
-
-#define OS_DBG_SO_THREAD  0
-#define OS_DBG_SO_SEMA    0
-#define OS_DBG_SO_CRITSEC 0
-
-#define OS_THREAD_MAX_NAME 16
-
-const int OS_THREAD_DEFAULT_PRI = 0;
-const int OS_THREAD_DEFAULT_STACK = 120;
-
-typedef unsigned int(__stdcall *win32_thead_func)(void *);
-
-struct os_thread_s
-{
-    HANDLE handle;
-    win32_thead_func entry_point;
-    os_thread_arg arg;
-    int pri;
-    int stack_size;
-    char name[OS_THREAD_MAX_NAME];
-};
-
-void os_kernel_sleep(uint32_t time_ms)
-{
-	Sleep(time_ms);
-}
-
-int os_kernel_get_def_pri(void)
-{
-    return OS_THREAD_DEFAULT_PRI;
-}
-
-unsigned int os_kernel_get_def_stack(void)
-{
-    return OS_THREAD_DEFAULT_STACK;
-}
-
-unsigned int os_kernel_get_def_time_slice(void)
-{
-    return 0;
-}
-
-
-os_thread_t os_kernel_create(os_kernel_func entry_point, const char* task_name, os_thread_arg arg,
-    int pri, int stack_size, int time_slice_ms, int auto_start)
-{
-    os_thread_t tsk = NULL;
-    /* time_slice and auto_start not used for win32 port */
-
-    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Creating thread: %s, priority: %d, stack_size: %d - Allocating TCB...", task_name, pri, stack_size));
-
-
-    tsk = (os_thread_t) calloc(1, sizeof(struct os_thread_s));
-    OS_UTIL_ASSERT(tsk);
-
-    tsk->entry_point = (win32_thead_func) entry_point;
-    tsk->arg = arg;
-    tsk->pri = pri;
-    tsk->stack_size = stack_size;
-    strncpy(tsk->name, task_name, OS_THREAD_MAX_NAME);
-
-    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Creating thread (EP=%08X, ARGS=%08X, PRI=%d)",
-        (void *) entry_point, arg, pri));
-
-    // security attributes
-    // stack size
-    // thread's start address
-    // arguments
-    // thread's initial state
-    // return thread id.
-
-    tsk->handle = (HANDLE) _beginthreadex(NULL, 0, tsk->entry_point, tsk->arg,
-        auto_start ? 0 : CREATE_SUSPENDED, NULL);
-
-    OS_UTIL_ASSERT(tsk->handle);
-
-    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Thread created"));
-
-    return tsk;
-}
+#include <windows.h>
+#include <stdint.h>
+#include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
+#include "os_util.h"
+
+#define OS_DBG_SO_THREAD  0
+#define OS_DBG_SO_SEMA    0
+#define OS_DBG_SO_CRITSEC 0
+
+#define OS_THREAD_MAX_NAME 16
+
+const int OS_THREAD_DEFAULT_PRI = 0;
+const int OS_THREAD_DEFAULT_STACK = 120;
+
+typedef unsigned int(__stdcall *win32_thead_func)(void *);
+
+struct os_thread_s
+{
+    HANDLE handle;
+    win32_thead_func entry_point;
+    os_thread_arg arg;
+    int pri;
+    int stack_size;
+    char name[OS_THREAD_MAX_NAME];
+};
+
+void os_kernel_sleep(uint32_t time_ms)
+{
+	Sleep(time_ms);
+}
+
+int os_kernel_get_def_pri(void)
+{
+    return OS_THREAD_DEFAULT_PRI;
+}
+
+unsigned int os_kernel_get_def_stack(void)
+{
+    return OS_THREAD_DEFAULT_STACK;
+}
+
+unsigned int os_kernel_get_def_time_slice(void)
+{
+    return 0;
+}
+
+
+os_thread_t os_kernel_create(os_kernel_func entry_point, const char* task_name, os_thread_arg arg,
+    int pri, int stack_size, int time_slice_ms, int auto_start)
+{
+    os_thread_t tsk = NULL;
+    /* time_slice and auto_start not used for win32 port */
+
+    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Creating thread: %s, priority: %d, stack_size: %d - Allocating TCB...", task_name, pri, stack_size));
+
+
+    tsk = (os_thread_t) calloc(1, sizeof(struct os_thread_s));
+    OS_UTIL_ASSERT(tsk);
+
+    tsk->entry_point = (win32_thead_func) entry_point;
+    tsk->arg = arg;
+    tsk->pri = pri;
+    tsk->stack_size = stack_size;
+    strncpy(tsk->name, task_name, OS_THREAD_MAX_NAME);
+
+    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Creating thread (EP=%08X, ARGS=%08X, PRI=%d)",
+        (void *) entry_point, arg, pri));
+
+    // security attributes
+    // stack size
+    // thread's start address
+    // arguments
+    // thread's initial state
+    // return thread id.
+
+    tsk->handle = (HANDLE) _beginthreadex(NULL, 0, tsk->entry_point, tsk->arg,
+        auto_start ? 0 : CREATE_SUSPENDED, NULL);
+
+    OS_UTIL_ASSERT(tsk->handle);
+
+    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Thread created"));
+
+    return tsk;
+}
+
+struct os_mutex_s
+{
+    CRITICAL_SECTION cs;
+};
+
+struct os_event_s
+{
+    HANDLE handle;
+};
+
+uint64_t os_kernel_get_time_us(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+
+    QueryPerformanceCounter(&count);
+
+    return (uint64_t) ((count.QuadPart / freq.QuadPart) * 1000000ULL +
+        ((count.QuadPart % freq.QuadPart) * 1000000ULL) / freq.QuadPart);
+}
+
+os_mutex_t os_kernel_mutex_create(void)
+{
+    os_mutex_t mtx = (os_mutex_t) calloc(1, sizeof(struct os_mutex_s));
+    OS_UTIL_ASSERT(mtx);
+
+    InitializeCriticalSection(&mtx->cs);
+
+    return mtx;
+}
+
+void os_kernel_mutex_lock(os_mutex_t mtx)
+{
+    EnterCriticalSection(&mtx->cs);
+}
+
+void os_kernel_mutex_unlock(os_mutex_t mtx)
+{
+    LeaveCriticalSection(&mtx->cs);
+}
+
+void os_kernel_mutex_delete(os_mutex_t mtx)
+{
+    DeleteCriticalSection(&mtx->cs);
+    free(mtx);
+}
+
+os_event_t os_kernel_event_create(void)
+{
+    os_event_t ev = (os_event_t) calloc(1, sizeof(struct os_event_s));
+    OS_UTIL_ASSERT(ev);
+
+    // auto reset, initially not signaled
+    ev->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    OS_UTIL_ASSERT(ev->handle);
+
+    return ev;
+}
+
+void os_kernel_event_signal(os_event_t ev)
+{
+    SetEvent(ev->handle);
+}
+
+int os_kernel_event_wait(os_event_t ev, uint32_t timeout_ms)
+{
+    DWORD status;
+
+    status = WaitForSingleObject(ev->handle, timeout_ms == OS_INFINTE_TMROUT ? INFINITE : timeout_ms);
+
+    return (status == WAIT_OBJECT_0 ? OS_SUCCESS : OS_TIMEOUT);
+}
+
+void os_kernel_event_delete(os_event_t ev)
+{
+    CloseHandle(ev->handle);
+    free(ev);
+}
+
+void os_kernel_once(os_once_t *once, void (*func)(void))
+{
+    // 0: not done, 1: running, 2: done
+    if (OS_ATOMIC_LOAD_ACQ(once) == 2)
+        return;
+
+    if (OS_ATOMIC_CAS(once, 0, 1))
+    {
+        func();
+        OS_ATOMIC_STORE_REL(once, 2);
+        return;
+    }
+
+    while (OS_ATOMIC_LOAD_ACQ(once) != 2)
+        SwitchToThread();
+}
+
+int os_kernel_sim_enable(void)
+{
+    // virtual time is only implemented by the POSIX backend
+    return OS_ERROR;
+}
+
+int os_kernel_sim_is_enabled(void)
+{
+    return 0;
+}
@@ -1,30 +1,98 @@
-#ifndef __OS_KERNEL__
-#define __OS_KERNEL__ 
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-struct os_thread_s;
-typedef struct os_thread_s * os_thread_t;
-typedef void* (*os_kernel_func)(void *);
-typedef void* os_thread_arg;
-
-/**
-    Suspend the current thread for time_ms milliseconds.
-    @param time_ms Number of milliseconds to sleep.
-*/
-
-void os_kernel_sleep(uint32_t time_ms);
-int os_kernel_get_def_pri(void);
-unsigned int os_kernel_get_def_stack(void);
-unsigned int os_kernel_get_def_time_slice(void);
-os_thread_t os_kernel_create(os_kernel_func entry_point, const char *task_name, os_thread_arg arg, int pri, int stack_size, int time_slice_ms, int auto_start);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif /*  __OS_KERNEL__ */
-
-
+#ifndef __OS_KERNEL__
+#define __OS_KERNEL__ 
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct os_thread_s;
+typedef struct os_thread_s * os_thread_t;
+typedef void* (*os_kernel_func)(void *);
+typedef void* os_thread_arg;
+
+struct os_mutex_s;
+typedef struct os_mutex_s * os_mutex_t;
+struct os_event_s;
+typedef struct os_event_s * os_event_t;
+/** One time initialization control, statically set to OS_KERNEL_ONCE_INIT */
+typedef volatile uint32_t os_once_t;
+#define OS_KERNEL_ONCE_INIT 0
+
+/**
+    Suspend the current thread for time_ms milliseconds.
+    @param time_ms Number of milliseconds to sleep.
+*/
+
+void os_kernel_sleep(uint32_t time_ms);
+int os_kernel_get_def_pri(void);
+unsigned int os_kernel_get_def_stack(void);
+unsigned int os_kernel_get_def_time_slice(void);
+os_thread_t os_kernel_create(os_kernel_func entry_point, const char *task_name, os_thread_arg arg, int pri, int stack_size, int time_slice_ms, int auto_start);
+
+/**
+    Monotonic time since an unspecified starting point.
+    @return time in microseconds
+*/
+uint64_t os_kernel_get_time_us(void);
+
+/**
+    Mutual exclusion (not recursive).
+*/
+os_mutex_t os_kernel_mutex_create(void);
+void os_kernel_mutex_lock(os_mutex_t mtx);
+void os_kernel_mutex_unlock(os_mutex_t mtx);
+void os_kernel_mutex_delete(os_mutex_t mtx);
+
+/**
+    Auto reset event: os_kernel_event_signal() releases one waiter, or the next
+    call to os_kernel_event_wait() when nobody is waiting.
+*/
+os_event_t os_kernel_event_create(void);
+void os_kernel_event_signal(os_event_t ev);
+void os_kernel_event_delete(os_event_t ev);
+
+/**
+    Waits for an event.
+    @param ev Event
+    @param timeout_ms Timeout in milliseconds (OS_INFINTE_TMROUT for no timeout)
+    @retval OS_SUCCESS event signaled
+    @retval OS_TIMEOUT timeout
+*/
+int os_kernel_event_wait(os_event_t ev, uint32_t timeout_ms);
+
+/**
+    Runs func once, whatever the number of threads calling it with the same
+    control. Every caller returns after func has returned.
+    @param once Control, initialized with OS_KERNEL_ONCE_INIT
+    @param func Initialization function
+*/
+void os_kernel_once(os_once_t *once, void (*func)(void));
+
+/**
+    Switches to virtual time (POSIX only), before any thread is created.
+
+    os_kernel_get_time_us(), os_kernel_sleep(), event timeouts and therefore
+    os_timer follow a virtual clock. The clock jumps to the next deadline as
+    soon as every thread (the caller and all threads created by
+    os_kernel_create()) is blocked in os_kernel_sleep() or
+    os_kernel_event_wait(), so timeouts of seconds or hours take no time.
+    Threads must not block anywhere else (poll() on a pty or serial port,
+    for instance) or the clock stops.
+
+    @retval OS_SUCCESS virtual time enabled
+    @retval OS_ERROR   not supported or threads already created
+*/
+int os_kernel_sim_enable(void);
+
+/**
+    @retval 1 when virtual time is enabled, 0 otherwise
+*/
+int os_kernel_sim_is_enabled(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  __OS_KERNEL__ */
+
+
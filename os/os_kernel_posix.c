@@ -0,0 +1,483 @@
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
+#include "os_util.h"
+
+#define OS_DBG_SO_THREAD  0
+
+#define OS_THREAD_MAX_NAME 16
+
+/* default priority (0) means "use the default scheduling policy" */
+const int OS_THREAD_DEFAULT_PRI = 0;
+/* stack size in bytes */
+const int OS_THREAD_DEFAULT_STACK = 64*1024;
+
+/* virtual time starts at 1s, some code uses a null time as "not set" */
+#define OS_SIM_START_US 1000000ULL
+#define OS_SIM_FOREVER  UINT64_MAX
+
+struct os_thread_s
+{
+    pthread_t handle;
+    os_kernel_func entry_point;
+    os_thread_arg arg;
+    int pri;
+    int stack_size;
+    char name[OS_THREAD_MAX_NAME];
+};
+
+struct os_mutex_s
+{
+    pthread_mutex_t mutex;
+};
+
+struct os_event_s
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int signaled;
+};
+
+/*
+    Virtual time.
+
+    Every thread blocked in os_kernel_sleep() or os_kernel_event_wait() has a
+    waiter in sim_waiters. When the number of blocked threads reaches the
+    number of threads, the clock jumps to the earliest deadline and the
+    threads waiting for it are released. A released thread is no longer
+    counted as blocked, even before it actually runs, so the clock cannot
+    jump again until it blocks once more.
+*/
+typedef struct os_sim_waiter_s
+{
+    pthread_cond_t cond;
+    uint64_t deadline;
+    os_event_t ev;
+    int released;
+    struct os_sim_waiter_s *next;
+} os_sim_waiter_t;
+
+static volatile int sim_enabled = 0;
+static int sim_threads = 0;
+static int sim_blocked = 0;
+static int sim_created = 0;
+static uint64_t sim_now_us = 0;
+static os_sim_waiter_t *sim_waiters = 0;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void os_kernel_sim_release(os_sim_waiter_t *w)
+{
+    w->released = 1;
+    sim_blocked--;
+    pthread_cond_signal(&w->cond);
+}
+
+// called with sim_lock held
+static void os_kernel_sim_advance(void)
+{
+    uint64_t next = OS_SIM_FOREVER;
+    os_sim_waiter_t *w;
+
+    if (sim_blocked < sim_threads)
+        return;
+
+    for (w = sim_waiters; w; w = w->next)
+    {
+        if (!w->released && (w->deadline < next))
+            next = w->deadline;
+    }
+
+    // everybody waits for an event nobody will signal
+    if (next == OS_SIM_FOREVER)
+        return;
+
+    if (next > sim_now_us)
+        sim_now_us = next;
+
+    for (w = sim_waiters; w; w = w->next)
+    {
+        if (!w->released && (w->deadline <= sim_now_us))
+            os_kernel_sim_release(w);
+    }
+}
+
+// called with sim_lock held, returns OS_SUCCESS when ev was signaled (or ev is null)
+static int os_kernel_sim_wait(os_event_t ev, uint32_t timeout_ms)
+{
+    os_sim_waiter_t w;
+    os_sim_waiter_t **pw;
+    int ret;
+
+    if ((ev == 0) || (!ev->signaled && (timeout_ms > 0)))
+    {
+        pthread_cond_init(&w.cond, NULL);
+        w.deadline = timeout_ms == OS_INFINTE_TMROUT ? OS_SIM_FOREVER : sim_now_us + (uint64_t) timeout_ms * 1000;
+        w.ev = ev;
+        w.released = 0;
+        w.next = sim_waiters;
+        sim_waiters = &w;
+        sim_blocked++;
+
+        os_kernel_sim_advance();
+
+        while (!w.released)
+            pthread_cond_wait(&w.cond, &sim_lock);
+
+        for (pw = &sim_waiters; *pw != &w; pw = &(*pw)->next)
+            ;
+        *pw = w.next;
+
+        pthread_cond_destroy(&w.cond);
+    }
+
+    if (ev == 0)
+        return OS_SUCCESS;
+
+    ret = ev->signaled ? OS_SUCCESS : OS_TIMEOUT;
+    ev->signaled = 0;
+
+    return ret;
+}
+
+void os_kernel_once(os_once_t *once, void (*func)(void))
+{
+    // 0: not done, 1: running, 2: done
+    if (OS_ATOMIC_LOAD_ACQ(once) == 2)
+        return;
+
+    if (OS_ATOMIC_CAS(once, 0, 1))
+    {
+        func();
+        OS_ATOMIC_STORE_REL(once, 2);
+        return;
+    }
+
+    while (OS_ATOMIC_LOAD_ACQ(once) != 2)
+        sched_yield();
+}
+
+int os_kernel_sim_enable(void)
+{
+    int ret = OS_ERROR;
+
+    pthread_mutex_lock(&sim_lock);
+
+    if (sim_enabled)
+    {
+        ret = OS_SUCCESS;
+    }
+    else if (sim_created == 0)
+    {
+        sim_now_us = OS_SIM_START_US;
+        // the calling thread
+        sim_threads = 1;
+        sim_enabled = 1;
+        ret = OS_SUCCESS;
+    }
+
+    pthread_mutex_unlock(&sim_lock);
+
+    return ret;
+}
+
+int os_kernel_sim_is_enabled(void)
+{
+    return sim_enabled;
+}
+
+void os_kernel_sleep(uint32_t time_ms)
+{
+    struct timespec ts;
+
+    if (sim_enabled)
+    {
+        if (time_ms == 0)
+        {
+            sched_yield();
+            return;
+        }
+
+        pthread_mutex_lock(&sim_lock);
+        os_kernel_sim_wait(0, time_ms);
+        pthread_mutex_unlock(&sim_lock);
+        return;
+    }
+
+    ts.tv_sec = time_ms / 1000;
+    ts.tv_nsec = (time_ms % 1000) * 1000000L;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+        ;
+}
+
+int os_kernel_get_def_pri(void)
+{
+    return OS_THREAD_DEFAULT_PRI;
+}
+
+unsigned int os_kernel_get_def_stack(void)
+{
+    return OS_THREAD_DEFAULT_STACK;
+}
+
+unsigned int os_kernel_get_def_time_slice(void)
+{
+    return 0;
+}
+
+static void *os_kernel_entry_point(void *param)
+{
+    os_thread_t tsk = (os_thread_t) param;
+    void *ret;
+
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), tsk->name);
+#endif
+
+    ret = tsk->entry_point(tsk->arg);
+
+    if (sim_enabled)
+    {
+        pthread_mutex_lock(&sim_lock);
+        sim_threads--;
+        os_kernel_sim_advance();
+        pthread_mutex_unlock(&sim_lock);
+    }
+
+    return ret;
+}
+
+static int os_kernel_set_attr(pthread_attr_t *attr, os_thread_t tsk, int use_pri)
+{
+    int status;
+
+    status = pthread_attr_init(attr);
+    if (status)
+        return status;
+
+    if (tsk->stack_size > 0)
+    {
+        size_t stack_size = (size_t) tsk->stack_size;
+
+        if (stack_size < PTHREAD_STACK_MIN)
+            stack_size = PTHREAD_STACK_MIN;
+
+        status = pthread_attr_setstacksize(attr, stack_size);
+        if (status)
+            return status;
+    }
+
+    // real time priority, only when requested (requires privileges)
+    if (use_pri && (tsk->pri > 0))
+    {
+        struct sched_param param;
+        int pri_min = sched_get_priority_min(SCHED_FIFO);
+        int pri_max = sched_get_priority_max(SCHED_FIFO);
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = tsk->pri < pri_min ? pri_min : (tsk->pri > pri_max ? pri_max : tsk->pri);
+
+        pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+        status = pthread_attr_setschedparam(attr, &param);
+    }
+
+    return status;
+}
+
+os_thread_t os_kernel_create(os_kernel_func entry_point, const char* task_name, os_thread_arg arg,
+    int pri, int stack_size, int time_slice_ms, int auto_start)
+{
+    os_thread_t tsk = NULL;
+    pthread_attr_t attr;
+    int status;
+    /* time_slice and auto_start not used for posix port */
+
+    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Creating thread: %s, priority: %d, stack_size: %d - Allocating TCB...", task_name, pri, stack_size));
+
+    tsk = (os_thread_t) calloc(1, sizeof(struct os_thread_s));
+    OS_UTIL_ASSERT(tsk);
+
+    tsk->entry_point = entry_point;
+    tsk->arg = arg;
+    tsk->pri = pri;
+    tsk->stack_size = stack_size;
+    strncpy(tsk->name, task_name, OS_THREAD_MAX_NAME - 1);
+
+    // counted before it starts, so the clock does not jump while it is starting
+    pthread_mutex_lock(&sim_lock);
+    sim_created++;
+    if (sim_enabled)
+        sim_threads++;
+    pthread_mutex_unlock(&sim_lock);
+
+    status = os_kernel_set_attr(&attr, tsk, 1);
+    OS_UTIL_ASSERT(status == 0);
+
+    status = pthread_create(&tsk->handle, &attr, os_kernel_entry_point, tsk);
+    pthread_attr_destroy(&attr);
+
+    if (status == EPERM)
+    {
+        // no privileges for real time scheduling, fall back to default policy
+        OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Priority %d not allowed for %s, using default policy", pri, task_name));
+
+        status = os_kernel_set_attr(&attr, tsk, 0);
+        OS_UTIL_ASSERT(status == 0);
+        status = pthread_create(&tsk->handle, &attr, os_kernel_entry_point, tsk);
+        pthread_attr_destroy(&attr);
+    }
+
+    OS_UTIL_ASSERT(status == 0);
+
+    OS_UTIL_LOG(OS_DBG_SO_THREAD, ("Thread created"));
+
+    return tsk;
+}
+
+uint64_t os_kernel_get_time_us(void)
+{
+    struct timespec ts;
+    uint64_t now;
+
+    if (sim_enabled)
+    {
+        pthread_mutex_lock(&sim_lock);
+        now = sim_now_us;
+        pthread_mutex_unlock(&sim_lock);
+        return now;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+os_mutex_t os_kernel_mutex_create(void)
+{
+    os_mutex_t mtx = (os_mutex_t) calloc(1, sizeof(struct os_mutex_s));
+    OS_UTIL_ASSERT(mtx);
+
+    pthread_mutex_init(&mtx->mutex, NULL);
+
+    return mtx;
+}
+
+void os_kernel_mutex_lock(os_mutex_t mtx)
+{
+    pthread_mutex_lock(&mtx->mutex);
+}
+
+void os_kernel_mutex_unlock(os_mutex_t mtx)
+{
+    pthread_mutex_unlock(&mtx->mutex);
+}
+
+void os_kernel_mutex_delete(os_mutex_t mtx)
+{
+    pthread_mutex_destroy(&mtx->mutex);
+    free(mtx);
+}
+
+os_event_t os_kernel_event_create(void)
+{
+    pthread_condattr_t attr;
+    os_event_t ev = (os_event_t) calloc(1, sizeof(struct os_event_s));
+    OS_UTIL_ASSERT(ev);
+
+    pthread_mutex_init(&ev->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ev->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    return ev;
+}
+
+void os_kernel_event_signal(os_event_t ev)
+{
+    os_sim_waiter_t *w;
+
+    if (sim_enabled)
+    {
+        pthread_mutex_lock(&sim_lock);
+        ev->signaled = 1;
+
+        // releases one waiter
+        for (w = sim_waiters; w; w = w->next)
+        {
+            if ((w->ev == ev) && !w->released)
+            {
+                os_kernel_sim_release(w);
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&sim_lock);
+        return;
+    }
+
+    pthread_mutex_lock(&ev->mutex);
+    ev->signaled = 1;
+    pthread_cond_signal(&ev->cond);
+    pthread_mutex_unlock(&ev->mutex);
+}
+
+int os_kernel_event_wait(os_event_t ev, uint32_t timeout_ms)
+{
+    struct timespec ts;
+    int status = 0;
+    int ret;
+
+    if (sim_enabled)
+    {
+        pthread_mutex_lock(&sim_lock);
+        ret = os_kernel_sim_wait(ev, timeout_ms);
+        pthread_mutex_unlock(&sim_lock);
+        return ret;
+    }
+
+    if (timeout_ms != OS_INFINTE_TMROUT)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&ev->mutex);
+
+    while (!ev->signaled && (status != ETIMEDOUT))
+    {
+        if (timeout_ms == OS_INFINTE_TMROUT)
+            status = pthread_cond_wait(&ev->cond, &ev->mutex);
+        else
+            status = pthread_cond_timedwait(&ev->cond, &ev->mutex, &ts);
+    }
+
+    ret = ev->signaled ? OS_SUCCESS : OS_TIMEOUT;
+    ev->signaled = 0;
+
+    pthread_mutex_unlock(&ev->mutex);
+
+    return ret;
+}
+
+void os_kernel_event_delete(os_event_t ev)
+{
+    pthread_cond_destroy(&ev->cond);
+    pthread_mutex_destroy(&ev->mutex);
+    free(ev);
+}
@@ -0,0 +1,132 @@
+#include <string.h>
+#include <stdint.h>
+#include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
+#include "os_util.h"
+#include "../pt/pt.h"
+#include "os_pt_sched.h"
+
+#define OS_DBG_PT_SCHED 0
+
+static os_pt_task_t *tasks[OS_PT_SCHED_MAX_TASKS];
+static uint8_t num_tasks = 0;
+// bit n set: tasks[n] is runnable
+static volatile uint32_t ready_mask = 0;
+static volatile uint32_t idle_count = 0;
+static os_event_t wakeup = 0;
+
+static void os_pt_sched_set_ready(uint32_t mask)
+{
+    uint32_t cur;
+
+    do
+    {
+        cur = OS_ATOMIC_LOAD_ACQ(&ready_mask);
+    } while (!OS_ATOMIC_CAS(&ready_mask, cur, cur | mask));
+}
+
+static uint32_t os_pt_sched_take_ready(void)
+{
+    uint32_t cur;
+
+    do
+    {
+        cur = OS_ATOMIC_LOAD_ACQ(&ready_mask);
+    } while (cur && !OS_ATOMIC_CAS(&ready_mask, cur, 0));
+
+    return cur;
+}
+
+void os_pt_sched_init(void)
+{
+    memset(tasks, 0, sizeof(tasks));
+    num_tasks = 0;
+    ready_mask = 0;
+    idle_count = 0;
+
+    if (wakeup == 0)
+        wakeup = os_kernel_event_create();
+}
+
+int os_pt_sched_add(os_pt_task_t *task, os_pt_func_t func, const char *name)
+{
+    OS_UTIL_ASSERT(task);
+    OS_UTIL_ASSERT(func);
+
+    if (num_tasks >= OS_PT_SCHED_MAX_TASKS)
+        return OS_ERROR;
+
+    PT_INIT(&task->pt);
+    task->func = func;
+    task->name = name;
+    task->id = num_tasks;
+    task->done = 0;
+    task->runs = 0;
+    task->signals = 0;
+
+    tasks[num_tasks++] = task;
+
+    // first run reaches the first wait condition
+    os_pt_sched_signal(task);
+
+    return OS_SUCCESS;
+}
+
+void os_pt_sched_signal(os_pt_task_t *task)
+{
+    OS_ATOMIC_FETCH_INC(&task->signals);
+    os_pt_sched_set_ready(1u << task->id);
+
+    // auto reset event: a signal sent before the scheduler sleeps is not lost
+    os_kernel_event_signal(wakeup);
+}
+
+uint32_t os_pt_sched_run_once(void)
+{
+    uint32_t mask = os_pt_sched_take_ready();
+    uint32_t yielded = 0;
+    uint32_t num_run = 0;
+    uint8_t n;
+    int ret;
+
+    for (n = 0; mask; n++, mask >>= 1)
+    {
+        if (((mask & 1) == 0) || tasks[n]->done)
+            continue;
+
+        ret = tasks[n]->func(&tasks[n]->pt);
+        tasks[n]->runs++;
+        num_run++;
+
+        if (ret == PT_YIELDED)
+            yielded |= 1u << n;
+        else if ((ret == PT_EXITED) || (ret == PT_ENDED))
+            tasks[n]->done = 1;
+    }
+
+    if (yielded)
+        os_pt_sched_set_ready(yielded);
+
+    return num_run;
+}
+
+void os_pt_sched_run(void)
+{
+    OS_UTIL_ASSERT(wakeup);
+
+    while (1)
+    {
+        if (os_pt_sched_run_once() == 0)
+        {
+            idle_count++;
+            OS_UTIL_LOG(OS_DBG_PT_SCHED, ("Idle\n"));
+            os_kernel_event_wait(wakeup, OS_INFINTE_TMROUT);
+        }
+    }
+}
+
+uint32_t os_pt_sched_get_idle_count(void)
+{
+    return idle_count;
+}
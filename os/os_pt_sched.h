@@ -0,0 +1,92 @@
+/**
+    @file os_pt_sched.h
+    @brief Event driven run queue for protothreads
+*/
+#ifndef __OS_PT_SCHED__
+#define __OS_PT_SCHED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+    @defgroup OSPTSCHED Protothread scheduler
+    @ingroup OSGLOBALS
+
+    Protothreads (pt/pt.h) only run when they were signaled, instead of
+    being polled in a loop. Interrupts, timers and other threads call
+    os_pt_sched_signal() after changing the condition a protothread waits
+    for. When no protothread is runnable, os_pt_sched_run() sleeps
+    (os_kernel_event_wait() here, WFI on a microcontroller port).
+
+    A protothread that returns PT_YIELDED is runnable again on the next
+    pass, one that returns PT_WAITING sleeps until signaled and one that
+    exits or ends is never run again.
+    @{
+*/
+
+/** Maximum number of protothreads (bits in the ready mask) */
+#define OS_PT_SCHED_MAX_TASKS 32
+
+/** Protothread function */
+typedef int (*os_pt_func_t)(struct pt *pt);
+
+/** Protothread control block, allocated by the user (usually static) */
+typedef struct os_pt_task_s
+{
+    struct pt pt;
+    os_pt_func_t func;
+    const char *name;
+    uint8_t id;
+    uint8_t done;
+    /** Number of times the protothread was run */
+    volatile uint32_t runs;
+    /** Number of os_pt_sched_signal() calls */
+    volatile uint32_t signals;
+} os_pt_task_t;
+
+/**
+    Initializes the scheduler, removing all protothreads.
+*/
+extern void os_pt_sched_init(void);
+
+/**
+    Adds a protothread. It is initialized (PT_INIT) and runnable.
+
+    @param task Control block
+    @param func Protothread function
+    @param name Name, for statistics
+    @retval OS_SUCCESS or OS_ERROR (too many protothreads)
+*/
+extern int os_pt_sched_add(os_pt_task_t *task, os_pt_func_t func, const char *name);
+
+/**
+    Marks a protothread runnable and wakes up the scheduler.
+    Safe to call from interrupts, timer callbacks and other threads.
+*/
+extern void os_pt_sched_signal(os_pt_task_t *task);
+
+/**
+    Runs every runnable protothread once, without sleeping.
+
+    @retval number of protothreads run
+*/
+extern uint32_t os_pt_sched_run_once(void);
+
+/**
+    Scheduler loop, sleeps while no protothread is runnable. Never returns.
+*/
+extern void os_pt_sched_run(void);
+
+/**
+    Number of times the scheduler went to sleep.
+*/
+extern uint32_t os_pt_sched_get_idle_count(void);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  __OS_PT_SCHED__ */
@@ -6,13 +6,18 @@
 #include <stdint.h>
 #include "windows.h"
 
+#include "os_defs.h"
 #include "os_util.h"
 #include "os_serial.h"
 
 
 #define OS_DBG_SER_DRV 0
 
-#define MAX_PORT_NAME 10
+#define MAX_PORT_NAME 64
+/* longest single wait passed to ReadFile (MAXDWORD is not allowed) */
+#define OS_SERIAL_MAX_WAIT_MS 0x7FFFFFFF
+/* time spent on each port when waiting for several ports */
+#define OS_SERIAL_WAIT_SLICE_MS 1
 
 struct os_serial_drv_s 
 {
@@ -21,12 +26,41 @@ struct os_serial_drv_s
     HANDLE       hcom;
     DCB          dcb;
     COMMTIMEOUTS to;
+    int          has_peek;   /* byte consumed by os_serial_wait_readable() */
+    unsigned char peek;
 };
 
+static DWORD os_serial_get_baud(int bps)
+{
+    switch (bps)
+    {
+        case OS_SERIAL_BR_9600:
+            return CBR_9600;
+        case OS_SERIAL_BR_19200:
+            return CBR_19200;
+        case OS_SERIAL_BR_38400:
+            return CBR_38400;
+        case OS_SERIAL_BR_57600:
+            return CBR_57600;
+        case OS_SERIAL_BR_115200:
+            return CBR_115200;
+        // no CBR_ constants, the driver takes the rate as is
+        case OS_SERIAL_BR_230400:
+        case OS_SERIAL_BR_460800:
+        case OS_SERIAL_BR_921600:
+        case OS_SERIAL_BR_1M:
+        case OS_SERIAL_BR_2M:
+        case OS_SERIAL_BR_3M:
+            return (DWORD) bps;
+        default:
+            return 0;
+    }
+}
+
 os_serial_t os_serial_open(os_serial_options_t options)
 {
     int is_error = 1;    
-    char port[10];
+    char port[MAX_PORT_NAME];
 
     os_serial_t ser = (os_serial_t) calloc(1,sizeof(struct os_serial_drv_s));
     OS_UTIL_ASSERT(ser);
@@ -34,7 +68,10 @@ os_serial_t os_serial_open(os_serial_options_t options)
     ser->port = options.port;
     ser->bps  = options.bps;
 
-    sprintf_s(port, 10,  "\\\\.\\COM%d", ser->port);
+    if (options.name)
+        sprintf_s(port, MAX_PORT_NAME, "%s", options.name);
+    else
+        sprintf_s(port, MAX_PORT_NAME, "\\\\.\\COM%d", ser->port);
 
 	OS_UTIL_LOG( OS_DBG_SER_DRV, ("Port %s, bps=%d)\n",port,options.bps) );
     
@@ -61,22 +98,12 @@ os_serial_t os_serial_open(os_serial_options_t options)
     }
     
     // set bps, 8 data bits, no parity, no flow control, and 1 stop bit.
-    switch (ser->bps) 
+    ser->dcb.BaudRate = os_serial_get_baud(ser->bps);
+    if (ser->dcb.BaudRate == 0)
 	{
-        case(OS_SERIAL_BR_9600):
-            ser->dcb.BaudRate = CBR_9600;
-            break;
-        case(OS_SERIAL_BR_19200):
-            ser->dcb.BaudRate = CBR_19200;
-            break;            
-        case(OS_SERIAL_BR_115200):
-            ser->dcb.BaudRate = CBR_115200;
-            break;
-        default:
-            CloseHandle(ser->hcom);
-			OS_UTIL_LOG( OS_DBG_SER_DRV, ("Invalid bit rate error: %d\n", GetLastError()) );
-			return 0;
-            break;
+        CloseHandle(ser->hcom);
+		OS_UTIL_LOG( OS_DBG_SER_DRV, ("Invalid bit rate error: %d\n", GetLastError()) );
+		return 0;
     }
 
     ser->dcb.ByteSize      = 8;            // data size, xmit, and rcv
@@ -95,11 +122,11 @@ os_serial_t os_serial_open(os_serial_options_t options)
 		return 0;
     }
 
-    /* Set timeout values */
+    /* Set timeout values: reads return immediately with whatever is available */
     memset(&(ser->to), 0, sizeof(ser->to));
-    ser->to.ReadIntervalTimeout         = 1;    /* 1 msec timeout per byte */
-    ser->to.ReadTotalTimeoutConstant    = 0;    /* No extra timeout for read operation */
-    ser->to.ReadTotalTimeoutMultiplier  = 1;    /* Use byte's timeout */
+    ser->to.ReadIntervalTimeout         = MAXDWORD;
+    ser->to.ReadTotalTimeoutConstant    = 0;
+    ser->to.ReadTotalTimeoutMultiplier  = 0;
     ser->to.WriteTotalTimeoutConstant   = 0;    /* Write data immediately */
     ser->to.WriteTotalTimeoutMultiplier = 0;
 
@@ -116,17 +143,31 @@ os_serial_t os_serial_open(os_serial_options_t options)
 int os_serial_read(os_serial_t ser, unsigned char *data, int len)
 {
     DWORD dwRead = 0;
+    int offset = 0;
 
 	OS_UTIL_ASSERT(ser);
 	OS_UTIL_ASSERT(data);
 
-    if (ReadFile((HANDLE)ser->hcom, data, len, &dwRead, NULL) ) 
+    if (ser->has_peek && (len > 0))
+    {
+        data[0] = ser->peek;
+        ser->has_peek = 0;
+        offset = 1;
+    }
+
+    if (len == offset)
+        return offset;
+
+    if (ReadFile((HANDLE)ser->hcom, &data[offset], len - offset, &dwRead, NULL) ) 
 	{
-		OS_UTIL_LOG( OS_DBG_SER_DRV, ("Read %d of %d Bytes\n", dwRead,len) );
+		OS_UTIL_LOG( OS_DBG_SER_DRV, ("Read %d of %d Bytes\n", dwRead + offset,len) );
 		/*dump_frame(data,dwRead);*/
-		return dwRead;
+		return dwRead + offset;
 	}
 
+    if (offset)
+        return offset;
+
 	OS_UTIL_LOG( OS_DBG_SER_DRV, ("Error reading byte: %d. os_serial_win32::os_serial_read.\n", GetLastError()) );
 	return -1;
 }
@@ -159,6 +200,13 @@ int os_serial_read_byte(os_serial_t ser, unsigned char *data)
 	OS_UTIL_ASSERT(ser);
 	OS_UTIL_ASSERT(data);
 
+    if (ser->has_peek)
+    {
+        *data = ser->peek;
+        ser->has_peek = 0;
+        return 1;
+    }
+
     if ( ReadFile((HANDLE)ser->hcom, data, sizeof(unsigned char), &dwRead, NULL) ) 
 	{
         if (dwRead == sizeof(unsigned char)) 
@@ -212,6 +260,137 @@ int os_serial_flush(os_serial_t ser)
 
 	OS_UTIL_LOG( OS_DBG_SER_DRV, ("Flushing port %d\n", ser->port) );
 
+    ser->has_peek = 0;
+
     return (PurgeComm(ser->hcom,PURGE_RXCLEAR|PURGE_RXABORT|PURGE_TXABORT|PURGE_TXCLEAR) == 0 ? 0 : 1);
 }
- 
\ No newline at end of file
+ 
+int os_serial_wait_readable(os_serial_t ser, unsigned long timeout_ms)
+{
+    COMSTAT stat;
+    COMMTIMEOUTS to;
+    DWORD errors;
+    DWORD dwRead = 0;
+    BOOL ok;
+
+	OS_UTIL_ASSERT(ser);
+
+    if (ser->has_peek)
+        return OS_SUCCESS;
+
+    if (ClearCommError(ser->hcom, &errors, &stat) && (stat.cbInQue > 0))
+        return OS_SUCCESS;
+
+    if (timeout_ms == 0)
+        return OS_TIMEOUT;
+
+    /* 
+       With both interval and multiplier set to MAXDWORD, ReadFile returns as soon as
+       one byte arrives or when the constant timeout expires. The byte is kept for
+       the next read.
+    */
+    to = ser->to;
+    to.ReadIntervalTimeout        = MAXDWORD;
+    to.ReadTotalTimeoutMultiplier = MAXDWORD;
+
+    do
+    {
+        to.ReadTotalTimeoutConstant = timeout_ms > OS_SERIAL_MAX_WAIT_MS ? OS_SERIAL_MAX_WAIT_MS : timeout_ms;
+        if (timeout_ms != OS_INFINTE_TMROUT)
+            timeout_ms -= to.ReadTotalTimeoutConstant;
+
+        if (!SetCommTimeouts(ser->hcom, &to))
+        {
+            OS_UTIL_LOG( OS_DBG_SER_DRV, ("SetCommTimeouts error: %d\n", GetLastError()) );
+            return OS_ERROR;
+        }
+
+        ok = ReadFile((HANDLE)ser->hcom, &ser->peek, sizeof(unsigned char), &dwRead, NULL);
+
+    } while (ok && (dwRead == 0) && (timeout_ms > 0));
+
+    SetCommTimeouts(ser->hcom, &(ser->to));
+
+    if (!ok)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Error waiting data: %d\n", GetLastError()) );
+        return OS_ERROR;
+    }
+
+    if (dwRead == 0)
+        return OS_TIMEOUT;
+
+    ser->has_peek = 1;
+
+    return OS_SUCCESS;
+}
+
+int os_serial_wait_readable_any(os_serial_t *sers, int num, unsigned long timeout_ms)
+{
+    COMSTAT stat;
+    DWORD errors;
+    int ret;
+    int n;
+
+    if (num <= 0)
+        return OS_ERROR;
+
+    if (num == 1)
+        return os_serial_wait_readable(sers[0], timeout_ms);
+
+    /*
+       Synchronous handles can not be waited for together, so each port is
+       waited for a short slice in turn.
+    */
+    while (1)
+    {
+        for (n = 0; n < num; n++)
+        {
+            OS_UTIL_ASSERT(sers[n]);
+            if (sers[n]->has_peek)
+                return OS_SUCCESS;
+            if (ClearCommError(sers[n]->hcom, &errors, &stat) && (stat.cbInQue > 0))
+                return OS_SUCCESS;
+        }
+
+        for (n = 0; n < num; n++)
+        {
+            if (timeout_ms == 0)
+                return OS_TIMEOUT;
+
+            ret = os_serial_wait_readable(sers[n], OS_SERIAL_WAIT_SLICE_MS);
+            if (ret != OS_TIMEOUT)
+                return ret;
+
+            if (timeout_ms != OS_INFINTE_TMROUT)
+                timeout_ms -= timeout_ms > OS_SERIAL_WAIT_SLICE_MS ? OS_SERIAL_WAIT_SLICE_MS : timeout_ms;
+        }
+    }
+}
+
+int os_serial_set_bps(os_serial_t ser, int bps)
+{
+    DWORD baud = os_serial_get_baud(bps);
+
+	OS_UTIL_ASSERT(ser);
+
+    if (baud == 0)
+    {
+		OS_UTIL_LOG( OS_DBG_SER_DRV, ("Invalid bit rate %d\n", bps) );
+        return OS_ERROR;
+    }
+
+    // the last answer sent at the old rate must leave the port first
+    FlushFileBuffers(ser->hcom);
+
+    ser->dcb.BaudRate = baud;
+    if (!SetCommState(ser->hcom, &(ser->dcb)))
+    {
+		OS_UTIL_LOG( OS_DBG_SER_DRV, ("SetCommState error: %d\n", GetLastError()) );
+        return OS_ERROR;
+    }
+
+    ser->bps = bps;
+
+    return OS_SUCCESS;
+}
@@ -9,7 +9,15 @@ enum os_serial_baud_rate_e
 {
 	OS_SERIAL_BR_9600   = 9600,
     OS_SERIAL_BR_19200  = 19200,
-	OS_SERIAL_BR_115200 = 115200
+	OS_SERIAL_BR_38400  = 38400,
+	OS_SERIAL_BR_57600  = 57600,
+	OS_SERIAL_BR_115200 = 115200,
+	OS_SERIAL_BR_230400 = 230400,
+	OS_SERIAL_BR_460800 = 460800,
+	OS_SERIAL_BR_921600 = 921600,
+	OS_SERIAL_BR_1M     = 1000000,
+	OS_SERIAL_BR_2M     = 2000000,
+	OS_SERIAL_BR_3M     = 3000000
 };
 
 enum os_serial_parity_e
@@ -40,6 +48,7 @@ typedef struct
 	int parity;
 	int stop_bits;
 	int port;
+	const char *name; /**< device name (optional, when set port number is not used) */
 } os_serial_options_t;
 
 typedef struct os_serial_drv_s * os_serial_t;
@@ -51,6 +60,23 @@ extern int os_serial_read_byte(os_serial_t ser, unsigned char *data);
 extern int os_serial_write_byte(os_serial_t ser, unsigned char data);
 extern int os_serial_close(os_serial_t ser);
 extern int os_serial_flush(os_serial_t ser);
+/** Waits for received data (timeout in ms or OS_INFINTE_TMROUT), returns OS_SUCCESS, OS_TIMEOUT or OS_ERROR */
+extern int os_serial_wait_readable(os_serial_t ser, unsigned long timeout_ms);
+/** Most ports waited for at once by os_serial_wait_readable_any() */
+#define OS_SERIAL_WAIT_MAX 64
+/**
+    Waits for received data on any of num ports, returns OS_SUCCESS, OS_TIMEOUT or OS_ERROR.
+
+    On POSIX all ports are waited for in a single poll(). The Win32 ports are
+    opened for synchronous I/O and can not be waited for together: each one is
+    waited for 1 ms in turn. Since Windows timers have a coarser resolution
+    (15.6 ms by default, unless timeBeginPeriod() was called), data may be
+    noticed up to num timer periods late and the thread wakes up continuously
+    while waiting. A single port is waited for without polling.
+*/
+extern int os_serial_wait_readable_any(os_serial_t *sers, int num, unsigned long timeout_ms);
+/** Changes the bit rate of an open port after pending output is sent, returns OS_SUCCESS or OS_ERROR (rate not supported) */
+extern int os_serial_set_bps(os_serial_t ser, int bps);
 
 
 #ifdef __cplusplus
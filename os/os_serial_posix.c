@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "os_defs.h"
+#include "os_util.h"
+#include "os_serial.h"
+
+#define OS_DBG_SER_DRV 0
+
+#define MAX_PORT_NAME 64
+
+/* time to wait for the output buffer when it is full */
+#define OS_SERIAL_WRITE_TMROUT_MS 1000
+
+struct os_serial_drv_s
+{
+    int            port;
+    int            bps;
+    int            fd;
+    char           name[MAX_PORT_NAME];
+    struct termios tio;
+};
+
+static speed_t os_serial_get_speed(int bps)
+{
+    switch (bps)
+    {
+        case OS_SERIAL_BR_9600:
+            return B9600;
+        case OS_SERIAL_BR_19200:
+            return B19200;
+        case OS_SERIAL_BR_38400:
+            return B38400;
+        case OS_SERIAL_BR_57600:
+            return B57600;
+        case OS_SERIAL_BR_115200:
+            return B115200;
+        case OS_SERIAL_BR_230400:
+            return B230400;
+#ifdef B460800
+        case OS_SERIAL_BR_460800:
+            return B460800;
+#endif
+#ifdef B921600
+        case OS_SERIAL_BR_921600:
+            return B921600;
+#endif
+#ifdef B1000000
+        case OS_SERIAL_BR_1M:
+            return B1000000;
+#endif
+#ifdef B2000000
+        case OS_SERIAL_BR_2M:
+            return B2000000;
+#endif
+#ifdef B3000000
+        case OS_SERIAL_BR_3M:
+            return B3000000;
+#endif
+        default:
+            return 0;
+    }
+}
+
+os_serial_t os_serial_open(os_serial_options_t options)
+{
+    speed_t speed;
+    os_serial_t ser = (os_serial_t) calloc(1,sizeof(struct os_serial_drv_s));
+    OS_UTIL_ASSERT(ser);
+
+    ser->port = options.port;
+    ser->bps  = options.bps;
+    ser->fd   = -1;
+
+    // COM1 is mapped to /dev/ttyS0 and so on, unless a device name is given
+    if (options.name)
+        snprintf(ser->name, MAX_PORT_NAME, "%s", options.name);
+    else
+        snprintf(ser->name, MAX_PORT_NAME, "/dev/ttyS%d", ser->port > 0 ? ser->port - 1 : 0);
+
+    OS_UTIL_LOG( OS_DBG_SER_DRV, ("Port %s, bps=%d)\n",ser->name,options.bps) );
+
+    speed = os_serial_get_speed(ser->bps);
+    if (speed == 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Invalid bit rate %d\n", ser->bps) );
+        free(ser);
+        return 0;
+    }
+
+    ser->fd = open(ser->name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (ser->fd < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("open error: %d\n", errno) );
+        free(ser);
+        return 0;
+    }
+
+    if (tcgetattr(ser->fd, &ser->tio) < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("tcgetattr error: %d\n", errno) );
+        close(ser->fd);
+        free(ser);
+        return 0;
+    }
+
+    // raw mode, 8 data bits, no flow control
+    cfmakeraw(&ser->tio);
+    ser->tio.c_cflag |= CLOCAL | CREAD;
+    ser->tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    ser->tio.c_cflag |= CS8;
+
+    if (options.parity == OS_SERIAL_PR_ODD)
+        ser->tio.c_cflag |= PARENB | PARODD;
+    else if (options.parity == OS_SERIAL_PR_EVEN)
+        ser->tio.c_cflag |= PARENB;
+
+    if (options.stop_bits == OS_SERIAL_PB_2)
+        ser->tio.c_cflag |= CSTOPB;
+
+    // non blocking reads: return immediately with whatever is available
+    ser->tio.c_cc[VMIN] = 0;
+    ser->tio.c_cc[VTIME] = 0;
+
+    cfsetispeed(&ser->tio, speed);
+    cfsetospeed(&ser->tio, speed);
+
+    if (tcsetattr(ser->fd, TCSANOW, &ser->tio) < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("tcsetattr error: %d\n", errno) );
+        close(ser->fd);
+        free(ser);
+        return 0;
+    }
+
+    tcflush(ser->fd, TCIOFLUSH);
+
+    return ser;
+}
+
+int os_serial_read(os_serial_t ser, unsigned char *data, int len)
+{
+    ssize_t num_read;
+
+    OS_UTIL_ASSERT(ser);
+    OS_UTIL_ASSERT(data);
+
+    do
+    {
+        num_read = read(ser->fd, data, len);
+    } while ((num_read < 0) && (errno == EINTR));
+
+    if (num_read >= 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Read %d of %d Bytes\n", (int) num_read,len) );
+        return (int) num_read;
+    }
+
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+
+    OS_UTIL_LOG( OS_DBG_SER_DRV, ("Error reading byte: %d. os_serial_posix::os_serial_read.\n", errno) );
+    return -1;
+}
+
+int os_serial_write(os_serial_t ser, unsigned char *data, int len)
+{
+    int written = 0;
+
+    OS_UTIL_ASSERT(ser);
+    OS_UTIL_ASSERT(data);
+    OS_UTIL_ASSERT(len >= 0);
+
+    while (written < len)
+    {
+        ssize_t n = write(ser->fd, data + written, len - written);
+
+        if (n > 0)
+        {
+            written += (int) n;
+        }
+        else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            // output buffer is full, wait until it is writable again
+            struct pollfd pfd;
+            pfd.fd = ser->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, OS_SERIAL_WRITE_TMROUT_MS) <= 0)
+                break;
+        }
+        else if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else
+        {
+            OS_UTIL_LOG( OS_DBG_SER_DRV, ("Write error: %d (len=%d)\n", errno,len) );
+            return -1;
+        }
+    }
+
+    OS_UTIL_LOG( OS_DBG_SER_DRV, ("Writen %d of %d Bytes\n", written,len) );
+    return written;
+}
+
+int os_serial_read_byte(os_serial_t ser, unsigned char *data)
+{
+    if (os_serial_read(ser, data, sizeof(unsigned char)) == sizeof(unsigned char))
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Serial IN: %02X\n", *data ) );
+        return 1;
+    }
+
+    return 0;
+}
+
+int os_serial_write_byte(os_serial_t ser, unsigned char data)
+{
+    if (os_serial_write(ser, &data, sizeof(unsigned char)) == sizeof(unsigned char))
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Serial OUT: %02X\n", data ) );
+        return 1;
+    }
+
+    return 0;
+}
+
+int os_serial_close(os_serial_t ser)
+{
+    OS_UTIL_ASSERT(ser);
+
+    OS_UTIL_LOG( OS_DBG_SER_DRV, ("Closing port %s\n", ser->name) );
+
+    if (ser->fd >= 0)
+        close(ser->fd);
+
+    free(ser);
+
+    return 0;
+}
+
+int os_serial_flush(os_serial_t ser)
+{
+    OS_UTIL_ASSERT(ser);
+    OS_UTIL_ASSERT(ser->fd >= 0);
+
+    OS_UTIL_LOG( OS_DBG_SER_DRV, ("Flushing port %s\n", ser->name) );
+
+    return (tcflush(ser->fd, TCIOFLUSH) == 0 ? 1 : 0);
+}
+
+int os_serial_wait_readable(os_serial_t ser, unsigned long timeout_ms)
+{
+    struct pollfd pfd;
+    int ret;
+
+    OS_UTIL_ASSERT(ser);
+
+    pfd.fd = ser->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        ret = poll(&pfd, 1, timeout_ms == OS_INFINTE_TMROUT ? -1 : (int) timeout_ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("poll error: %d\n", errno) );
+        return OS_ERROR;
+    }
+
+    return ret == 0 ? OS_TIMEOUT : OS_SUCCESS;
+}
+
+int os_serial_wait_readable_any(os_serial_t *sers, int num, unsigned long timeout_ms)
+{
+    struct pollfd pfd[OS_SERIAL_WAIT_MAX];
+    int ret;
+    int n;
+
+    if ((num <= 0) || (num > OS_SERIAL_WAIT_MAX))
+        return OS_ERROR;
+
+    for (n = 0; n < num; n++)
+    {
+        OS_UTIL_ASSERT(sers[n]);
+        pfd[n].fd = sers[n]->fd;
+        pfd[n].events = POLLIN;
+        pfd[n].revents = 0;
+    }
+
+    do
+    {
+        ret = poll(pfd, num, timeout_ms == OS_INFINTE_TMROUT ? -1 : (int) timeout_ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("poll error: %d\n", errno) );
+        return OS_ERROR;
+    }
+
+    return ret == 0 ? OS_TIMEOUT : OS_SUCCESS;
+}
+
+int os_serial_set_bps(os_serial_t ser, int bps)
+{
+    speed_t speed;
+
+    OS_UTIL_ASSERT(ser);
+    OS_UTIL_ASSERT(ser->fd >= 0);
+
+    speed = os_serial_get_speed(bps);
+    if (speed == 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("Invalid bit rate %d\n", bps) );
+        return OS_ERROR;
+    }
+
+    cfsetispeed(&ser->tio, speed);
+    cfsetospeed(&ser->tio, speed);
+
+    // the last answer sent at the old rate must leave the port first
+    if (tcsetattr(ser->fd, TCSADRAIN, &ser->tio) < 0)
+    {
+        OS_UTIL_LOG( OS_DBG_SER_DRV, ("tcsetattr error: %d\n", errno) );
+        return OS_ERROR;
+    }
+
+    ser->bps = bps;
+
+    return OS_SUCCESS;
+}
@@ -1,61 +1,292 @@
-#include <Windows.h>
 #include <stdint.h>
+#include <string.h>
 #include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
 #include "os_timer.h"
 #include "os_util.h"
 
+/*
+    Timer service.
+
+    All timers are handled by a single thread, ordered in a binary min-heap
+    by expiration time. Timers come from a preallocated pool.
+
+    Rearming a timer to a later deadline (the common case, e.g. an inter-byte
+    timeout restarted on every received byte) only updates the deadline field.
+    The heap key is fixed lazily when the entry reaches the top of the heap.
+    Only an earlier deadline needs a heap operation and a thread wake up.
+
+    Callbacks run without the lock held. The service thread records the timer
+    whose callback is running, so deactivating or deleting a timer can wait
+    for the end of its callback.
+*/
+
+#define OS_TIMER_POOL_SIZE 32
+
 enum {
-    WIN_TIMER_OFF = 0,
-    WIN_TIMER_ON
+    OS_TIMER_OFF = 0,
+    OS_TIMER_ON
 };
 
 struct os_timer_s
 {
-    HANDLE handle;
     os_timer_func   timer_func;
-    uint32_t    expire_in_ms;
-    uint32_t    reschedule_in_ms;
-    os_timer_type_t time_type;
     void*           timer_arg;
-    int             state;
+    uint32_t        expire_in_ms;
+    uint32_t        reschedule_in_ms;
+    os_timer_type_t time_type;
+    uint64_t        deadline;  // current expiration time (ms)
+    uint64_t        heap_key;  // expiration time used for heap ordering (ms)
+    int16_t         heap_pos;  // position in the heap or -1
+    uint8_t         state;
+    uint8_t         in_use;
 };
 
-static VOID CALLBACK timer_callback(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+static struct os_timer_s timer_pool[OS_TIMER_POOL_SIZE];
+static os_timer_t timer_heap[OS_TIMER_POOL_SIZE];
+static uint16_t timer_heap_size = 0;
+static os_mutex_t timer_lock = 0;
+static os_event_t timer_wakeup = 0;
+static os_thread_t timer_thread = 0;
+static os_once_t timer_once = OS_KERNEL_ONCE_INIT;
+// timer whose callback is running, and threads waiting for its end
+static os_timer_t timer_running = 0;
+static uint32_t timer_idle_waiters = 0;
+static os_event_t timer_idle = 0;
+static OS_TLS uint8_t timer_service_thread = 0;
+
+static uint64_t os_timer_now_ms(void)
+{
+    return os_kernel_get_time_us() / 1000;
+}
+
+static void heap_set(uint16_t pos, os_timer_t tmr)
+{
+    timer_heap[pos] = tmr;
+    tmr->heap_pos = pos;
+}
+
+static void heap_sift_up(uint16_t pos)
+{
+    os_timer_t tmr = timer_heap[pos];
+
+    while (pos > 0)
+    {
+        uint16_t parent = (pos - 1) / 2;
+
+        if (timer_heap[parent]->heap_key <= tmr->heap_key)
+            break;
+
+        heap_set(pos, timer_heap[parent]);
+        pos = parent;
+    }
+
+    heap_set(pos, tmr);
+}
+
+static void heap_sift_down(uint16_t pos)
+{
+    os_timer_t tmr = timer_heap[pos];
+
+    while (1)
+    {
+        uint16_t child = 2 * pos + 1;
+
+        if (child >= timer_heap_size)
+            break;
+
+        if ((child + 1 < timer_heap_size) && (timer_heap[child + 1]->heap_key < timer_heap[child]->heap_key))
+            child++;
+
+        if (tmr->heap_key <= timer_heap[child]->heap_key)
+            break;
+
+        heap_set(pos, timer_heap[child]);
+        pos = child;
+    }
+
+    heap_set(pos, tmr);
+}
+
+static void heap_insert(os_timer_t tmr)
 {
-    os_timer_t tmr = (os_timer_t)lpParameter;
-    tmr->timer_func(tmr->timer_arg);
+    OS_UTIL_ASSERT(timer_heap_size < OS_TIMER_POOL_SIZE);
+
+    tmr->heap_key = tmr->deadline;
+    heap_set(timer_heap_size, tmr);
+    timer_heap_size++;
+    heap_sift_up(tmr->heap_pos);
+}
+
+static void heap_remove(os_timer_t tmr)
+{
+    uint16_t pos = tmr->heap_pos;
+
+    timer_heap_size--;
+    tmr->heap_pos = -1;
+
+    if (pos == timer_heap_size)
+        return;
+
+    heap_set(pos, timer_heap[timer_heap_size]);
+    heap_sift_down(pos);
+    heap_sift_up(timer_heap[pos]->heap_pos);
+}
+
+static void* os_timer_service(void *param)
+{
+    os_timer_t tmr;
+    os_timer_func timer_func;
+    void *timer_arg;
+    uint64_t now;
+    uint32_t wait_ms;
+
+    timer_service_thread = 1;
+
+    while (1)
+    {
+        os_kernel_mutex_lock(timer_lock);
+
+        // previous callback done
+        timer_running = 0;
+        if (timer_idle_waiters)
+            os_kernel_event_signal(timer_idle);
+
+        wait_ms = OS_INFINTE_TMROUT;
+        timer_func = 0;
+
+        while (timer_heap_size > 0)
+        {
+            tmr = timer_heap[0];
+
+            // deadline postponed after insertion: fix the key and reorder
+            if (tmr->deadline != tmr->heap_key)
+            {
+                tmr->heap_key = tmr->deadline;
+                heap_sift_down(0);
+                continue;
+            }
+
+            now = os_timer_now_ms();
+            if (tmr->heap_key > now)
+            {
+                wait_ms = (uint32_t) (tmr->heap_key - now);
+                break;
+            }
+
+            // expired
+            heap_remove(tmr);
+
+            if (tmr->time_type == OS_TIMER_CYCLIC)
+            {
+                tmr->deadline += tmr->reschedule_in_ms;
+                heap_insert(tmr);
+            }
+            else
+            {
+                tmr->state = OS_TIMER_OFF;
+            }
+
+            timer_func = tmr->timer_func;
+            timer_arg = tmr->timer_arg;
+            timer_running = tmr;
+            break;
+        }
+
+        os_kernel_mutex_unlock(timer_lock);
+
+        // callbacks run without the lock held, they are allowed to change timers
+        if (timer_func)
+            timer_func(timer_arg);
+        else
+            os_kernel_event_wait(timer_wakeup, wait_ms);
+    }
+
+    return 0;
 }
 
 static int add_timer(os_timer_t tmr, uint32_t expire_in_ms, uint32_t reschedule_in_ms)
 {
-    int status;
+    int wakeup = 0;
+
+    os_kernel_mutex_lock(timer_lock);
 
     tmr->reschedule_in_ms = reschedule_in_ms;
     tmr->expire_in_ms = expire_in_ms;
     tmr->time_type = reschedule_in_ms > 0 ? OS_TIMER_CYCLIC : OS_TIMER_ONE_SHOT;
+    tmr->deadline = os_timer_now_ms() + expire_in_ms;
+    tmr->state = OS_TIMER_ON;
 
-    tmr->handle = CreateWaitableTimer(NULL, TRUE, "");
-    OS_UTIL_ASSERT(tmr->handle);
+    if (tmr->heap_pos < 0)
+    {
+        heap_insert(tmr);
+        wakeup = (tmr->heap_pos == 0);
+    }
+    else if (tmr->deadline < tmr->heap_key)
+    {
+        tmr->heap_key = tmr->deadline;
+        heap_sift_up(tmr->heap_pos);
+        wakeup = (tmr->heap_pos == 0);
+    }
+    // else: later deadline, lazy update (O(1))
 
-    status = CreateTimerQueueTimer(&tmr->handle, NULL, timer_callback, (void *)tmr,
-        tmr->expire_in_ms, tmr->reschedule_in_ms,
-        WT_EXECUTEDEFAULT);
-    OS_UTIL_ASSERT(status);
+    os_kernel_mutex_unlock(timer_lock);
 
-    tmr->state = WIN_TIMER_ON;
+    if (wakeup)
+        os_kernel_event_signal(timer_wakeup);
 
-    return (status ? OS_SUCCESS : OS_ERROR);
+    return OS_SUCCESS;
 }
 
-static void del_timer(os_timer_t tmr)
+// called with the lock held, a callback may change its own timer
+static void wait_callback(os_timer_t tmr)
 {
-    if (tmr->state == WIN_TIMER_ON)
+    if (timer_service_thread)
+        return;
+
+    while (timer_running == tmr)
     {
-        int status;
-        status = DeleteTimerQueueTimer(NULL, tmr->handle, NULL);
-        OS_UTIL_ASSERT(status);
-        //CloseHandle(tmr->handle);
+        timer_idle_waiters++;
+        os_kernel_mutex_unlock(timer_lock);
+        os_kernel_event_wait(timer_idle, OS_INFINTE_TMROUT);
+        os_kernel_mutex_lock(timer_lock);
+        timer_idle_waiters--;
     }
+
+    // one signal for several waiters, pass it on
+    if (timer_idle_waiters)
+        os_kernel_event_signal(timer_idle);
+}
+
+static void del_timer(os_timer_t tmr)
+{
+    os_kernel_mutex_lock(timer_lock);
+
+    if (tmr->heap_pos >= 0)
+        heap_remove(tmr);
+
+    tmr->state = OS_TIMER_OFF;
+
+    wait_callback(tmr);
+
+    os_kernel_mutex_unlock(timer_lock);
+}
+
+static void os_timer_init_once(void)
+{
+    memset(timer_pool, 0, sizeof(timer_pool));
+    timer_heap_size = 0;
+    timer_lock = os_kernel_mutex_create();
+    timer_wakeup = os_kernel_event_create();
+    timer_idle = os_kernel_event_create();
+    timer_thread = os_kernel_create(os_timer_service, "TIMER_SVC", (os_thread_arg) 0,
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+}
+
+void os_timer_init(void)
+{
+    os_kernel_once(&timer_once, os_timer_init_once);
 }
 
 os_timer_t os_timer_create(os_timer_func timer_func, void *timer_arg,
@@ -63,12 +294,37 @@ os_timer_t os_timer_create(os_timer_func timer_func, void *timer_arg,
     uint32_t auto_start)
 {
     os_timer_t tmr = NULL;
-    tmr = (os_timer_t)calloc(1, sizeof(struct os_timer_s));
-    OS_UTIL_ASSERT(tmr);
+    uint8_t n;
+
+    os_timer_init();
+
+    os_kernel_mutex_lock(timer_lock);
+
+    for (n = 0; n < OS_TIMER_POOL_SIZE; n++)
+    {
+        if (!timer_pool[n].in_use)
+        {
+            tmr = &timer_pool[n];
+            memset(tmr, 0, sizeof(struct os_timer_s));
+            tmr->in_use = 1;
+            tmr->heap_pos = -1;
+            break;
+        }
+    }
+
+    os_kernel_mutex_unlock(timer_lock);
+
+    if (tmr == NULL)
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_ERROR, 1, ("Timer pool exhausted (%u timers)\n", OS_TIMER_POOL_SIZE));
+        return NULL;
+    }
 
     tmr->timer_func = timer_func;
     tmr->timer_arg = timer_arg;
-    tmr->state = WIN_TIMER_OFF;
+    tmr->expire_in_ms = expire_in_ms;
+    tmr->reschedule_in_ms = reschedule_in_ms;
+    tmr->state = OS_TIMER_OFF;
 
     if (auto_start)
         add_timer(tmr, expire_in_ms, reschedule_in_ms);
@@ -80,8 +336,6 @@ uint32_t os_timer_change(os_timer_t tmr, uint32_t expire_in_ms, uint32_t resched
 {
     OS_UTIL_ASSERT(tmr);
 
-    del_timer(tmr);
-
     return add_timer(tmr, expire_in_ms, reschedule_in_ms);
 }
 
@@ -89,8 +343,6 @@ uint32_t os_timer_activate(os_timer_t tmr)
 {
     OS_UTIL_ASSERT(tmr);
 
-    del_timer(tmr);
-
     return add_timer(tmr, tmr->expire_in_ms, tmr->reschedule_in_ms);
 }
 
@@ -99,7 +351,6 @@ uint32_t os_timer_deactivate(os_timer_t tmr)
     OS_UTIL_ASSERT(tmr);
 
     del_timer(tmr);
-    tmr->state = WIN_TIMER_OFF;
 
     return OS_SUCCESS;
 }
@@ -109,8 +360,10 @@ uint32_t os_timer_delete(os_timer_t tmr)
     OS_UTIL_ASSERT(tmr);
 
     del_timer(tmr);
-    tmr->state = WIN_TIMER_OFF;
-    free(tmr);
+
+    os_kernel_mutex_lock(timer_lock);
+    tmr->in_use = 0;
+    os_kernel_mutex_unlock(timer_lock);
 
     return OS_SUCCESS;
 }
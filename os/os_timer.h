@@ -17,13 +17,14 @@ typedef enum os_timer_type_e
 typedef struct os_timer_s *os_timer_t;
 
 /**
- * timer callback
+ * timer callback, run by the timer service thread without any lock held.
+ * Callbacks of all timers run one at a time, so they must not block.
  * */
 typedef void (*os_timer_func)(void *);
 
 /**
- * Initialize timer infrastructure.
- * This routine must be called before any timer usage.
+ * Initialize timer infrastructure (timer service thread and timer pool).
+ * It is called by os_timer_create() when needed, from any thread.
  */
 void os_timer_init(void);
 
@@ -38,7 +39,7 @@ void os_timer_init(void);
  * @param enabled       Use 1 to create an active timer and 0 to create
  *                      an inactive timer
 
- * @retval a valid timer handler or null pointer
+ * @retval a valid timer handler or null pointer (pool exhausted)
  */
 os_timer_t os_timer_create(os_timer_func callback, 
                            void *arg, 
@@ -47,7 +48,8 @@ os_timer_t os_timer_create(os_timer_func callback,
                            uint32_t enabled);
 
 /**
- * Delete a timer
+ * Delete a timer. When its callback is running, waits for its end (unless
+ * called from a timer callback), so the callback never runs after return.
  * 
  * @param tmr timer handler
  * @retval OS_SUCCESS timer deleted
@@ -65,7 +67,9 @@ uint32_t os_timer_delete(os_timer_t tmr);
 uint32_t os_timer_activate(os_timer_t tmr);
 
 /**
- * Deactivate a timer
+ * Deactivate a timer. When its callback is running, waits for its end
+ * (unless called from a timer callback), so the callback never runs after
+ * return until the timer is activated again.
  * 
  * @param tmr timer handler
  * @retval OS_SUCCESS timer deactivated
@@ -74,8 +78,9 @@ uint32_t os_timer_activate(os_timer_t tmr);
 uint32_t os_timer_deactivate(os_timer_t tmr);
 
 /**
- * Change current timer values. Timer will be stopped and started again 
- * using the new values.
+ * Change current timer values. Timer will be restarted using the new values.
+ * Postponing an active timer is O(1) (only its deadline is updated), so it
+ * can be called for every received byte.
  * 
  * @param tmr timer handler
  * @param schedule_ms   first expiration time, in ms
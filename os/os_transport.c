@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
+#include "os_serial.h"
+#include "os_transport.h"
+#include "os_util.h"
+
+#define OS_DBG_TRANSPORT 0
+
+/* time to wait for space when a pipe is full */
+#define OS_TRANSPORT_SEND_TMROUT_MS 1000
+
+int os_transport_send(os_transport_t t, const uint8_t *data, int len)
+{
+    int n = t->ops->send(t, data, len);
+
+    if (n > 0)
+        t->tx_bytes += n;
+
+    return n;
+}
+
+int os_transport_recv(os_transport_t t, uint8_t *data, int len)
+{
+    int n = t->ops->recv(t, data, len);
+
+    if (n > 0)
+        t->rx_bytes += n;
+
+    return n;
+}
+
+int os_transport_wait_readable(os_transport_t t, uint32_t timeout_ms)
+{
+    return t->ops->wait_readable(t, timeout_ms);
+}
+
+int os_transport_wait_any(os_transport_t *set, int num, uint32_t timeout_ms)
+{
+    int n;
+
+    if (num <= 0)
+        return OS_ERROR;
+
+    if (num == 1)
+        return os_transport_wait_readable(set[0], timeout_ms);
+
+    // one backend waits for the whole set
+    for (n = 1; n < num; n++)
+    {
+        if (set[n]->ops != set[0]->ops)
+            return OS_ERROR;
+    }
+
+    if (set[0]->ops->wait_any == 0)
+        return OS_ERROR;
+
+    return set[0]->ops->wait_any(set, num, timeout_ms);
+}
+
+int os_transport_flush(os_transport_t t)
+{
+    return t->ops->flush(t);
+}
+
+void os_transport_close(os_transport_t t)
+{
+    t->ops->close(t);
+}
+
+void os_transport_set_line(os_transport_t t, uint32_t bps, uint8_t char_bits)
+{
+    t->bps = bps;
+    t->char_bits = char_bits;
+}
+
+int os_transport_set_speed(os_transport_t t, uint32_t bps)
+{
+    if (t->ops->set_speed && (t->ops->set_speed(t, bps) != OS_SUCCESS))
+        return OS_ERROR;
+
+    t->bps = bps;
+    // 8N1 unless the line was set before
+    if (t->char_bits == 0)
+        t->char_bits = 10;
+
+    return OS_SUCCESS;
+}
+
+void os_transport_get_stats(os_transport_t t, os_transport_stats_t *stats)
+{
+    stats->tx_bytes = t->tx_bytes;
+    stats->rx_bytes = t->rx_bytes;
+    stats->bps = t->bps;
+    stats->char_bits = t->char_bits;
+}
+
+static uint32_t os_transport_elapsed_ms(uint64_t start_us)
+{
+    return (uint32_t) ((os_kernel_get_time_us() - start_us) / 1000);
+}
+
+//=========================== serial port ======================================
+
+typedef struct os_transport_serial_s
+{
+    struct os_transport_s base;
+    os_serial_t ser;
+} os_transport_serial_t;
+
+static int os_transport_serial_send(os_transport_t t, const uint8_t *data, int len)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    return os_serial_write(st->ser, (unsigned char *) data, len);
+}
+
+static int os_transport_serial_recv(os_transport_t t, uint8_t *data, int len)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    return os_serial_read(st->ser, data, len);
+}
+
+static int os_transport_serial_wait_readable(os_transport_t t, uint32_t timeout_ms)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    return os_serial_wait_readable(st->ser, timeout_ms);
+}
+
+static int os_transport_serial_wait_any(os_transport_t *set, int num, uint32_t timeout_ms)
+{
+    os_serial_t sers[OS_TRANSPORT_WAIT_MAX];
+    int n;
+
+    if (num > OS_TRANSPORT_WAIT_MAX)
+        return OS_ERROR;
+
+    for (n = 0; n < num; n++)
+        sers[n] = ((os_transport_serial_t *) set[n])->ser;
+
+    return os_serial_wait_readable_any(sers, num, timeout_ms);
+}
+
+static int os_transport_serial_flush(os_transport_t t)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    return os_serial_flush(st->ser);
+}
+
+static void os_transport_serial_close(os_transport_t t)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    os_serial_close(st->ser);
+    free(st);
+}
+
+static int os_transport_serial_set_speed(os_transport_t t, uint32_t bps)
+{
+    os_transport_serial_t *st = (os_transport_serial_t *) t;
+
+    return os_serial_set_bps(st->ser, (int) bps);
+}
+
+static const os_transport_ops_t os_transport_serial_ops =
+{
+    os_transport_serial_send,
+    os_transport_serial_recv,
+    os_transport_serial_wait_readable,
+    os_transport_serial_flush,
+    os_transport_serial_close,
+    os_transport_serial_set_speed,
+    os_transport_serial_wait_any
+};
+
+os_transport_t os_transport_serial_open(os_serial_options_t options)
+{
+    os_transport_serial_t *st;
+
+    st = (os_transport_serial_t *) calloc(1, sizeof(os_transport_serial_t));
+    OS_UTIL_ASSERT(st);
+
+    st->ser = os_serial_open(options);
+    if (st->ser == 0)
+    {
+        free(st);
+        return 0;
+    }
+
+    st->base.ops = &os_transport_serial_ops;
+    // start, 8 data bits, parity and stop bits
+    os_transport_set_line(&st->base, (uint32_t) options.bps,
+        (uint8_t) (1 + 8 + (options.parity != OS_SERIAL_PR_NONE ? 1 : 0) + options.stop_bits));
+
+    return &st->base;
+}
+
+//=========================== in-process pipe ==================================
+
+typedef struct os_transport_ring_s
+{
+    volatile uint32_t head; // written by the sender only
+    volatile uint32_t tail; // written by the receiver only
+    volatile uint32_t waiting;
+    uint32_t size;
+    os_event_t readable;
+    // event of a set waited with os_transport_wait_any(), 0 when there is none
+    os_event_t volatile notify;
+    uint8_t *data;
+} os_transport_ring_t;
+
+struct os_transport_pipe_pair_s;
+
+typedef struct os_transport_pipe_s
+{
+    struct os_transport_s base;
+    os_transport_ring_t *rx;
+    os_transport_ring_t *tx;
+    struct os_transport_pipe_pair_s *pair;
+} os_transport_pipe_t;
+
+typedef struct os_transport_pipe_pair_s
+{
+    volatile uint32_t refs;
+    os_transport_ring_t rings[2];
+    os_transport_pipe_t ends[2];
+} os_transport_pipe_pair_t;
+
+static int os_transport_pipe_send(os_transport_t t, const uint8_t *data, int len)
+{
+    os_transport_ring_t *ring = ((os_transport_pipe_t *) t)->tx;
+    uint64_t start = 0;
+    int written = 0;
+
+    while (written < len)
+    {
+        uint32_t head = ring->head;
+        uint32_t space = ring->size - (head - OS_ATOMIC_LOAD_ACQ(&ring->tail));
+        uint32_t pos = head & (ring->size - 1);
+        uint32_t n = (uint32_t) (len - written) < space ? (uint32_t) (len - written) : space;
+
+        if (n > 0)
+        {
+            uint32_t first = ring->size - pos < n ? ring->size - pos : n;
+
+            memcpy(&ring->data[pos], &data[written], first);
+            memcpy(ring->data, &data[written + first], n - first);
+            OS_ATOMIC_STORE_REL(&ring->head, head + n);
+            written += n;
+
+            // pairs with the waiting flag set by the receiver before sleeping
+            OS_ATOMIC_FENCE();
+            if (ring->waiting)
+                os_kernel_event_signal(ring->readable);
+            if (ring->notify)
+                os_kernel_event_signal(ring->notify);
+        }
+        else
+        {
+            // full, give the receiver some time
+            if (start == 0)
+                start = os_kernel_get_time_us();
+            else if (os_transport_elapsed_ms(start) >= OS_TRANSPORT_SEND_TMROUT_MS)
+                break;
+
+            os_kernel_sleep(1);
+        }
+    }
+
+    return written;
+}
+
+static int os_transport_pipe_recv(os_transport_t t, uint8_t *data, int len)
+{
+    os_transport_ring_t *ring = ((os_transport_pipe_t *) t)->rx;
+    uint32_t tail = ring->tail;
+    uint32_t avail = OS_ATOMIC_LOAD_ACQ(&ring->head) - tail;
+    uint32_t pos = tail & (ring->size - 1);
+    uint32_t n = (uint32_t) len < avail ? (uint32_t) len : avail;
+    uint32_t first = ring->size - pos < n ? ring->size - pos : n;
+
+    memcpy(data, &ring->data[pos], first);
+    memcpy(&data[first], ring->data, n - first);
+    OS_ATOMIC_STORE_REL(&ring->tail, tail + n);
+
+    return (int) n;
+}
+
+static int os_transport_pipe_wait_readable(os_transport_t t, uint32_t timeout_ms)
+{
+    os_transport_ring_t *ring = ((os_transport_pipe_t *) t)->rx;
+    uint64_t start = os_kernel_get_time_us();
+    uint32_t elapsed;
+
+    while (OS_ATOMIC_LOAD_ACQ(&ring->head) == ring->tail)
+    {
+        elapsed = os_transport_elapsed_ms(start);
+        if ((timeout_ms != OS_INFINTE_TMROUT) && (elapsed >= timeout_ms))
+            return OS_TIMEOUT;
+
+        // announce the wait, then check again before sleeping
+        ring->waiting = 1;
+        OS_ATOMIC_FENCE();
+
+        if (OS_ATOMIC_LOAD_ACQ(&ring->head) == ring->tail)
+            os_kernel_event_wait(ring->readable, timeout_ms == OS_INFINTE_TMROUT ? OS_INFINTE_TMROUT : timeout_ms - elapsed);
+
+        ring->waiting = 0;
+    }
+
+    return OS_SUCCESS;
+}
+
+static int os_transport_pipe_any_readable(os_transport_t *set, int num)
+{
+    os_transport_ring_t *ring;
+    int n;
+
+    for (n = 0; n < num; n++)
+    {
+        ring = ((os_transport_pipe_t *) set[n])->rx;
+        if (OS_ATOMIC_LOAD_ACQ(&ring->head) != ring->tail)
+            return 1;
+    }
+
+    return 0;
+}
+
+// the senders of the whole set signal the event of the first receiving ring
+static int os_transport_pipe_wait_any(os_transport_t *set, int num, uint32_t timeout_ms)
+{
+    os_event_t ev = ((os_transport_pipe_t *) set[0])->rx->readable;
+    uint64_t start = os_kernel_get_time_us();
+    uint32_t elapsed;
+    int n;
+
+    while (!os_transport_pipe_any_readable(set, num))
+    {
+        elapsed = os_transport_elapsed_ms(start);
+        if ((timeout_ms != OS_INFINTE_TMROUT) && (elapsed >= timeout_ms))
+            return OS_TIMEOUT;
+
+        // announce the wait, then check again before sleeping
+        for (n = 0; n < num; n++)
+            ((os_transport_pipe_t *) set[n])->rx->notify = ev;
+        OS_ATOMIC_FENCE();
+
+        if (!os_transport_pipe_any_readable(set, num))
+            os_kernel_event_wait(ev, timeout_ms == OS_INFINTE_TMROUT ? OS_INFINTE_TMROUT : timeout_ms - elapsed);
+
+        for (n = 0; n < num; n++)
+            ((os_transport_pipe_t *) set[n])->rx->notify = 0;
+    }
+
+    return OS_SUCCESS;
+}
+
+static int os_transport_pipe_flush(os_transport_t t)
+{
+    os_transport_ring_t *ring = ((os_transport_pipe_t *) t)->rx;
+
+    OS_ATOMIC_STORE_REL(&ring->tail, OS_ATOMIC_LOAD_ACQ(&ring->head));
+
+    return 1;
+}
+
+static void os_transport_pipe_close(os_transport_t t)
+{
+    os_transport_pipe_pair_t *pair = ((os_transport_pipe_t *) t)->pair;
+    uint8_t n;
+
+    // the pair is released when both ends are closed
+    if (OS_ATOMIC_FETCH_ADD(&pair->refs, (uint32_t) -1) != 1)
+        return;
+
+    for (n = 0; n < 2; n++)
+    {
+        os_kernel_event_delete(pair->rings[n].readable);
+        free(pair->rings[n].data);
+    }
+
+    free(pair);
+}
+
+static const os_transport_ops_t os_transport_pipe_ops =
+{
+    os_transport_pipe_send,
+    os_transport_pipe_recv,
+    os_transport_pipe_wait_readable,
+    os_transport_pipe_flush,
+    os_transport_pipe_close,
+    0,
+    os_transport_pipe_wait_any
+};
+
+int os_transport_pipe_create(os_transport_t *end_a, os_transport_t *end_b, uint32_t size)
+{
+    os_transport_pipe_pair_t *pair;
+    uint8_t n;
+
+    if (size == 0)
+        size = OS_TRANSPORT_PIPE_SIZE;
+
+    if (size & (size - 1))
+        return OS_ERROR;
+
+    pair = (os_transport_pipe_pair_t *) calloc(1, sizeof(os_transport_pipe_pair_t));
+    OS_UTIL_ASSERT(pair);
+
+    for (n = 0; n < 2; n++)
+    {
+        pair->rings[n].size = size;
+        pair->rings[n].data = (uint8_t *) malloc(size);
+        OS_UTIL_ASSERT(pair->rings[n].data);
+        pair->rings[n].readable = os_kernel_event_create();
+
+        pair->ends[n].base.ops = &os_transport_pipe_ops;
+        pair->ends[n].pair = pair;
+    }
+
+    // end a sends on ring 0 and receives on ring 1, end b the opposite
+    pair->ends[0].tx = &pair->rings[0];
+    pair->ends[0].rx = &pair->rings[1];
+    pair->ends[1].tx = &pair->rings[1];
+    pair->ends[1].rx = &pair->rings[0];
+    pair->refs = 2;
+
+    *end_a = &pair->ends[0].base;
+    *end_b = &pair->ends[1].base;
+
+    OS_UTIL_LOG(OS_DBG_TRANSPORT, ("Pipe created (%u bytes)\n", size));
+
+    return OS_SUCCESS;
+}
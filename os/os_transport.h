@@ -0,0 +1,156 @@
+/**
+    @file os_transport.h
+    @brief Byte stream transports (serial port, in-process pipe, pty)
+*/
+#ifndef __OS_TRANSPORT__
+#define __OS_TRANSPORT__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+    @defgroup OSTRANSPORT Transports
+    @ingroup OSGLOBALS
+
+    A transport is a bidirectional byte stream used to exchange frames
+    between mote and sensor. Backends implement os_transport_ops_t and
+    embed struct os_transport_s as the first member of their handle.
+    @{
+*/
+
+/** Transport handler */
+typedef struct os_transport_s * os_transport_t;
+
+/** Backend operations */
+typedef struct os_transport_ops_s
+{
+    /** Writes len bytes, returns bytes written or -1 on error */
+    int (*send)(os_transport_t t, const uint8_t *data, int len);
+    /** Reads up to len bytes without blocking, returns bytes read (0 if none) or -1 on error */
+    int (*recv)(os_transport_t t, uint8_t *data, int len);
+    /** Waits for received data, returns OS_SUCCESS, OS_TIMEOUT or OS_ERROR */
+    int (*wait_readable)(os_transport_t t, uint32_t timeout_ms);
+    /** Discards pending data */
+    int (*flush)(os_transport_t t);
+    /** Closes the transport and releases the handler */
+    void (*close)(os_transport_t t);
+    /** Changes the line speed after pending data is sent, returns OS_SUCCESS or OS_ERROR (null when the transport has no line) */
+    int (*set_speed)(os_transport_t t, uint32_t bps);
+    /** Waits for received data on any of num transports of this backend, returns OS_SUCCESS, OS_TIMEOUT or OS_ERROR */
+    int (*wait_any)(os_transport_t *set, int num, uint32_t timeout_ms);
+} os_transport_ops_t;
+
+struct os_transport_s
+{
+    const os_transport_ops_t *ops;
+    /** Bytes sent, written by the sender thread only */
+    volatile uint32_t tx_bytes;
+    /** Bytes received, written by the receiver thread only */
+    volatile uint32_t rx_bytes;
+    /** Line speed (0 when the transport is not rate limited) */
+    uint32_t bps;
+    /** Bits on the wire per byte (start, data, parity and stop bits) */
+    uint8_t char_bits;
+};
+
+/** Transport counters and line settings */
+typedef struct os_transport_stats_s
+{
+    uint32_t tx_bytes;  /**< bytes sent (wraps around) */
+    uint32_t rx_bytes;  /**< bytes received (wraps around) */
+    uint32_t bps;       /**< line speed, 0 if unknown */
+    uint8_t char_bits;  /**< bits per byte on the wire */
+} os_transport_stats_t;
+
+/** Most transports waited for at once (os_transport_wait_any()) */
+#define OS_TRANSPORT_WAIT_MAX OS_SERIAL_WAIT_MAX
+
+/** Default pipe size (bytes per direction) */
+#define OS_TRANSPORT_PIPE_SIZE 4096
+
+/**
+    Opens a serial port transport.
+
+    @param options Serial port options
+    @retval a valid transport or null pointer
+*/
+extern os_transport_t os_transport_serial_open(os_serial_options_t options);
+
+/**
+    Creates a connected pair of in-process transports.
+    Bytes sent on one end are received on the other. Each direction is a
+    lock-free single producer/single consumer ring, so each end must be used
+    by one sender thread and one receiver thread.
+
+    @param end_a First end
+    @param end_b Second end
+    @param size  Ring size in bytes (power of 2, 0 for OS_TRANSPORT_PIPE_SIZE)
+    @retval OS_SUCCESS or OS_ERROR
+*/
+extern int os_transport_pipe_create(os_transport_t *end_a, os_transport_t *end_b, uint32_t size);
+
+/**
+    Creates a pseudo terminal pair (POSIX only). The master and slave ends
+    are opened in raw mode, behaving like a null modem serial cable.
+
+    @param master Master end
+    @param slave  Slave end
+    @param slave_name Slave device name buffer (optional, may be null)
+    @param name_size Size of slave_name
+    @retval OS_SUCCESS or OS_ERROR
+*/
+extern int os_transport_pty_create(os_transport_t *master, os_transport_t *slave, char *slave_name, int name_size);
+
+extern int os_transport_send(os_transport_t t, const uint8_t *data, int len);
+extern int os_transport_recv(os_transport_t t, uint8_t *data, int len);
+extern int os_transport_wait_readable(os_transport_t t, uint32_t timeout_ms);
+
+/**
+    Waits for received data on any transport of a set, so one thread can
+    serve several transports without polling them. All transports of the
+    set must be of the same kind (serial ports, pipes or ptys).
+
+    @param set        Transports
+    @param num        Number of transports
+    @param timeout_ms Timeout in ms or OS_INFINTE_TMROUT
+    @retval OS_SUCCESS (at least one transport has data), OS_TIMEOUT or
+            OS_ERROR (empty or mixed set, backend error)
+*/
+extern int os_transport_wait_any(os_transport_t *set, int num, uint32_t timeout_ms);
+extern int os_transport_flush(os_transport_t t);
+extern void os_transport_close(os_transport_t t);
+
+/**
+    Sets the line speed used to compute the wire occupation. Serial ports
+    get it from their options, pipes and ptys may emulate a serial line.
+
+    @param t         Transport
+    @param bps       Line speed (0 when not rate limited)
+    @param char_bits Bits per byte on the wire (10 for 8N1)
+*/
+extern void os_transport_set_line(os_transport_t t, uint32_t bps, uint8_t char_bits);
+
+/**
+    Changes the line speed of a running transport, after pending data is
+    sent. Serial ports are reprogrammed, pipes and ptys only record the new
+    speed for the wire occupation.
+
+    @param t   Transport
+    @param bps New line speed (one of os_serial_baud_rate_e)
+    @retval OS_SUCCESS or OS_ERROR (speed not supported, line unchanged)
+*/
+extern int os_transport_set_speed(os_transport_t t, uint32_t bps);
+
+/**
+    Reads the byte counters and line settings.
+*/
+extern void os_transport_get_stats(os_transport_t t, os_transport_stats_t *stats);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  __OS_TRANSPORT__ */
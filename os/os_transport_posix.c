@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "os_defs.h"
+#include "os_serial.h"
+#include "os_transport.h"
+#include "os_util.h"
+
+#define OS_DBG_TRANSPORT 0
+
+/* time to wait for the output buffer when it is full */
+#define OS_TRANSPORT_WRITE_TMROUT_MS 1000
+
+typedef struct os_transport_fd_s
+{
+    struct os_transport_s base;
+    int fd;
+} os_transport_fd_t;
+
+static int os_transport_fd_send(os_transport_t t, const uint8_t *data, int len)
+{
+    os_transport_fd_t *ft = (os_transport_fd_t *) t;
+    int written = 0;
+
+    while (written < len)
+    {
+        ssize_t n = write(ft->fd, data + written, len - written);
+
+        if (n > 0)
+        {
+            written += (int) n;
+        }
+        else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            struct pollfd pfd;
+            pfd.fd = ft->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, OS_TRANSPORT_WRITE_TMROUT_MS) <= 0)
+                break;
+        }
+        else if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else
+        {
+            OS_UTIL_LOG(OS_DBG_TRANSPORT, ("Write error: %d\n", errno));
+            return -1;
+        }
+    }
+
+    return written;
+}
+
+static int os_transport_fd_recv(os_transport_t t, uint8_t *data, int len)
+{
+    os_transport_fd_t *ft = (os_transport_fd_t *) t;
+    ssize_t n;
+
+    do
+    {
+        n = read(ft->fd, data, len);
+    } while ((n < 0) && (errno == EINTR));
+
+    if (n >= 0)
+        return (int) n;
+
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+
+    return -1;
+}
+
+static int os_transport_fd_wait_readable(os_transport_t t, uint32_t timeout_ms)
+{
+    os_transport_fd_t *ft = (os_transport_fd_t *) t;
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = ft->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        ret = poll(&pfd, 1, timeout_ms == OS_INFINTE_TMROUT ? -1 : (int) timeout_ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+        return OS_ERROR;
+
+    return ret == 0 ? OS_TIMEOUT : OS_SUCCESS;
+}
+
+static int os_transport_fd_wait_any(os_transport_t *set, int num, uint32_t timeout_ms)
+{
+    struct pollfd pfd[OS_TRANSPORT_WAIT_MAX];
+    int ret;
+    int n;
+
+    if (num > OS_TRANSPORT_WAIT_MAX)
+        return OS_ERROR;
+
+    for (n = 0; n < num; n++)
+    {
+        pfd[n].fd = ((os_transport_fd_t *) set[n])->fd;
+        pfd[n].events = POLLIN;
+        pfd[n].revents = 0;
+    }
+
+    do
+    {
+        ret = poll(pfd, num, timeout_ms == OS_INFINTE_TMROUT ? -1 : (int) timeout_ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+        return OS_ERROR;
+
+    return ret == 0 ? OS_TIMEOUT : OS_SUCCESS;
+}
+
+static int os_transport_fd_flush(os_transport_t t)
+{
+    os_transport_fd_t *ft = (os_transport_fd_t *) t;
+
+    return (tcflush(ft->fd, TCIOFLUSH) == 0 ? 1 : 0);
+}
+
+static void os_transport_fd_close(os_transport_t t)
+{
+    os_transport_fd_t *ft = (os_transport_fd_t *) t;
+
+    close(ft->fd);
+    free(ft);
+}
+
+static const os_transport_ops_t os_transport_fd_ops =
+{
+    os_transport_fd_send,
+    os_transport_fd_recv,
+    os_transport_fd_wait_readable,
+    os_transport_fd_flush,
+    os_transport_fd_close,
+    0,
+    os_transport_fd_wait_any
+};
+
+static os_transport_t os_transport_fd_create(int fd)
+{
+    os_transport_fd_t *ft;
+    struct termios tio;
+
+    // raw mode, like a serial port
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    ft = (os_transport_fd_t *) calloc(1, sizeof(os_transport_fd_t));
+    OS_UTIL_ASSERT(ft);
+
+    ft->base.ops = &os_transport_fd_ops;
+    ft->fd = fd;
+
+    return &ft->base;
+}
+
+int os_transport_pty_create(os_transport_t *master, os_transport_t *slave, char *slave_name, int name_size)
+{
+    const char *name;
+    int mfd, sfd;
+
+    mfd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (mfd < 0)
+        return OS_ERROR;
+
+    if ((grantpt(mfd) < 0) || (unlockpt(mfd) < 0) || ((name = ptsname(mfd)) == 0))
+    {
+        close(mfd);
+        return OS_ERROR;
+    }
+
+    sfd = open(name, O_RDWR | O_NOCTTY);
+    if (sfd < 0)
+    {
+        close(mfd);
+        return OS_ERROR;
+    }
+
+    OS_UTIL_LOG(OS_DBG_TRANSPORT, ("Pty created: %s\n", name));
+
+    if (slave_name && (name_size > 0))
+        snprintf(slave_name, name_size, "%s", name);
+
+    *master = os_transport_fd_create(mfd);
+    *slave = os_transport_fd_create(sfd);
+
+    return OS_SUCCESS;
+}
@@ -1,16 +1,103 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
-#include <time.h> 
 
+#include "os_defs.h"
+#include "os_atomic.h"
+#include "os_kernel.h"
 #include "os_util.h"
 
-#define MAX_LOG_BUF 256
-static char buffer[MAX_LOG_BUF];
+/*
+    Asynchronous logger.
 
-static volatile int os_util_log_started = 0;
+    Each thread owns a single producer/single consumer ring of log records,
+    allocated on its first log call. A record keeps the format pointer, the
+    timestamp and the raw arguments (strings are copied), so the caller does
+    not format anything. A drain thread merges the rings by timestamp,
+    formats the records and writes them to the output.
+
+    Format strings must stay valid until the record is drained, so they are
+    expected to be string literals (as in all OS_UTIL_LOG calls).
+    When a ring is full the record is dropped and counted, callers never block.
+    Rings are never released, threads started after the first
+    OS_UTIL_LOG_MAX_THREADS ones share one more ring under a lock.
+*/
+
+#define OS_UTIL_LOG_MAX_THREADS 32
+#define OS_UTIL_LOG_RING_SIZE   128 // records per thread, power of 2
+#define OS_UTIL_LOG_MAX_ARGS    16
+#define OS_UTIL_LOG_STR_SIZE    128 // space for copied strings, per record
+#define OS_UTIL_LOG_LINE_SIZE   512
+#define OS_UTIL_LOG_DRAIN_MS    20
+
+typedef union os_util_log_arg_u
+{
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void *p;
+} os_util_log_arg_t;
+
+typedef struct os_util_log_rec_s
+{
+    uint64_t timestamp;
+    const char *fmt;
+    uint16_t str_len;
+    os_util_log_arg_t args[OS_UTIL_LOG_MAX_ARGS];
+    char str[OS_UTIL_LOG_STR_SIZE]; // %s arguments, args[n].u is the offset
+} os_util_log_rec_t;
+
+typedef struct os_util_log_ring_s
+{
+    volatile uint32_t head; // written by the producer thread only
+    volatile uint32_t tail; // written by the consumer only
+    volatile uint32_t dropped;
+    uint32_t dropped_reported;
+    os_util_log_rec_t recs[OS_UTIL_LOG_RING_SIZE];
+} os_util_log_ring_t;
+
+enum os_util_log_len_e
+{
+    OS_UTIL_LOG_LEN_NONE = 0,
+    OS_UTIL_LOG_LEN_HH,
+    OS_UTIL_LOG_LEN_H,
+    OS_UTIL_LOG_LEN_L,
+    OS_UTIL_LOG_LEN_LL,
+    OS_UTIL_LOG_LEN_LD,
+    OS_UTIL_LOG_LEN_Z,
+    OS_UTIL_LOG_LEN_J,
+    OS_UTIL_LOG_LEN_T
+};
+
+typedef struct os_util_log_spec_s
+{
+    const char *flags;   // first char after '%'
+    const char *length;  // first char of the length modifier
+    uint8_t star_width;
+    uint8_t star_prec;
+    uint8_t len;
+    char conv;
+} os_util_log_spec_t;
+
+volatile int os_util_log_level = OS_UTIL_LOG_OFF;
+
+static int os_util_log_level_cfg = OS_UTIL_LOG_DEBUG;
+// the last one is the shared ring
+static os_util_log_ring_t * volatile log_rings[OS_UTIL_LOG_MAX_THREADS + 1];
+static volatile uint32_t log_num_rings = 0;
+static volatile uint32_t log_shared_threads = 0;
+static uint32_t log_shared_reported = 0;
+static os_mutex_t log_shared_lock = 0;
+static OS_TLS os_util_log_ring_t *log_ring = 0;
+static os_thread_t log_thread = 0;
+static os_mutex_t log_lock = 0;
+static os_event_t log_wakeup = 0;
+static FILE *log_output = 0;
+static uint64_t log_start_us = 0;
 
 void os_util_assert(int cond)
 {
@@ -23,37 +110,521 @@ const uint8_t *os_util_strip_path(const unsigned char *filename)
 
 	pos = strlen(filename) - 1; // avoiding null terminator
 
-	while( (filename[pos] != '\\') && (pos > 0) ) 
+	while( (filename[pos] != '\\') && (pos > 0) )
 		pos--;
 
-	if(pos != 0) 
+	if(pos != 0)
 		pos++; // removing "\"
-	
+
 	return &filename[pos];
 }
 
+static const char *os_util_log_parse_spec(const char *p, os_util_log_spec_t *spec)
+{
+    memset(spec, 0, sizeof(os_util_log_spec_t));
+
+    spec->flags = p;
+    while ((*p == '-') || (*p == '+') || (*p == ' ') || (*p == '#') || (*p == '0'))
+        p++;
+
+    if (*p == '*')
+    {
+        spec->star_width = 1;
+        p++;
+    }
+    else
+    {
+        while ((*p >= '0') && (*p <= '9'))
+            p++;
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            spec->star_prec = 1;
+            p++;
+        }
+        else
+        {
+            while ((*p >= '0') && (*p <= '9'))
+                p++;
+        }
+    }
+
+    spec->length = p;
+    switch (*p)
+    {
+    case 'h':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_H;
+        if (*p == 'h')
+        {
+            p++;
+            spec->len = OS_UTIL_LOG_LEN_HH;
+        }
+        break;
+    case 'l':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_L;
+        if (*p == 'l')
+        {
+            p++;
+            spec->len = OS_UTIL_LOG_LEN_LL;
+        }
+        break;
+    case 'L':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_LD;
+        break;
+    case 'z':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_Z;
+        break;
+    case 'j':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_J;
+        break;
+    case 't':
+        p++;
+        spec->len = OS_UTIL_LOG_LEN_T;
+        break;
+    default:
+        break;
+    }
+
+    spec->conv = *p;
+
+    return p;
+}
+
+static int64_t os_util_log_get_signed(va_list *argp, uint8_t len)
+{
+    switch (len)
+    {
+    case OS_UTIL_LOG_LEN_HH:
+        return (signed char) va_arg(*argp, int);
+    case OS_UTIL_LOG_LEN_H:
+        return (short) va_arg(*argp, int);
+    case OS_UTIL_LOG_LEN_L:
+        return va_arg(*argp, long);
+    case OS_UTIL_LOG_LEN_LL:
+        return va_arg(*argp, long long);
+    case OS_UTIL_LOG_LEN_Z:
+        return (int64_t) va_arg(*argp, size_t);
+    case OS_UTIL_LOG_LEN_J:
+        return va_arg(*argp, intmax_t);
+    case OS_UTIL_LOG_LEN_T:
+        return va_arg(*argp, ptrdiff_t);
+    default:
+        return va_arg(*argp, int);
+    }
+}
+
+static uint64_t os_util_log_get_unsigned(va_list *argp, uint8_t len)
+{
+    switch (len)
+    {
+    case OS_UTIL_LOG_LEN_HH:
+        return (unsigned char) va_arg(*argp, unsigned int);
+    case OS_UTIL_LOG_LEN_H:
+        return (unsigned short) va_arg(*argp, unsigned int);
+    case OS_UTIL_LOG_LEN_L:
+        return va_arg(*argp, unsigned long);
+    case OS_UTIL_LOG_LEN_LL:
+        return va_arg(*argp, unsigned long long);
+    case OS_UTIL_LOG_LEN_Z:
+        return va_arg(*argp, size_t);
+    case OS_UTIL_LOG_LEN_J:
+        return va_arg(*argp, uintmax_t);
+    case OS_UTIL_LOG_LEN_T:
+        return (uint64_t) va_arg(*argp, ptrdiff_t);
+    default:
+        return va_arg(*argp, unsigned int);
+    }
+}
+
+static void os_util_log_capture(os_util_log_rec_t *rec, const char *fmt, va_list *argp)
+{
+    os_util_log_spec_t spec;
+    uint8_t n = 0;
+    const char *p;
+
+    rec->fmt = fmt;
+    rec->str_len = 0;
+
+    for (p = fmt; *p; p++)
+    {
+        if (*p != '%')
+            continue;
+
+        p++;
+        if (*p == '%')
+            continue;
+
+        p = os_util_log_parse_spec(p, &spec);
+        if (*p == '\0')
+            break;
+
+        // not enough room: remaining conversions are rendered without arguments
+        if ((n + spec.star_width + spec.star_prec) >= OS_UTIL_LOG_MAX_ARGS)
+            break;
+
+        if (spec.star_width)
+            rec->args[n++].i = va_arg(*argp, int);
+
+        if (spec.star_prec)
+            rec->args[n++].i = va_arg(*argp, int);
+
+        switch (spec.conv)
+        {
+        case 'd':
+        case 'i':
+            rec->args[n++].i = os_util_log_get_signed(argp, spec.len);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            rec->args[n++].u = os_util_log_get_unsigned(argp, spec.len);
+            break;
+        case 'c':
+            rec->args[n++].i = va_arg(*argp, int);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (spec.len == OS_UTIL_LOG_LEN_LD)
+                rec->args[n++].d = (double) va_arg(*argp, long double);
+            else
+                rec->args[n++].d = va_arg(*argp, double);
+            break;
+        case 's':
+        {
+            const char *s = va_arg(*argp, const char *);
+            uint16_t size = OS_UTIL_LOG_STR_SIZE - rec->str_len;
+            uint16_t len = 0;
+
+            if (s == 0)
+                s = "(null)";
+
+            // truncate when there is no room left
+            while ((len + 1 < size) && s[len])
+                len++;
+
+            if (size > 0)
+            {
+                memcpy(&rec->str[rec->str_len], s, len);
+                rec->str[rec->str_len + len] = '\0';
+                rec->args[n++].u = rec->str_len;
+                rec->str_len += len + 1;
+            }
+            else
+            {
+                rec->args[n++].u = OS_UTIL_LOG_STR_SIZE;
+            }
+            break;
+        }
+        case 'p':
+            rec->args[n++].p = va_arg(*argp, void *);
+            break;
+        default:
+            // %n and unknown conversions are not supported
+            break;
+        }
+    }
+}
+
+static int os_util_log_render(const os_util_log_rec_t *rec, char *line, int size)
+{
+    os_util_log_spec_t spec;
+    char conv[32];
+    const char *p;
+    uint8_t n = 0;
+    int pos;
+
+    pos = snprintf(line, size, "[%6lu.%06lu] ",
+        (unsigned long) (rec->timestamp / 1000000), (unsigned long) (rec->timestamp % 1000000));
+
+    for (p = rec->fmt; *p && (pos < size - 1); p++)
+    {
+        const char *f;
+        int c = 0;
+        int len;
+
+        if (*p != '%')
+        {
+            line[pos++] = *p;
+            continue;
+        }
+
+        p++;
+        if (*p == '%')
+        {
+            line[pos++] = '%';
+            continue;
+        }
+
+        p = os_util_log_parse_spec(p, &spec);
+        if (*p == '\0')
+            break;
+
+        if ((n + spec.star_width + spec.star_prec) >= OS_UTIL_LOG_MAX_ARGS)
+            break;
+
+        // rebuild the conversion: flags, width and precision (with '*' replaced
+        // by the captured values) followed by the length used at capture time
+        conv[c++] = '%';
+        for (f = spec.flags; (f < spec.length) && (c < (int) sizeof(conv) - 16); f++)
+        {
+            if (*f == '*')
+                c += snprintf(&conv[c], sizeof(conv) - c - 4, "%d", (int) rec->args[n++].i);
+            else
+                conv[c++] = *f;
+        }
+
+        len = size - pos;
+        switch (spec.conv)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            conv[c++] = 'l';
+            conv[c++] = 'l';
+            conv[c++] = spec.conv;
+            conv[c] = '\0';
+            if ((spec.conv == 'd') || (spec.conv == 'i'))
+                len = snprintf(&line[pos], len, conv, (long long) rec->args[n++].i);
+            else
+                len = snprintf(&line[pos], len, conv, (unsigned long long) rec->args[n++].u);
+            break;
+        case 'c':
+            conv[c++] = 'c';
+            conv[c] = '\0';
+            len = snprintf(&line[pos], len, conv, (int) rec->args[n++].i);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            conv[c++] = spec.conv;
+            conv[c] = '\0';
+            len = snprintf(&line[pos], len, conv, rec->args[n++].d);
+            break;
+        case 's':
+            conv[c++] = 's';
+            conv[c] = '\0';
+            len = snprintf(&line[pos], len, conv,
+                rec->args[n].u < OS_UTIL_LOG_STR_SIZE ? &rec->str[rec->args[n].u] : "");
+            n++;
+            break;
+        case 'p':
+            conv[c++] = 'p';
+            conv[c] = '\0';
+            len = snprintf(&line[pos], len, conv, rec->args[n++].p);
+            break;
+        default:
+            len = 0;
+            break;
+        }
+
+        if (len > 0)
+            pos += len;
+    }
+
+    if (pos > size - 1)
+        pos = size - 1;
+
+    line[pos] = '\0';
+
+    return pos;
+}
+
+// called once per thread
+static os_util_log_ring_t *os_util_log_register(void)
+{
+    os_util_log_ring_t *ring = 0;
+    uint32_t idx;
+
+    idx = OS_ATOMIC_FETCH_INC(&log_num_rings);
+    if (idx < OS_UTIL_LOG_MAX_THREADS)
+        ring = (os_util_log_ring_t *) calloc(1, sizeof(os_util_log_ring_t));
+
+    if (ring == 0)
+    {
+        OS_ATOMIC_FETCH_INC(&log_shared_threads);
+        return log_rings[OS_UTIL_LOG_MAX_THREADS];
+    }
+
+    OS_ATOMIC_STORE_REL(&log_rings[idx], ring);
+
+    return ring;
+}
+
 void os_util_log(const unsigned char *line, ...)
 {
-    time_t cur_time;
-	struct tm * timeinfo;
-    
+    os_util_log_ring_t *ring;
+    os_util_log_rec_t *rec;
+    uint32_t head, tail;
     va_list argp;
-   
-    if(!os_util_log_started)
-		return;
+    int shared;
+
+    if (os_util_log_level == OS_UTIL_LOG_OFF)
+        return;
+
+    ring = log_ring;
+    if (ring == 0)
+        ring = log_ring = os_util_log_register();
+
+    // several producers on the shared ring
+    shared = (ring == log_rings[OS_UTIL_LOG_MAX_THREADS]);
+    if (shared)
+        os_kernel_mutex_lock(log_shared_lock);
 
-    time(&cur_time);
-    timeinfo = localtime (&cur_time);
-    strftime(buffer,80,"[%x %X] ",timeinfo);
-    printf("%s",buffer);
+    head = ring->head;
+    tail = OS_ATOMIC_LOAD_ACQ(&ring->tail);
 
-	va_start(argp, line);
-    vsnprintf(buffer,MAX_LOG_BUF,line, argp);
+    if ((head - tail) >= OS_UTIL_LOG_RING_SIZE)
+    {
+        ring->dropped++;
+        if (shared)
+            os_kernel_mutex_unlock(log_shared_lock);
+        return;
+    }
+
+    rec = &ring->recs[head & (OS_UTIL_LOG_RING_SIZE - 1)];
+    rec->timestamp = os_kernel_get_time_us() - log_start_us;
+
+    va_start(argp, line);
+    os_util_log_capture(rec, (const char *) line, &argp);
     va_end(argp);
-    
-    buffer[MAX_LOG_BUF-1] = '\0';
 
-    printf("%s",buffer);
+    OS_ATOMIC_STORE_REL(&ring->head, head + 1);
+
+    if (shared)
+        os_kernel_mutex_unlock(log_shared_lock);
+
+    // wake up the drain thread earlier when the ring is getting full
+    if (((head + 1 - tail) == (OS_UTIL_LOG_RING_SIZE / 2)) && log_wakeup)
+        os_kernel_event_signal(log_wakeup);
+}
+
+void os_util_log_flush(void)
+{
+    char line[OS_UTIL_LOG_LINE_SIZE];
+    uint32_t shared_threads;
+    uint32_t written = 0;
+    uint32_t n;
+    FILE *out;
+
+    if (log_lock == 0)
+        return;
+
+    os_kernel_mutex_lock(log_lock);
+
+    out = log_output ? log_output : stdout;
+
+    while (1)
+    {
+        os_util_log_ring_t *oldest = 0;
+        os_util_log_rec_t *rec;
+        uint64_t ts = 0;
+
+        // merge the rings by picking the oldest pending record
+        for (n = 0; n <= OS_UTIL_LOG_MAX_THREADS; n++)
+        {
+            os_util_log_ring_t *ring = OS_ATOMIC_LOAD_ACQ(&log_rings[n]);
+
+            if ((ring == 0) || (ring->tail == OS_ATOMIC_LOAD_ACQ(&ring->head)))
+                continue;
+
+            rec = &ring->recs[ring->tail & (OS_UTIL_LOG_RING_SIZE - 1)];
+            if ((oldest == 0) || (rec->timestamp < ts))
+            {
+                oldest = ring;
+                ts = rec->timestamp;
+            }
+        }
+
+        if (oldest == 0)
+            break;
+
+        rec = &oldest->recs[oldest->tail & (OS_UTIL_LOG_RING_SIZE - 1)];
+        fwrite(line, 1, os_util_log_render(rec, line, sizeof(line)), out);
+        written++;
+
+        OS_ATOMIC_STORE_REL(&oldest->tail, oldest->tail + 1);
+    }
+
+    for (n = 0; n <= OS_UTIL_LOG_MAX_THREADS; n++)
+    {
+        os_util_log_ring_t *ring = OS_ATOMIC_LOAD_ACQ(&log_rings[n]);
+        uint32_t dropped;
+
+        if (ring == 0)
+            continue;
+
+        dropped = ring->dropped;
+        if (dropped != ring->dropped_reported)
+        {
+            fprintf(out, "[log] %u messages dropped\n", (unsigned int) (dropped - ring->dropped_reported));
+            ring->dropped_reported = dropped;
+            written++;
+        }
+    }
+
+    shared_threads = OS_ATOMIC_LOAD_ACQ(&log_shared_threads);
+    if (shared_threads != log_shared_reported)
+    {
+        fprintf(out, "[log] %u threads beyond %u log through the shared ring\n",
+            (unsigned int) shared_threads, (unsigned int) OS_UTIL_LOG_MAX_THREADS);
+        log_shared_reported = shared_threads;
+        written++;
+    }
+
+    // an idle drain thread must not touch the stream (it may be stdout while exiting)
+    if (written)
+        fflush(out);
+
+    os_kernel_mutex_unlock(log_lock);
+}
+
+static void* os_util_log_drain(void *param)
+{
+    while (1)
+    {
+        os_kernel_event_wait(log_wakeup, OS_UTIL_LOG_DRAIN_MS);
+        os_util_log_flush();
+    }
+
+    return 0;
+}
+
+void os_util_log_set_output(FILE *fp)
+{
+    os_util_log_flush();
+    log_output = fp;
+}
+
+void os_util_log_set_level(int level)
+{
+    os_util_log_level_cfg = level;
+
+    if (os_util_log_level != OS_UTIL_LOG_OFF)
+        os_util_log_level = level;
 }
 
 void os_util_dump_frame(const unsigned char * const data, int len)
@@ -72,16 +643,27 @@ void os_util_dump_frame(const unsigned char * const data, int len)
 
 int os_util_log_stop(void)
 {
-	if(os_util_log_started)
-        os_util_log_started  = 0;
+    os_util_log_level = OS_UTIL_LOG_OFF;
+    os_util_log_flush();
 
 	return 0;
 }
 
 int os_util_log_start(void)
 {
-	if(!os_util_log_started)
-        os_util_log_started  = 1;
+    if (log_thread == 0)
+    {
+        log_start_us = os_kernel_get_time_us();
+        log_lock = os_kernel_mutex_create();
+        log_shared_lock = os_kernel_mutex_create();
+        log_rings[OS_UTIL_LOG_MAX_THREADS] = (os_util_log_ring_t *) calloc(1, sizeof(os_util_log_ring_t));
+        OS_UTIL_ASSERT(log_rings[OS_UTIL_LOG_MAX_THREADS]);
+        log_wakeup = os_kernel_event_create();
+        log_thread = os_kernel_create(os_util_log_drain, "LOG_DRAIN", (os_thread_arg) 0,
+            os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    }
+
+    os_util_log_level = os_util_log_level_cfg;
 
 	return 0;
 }
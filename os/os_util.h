@@ -5,6 +5,8 @@
 #ifndef __OS_UTIL__
 #define __OS_UTIL__ 
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,6 +17,23 @@ extern "C" {
     @{
 */
 
+/**
+    Log levels, from the most to the least important.
+    OS_UTIL_LOG_OFF disables logging.
+*/
+enum os_util_log_level_e
+{
+    OS_UTIL_LOG_OFF = 0,
+    OS_UTIL_LOG_ERROR,
+    OS_UTIL_LOG_WARN,
+    OS_UTIL_LOG_INFO,
+    OS_UTIL_LOG_DEBUG,
+    OS_UTIL_LOG_TRACE
+};
+
+/** Current log level (OS_UTIL_LOG_OFF when log is stopped). */
+extern volatile int os_util_log_level;
+
 /** 
     Assertion like function.
     
@@ -24,13 +43,36 @@ extern void os_util_assert(int cond);
 
 /**
     Message log utility.
-    
+
+    Arguments are captured into a per-thread ring and formatted later by the
+    log drain thread, so the format string must be a string literal.
+    String arguments are copied.
+
     @param line Variable parameters list like printf.
 */
 extern void os_util_log(const unsigned char *line, ...);
 
 /**
-    Start log.
+    Write all pending log messages to the output.
+*/
+extern void os_util_log_flush(void);
+
+/**
+    Select the log output (stdout by default).
+
+    @param fp Output file.
+*/
+extern void os_util_log_set_output(FILE *fp);
+
+/**
+    Set the log level used while log is started (OS_UTIL_LOG_DEBUG by default).
+
+    @param level New log level (see os_util_log_level_e).
+*/
+extern void os_util_log_set_level(int level);
+
+/**
+    Start log. The log drain thread is created on the first call.
 
     @retval 1 Log not started.
     @retval 0 Log started.
@@ -38,7 +80,7 @@ extern void os_util_log(const unsigned char *line, ...);
 extern int os_util_log_start(void);
 
 /**
-	Stop log .
+	Stop log, pending messages are written before returning.
 
 @retval 1 Log not stopped.
 @retval 0 Log stopped.
@@ -66,13 +108,24 @@ extern void os_util_dump_frame(const unsigned char *const data, int len);
     @brief Assertion macro
 */
 #define OS_UTIL_ASSERT(cond)   os_util_assert( !!(cond) )
-#define OS_UTIL_LOG(cond,expr)  \
+
+/**
+    @def OS_UTIL_LOG_LVL
+    @brief Log when cond is true (usually a compile time debug flag) and level is enabled
+*/
+#define OS_UTIL_LOG_LVL(level,cond,expr)  \
     do {\
-        if( (cond) ){ \
+        if( (cond) && ((level) <= os_util_log_level) ){ \
             os_util_log expr; \
         } \
     } while(0)
 
+/**
+    @def OS_UTIL_LOG
+    @brief Debug level log
+*/
+#define OS_UTIL_LOG(cond,expr)  OS_UTIL_LOG_LVL(OS_UTIL_LOG_DEBUG,cond,expr)
+
 /**@}*/
 
 #ifdef __cplusplus
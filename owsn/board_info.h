@@ -14,7 +14,11 @@
 
 #define port_INLINE                         
 
+#if defined(_MSC_VER)
 #define PRAGMA(x)  __pragma(x)
+#else
+#define PRAGMA(x)  _Pragma(#x)
+#endif
 #define PACK(x)     pack(x)
 
 #define INTERRUPT_DECLARATION()             ;
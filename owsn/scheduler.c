@@ -19,6 +19,16 @@ scheduler_dbg_t  scheduler_dbg;
 
 void consumeTask(uint8_t taskId);
 
+// index of the lowest bit set (x != 0), i.e. the highest priority ready
+#if defined(__GNUC__)
+#define SCHEDULER_FFS(x)  ((uint8_t) __builtin_ctz(x))
+#else
+static const uint8_t scheduler_ffs_nibble[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+#define SCHEDULER_FFS(x)  (((x) & 0x0F) ? scheduler_ffs_nibble[(x) & 0x0F] : 4 + scheduler_ffs_nibble[((x) >> 4) & 0x0F])
+#endif
+
+static task_cbt scheduler_pop_task();
+
 //=========================== public ==========================================
 
 void scheduler_init() {   
@@ -32,46 +42,42 @@ void scheduler_init() {
 }
 
 void scheduler_start() {
-   taskList_item_t* pThisTask;
    while (1) {
-      while(scheduler_vars.task_list!=NULL) {
-         // there is still at least one task in the linked-list of tasks
-         
-         // the task to execute is the one at the head of the queue
-         pThisTask                = scheduler_vars.task_list;
-         
-         // shift the queue by one task
-         scheduler_vars.task_list = pThisTask->next;
-         
-         // execute the current task
-         pThisTask->cb();
-         
-         // free up this task container
-         pThisTask->cb            = NULL;
-         pThisTask->prio          = TASKPRIO_NONE;
-         pThisTask->next          = NULL;
-         scheduler_dbg.numTasksCur--;
-      }
+      scheduler_run_pending();
       debugpins_task_clr();
       board_sleep();
       debugpins_task_set();                      // IAR should halt here if nothing to do
    }
 }
 
+/**
+\brief Runs queued tasks, highest priority first, until there is none.
+
+Used by scheduler_start() and by host builds (benchmarks, tests).
+
+\returns number of tasks run
+*/
+uint16_t scheduler_run_pending() {
+   task_cbt cb;
+   uint16_t numRun = 0;
+   
+   while ((cb = scheduler_pop_task())!=NULL) {
+      cb();
+      numRun++;
+   }
+   
+   return numRun;
+}
+
  void scheduler_push_task(task_cbt cb, task_prio_t prio) {
-   taskList_item_t*  taskContainer;
-   taskList_item_t** taskListWalker;
+   task_ring_t* ring;
    INTERRUPT_DECLARATION();
    
+   ring = &scheduler_vars.rings[prio];
+   
    DISABLE_INTERRUPTS();
    
-   // find an empty task container
-   taskContainer = &scheduler_vars.taskBuf[0];
-   while (taskContainer->cb!=NULL &&
-          taskContainer<=&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
-      taskContainer++;
-   }
-   if (taskContainer>&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
+   if (ring->count>=TASK_LIST_DEPTH) {
       // task list has overflown. This should never happpen!
    
       // we can not print from within the kernel. Instead:
@@ -79,20 +85,14 @@ void scheduler_start() {
       leds_error_blink();
       // reset the board
       board_reset();
+      ENABLE_INTERRUPTS();
+      return;
    }
-   // fill that task container with this task
-   taskContainer->cb              = cb;
-   taskContainer->prio            = prio;
-   
-   // find position in queue
-   taskListWalker                 = &scheduler_vars.task_list;
-   while (*taskListWalker!=NULL &&
-          (*taskListWalker)->prio < taskContainer->prio) {
-      taskListWalker              = (taskList_item_t**)&((*taskListWalker)->next);
-   }
-   // insert at that position
-   taskContainer->next            = *taskListWalker;
-   *taskListWalker                = taskContainer;
+   // append to the FIFO of this priority
+   ring->task[ring->tail]         = cb;
+   ring->tail                     = (ring->tail+1>=TASK_LIST_DEPTH) ? 0 : ring->tail+1;
+   ring->count++;
+   scheduler_vars.ready          |= (uint8_t) (1<<prio);
    // maintain debug stats
    scheduler_dbg.numTasksCur++;
    if (scheduler_dbg.numTasksCur>scheduler_dbg.numTasksMax) {
@@ -103,3 +103,27 @@ void scheduler_start() {
 }
 
 //=========================== private =========================================
+
+static task_cbt scheduler_pop_task() {
+   task_ring_t* ring;
+   task_cbt     cb = NULL;
+   uint8_t      prio;
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   
+   if (scheduler_vars.ready!=0) {
+      prio                        = SCHEDULER_FFS(scheduler_vars.ready);
+      ring                        = &scheduler_vars.rings[prio];
+      cb                          = ring->task[ring->head];
+      ring->head                  = (ring->head+1>=TASK_LIST_DEPTH) ? 0 : ring->head+1;
+      if (--ring->count==0) {
+         scheduler_vars.ready    &= (uint8_t) ~(1<<prio);
+      }
+      scheduler_dbg.numTasksCur--;
+   }
+   
+   ENABLE_INTERRUPTS();
+   
+   return cb;
+}
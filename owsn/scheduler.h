@@ -27,23 +27,25 @@ typedef enum {
    TASKPRIO_MAX                = 0x08,
 } task_prio_t;
 
-#define TASK_LIST_DEPTH      10
+#define TASK_LIST_DEPTH      10 // per priority
 
 //=========================== typedef =========================================
 
 typedef void (*task_cbt)();
 
-typedef struct task_llist_t {
-   task_cbt             cb;
-   task_prio_t          prio;
-   void*                next;
-} taskList_item_t;
+// FIFO of the tasks pushed with one priority
+typedef struct {
+   task_cbt             task[TASK_LIST_DEPTH];
+   uint8_t              head;
+   uint8_t              tail;
+   uint8_t              count;
+} task_ring_t;
 
 //=========================== module variables ================================
 
 typedef struct {
-   taskList_item_t      taskBuf[TASK_LIST_DEPTH];
-   taskList_item_t*     task_list;
+   task_ring_t          rings[TASKPRIO_MAX];
+   uint8_t              ready;          // bit p set when rings[p] is not empty
    uint8_t              numTasksCur;
    uint8_t              numTasksMax;
 } scheduler_vars_t;
@@ -59,6 +61,7 @@ typedef struct {
 void scheduler_init();
 void scheduler_start();
 void scheduler_push_task(task_cbt task_cb, task_prio_t prio);
+uint16_t scheduler_run_pending();
 
 // interrupt handlers
 void isr_ieee154e_newSlot();
@@ -8,6 +8,10 @@
 #ifndef __OSENS_H__
 #define __OSENS_H__
 
+/*
+    Boards of a newer version keep the registers of the older ones, what they
+    add is announced by OSENS_REGMAP_FEATURES: the mote accepts any version.
+*/
 #define OSENS_LATEST_VERSION     0
 #define OSENS_MODEL_NAME_SIZE    8
 #define OSENS_MANUF_NAME_SIZE    8
@@ -42,8 +46,20 @@ enum osens_datatypes_e
 	OSENS_DT_S64    = 0x07, /**< 64 bits signed */
 	OSENS_DT_FLOAT  = 0x08, /**< IEEE 754 single precision */
 	OSENS_DT_DOUBLE = 0x09, /**< IEEE 754 double precision */
+	OSENS_DT_ARRAY_S16   = 0x0A, /**< block of 16 bits signed samples */
+	OSENS_DT_ARRAY_FLOAT = 0x0B, /**< block of single precision samples */
 };
 
+/**
+    Value of an array point (waveforms): count elements of the array type,
+    in host byte order. The storage belongs to the owner of the point.
+*/
+typedef struct osens_point_array_s
+{
+	uint16_t count;
+	void *data;
+} osens_point_array_t;
+
 union osens_point_data_u
 {
 	uint8_t  u8;
@@ -56,6 +72,7 @@ union osens_point_data_u
 	int64_t  s64;
 	float    fp32;
 	double   fp64;
+	osens_point_array_t array;
 };
 
 typedef struct osens_brd_id_s
@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "osens_capture.h"
+
+/*
+    Capture file decoder.
+
+    usage: osens_capdec [options] file
+        -b <id>    only frames from/to board id
+        -r <addr>  only frames for register addr (decimal or 0x hex)
+        -d req|res only requests or responses
+        -x         hex dump of the raw frames
+        -q         do not print frames (useful with -l)
+        -l         per register latency (request to response) summary
+*/
+
+#define CAPDEC_MAX_BOARDS 256
+#define CAPDEC_NUM_REGS   256
+
+typedef struct capdec_opts_s
+{
+    int board;
+    int reg;
+    int dir;
+    int hex;
+    int quiet;
+    int latency;
+    const char *filename;
+} capdec_opts_t;
+
+typedef struct capdec_pending_s
+{
+    uint8_t active;
+    uint8_t addr;
+    uint64_t timestamp;
+} capdec_pending_t;
+
+typedef struct capdec_reg_stats_s
+{
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t errors;
+    uint32_t no_answer;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t lat_sum;
+} capdec_reg_stats_t;
+
+static capdec_pending_t pending[CAPDEC_MAX_BOARDS];
+static capdec_reg_stats_t reg_stats[CAPDEC_NUM_REGS];
+
+static const char *capdec_reg_name(uint8_t addr)
+{
+    static char name[32];
+    static const char *names[] = {
+        "ITF_VERSION", "BRD_ID", "BRD_STATUS", "BRD_CMD", "READ_BAT_STATUS",
+        "WRITE_BAT_STATUS", "READ_BAT_CHARGE", "WRITE_BAT_CHARGE", "WPAN_STATUS",
+        "WPAN_STRENGTH", "DSP_WRITE", "SVR_MAIN_ADDR", "SVR_SEC_ADDR"
+    };
+
+    if (addr <= OSENS_REGMAP_SVR_SEC_ADDR)
+        return names[addr];
+
+    if ((addr >= OSENS_REGMAP_POINT_DESC_1) && (addr <= OSENS_REGMAP_POINT_DESC_32))
+        sprintf(name, "POINT_DESC_%d", addr - OSENS_REGMAP_POINT_DESC_1 + 1);
+    else if ((addr >= OSENS_REGMAP_READ_POINT_DATA_1) && (addr <= OSENS_REGMAP_READ_POINT_DATA_32))
+        sprintf(name, "READ_POINT_DATA_%d", addr - OSENS_REGMAP_READ_POINT_DATA_1 + 1);
+    else if ((addr >= OSENS_REGMAP_WRITE_POINT_DATA_1) && (addr <= OSENS_REGMAP_WRITE_POINT_DATA_32))
+        sprintf(name, "WRITE_POINT_DATA_%d", addr - OSENS_REGMAP_WRITE_POINT_DATA_1 + 1);
+    else if (addr == OSENS_REGMAP_LINK_RATES)
+        return "LINK_RATES";
+    else if (addr == OSENS_REGMAP_LINK_SPEED)
+        return "LINK_SPEED";
+    else if (addr == OSENS_REGMAP_FRAME_SIZE)
+        return "FRAME_SIZE";
+    else if (addr == OSENS_REGMAP_STREAM)
+        return "STREAM";
+    else if (addr == OSENS_REGMAP_STREAM_DATA)
+        return "STREAM_DATA";
+    else if (addr == OSENS_REGMAP_WRITE_BLOCK)
+        return "WRITE_BLOCK";
+    else if (addr == OSENS_REGMAP_AGGREGATE)
+        return "AGGREGATE";
+    else if (addr == OSENS_REGMAP_FEATURES)
+        return "FEATURES";
+    else if (addr == OSENS_REGMAP_TIME_SYNC)
+        return "TIME_SYNC";
+    else
+        sprintf(name, "REG_%02X", addr);
+
+    return name;
+}
+
+static void capdec_print_value(const osens_point_t *point)
+{
+    switch (point->type)
+    {
+    case OSENS_DT_U8:
+        printf("u8 %u", point->value.u8);
+        break;
+    case OSENS_DT_S8:
+        printf("s8 %d", point->value.s8);
+        break;
+    case OSENS_DT_U16:
+        printf("u16 %u", point->value.u16);
+        break;
+    case OSENS_DT_S16:
+        printf("s16 %d", point->value.s16);
+        break;
+    case OSENS_DT_U32:
+        printf("u32 %lu", (unsigned long) point->value.u32);
+        break;
+    case OSENS_DT_S32:
+        printf("s32 %ld", (long) point->value.s32);
+        break;
+    case OSENS_DT_U64:
+        printf("u64 %llu", (unsigned long long) point->value.u64);
+        break;
+    case OSENS_DT_S64:
+        printf("s64 %lld", (long long) point->value.s64);
+        break;
+    case OSENS_DT_FLOAT:
+        printf("float %g", point->value.fp32);
+        break;
+    case OSENS_DT_DOUBLE:
+        printf("double %g", point->value.fp64);
+        break;
+    case OSENS_DT_ARRAY_S16:
+        printf("s16[%u]", point->value.array.count);
+        break;
+    case OSENS_DT_ARRAY_FLOAT:
+        printf("float[%u]", point->value.array.count);
+        break;
+    default:
+        printf("type %u", point->type);
+        break;
+    }
+}
+
+// register of a captured frame, 0xFF when the header is truncated
+static uint8_t capdec_frame_addr(const uint8_t *frame, uint16_t size)
+{
+    uint16_t frame_size;
+    uint8_t hdr_len = osens_frame_size(frame, size, &frame_size);
+
+    return (hdr_len > 0) && (size > hdr_len) ? frame[hdr_len] : 0xFF;
+}
+
+// the size field must fit in the captured frame before unpacking
+static uint8_t capdec_frame_complete(const uint8_t *frame, uint16_t size)
+{
+    uint16_t frame_size;
+    uint8_t hdr_len = osens_frame_size(frame, size, &frame_size);
+
+    return (hdr_len > 0) && (size >= 3) && ((uint32_t) frame_size + 2 <= size);
+}
+
+static void capdec_print_req(uint8_t *frame, uint16_t size)
+{
+    osens_cmd_req_t cmd;
+    uint8_t n;
+
+    memset(&cmd, 0, sizeof(cmd));
+    if (osens_unpack_cmd_req(&cmd, frame, size) == 0)
+    {
+        printf("  invalid frame");
+        return;
+    }
+
+    if ((cmd.hdr.addr >= OSENS_REGMAP_WRITE_POINT_DATA_1) && (cmd.hdr.addr <= OSENS_REGMAP_WRITE_POINT_DATA_32))
+    {
+        printf("  ");
+        capdec_print_value(&cmd.payload.point_value_cmd);
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_LINK_SPEED)
+    {
+        printf("  %lu bps", (unsigned long) osens_link_rate_to_bps(cmd.payload.link_speed_cmd.rate));
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_FRAME_SIZE)
+    {
+        printf("  max %u bytes", cmd.payload.frame_size_cmd.max_size);
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_STREAM)
+    {
+        printf("  points %08lX every %u ms batch %u", (unsigned long) cmd.payload.stream_cmd.mask,
+            cmd.payload.stream_cmd.period_ms, cmd.payload.stream_cmd.batch);
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_WRITE_BLOCK)
+    {
+        for (n = 0; n < cmd.payload.write_block_cmd.num_points; n++)
+        {
+            printf("  [%u] ", cmd.payload.write_block_cmd.index[n]);
+            capdec_print_value(&cmd.payload.write_block_cmd.values[n]);
+        }
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_AGGREGATE)
+    {
+        printf("  point %u", cmd.payload.aggregate_cmd.index);
+    }
+    else if (cmd.hdr.addr == OSENS_REGMAP_TIME_SYNC)
+    {
+        printf("  mote %lu ms flags %02X", (unsigned long) cmd.payload.time_sync_cmd.mote_ms,
+            cmd.payload.time_sync_cmd.flags);
+    }
+}
+
+static void capdec_print_res(uint8_t *frame, uint16_t size)
+{
+    osens_cmd_res_t ans;
+    uint8_t addr;
+    uint8_t n;
+
+    memset(&ans, 0, sizeof(ans));
+    if (osens_unpack_cmd_res(&ans, frame, size) == 0)
+    {
+        if (ans.hdr.status == OSENS_ANS_CRC_ERROR)
+            printf("  CRC error");
+        else
+            printf("  status %u", ans.hdr.status);
+        return;
+    }
+
+    addr = ans.hdr.addr;
+    printf("  OK");
+
+    if (addr == OSENS_REGMAP_ITF_VERSION)
+    {
+        printf("  version %u", ans.payload.itf_version_cmd.version);
+    }
+    else if (addr == OSENS_REGMAP_BRD_ID)
+    {
+        printf("  model %.8s manuf %.8s id %08lX rev %02X points %u",
+            ans.payload.brd_id_cmd.model, ans.payload.brd_id_cmd.manufactor,
+            (unsigned long) ans.payload.brd_id_cmd.sensor_id, ans.payload.brd_id_cmd.hardware_revision,
+            ans.payload.brd_id_cmd.num_of_points);
+    }
+    else if ((addr >= OSENS_REGMAP_POINT_DESC_1) && (addr <= OSENS_REGMAP_POINT_DESC_32))
+    {
+        printf("  name %.8s type %u unit %u rights %02X sampling %lu",
+            ans.payload.point_desc_cmd.name, ans.payload.point_desc_cmd.type,
+            ans.payload.point_desc_cmd.unit, ans.payload.point_desc_cmd.access_rights,
+            (unsigned long) ans.payload.point_desc_cmd.sampling_time_x250ms);
+    }
+    else if ((addr >= OSENS_REGMAP_READ_POINT_DATA_1) && (addr <= OSENS_REGMAP_READ_POINT_DATA_32))
+    {
+        printf("  ");
+        capdec_print_value(&ans.payload.point_value_cmd);
+        if (ans.time.valid)
+            printf("  at %lu - %u ms", (unsigned long) ans.time.base_ms, ans.time.age_ms);
+    }
+    else if (addr == OSENS_REGMAP_LINK_RATES)
+    {
+        printf("  rates %04X current %lu bps", ans.payload.link_rates_cmd.rates,
+            (unsigned long) osens_link_rate_to_bps(ans.payload.link_rates_cmd.current));
+    }
+    else if (addr == OSENS_REGMAP_FRAME_SIZE)
+    {
+        printf("  max %u bytes", ans.payload.frame_size_cmd.max_size);
+    }
+    else if (addr == OSENS_REGMAP_FEATURES)
+    {
+        printf("  features %08lX", (unsigned long) ans.payload.features_cmd.features);
+    }
+    else if (addr == OSENS_REGMAP_STREAM_DATA)
+    {
+        printf("  seq %u samples %u (%u bytes)", ans.payload.stream_data_cmd.seq,
+            ans.payload.stream_data_cmd.num_samples, ans.payload.stream_data_cmd.size);
+    }
+    else if (addr == OSENS_REGMAP_WRITE_BLOCK)
+    {
+        printf("  status");
+        for (n = 0; n < ans.payload.write_block_cmd.num_points; n++)
+            printf(" %u", ans.payload.write_block_cmd.status[n]);
+    }
+    else if (addr == OSENS_REGMAP_AGGREGATE)
+    {
+        printf("  point %u count %lu min %g max %g mean %g variance %g", ans.payload.aggregate_cmd.index,
+            (unsigned long) ans.payload.aggregate_cmd.count, ans.payload.aggregate_cmd.min,
+            ans.payload.aggregate_cmd.max, ans.payload.aggregate_cmd.mean, ans.payload.aggregate_cmd.variance);
+    }
+    else if (addr == OSENS_REGMAP_TIME_SYNC)
+    {
+        printf("  mote %lu ms sensor rx %lu tx %lu ms flags %02X", (unsigned long) ans.payload.time_sync_cmd.mote_ms,
+            (unsigned long) ans.payload.time_sync_cmd.rx_ms, (unsigned long) ans.payload.time_sync_cmd.tx_ms,
+            ans.payload.time_sync_cmd.flags);
+    }
+}
+
+static void capdec_latency(uint64_t timestamp, uint8_t board_id, uint8_t dir, uint8_t *frame, uint16_t size)
+{
+    capdec_pending_t *p = &pending[board_id];
+    capdec_reg_stats_t *st;
+    osens_cmd_res_t ans;
+    uint8_t addr = capdec_frame_addr(frame, size);
+
+    if (dir == OSENS_CAPTURE_DIR_REQ)
+    {
+        // previous request was never answered
+        if (p->active)
+            reg_stats[p->addr].no_answer++;
+
+        reg_stats[addr].requests++;
+        p->active = 1;
+        p->addr = addr;
+        p->timestamp = timestamp;
+        return;
+    }
+
+    // pushed samples do not answer the pending request
+    if (!p->active || (addr == OSENS_REGMAP_STREAM_DATA))
+        return;
+
+    st = &reg_stats[p->addr];
+    p->active = 0;
+
+    // wrong register, truncated, CRC or status errors
+    if (!capdec_frame_complete(frame, size) || (addr != p->addr) ||
+        (osens_unpack_cmd_res(&ans, frame, size) == 0))
+    {
+        st->errors++;
+        return;
+    }
+
+    timestamp -= p->timestamp;
+    if ((st->responses == 0) || (timestamp < st->lat_min))
+        st->lat_min = timestamp;
+    if (timestamp > st->lat_max)
+        st->lat_max = timestamp;
+    st->lat_sum += timestamp;
+    st->responses++;
+}
+
+static void capdec_print_latency(void)
+{
+    int n;
+
+    printf("\n%-22s %8s %8s %8s %8s %10s %10s %10s\n", "register", "req", "res", "errors", "no ans", "min(us)", "avg(us)", "max(us)");
+
+    for (n = 0; n < CAPDEC_NUM_REGS; n++)
+    {
+        capdec_reg_stats_t *st = &reg_stats[n];
+
+        if (st->requests == 0)
+            continue;
+
+        printf("%-22s %8lu %8lu %8lu %8lu %10llu %10llu %10llu\n", capdec_reg_name((uint8_t) n),
+            (unsigned long) st->requests, (unsigned long) st->responses,
+            (unsigned long) st->errors, (unsigned long) st->no_answer,
+            (unsigned long long) st->lat_min,
+            (unsigned long long) (st->responses ? st->lat_sum / st->responses : 0),
+            (unsigned long long) st->lat_max);
+    }
+}
+
+static int capdec_get_varint(FILE *fp, uint64_t *value)
+{
+    int shift = 0;
+    int c;
+
+    *value = 0;
+
+    do
+    {
+        c = fgetc(fp);
+        if ((c == EOF) || (shift > 63))
+            return 0;
+
+        *value |= (uint64_t) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return 1;
+}
+
+static int capdec_parse_args(int argc, char *argv[], capdec_opts_t *opts)
+{
+    int n;
+
+    memset(opts, 0, sizeof(capdec_opts_t));
+    opts->board = -1;
+    opts->reg = -1;
+    opts->dir = -1;
+
+    for (n = 1; n < argc; n++)
+    {
+        if ((strcmp(argv[n], "-b") == 0) && (n + 1 < argc))
+            opts->board = (int) strtol(argv[++n], 0, 0);
+        else if ((strcmp(argv[n], "-r") == 0) && (n + 1 < argc))
+            opts->reg = (int) strtol(argv[++n], 0, 0);
+        else if ((strcmp(argv[n], "-d") == 0) && (n + 1 < argc))
+        {
+            n++;
+            if (strcmp(argv[n], "req") == 0)
+                opts->dir = OSENS_CAPTURE_DIR_REQ;
+            else if (strcmp(argv[n], "res") == 0)
+                opts->dir = OSENS_CAPTURE_DIR_RES;
+            else
+                return 0;
+        }
+        else if (strcmp(argv[n], "-x") == 0)
+            opts->hex = 1;
+        else if (strcmp(argv[n], "-q") == 0)
+            opts->quiet = 1;
+        else if (strcmp(argv[n], "-l") == 0)
+            opts->latency = 1;
+        else if ((argv[n][0] != '-') && (opts->filename == 0))
+            opts->filename = argv[n];
+        else
+            return 0;
+    }
+
+    return opts->filename != 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t hdr[OSENS_CAPTURE_HEADER_SIZE];
+    static uint8_t frame[OSENS_MAX_EXT_FRAME_SIZE];
+    capdec_opts_t opts;
+    uint64_t timestamp = 0;
+    uint32_t records = 0;
+    FILE *fp;
+
+    if (!capdec_parse_args(argc, argv, &opts))
+    {
+        printf("usage: %s [-b board] [-r register] [-d req|res] [-x] [-q] [-l] file\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(opts.filename, "rb");
+    if (fp == 0)
+    {
+        printf("Could not open %s\n", opts.filename);
+        return 1;
+    }
+
+    if ((fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) ||
+        (memcmp(hdr, OSENS_CAPTURE_MAGIC, 4) != 0) || (hdr[4] != OSENS_CAPTURE_VERSION))
+    {
+        printf("%s is not a capture file\n", opts.filename);
+        fclose(fp);
+        return 1;
+    }
+
+    while (1)
+    {
+        uint64_t delta, size;
+        int dir, board_id;
+        uint8_t addr;
+
+        if (!capdec_get_varint(fp, &delta))
+            break;
+
+        dir = fgetc(fp);
+        board_id = fgetc(fp);
+        if ((board_id == EOF) || !capdec_get_varint(fp, &size) || (size > sizeof(frame)) ||
+            (fread(frame, 1, (size_t) size, fp) != size))
+        {
+            printf("Truncated record %lu\n", (unsigned long) records);
+            break;
+        }
+
+        // zigzag decoding
+        timestamp += (uint64_t) ((int64_t) (delta >> 1) ^ -(int64_t) (delta & 1));
+        records++;
+
+        addr = capdec_frame_addr(frame, (uint16_t) size);
+
+        if (((opts.board >= 0) && (opts.board != board_id)) ||
+            ((opts.dir >= 0) && (opts.dir != dir)))
+            continue;
+
+        if (opts.latency && (size > 1))
+            capdec_latency(timestamp, (uint8_t) board_id, (uint8_t) dir, frame, (uint16_t) size);
+
+        if (opts.quiet || ((opts.reg >= 0) && (opts.reg != addr)))
+            continue;
+
+        printf("%12.6f  B%03d  %s  %02X %-20s %3u",
+            (double) timestamp / 1e6, board_id, dir == OSENS_CAPTURE_DIR_REQ ? "REQ" : "RES",
+            addr, capdec_reg_name(addr), (unsigned int) size);
+
+        // boards of a shared bus
+        if (osens_frame_bus_addr(frame, (uint16_t) size) != OSENS_BUS_ADDR_NONE)
+            printf("  bus %u", osens_frame_bus_addr(frame, (uint16_t) size) & OSENS_BUS_ADDR_MAX);
+
+        if (!capdec_frame_complete(frame, (uint16_t) size))
+            printf("  truncated frame");
+        else if (dir == OSENS_CAPTURE_DIR_REQ)
+            capdec_print_req(frame, (uint16_t) size);
+        else
+            capdec_print_res(frame, (uint16_t) size);
+
+        printf("\n");
+
+        if (opts.hex)
+        {
+            uint64_t n;
+
+            for (n = 0; n < size; n++)
+                printf("%s%02X", (n % 16) ? " " : "    ", frame[n]);
+            printf("\n");
+        }
+    }
+
+    fclose(fp);
+
+    if (opts.latency)
+        capdec_print_latency();
+
+    return 0;
+}
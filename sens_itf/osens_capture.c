@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "osens_capture.h"
+#include "../os/os_defs.h"
+#include "../os/os_atomic.h"
+#include "../os/os_kernel.h"
+#include "../os/os_util.h"
+#include "../util/buf_io.h"
+
+/*
+    Frames are stored in a bounded multi producer/single consumer ring.
+    Each slot has a sequence number: producers claim a position with a CAS
+    and publish the slot by advancing its sequence, the capture thread
+    consumes published slots in order and gives them back.
+*/
+
+#define OSENS_DBG_CAPTURE 0
+
+typedef struct osens_capture_slot_s
+{
+    volatile uint32_t seq;
+    uint64_t timestamp;
+    uint8_t board_id;
+    uint8_t dir;
+    uint16_t size;
+    uint8_t data[OSENS_CAPTURE_FRAME_SIZE];
+} osens_capture_slot_t;
+
+volatile uint32_t osens_capture_enabled = 0;
+
+static osens_capture_slot_t cap_ring[OSENS_CAPTURE_RING_SIZE];
+static volatile uint32_t cap_enqueue = 0;
+static uint32_t cap_dequeue = 0;
+static volatile uint32_t cap_dropped = 0;
+static uint32_t cap_captured = 0;
+static uint64_t cap_last_ts = 0;
+static FILE *cap_file = 0;
+static os_mutex_t cap_lock = 0;
+static os_event_t cap_wakeup = 0;
+static os_thread_t cap_thread = 0;
+
+static uint8_t osens_capture_put_varint(uint64_t value, uint8_t *buf)
+{
+    uint8_t n = 0;
+
+    while (value >= 0x80)
+    {
+        buf[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (uint8_t) value;
+
+    return n;
+}
+
+static void osens_capture_write(osens_capture_slot_t *slot)
+{
+    uint8_t hdr[24];
+    uint8_t n;
+    int64_t delta;
+
+    // frames may be published slightly out of order by different threads,
+    // so the delta is zigzag encoded
+    delta = (int64_t) (slot->timestamp - cap_last_ts);
+    cap_last_ts = slot->timestamp;
+
+    n = osens_capture_put_varint(((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63), hdr);
+    hdr[n++] = slot->dir;
+    hdr[n++] = slot->board_id;
+    n += osens_capture_put_varint(slot->size, &hdr[n]);
+
+    fwrite(hdr, 1, n, cap_file);
+    fwrite(slot->data, 1, slot->size, cap_file);
+
+    cap_captured++;
+}
+
+void osens_capture_flush(void)
+{
+    osens_capture_slot_t *slot;
+
+    if (cap_lock == 0)
+        return;
+
+    os_kernel_mutex_lock(cap_lock);
+
+    while (1)
+    {
+        slot = &cap_ring[cap_dequeue & (OSENS_CAPTURE_RING_SIZE - 1)];
+
+        if (OS_ATOMIC_LOAD_ACQ(&slot->seq) != (cap_dequeue + 1))
+            break;
+
+        if (cap_file)
+            osens_capture_write(slot);
+
+        // give the slot back for the next lap
+        OS_ATOMIC_STORE_REL(&slot->seq, cap_dequeue + OSENS_CAPTURE_RING_SIZE);
+        cap_dequeue++;
+    }
+
+    if (cap_file)
+        fflush(cap_file);
+
+    os_kernel_mutex_unlock(cap_lock);
+}
+
+static void* osens_capture_thread(void *param)
+{
+    while (1)
+    {
+        os_kernel_event_wait(cap_wakeup, OSENS_CAPTURE_FLUSH_MS);
+        osens_capture_flush();
+    }
+
+    return 0;
+}
+
+void osens_capture_frame(uint8_t board_id, uint8_t dir, const uint8_t *frame, uint16_t size)
+{
+    osens_capture_slot_t *slot;
+    uint32_t pos;
+    uint32_t seq;
+
+    if (!osens_capture_enabled)
+        return;
+
+    pos = OS_ATOMIC_LOAD_ACQ(&cap_enqueue);
+
+    while (1)
+    {
+        slot = &cap_ring[pos & (OSENS_CAPTURE_RING_SIZE - 1)];
+        seq = OS_ATOMIC_LOAD_ACQ(&slot->seq);
+
+        if (seq == pos)
+        {
+            if (OS_ATOMIC_CAS(&cap_enqueue, pos, pos + 1))
+                break;
+        }
+        else if ((int32_t) (seq - pos) < 0)
+        {
+            // full, never block the caller
+            OS_ATOMIC_FETCH_INC(&cap_dropped);
+            return;
+        }
+
+        pos = OS_ATOMIC_LOAD_ACQ(&cap_enqueue);
+    }
+
+    if (size > OSENS_CAPTURE_FRAME_SIZE)
+        size = OSENS_CAPTURE_FRAME_SIZE;
+
+    slot->timestamp = os_kernel_get_time_us();
+    slot->board_id = board_id;
+    slot->dir = dir;
+    slot->size = size;
+    memcpy(slot->data, frame, size);
+
+    OS_ATOMIC_STORE_REL(&slot->seq, pos + 1);
+
+    // wake up the capture thread earlier when the ring is getting full
+    if ((pos - cap_dequeue) == (OSENS_CAPTURE_RING_SIZE / 2))
+        os_kernel_event_signal(cap_wakeup);
+}
+
+uint8_t osens_capture_start(const char *filename)
+{
+    uint8_t hdr[OSENS_CAPTURE_HEADER_SIZE];
+    uint32_t n;
+
+    if (cap_thread == 0)
+    {
+        cap_lock = os_kernel_mutex_create();
+        cap_wakeup = os_kernel_event_create();
+        cap_thread = os_kernel_create(osens_capture_thread, "CAPTURE", (os_thread_arg) 0,
+            os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    }
+
+    os_kernel_mutex_lock(cap_lock);
+
+    if (cap_file)
+    {
+        os_kernel_mutex_unlock(cap_lock);
+        return 0;
+    }
+
+    cap_file = fopen(filename, "wb");
+    if (cap_file == 0)
+    {
+        OS_UTIL_LOG(OSENS_DBG_CAPTURE, ("Could not create capture file %s\n", filename));
+        os_kernel_mutex_unlock(cap_lock);
+        return 0;
+    }
+
+    for (n = 0; n < OSENS_CAPTURE_RING_SIZE; n++)
+        cap_ring[n].seq = n;
+
+    cap_enqueue = 0;
+    cap_dequeue = 0;
+    cap_dropped = 0;
+    cap_captured = 0;
+    cap_last_ts = os_kernel_get_time_us();
+
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, OSENS_CAPTURE_MAGIC, 4);
+    hdr[4] = OSENS_CAPTURE_VERSION;
+    buf_io_put64_tl(cap_last_ts, &hdr[8]);
+    fwrite(hdr, 1, sizeof(hdr), cap_file);
+
+    OS_ATOMIC_STORE_REL(&osens_capture_enabled, 1);
+
+    os_kernel_mutex_unlock(cap_lock);
+
+    return 1;
+}
+
+void osens_capture_stop(void)
+{
+    if (cap_lock == 0)
+        return;
+
+    OS_ATOMIC_STORE_REL(&osens_capture_enabled, 0);
+
+    osens_capture_flush();
+
+    os_kernel_mutex_lock(cap_lock);
+
+    if (cap_file)
+    {
+        fclose(cap_file);
+        cap_file = 0;
+    }
+
+    os_kernel_mutex_unlock(cap_lock);
+}
+
+void osens_capture_get_stats(osens_capture_stats_t *stats)
+{
+    stats->captured = cap_captured;
+    stats->dropped = cap_dropped;
+}
@@ -0,0 +1,105 @@
+/**
+@file osens_capture.h
+@brief Binary frame capture
+
+Frames sent and received on the sensor interface can be captured into a
+lock-free ring and written by a background thread to a compact binary file.
+Capturing a frame costs a copy into the ring, no formatting is done, so it
+can be left enabled in production. Capture files are decoded offline by the
+osens_capdec tool.
+
+File format (multi byte fields are little endian):
+
+    header : "OSCP" | version (1 byte) | flags (1 byte) | reserved (2 bytes) |
+             start time in us (8 bytes)
+    record : time since previous record in us (varint) | direction (1 byte) |
+             board id (1 byte) | frame size (varint) | frame bytes
+
+varint is the usual base 128 encoding, least significant group first.
+*/
+
+#ifndef __OSENS_CAPTURE_H__
+#define __OSENS_CAPTURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OSENS_CAPTURE_MAGIC        "OSCP"
+#define OSENS_CAPTURE_VERSION      1
+#define OSENS_CAPTURE_HEADER_SIZE  16
+/** Frames in the capture ring (power of 2) */
+#define OSENS_CAPTURE_RING_SIZE    256
+/** Ring flush period of the capture thread */
+#define OSENS_CAPTURE_FLUSH_MS     100
+#ifndef OSENS_CAPTURE_FRAME_SIZE
+/** Bytes kept per frame, longer (extended) frames are truncated */
+#define OSENS_CAPTURE_FRAME_SIZE   OSENS_MAX_FRAME_SIZE
+#endif
+
+/** Frame direction */
+enum osens_capture_dir_e
+{
+    OSENS_CAPTURE_DIR_REQ = 0, /**< mote to sensor (request) */
+    OSENS_CAPTURE_DIR_RES = 1, /**< sensor to mote (response) */
+};
+
+/** Capture statistics */
+typedef struct osens_capture_stats_s
+{
+    uint32_t captured; /**< frames written to the file */
+    uint32_t dropped;  /**< frames lost because the ring was full */
+} osens_capture_stats_t;
+
+/** Non zero while capturing (checked by OSENS_CAPTURE) */
+extern volatile uint32_t osens_capture_enabled;
+
+/**
+    Start capturing into a new file.
+
+    @param filename capture file name (truncated if it exists)
+    @retval 1 capture started
+    @retval 0 file could not be created or capture already running
+*/
+uint8_t osens_capture_start(const char *filename);
+
+/**
+    Stop capturing. Pending frames are written and the file is closed.
+*/
+void osens_capture_stop(void);
+
+/**
+    Add a frame to the capture ring. Safe to be called from several threads.
+    Use OSENS_CAPTURE to skip the call when capture is disabled.
+
+    @param board_id board identifier
+    @param dir      frame direction (osens_capture_dir_e)
+    @param frame    raw frame bytes
+    @param size     frame size
+*/
+void osens_capture_frame(uint8_t board_id, uint8_t dir, const uint8_t *frame, uint16_t size);
+
+/**
+    Write pending frames to the capture file.
+*/
+void osens_capture_flush(void);
+
+/**
+    Get capture statistics.
+
+    @param stats statistics destination
+*/
+void osens_capture_get_stats(osens_capture_stats_t *stats);
+
+/** Capture a frame when capture is enabled */
+#define OSENS_CAPTURE(board_id, dir, frame, size) \
+    do { \
+        if (osens_capture_enabled) \
+            osens_capture_frame((board_id), (dir), (frame), (size)); \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OSENS_CAPTURE_H__ */
@@ -7,12 +7,491 @@
 #include "../os/os_util.h"
 #include "../util/buf_io.h"
 #include "../util/crc16.h"
+#include "../util/rs.h"
 
 #define OSENS_DBG_FRAME 1
 
-uint8_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf)
+uint32_t osens_link_rate_to_bps(uint8_t rate)
 {
-    uint8_t size = 0;
+    static const uint32_t bps[OSENS_LINK_NUM_RATES] = { 9600, 19200, 38400, 57600, 115200,
+        230400, 460800, 921600, 1000000, 2000000, 3000000 };
+
+    return rate < OSENS_LINK_NUM_RATES ? bps[rate] : 0;
+}
+
+uint8_t osens_point_value_size(uint8_t type)
+{
+    static const uint8_t sizes[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 }; // check osens_datatypes_e order
+
+    return type < sizeof(sizes) ? sizes[type] : 0;
+}
+
+uint8_t osens_array_elem_size(uint8_t type)
+{
+    if (type == OSENS_DT_ARRAY_S16)
+        return 2;
+    else if (type == OSENS_DT_ARRAY_FLOAT)
+        return 4;
+
+    return 0;
+}
+
+uint32_t osens_register_feature(uint8_t addr)
+{
+    switch (addr)
+    {
+    case OSENS_REGMAP_LINK_RATES:
+    case OSENS_REGMAP_LINK_SPEED:
+        return OSENS_FEATURE_LINK_SPEED;
+    case OSENS_REGMAP_FRAME_SIZE:
+        return OSENS_FEATURE_EXT_FRAMES;
+    case OSENS_REGMAP_STREAM:
+    case OSENS_REGMAP_STREAM_DATA:
+        return OSENS_FEATURE_STREAM;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        return OSENS_FEATURE_WRITE_BLOCK;
+    case OSENS_REGMAP_AGGREGATE:
+        return OSENS_FEATURE_AGGREGATE;
+    case OSENS_REGMAP_TIME_SYNC:
+        return OSENS_FEATURE_TIMESTAMPS;
+    default:
+        return 0;
+    }
+}
+
+double osens_point_to_double(const osens_point_t *point)
+{
+    switch (point->type)
+    {
+    case OSENS_DT_U8:     return point->value.u8;
+    case OSENS_DT_S8:     return point->value.s8;
+    case OSENS_DT_U16:    return point->value.u16;
+    case OSENS_DT_S16:    return point->value.s16;
+    case OSENS_DT_U32:    return point->value.u32;
+    case OSENS_DT_S32:    return point->value.s32;
+    case OSENS_DT_U64:    return (double) point->value.u64;
+    case OSENS_DT_S64:    return (double) point->value.s64;
+    case OSENS_DT_FLOAT:  return point->value.fp32;
+    case OSENS_DT_DOUBLE: return point->value.fp64;
+    default:              return 0;
+    }
+}
+
+uint32_t osens_point_value_len(const osens_point_t *point)
+{
+    uint8_t elem_size = osens_array_elem_size(point->type);
+
+    if (elem_size)
+        return 2 + (uint32_t) point->value.array.count * elem_size;
+
+    return osens_point_value_size(point->type);
+}
+
+uint8_t osens_frame_size(const uint8_t *frame, uint16_t len, uint16_t *size)
+{
+    uint8_t pos = 0;
+
+    if (len < 1)
+        return 0;
+
+    // the size field follows the bus address
+    if (frame[0] == OSENS_FRAME_BUS_ADDR)
+    {
+        pos = OSENS_FRAME_BUS_FRAMING;
+        if (len < pos + 1)
+            return 0;
+    }
+
+    if (frame[pos] != OSENS_FRAME_EXT_SIZE)
+    {
+        *size = frame[pos];
+        return pos + 1;
+    }
+
+    if (len < pos + 3)
+        return 0;
+
+    *size = buf_io_get16_fl((uint8_t *) &frame[pos + 1]);
+    return pos + 3;
+}
+
+uint8_t osens_frame_bus_addr(const uint8_t *frame, uint16_t len)
+{
+    if ((len < OSENS_FRAME_BUS_FRAMING) || (frame[0] != OSENS_FRAME_BUS_ADDR))
+        return OSENS_BUS_ADDR_NONE;
+
+    return frame[1];
+}
+
+// code words of a protected frame, each one holds up to RS_MAX_SYMBOLS - roots bytes of the frame
+static uint16_t osens_fec_blocks(uint16_t size, uint8_t roots)
+{
+    return (uint16_t) ((size + RS_MAX_SYMBOLS - roots - 1) / (RS_MAX_SYMBOLS - roots));
+}
+
+uint16_t osens_fec_size(uint16_t size, uint8_t roots)
+{
+    if (roots == 0)
+        return size;
+
+    return OSENS_FEC_HDR_SIZE + size + osens_fec_blocks(size, roots) * roots;
+}
+
+uint16_t osens_fec_encode(uint8_t *frame, uint16_t size, uint8_t roots)
+{
+    uint16_t num_blocks = osens_fec_blocks(size, roots);
+    uint8_t *data = &frame[OSENS_FEC_HDR_SIZE];
+    uint8_t *parity = &data[size];
+    uint16_t n;
+
+    memmove(data, frame, size);
+
+    // code and length, one bad byte corrected
+    frame[0] = OSENS_FRAME_FEC;
+    frame[1] = roots;
+    buf_io_put16_tl(size, &frame[2]);
+    rs_encode(&frame[1], 3, 1, &frame[4], 2);
+
+    // byte n of the frame belongs to code word n % num_blocks
+    for (n = 0; n < num_blocks; n++)
+        rs_encode(&data[n], (uint16_t) ((size - n + num_blocks - 1) / num_blocks), num_blocks, &parity[n * roots], roots);
+
+    return OSENS_FEC_HDR_SIZE + size + num_blocks * roots;
+}
+
+uint8_t osens_fec_frame_size(const uint8_t *frame, uint16_t len, uint16_t *size)
+{
+    uint8_t hdr[OSENS_FEC_HDR_SIZE - 1];
+    uint16_t frame_size;
+    uint32_t total;
+
+    if (len < OSENS_FEC_HDR_SIZE)
+        return 0;
+
+    memcpy(hdr, &frame[1], sizeof(hdr));
+    *size = 0;
+
+    if (rs_decode(hdr, 3, 1, &hdr[3], 2) < 0)
+        return OSENS_FEC_HDR_SIZE;
+
+    frame_size = buf_io_get16_fl(&hdr[1]);
+    if ((hdr[0] == 0) || (hdr[0] > OSENS_FEC_MAX_ROOTS) || (frame_size == 0))
+        return OSENS_FEC_HDR_SIZE;
+
+    total = OSENS_FEC_HDR_SIZE + (uint32_t) frame_size + (uint32_t) osens_fec_blocks(frame_size, hdr[0]) * hdr[0];
+    if (total <= OSENS_MAX_EXT_FRAME_SIZE)
+        *size = (uint16_t) total;
+
+    return OSENS_FEC_HDR_SIZE;
+}
+
+uint16_t osens_fec_decode(uint8_t *frame, uint16_t len, uint8_t *roots, osens_fec_stats_t *stats)
+{
+    uint16_t total;
+    uint16_t size;
+    uint16_t num_blocks;
+    uint8_t *data = &frame[OSENS_FEC_HDR_SIZE];
+    uint8_t *parity;
+    uint32_t fixed;
+    uint16_t n;
+    int ret;
+
+    if ((len == 0) || (frame[0] != OSENS_FRAME_FEC) || (osens_fec_frame_size(frame, len, &total) == 0))
+        return 0;
+
+    if (stats)
+        stats->frames++;
+
+    if ((total == 0) || (total > len))
+    {
+        if (stats)
+            stats->uncorrectable++;
+        return 0;
+    }
+
+    fixed = (uint32_t) rs_decode(&frame[1], 3, 1, &frame[4], 2);
+    *roots = frame[1];
+    size = buf_io_get16_fl(&frame[2]);
+    num_blocks = osens_fec_blocks(size, *roots);
+    parity = &data[size];
+
+    for (n = 0; n < num_blocks; n++)
+    {
+        ret = rs_decode(&data[n], (uint16_t) ((size - n + num_blocks - 1) / num_blocks), num_blocks, &parity[n * *roots], *roots);
+        if (ret < 0)
+        {
+            if (stats)
+                stats->uncorrectable++;
+            return 0;
+        }
+        fixed += (uint32_t) ret;
+    }
+
+    if (stats && fixed)
+    {
+        stats->corrected++;
+        stats->bytes += fixed;
+    }
+
+    memmove(frame, data, size);
+
+    return size;
+}
+
+// writes the size field and the bus address (0 for none) of a frame packed with a one byte header, returns the final size
+static uint16_t osens_pack_frame_size(uint8_t *frame, uint16_t size, uint8_t bus)
+{
+    uint8_t pos = bus != OSENS_BUS_ADDR_NONE ? OSENS_FRAME_BUS_FRAMING : 0;
+
+    if (size + pos + 2 > OSENS_MAX_FRAME_SIZE)
+    {
+        memmove(&frame[pos + 3], &frame[1], size - 1);
+        size += pos + 2;
+        frame[pos] = OSENS_FRAME_EXT_SIZE;
+        buf_io_put16_tl(size, &frame[pos + 1]);
+    }
+    else
+    {
+        if (pos)
+            memmove(&frame[pos + 1], &frame[1], size - 1);
+        size += pos;
+        buf_io_put8_tl((uint8_t) size, &frame[pos]);
+    }
+
+    if (pos)
+    {
+        frame[0] = OSENS_FRAME_BUS_ADDR;
+        frame[1] = bus;
+    }
+
+    return size;
+}
+
+// value of a point of the given type, arrays need their count
+static uint32_t osens_value_payload_size(uint8_t type, const uint8_t *buf, uint16_t len)
+{
+    uint8_t elem_size = osens_array_elem_size(type);
+
+    if (elem_size == 0)
+        return osens_point_value_size(type);
+
+    if (len < 2)
+        return 2;
+
+    return 2 + (uint32_t) buf_io_get16_fl((uint8_t *) buf) * elem_size;
+}
+
+// point values: type followed by the value
+static uint32_t osens_point_payload_size(const uint8_t *buf, uint16_t len)
+{
+    if (len == 0)
+        return 1;
+
+    return 1 + osens_value_payload_size(buf[0], &buf[1], len - 1);
+}
+
+// point reads: a flagged type announces the sample time after the value
+static uint32_t osens_read_payload_size(const uint8_t *buf, uint16_t len)
+{
+    if ((len == 0) || ((buf[0] & OSENS_DT_TIMESTAMPED) == 0))
+        return osens_point_payload_size(buf, len);
+
+    return 1 + osens_value_payload_size(buf[0] & ~OSENS_DT_TIMESTAMPED, &buf[1], len - 1) + OSENS_SAMPLE_TIME_SIZE;
+}
+
+// write blocks: count followed by index, type and value of each point
+static uint32_t osens_write_block_payload_size(const uint8_t *buf, uint16_t len)
+{
+    uint32_t size = 1;
+    uint8_t n;
+
+    if (len == 0)
+        return 1;
+
+    if (buf[0] > OSENS_MAX_POINTS)
+        return (uint32_t) len + 1;
+
+    for (n = 0; (n < buf[0]) && (size <= len); n++)
+        size += 1 + osens_point_payload_size(&buf[size + 1], size + 1 <= len ? len - (uint16_t) size - 1 : 0);
+
+    return size;
+}
+
+// bytes required after the address of a request
+static uint32_t osens_req_payload_size(uint8_t addr, const uint8_t *buf, uint16_t len)
+{
+    switch (addr)
+    {
+    case OSENS_REGMAP_BRD_CMD:
+    case OSENS_REGMAP_WRITE_BAT_STATUS:
+    case OSENS_REGMAP_WRITE_BAT_CHARGE:
+    case OSENS_REGMAP_WPAN_STATUS:
+    case OSENS_REGMAP_WPAN_STRENGTH:
+    case OSENS_REGMAP_LINK_SPEED:
+    case OSENS_REGMAP_AGGREGATE:
+        return 1;
+    case OSENS_REGMAP_DSP_WRITE:
+        return 1 + OSENS_DSP_MSG_MAX_SIZE;
+    case OSENS_REGMAP_FRAME_SIZE:
+        return 2;
+    case OSENS_REGMAP_STREAM:
+        return 4 + 2 + 1;
+    case OSENS_REGMAP_TIME_SYNC:
+        return 4 + 1;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        return osens_write_block_payload_size(buf, len);
+    default:
+        break;
+    }
+
+    if ((addr >= OSENS_REGMAP_WRITE_POINT_DATA_1) && (addr <= OSENS_REGMAP_WRITE_POINT_DATA_32))
+        return osens_point_payload_size(buf, len);
+
+    return 0;
+}
+
+// bytes required after the status of an OK response
+static uint32_t osens_res_payload_size(uint8_t addr, const uint8_t *buf, uint16_t len)
+{
+    switch (addr)
+    {
+    case OSENS_REGMAP_ITF_VERSION:
+    case OSENS_REGMAP_BRD_STATUS:
+    case OSENS_REGMAP_BRD_CMD:
+    case OSENS_REGMAP_READ_BAT_STATUS:
+    case OSENS_REGMAP_READ_BAT_CHARGE:
+        return 1;
+    case OSENS_REGMAP_BRD_ID:
+        return OSENS_MODEL_NAME_SIZE + OSENS_MANUF_NAME_SIZE + 4 + 3;
+    case OSENS_REGMAP_SVR_MAIN_ADDR:
+    case OSENS_REGMAP_SVR_SEC_ADDR:
+        return OSENS_SERVER_ADDR_SIZE;
+    case OSENS_REGMAP_LINK_RATES:
+        return 3;
+    case OSENS_REGMAP_FRAME_SIZE:
+        return 2;
+    case OSENS_REGMAP_STREAM_DATA:
+        return 2 + 1;
+    case OSENS_REGMAP_AGGREGATE:
+        return 1 + 4 + 4 * 4;
+    case OSENS_REGMAP_FEATURES:
+        return 4;
+    case OSENS_REGMAP_TIME_SYNC:
+        return 4 + 4 + 4 + 1;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        if (len && (buf[0] > OSENS_MAX_POINTS))
+            return (uint32_t) len + 1;
+        return len ? 1 + buf[0] : 1;
+    default:
+        break;
+    }
+
+    if ((addr >= OSENS_REGMAP_POINT_DESC_1) && (addr <= OSENS_REGMAP_POINT_DESC_32))
+        return OSENS_POINT_NAME_SIZE + 3 + 4;
+
+    if ((addr >= OSENS_REGMAP_READ_POINT_DATA_1) && (addr <= OSENS_REGMAP_READ_POINT_DATA_32))
+        return osens_read_payload_size(buf, len);
+
+    return 0;
+}
+
+// register, status and payload of a frame, avail of its len bytes after the size field received
+static uint8_t osens_frame_body_valid(uint8_t kind, const uint8_t *buf, uint16_t avail, uint16_t len)
+{
+    uint16_t pos = kind == OSENS_FRAME_KIND_RES ? 2 : 1;
+    uint32_t need;
+
+    if (len < pos)
+        return 0;
+
+    if (avail < pos)
+        return 1;
+
+    if (kind == OSENS_FRAME_KIND_RES)
+    {
+        // errors carry no payload
+        if (buf[1] > OSENS_ANS_REGISTER_NOT_IMPLEMENTED)
+            return 0;
+        if (buf[1] != OSENS_ANS_OK)
+            return len == pos;
+        need = osens_res_payload_size(buf[0], &buf[pos], avail - pos);
+    }
+    else
+    {
+        need = osens_req_payload_size(buf[0], &buf[pos], avail - pos);
+    }
+
+    // pushed samples follow the stream header, a partial payload only gives a lower bound
+    if ((avail < len) || ((kind == OSENS_FRAME_KIND_RES) && (buf[0] == OSENS_REGMAP_STREAM_DATA)))
+        return need <= (uint32_t) (len - pos);
+
+    return need == (uint32_t) (len - pos);
+}
+
+uint8_t osens_frame_check(const uint8_t *frame, uint16_t len, uint8_t kinds, uint16_t max_size, uint16_t *size)
+{
+    uint16_t frame_size;
+    uint16_t avail;
+    uint8_t hdr_len;
+    uint8_t pos = 0;
+    uint8_t valid = 0;
+
+    hdr_len = osens_frame_size(frame, len, &frame_size);
+    if (hdr_len == 0)
+        return OSENS_FRAME_INCOMPLETE;
+
+    // the answer bit of the bus address tells requests from answers
+    if (frame[0] == OSENS_FRAME_BUS_ADDR)
+    {
+        if ((frame[1] & OSENS_BUS_ADDR_MAX) == OSENS_BUS_ADDR_NONE)
+            return OSENS_FRAME_INVALID;
+        kinds &= (frame[1] & OSENS_BUS_ADDR_ANSWER) ? OSENS_FRAME_KIND_RES : OSENS_FRAME_KIND_REQ;
+        pos = OSENS_FRAME_BUS_FRAMING;
+    }
+
+    // the extended size field is only used for frames the one byte field can not describe
+    if ((hdr_len == pos + 1) ? ((uint32_t) frame_size + 2 > OSENS_MAX_FRAME_SIZE) : (frame_size <= OSENS_MAX_FRAME_SIZE))
+        return OSENS_FRAME_INVALID;
+
+    if ((frame_size <= hdr_len) || ((uint32_t) frame_size + 2 > max_size))
+        return OSENS_FRAME_INVALID;
+
+    avail = (len < frame_size ? len : frame_size) - hdr_len;
+    if (kinds & OSENS_FRAME_KIND_REQ)
+        valid |= osens_frame_body_valid(OSENS_FRAME_KIND_REQ, &frame[hdr_len], avail, frame_size - hdr_len);
+    if (kinds & OSENS_FRAME_KIND_RES)
+        valid |= osens_frame_body_valid(OSENS_FRAME_KIND_RES, &frame[hdr_len], avail, frame_size - hdr_len);
+
+    if (!valid)
+        return OSENS_FRAME_INVALID;
+
+    if (len < (uint32_t) frame_size + 2)
+        return OSENS_FRAME_INCOMPLETE;
+
+    *size = frame_size + 2;
+
+    if (buf_io_get16_fl((uint8_t *) &frame[frame_size]) != crc16_calc((uint8_t *) frame, frame_size))
+        return OSENS_FRAME_BAD_CRC;
+
+    return OSENS_FRAME_VALID;
+}
+
+uint16_t osens_frame_find(const uint8_t *frame, uint16_t len, uint8_t kinds, uint16_t max_size, uint16_t *size)
+{
+    uint16_t pos;
+
+    for (pos = 0; pos < len; pos++)
+    {
+        if (osens_frame_check(&frame[pos], len - pos, kinds, max_size, size) == OSENS_FRAME_VALID)
+            break;
+    }
+
+    return pos;
+}
+
+uint16_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf)
+{
+    uint16_t size = 0;
 
     switch (point->type)
     {
@@ -56,6 +535,12 @@ uint8_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf)
         point->value.fp64 = buf_io_getd_fl(buf);
         size = 8;
         break;
+    case OSENS_DT_ARRAY_S16:
+    case OSENS_DT_ARRAY_FLOAT:
+        point->value.array.count = buf_io_get16_fl(buf);
+        point->value.array.data = &buf[2];
+        size = (uint16_t) osens_point_value_len(point);
+        break;
     default:
         break;
     }
@@ -63,9 +548,9 @@ uint8_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf)
     return size;
 }
 
-uint8_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf)
+uint16_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf)
 {
-    uint8_t size = 0;
+    uint16_t size = 0;
 
     switch (point->type)
     {
@@ -109,6 +594,16 @@ uint8_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf)
         buf_io_putd_tl(point->value.fp64, buf);
         size = 8;
         break;
+    case OSENS_DT_ARRAY_S16:
+        buf_io_put16_tl(point->value.array.count, buf);
+        buf_io_put16_tl_n(point->value.array.data, &buf[2], point->value.array.count);
+        size = (uint16_t) osens_point_value_len(point);
+        break;
+    case OSENS_DT_ARRAY_FLOAT:
+        buf_io_put16_tl(point->value.array.count, buf);
+        buf_io_put32_tl_n(point->value.array.data, &buf[2], point->value.array.count);
+        size = (uint16_t) osens_point_value_len(point);
+        break;
     default:
         break;
     }
@@ -116,21 +611,31 @@ uint8_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf)
     return size;
 }
 
-uint8_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint8_t frame_size)
+uint16_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint16_t frame_size)
 {
     uint8_t *buf = frame;
     uint16_t crc;
     uint16_t frame_crc;
-    uint8_t size;
+    uint16_t size;
+    uint8_t hdr_len;
+    uint8_t n;
 
-    if (frame_size < 3)
+    // size field, address and CRC must be inside the received bytes
+    hdr_len = osens_frame_size(frame, frame_size, &size);
+    if ((hdr_len == 0) || (size < hdr_len + 1) || ((uint32_t) size + 2 > frame_size))
     {
         //OS_UTIL_LOG(OSENS_DBG_FRAME, ("Invalid frame size %d", frame_size));
         return 0;
     }
     
+    // answers of other boards are seen on a bus
+    cmd->hdr.bus = osens_frame_bus_addr(frame, frame_size);
+    if (cmd->hdr.bus & OSENS_BUS_ADDR_ANSWER)
+        return 0;
+
     // minimal header decoding
-    cmd->hdr.size = buf_io_get8_fl_ap(buf);
+    buf += hdr_len;
+    cmd->hdr.size = size;
     cmd->hdr.addr = buf_io_get8_fl_ap(buf);
 
     frame_crc = buf_io_get16_fl(&frame[cmd->hdr.size]);
@@ -142,6 +647,12 @@ uint8_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint8_t frame
         //OS_UTIL_LOG(OSENS_DBG_FRAME, ("Invalid CRC %04X <> %04X", frame_crc, crc));
         return 0;
     }
+
+    if (osens_req_payload_size(cmd->hdr.addr, buf, size - hdr_len - 1) > size - hdr_len - 1)
+    {
+        //OS_UTIL_LOG(OSENS_DBG_FRAME, ("Short payload for register %02X", cmd->hdr.addr));
+        return 0;
+    }
     
     switch (cmd->hdr.addr)
     {
@@ -165,6 +676,33 @@ uint8_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint8_t frame
     case OSENS_REGMAP_WPAN_STRENGTH:
         cmd->payload.wpan_strength_cmd.strenght = buf_io_get8_fl_ap(buf);
         break;
+    case OSENS_REGMAP_LINK_SPEED:
+        cmd->payload.link_speed_cmd.rate = buf_io_get8_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_FRAME_SIZE:
+        cmd->payload.frame_size_cmd.max_size = buf_io_get16_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_STREAM:
+        cmd->payload.stream_cmd.mask = buf_io_get32_fl_ap(buf);
+        cmd->payload.stream_cmd.period_ms = buf_io_get16_fl_ap(buf);
+        cmd->payload.stream_cmd.batch = buf_io_get8_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        cmd->payload.write_block_cmd.num_points = buf_io_get8_fl_ap(buf);
+        for (n = 0; n < cmd->payload.write_block_cmd.num_points; n++)
+        {
+            cmd->payload.write_block_cmd.index[n] = buf_io_get8_fl_ap(buf);
+            cmd->payload.write_block_cmd.values[n].type = buf_io_get8_fl_ap(buf);
+            buf += osens_unpack_point_value(&cmd->payload.write_block_cmd.values[n], buf);
+        }
+        break;
+    case OSENS_REGMAP_AGGREGATE:
+        cmd->payload.aggregate_cmd.index = buf_io_get8_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_TIME_SYNC:
+        cmd->payload.time_sync_cmd.mote_ms = buf_io_get32_fl_ap(buf);
+        cmd->payload.time_sync_cmd.flags = buf_io_get8_fl_ap(buf);
+        break;
     default:
         break;
     }
@@ -181,11 +719,12 @@ uint8_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint8_t frame
     return size;
 }
 
-uint8_t osens_pack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame)
+uint16_t osens_pack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame)
 {
     uint8_t *buf = &frame[1];
-    uint8_t size = 0;
+    uint16_t size = 0;
     uint16_t crc;
+    uint8_t n;
 
     buf_io_put8_tl_ap(cmd->hdr.addr, buf);
     buf_io_put8_tl_ap(cmd->hdr.status, buf);
@@ -225,6 +764,41 @@ uint8_t osens_pack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame)
             memcpy(buf, cmd->payload.svr_addr_cmd.addr, OSENS_SERVER_ADDR_SIZE);
             buf += OSENS_SERVER_ADDR_SIZE;
             break;
+        case OSENS_REGMAP_LINK_RATES:
+            buf_io_put16_tl_ap(cmd->payload.link_rates_cmd.rates, buf);
+            buf_io_put8_tl_ap(cmd->payload.link_rates_cmd.current, buf);
+            break;
+        case OSENS_REGMAP_FRAME_SIZE:
+            buf_io_put16_tl_ap(cmd->payload.frame_size_cmd.max_size, buf);
+            break;
+        case OSENS_REGMAP_STREAM_DATA:
+            buf_io_put16_tl_ap(cmd->payload.stream_data_cmd.seq, buf);
+            buf_io_put8_tl_ap(cmd->payload.stream_data_cmd.num_samples, buf);
+            memcpy(buf, cmd->payload.stream_data_cmd.samples, cmd->payload.stream_data_cmd.size);
+            buf += cmd->payload.stream_data_cmd.size;
+            break;
+        case OSENS_REGMAP_WRITE_BLOCK:
+            buf_io_put8_tl_ap(cmd->payload.write_block_cmd.num_points, buf);
+            for (n = 0; n < cmd->payload.write_block_cmd.num_points; n++)
+                buf_io_put8_tl_ap(cmd->payload.write_block_cmd.status[n], buf);
+            break;
+        case OSENS_REGMAP_FEATURES:
+            buf_io_put32_tl_ap(cmd->payload.features_cmd.features, buf);
+            break;
+        case OSENS_REGMAP_AGGREGATE:
+            buf_io_put8_tl_ap(cmd->payload.aggregate_cmd.index, buf);
+            buf_io_put32_tl_ap(cmd->payload.aggregate_cmd.count, buf);
+            buf_io_putf_tl_ap(cmd->payload.aggregate_cmd.min, buf);
+            buf_io_putf_tl_ap(cmd->payload.aggregate_cmd.max, buf);
+            buf_io_putf_tl_ap(cmd->payload.aggregate_cmd.mean, buf);
+            buf_io_putf_tl_ap(cmd->payload.aggregate_cmd.variance, buf);
+            break;
+        case OSENS_REGMAP_TIME_SYNC:
+            buf_io_put32_tl_ap(cmd->payload.time_sync_cmd.mote_ms, buf);
+            buf_io_put32_tl_ap(cmd->payload.time_sync_cmd.rx_ms, buf);
+            buf_io_put32_tl_ap(cmd->payload.time_sync_cmd.tx_ms, buf);
+            buf_io_put8_tl_ap(cmd->payload.time_sync_cmd.flags, buf);
+            break;
         default:
             break;
         }
@@ -245,38 +819,59 @@ uint8_t osens_pack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame)
             (cmd->hdr.addr <= OSENS_REGMAP_READ_POINT_DATA_32))
         {
             //uint8_t point = cmd->hdr.addr - OSENS_REGMAP_READ_POINT_DATA_1;
-            buf_io_put8_tl_ap(cmd->payload.point_value_cmd.type,buf);
+            buf_io_put8_tl_ap(cmd->payload.point_value_cmd.type | (cmd->time.valid ? OSENS_DT_TIMESTAMPED : 0), buf);
             buf += osens_pack_point_value(&cmd->payload.point_value_cmd, buf);
+            if (cmd->time.valid)
+            {
+                buf_io_put32_tl_ap(cmd->time.base_ms, buf);
+                buf_io_put16_tl_ap(cmd->time.age_ms, buf);
+            }
         }
     }
 
-    size = buf - frame;
-    buf_io_put8_tl(size, frame);
+    size = osens_pack_frame_size(frame, (uint16_t) (buf - frame),
+        (cmd->hdr.bus & OSENS_BUS_ADDR_MAX) != OSENS_BUS_ADDR_NONE ? cmd->hdr.bus | OSENS_BUS_ADDR_ANSWER : OSENS_BUS_ADDR_NONE);
     crc = crc16_calc(frame, size);
     cmd->crc = crc;
     cmd->hdr.size = size;
-    buf_io_put16_tl(crc, buf);
+    buf_io_put16_tl(crc, &frame[size]);
     
     size += 2; // +crc 
     return size;
 }
 
 
-uint8_t osens_unpack_cmd_res(osens_cmd_res_t * cmd, uint8_t *frame, uint8_t frame_size)
+uint16_t osens_unpack_cmd_res(osens_cmd_res_t * cmd, uint8_t *frame, uint16_t frame_size)
 {
-    uint8_t size;
+    uint16_t size;
     uint8_t *buf = frame;
     uint16_t crc;
     uint16_t frame_crc;
+    uint8_t hdr_len;
+    uint8_t n;
 
-    if (frame_size < 3)
+    cmd->time.valid = 0;
+
+    // size field, address, status and CRC must be inside the received bytes
+    hdr_len = osens_frame_size(frame, frame_size, &size);
+    if ((hdr_len == 0) || (size < hdr_len + 2) || ((uint32_t) size + 2 > frame_size))
     {
         cmd->hdr.status = OSENS_ANS_ERROR;
         return 0;
     }
     
+    // requests are seen on a bus with local echo
+    cmd->hdr.bus = osens_frame_bus_addr(frame, frame_size);
+    if ((cmd->hdr.bus != OSENS_BUS_ADDR_NONE) && ((cmd->hdr.bus & OSENS_BUS_ADDR_ANSWER) == 0))
+    {
+        cmd->hdr.status = OSENS_ANS_ERROR;
+        return 0;
+    }
+    cmd->hdr.bus &= OSENS_BUS_ADDR_MAX;
+
     // minimal header decoding
-    cmd->hdr.size = buf_io_get8_fl_ap(buf);
+    buf += hdr_len;
+    cmd->hdr.size = size;
     cmd->hdr.addr = buf_io_get8_fl_ap(buf);
     cmd->hdr.status = buf_io_get8_fl_ap(buf);
 
@@ -298,6 +893,13 @@ uint8_t osens_unpack_cmd_res(osens_cmd_res_t * cmd, uint8_t *frame, uint8_t fram
         return 0;
     }
 
+    if (osens_res_payload_size(cmd->hdr.addr, buf, size - hdr_len - 2) > size - hdr_len - 2)
+    {
+        //OS_UTIL_LOG(OSENS_DBG_FRAME, ("Short payload for register %02X", cmd->hdr.addr));
+        cmd->hdr.status = OSENS_ANS_ERROR;
+        return 0;
+    }
+
 
     switch (cmd->hdr.addr)
     {
@@ -331,6 +933,43 @@ uint8_t osens_unpack_cmd_res(osens_cmd_res_t * cmd, uint8_t *frame, uint8_t fram
         memcpy(cmd->payload.svr_addr_cmd.addr, buf, OSENS_SERVER_ADDR_SIZE);
         buf += OSENS_SERVER_ADDR_SIZE;
         break;
+    case OSENS_REGMAP_LINK_RATES:
+        cmd->payload.link_rates_cmd.rates = buf_io_get16_fl_ap(buf);
+        cmd->payload.link_rates_cmd.current = buf_io_get8_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_FRAME_SIZE:
+        cmd->payload.frame_size_cmd.max_size = buf_io_get16_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_STREAM_DATA:
+        cmd->payload.stream_data_cmd.seq = buf_io_get16_fl_ap(buf);
+        cmd->payload.stream_data_cmd.num_samples = buf_io_get8_fl_ap(buf);
+        // samples stay in the frame, up to the CRC
+        cmd->payload.stream_data_cmd.samples = buf;
+        cmd->payload.stream_data_cmd.size = (uint16_t) (&frame[size] - buf);
+        buf += cmd->payload.stream_data_cmd.size;
+        break;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        cmd->payload.write_block_cmd.num_points = buf_io_get8_fl_ap(buf);
+        for (n = 0; n < cmd->payload.write_block_cmd.num_points; n++)
+            cmd->payload.write_block_cmd.status[n] = buf_io_get8_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_FEATURES:
+        cmd->payload.features_cmd.features = buf_io_get32_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_AGGREGATE:
+        cmd->payload.aggregate_cmd.index = buf_io_get8_fl_ap(buf);
+        cmd->payload.aggregate_cmd.count = buf_io_get32_fl_ap(buf);
+        cmd->payload.aggregate_cmd.min = buf_io_getf_fl_ap(buf);
+        cmd->payload.aggregate_cmd.max = buf_io_getf_fl_ap(buf);
+        cmd->payload.aggregate_cmd.mean = buf_io_getf_fl_ap(buf);
+        cmd->payload.aggregate_cmd.variance = buf_io_getf_fl_ap(buf);
+        break;
+    case OSENS_REGMAP_TIME_SYNC:
+        cmd->payload.time_sync_cmd.mote_ms = buf_io_get32_fl_ap(buf);
+        cmd->payload.time_sync_cmd.rx_ms = buf_io_get32_fl_ap(buf);
+        cmd->payload.time_sync_cmd.tx_ms = buf_io_get32_fl_ap(buf);
+        cmd->payload.time_sync_cmd.flags = buf_io_get8_fl_ap(buf);
+        break;
     default:
         break;
     }
@@ -350,18 +989,26 @@ uint8_t osens_unpack_cmd_res(osens_cmd_res_t * cmd, uint8_t *frame, uint8_t fram
         (cmd->hdr.addr <= OSENS_REGMAP_READ_POINT_DATA_32))
     {
         cmd->payload.point_value_cmd.type = buf_io_get8_fl_ap(buf);
+        cmd->time.valid = (cmd->payload.point_value_cmd.type & OSENS_DT_TIMESTAMPED) != 0;
+        cmd->payload.point_value_cmd.type &= ~OSENS_DT_TIMESTAMPED;
         buf += osens_unpack_point_value(&cmd->payload.point_value_cmd, buf);
+        if (cmd->time.valid)
+        {
+            cmd->time.base_ms = buf_io_get32_fl_ap(buf);
+            cmd->time.age_ms = buf_io_get16_fl_ap(buf);
+        }
     }
 
     size = cmd->hdr.size + 2; // crc 
     return size;
 }
 
-uint8_t osens_pack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame)
+uint16_t osens_pack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame)
 {
     uint8_t *buf = &frame[1];
-    uint8_t size = 0;
+    uint16_t size = 0;
     uint16_t crc;
+    uint8_t n;
 
     // address
     // commands without arguments are handled only with this line
@@ -389,6 +1036,33 @@ uint8_t osens_pack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame)
     case OSENS_REGMAP_WPAN_STRENGTH:
         buf_io_put8_tl_ap(cmd->payload.wpan_strength_cmd.strenght,buf);
         break;
+    case OSENS_REGMAP_LINK_SPEED:
+        buf_io_put8_tl_ap(cmd->payload.link_speed_cmd.rate, buf);
+        break;
+    case OSENS_REGMAP_FRAME_SIZE:
+        buf_io_put16_tl_ap(cmd->payload.frame_size_cmd.max_size, buf);
+        break;
+    case OSENS_REGMAP_STREAM:
+        buf_io_put32_tl_ap(cmd->payload.stream_cmd.mask, buf);
+        buf_io_put16_tl_ap(cmd->payload.stream_cmd.period_ms, buf);
+        buf_io_put8_tl_ap(cmd->payload.stream_cmd.batch, buf);
+        break;
+    case OSENS_REGMAP_WRITE_BLOCK:
+        buf_io_put8_tl_ap(cmd->payload.write_block_cmd.num_points, buf);
+        for (n = 0; n < cmd->payload.write_block_cmd.num_points; n++)
+        {
+            buf_io_put8_tl_ap(cmd->payload.write_block_cmd.index[n], buf);
+            buf_io_put8_tl_ap(cmd->payload.write_block_cmd.values[n].type, buf);
+            buf += osens_pack_point_value(&cmd->payload.write_block_cmd.values[n], buf);
+        }
+        break;
+    case OSENS_REGMAP_AGGREGATE:
+        buf_io_put8_tl_ap(cmd->payload.aggregate_cmd.index, buf);
+        break;
+    case OSENS_REGMAP_TIME_SYNC:
+        buf_io_put32_tl_ap(cmd->payload.time_sync_cmd.mote_ms, buf);
+        buf_io_put8_tl_ap(cmd->payload.time_sync_cmd.flags, buf);
+        break;
     default:
         break;
     }
@@ -400,12 +1074,11 @@ uint8_t osens_pack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame)
         buf += osens_pack_point_value(&cmd->payload.point_value_cmd, buf);
     }
 
-    size = buf - frame;
-    buf_io_put8_tl(size, frame);
+    size = osens_pack_frame_size(frame, (uint16_t) (buf - frame), cmd->hdr.bus & OSENS_BUS_ADDR_MAX);
     crc = crc16_calc(frame, size);
     cmd->crc = crc;
     cmd->hdr.size = size;
-    buf_io_put16_tl(crc, buf);
+    buf_io_put16_tl(crc, &frame[size]);
 
     size += 2; // + crc
 
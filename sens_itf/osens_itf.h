@@ -7,7 +7,35 @@
 extern "C" {
 #endif
 
+/** Longest frame with the one byte size field, and longest frame before the frame size is negotiated */
 #define OSENS_MAX_FRAME_SIZE   128
+/** Size field value announcing an extended header: a 16 bits size follows */
+#define OSENS_FRAME_EXT_SIZE  0xFF
+/** Longest extended frame, CRC included (frame lengths are 16 bits) */
+#define OSENS_MAX_EXT_FRAME_SIZE 0xFFFF
+/**
+    Size field value announcing a bus address: the address byte and the
+    size field follow. The size and the CRC cover both bytes.
+*/
+#define OSENS_FRAME_BUS_ADDR  0xFE
+/** Bytes added to a frame by the bus address */
+#define OSENS_FRAME_BUS_FRAMING 2
+/** No bus address (point to point link) */
+#define OSENS_BUS_ADDR_NONE   0x00
+/** Highest bus address */
+#define OSENS_BUS_ADDR_MAX    0x7F
+/** Set in the bus address of answers, a board never takes another board's answer for a request */
+#define OSENS_BUS_ADDR_ANSWER 0x80
+/**
+    First byte of a frame protected by forward error correction
+    (OSENS_FEATURE_FEC): the code and the frame length follow, with their own
+    parity, then the frame and the parity of its code words.
+*/
+#define OSENS_FRAME_FEC       0xFD
+/** FEC header: marker, parity bytes per code word, 16 bits frame length and 2 parity bytes */
+#define OSENS_FEC_HDR_SIZE    6
+/** Most parity bytes per code word, half as many bad bytes are corrected */
+#define OSENS_FEC_MAX_ROOTS   32
 #define OSENS_DSP_MSG_MAX_SIZE  24
 #define OSENS_SERVER_ADDR_SIZE  16
 
@@ -129,7 +157,17 @@ enum osens_register_map_e
 	OSENS_REGMAP_WRITE_POINT_DATA_31 = 0x6E, /**< Write Sensor Point Data 31 */
 	OSENS_REGMAP_WRITE_POINT_DATA_32 = 0x6F, /**< Write Sensor Point Data 32 */
 
-	/* 0x70 to 0xFF - Reserved */
+	OSENS_REGMAP_LINK_RATES = 0x70, /**< Supported and current link rates (read) */
+	OSENS_REGMAP_LINK_SPEED = 0x71, /**< Switch the link rate (write) */
+	OSENS_REGMAP_FRAME_SIZE = 0x72, /**< Exchange the longest frame each side accepts */
+	OSENS_REGMAP_STREAM = 0x73, /**< Start or stop streaming of points (write) */
+	OSENS_REGMAP_STREAM_DATA = 0x74, /**< Samples pushed by the sensor while streaming (never requested) */
+	OSENS_REGMAP_WRITE_BLOCK = 0x75, /**< Write several points at once (write) */
+	OSENS_REGMAP_AGGREGATE = 0x76, /**< Read and reset the aggregates of a point (read, with the point index) */
+	OSENS_REGMAP_FEATURES = 0x77, /**< Optional protocol features supported by the board (read) */
+	OSENS_REGMAP_TIME_SYNC = 0x78, /**< Clock synchronization and sample time stamping (write) */
+
+	/* 0x79 to 0xFF - Reserved */
 };
 
 enum osens_sensor_status_e
@@ -187,6 +225,62 @@ enum osens_ans_status_e
     OSENS_ANS_REGISTER_NOT_IMPLEMENTED = 5,
 };
 
+/**
+    Link rates, as bits of the supported rates mask. Boards start at
+    OSENS_LINK_RATE_DEFAULT. After answering a OSENS_REGMAP_LINK_SPEED write
+    at the old rate, the sensor switches and waits for a valid frame at the
+    new rate; both ends fall back to the default rate on repeated errors.
+*/
+enum osens_link_rate_e
+{
+	OSENS_LINK_RATE_9600    = 0,
+	OSENS_LINK_RATE_19200   = 1,
+	OSENS_LINK_RATE_38400   = 2,
+	OSENS_LINK_RATE_57600   = 3,
+	OSENS_LINK_RATE_115200  = 4,
+	OSENS_LINK_RATE_230400  = 5,
+	OSENS_LINK_RATE_460800  = 6,
+	OSENS_LINK_RATE_921600  = 7,
+	OSENS_LINK_RATE_1M      = 8,
+	OSENS_LINK_RATE_2M      = 9,
+	OSENS_LINK_RATE_3M      = 10,
+	OSENS_LINK_NUM_RATES    = 11,
+	OSENS_LINK_RATE_DEFAULT = OSENS_LINK_RATE_115200,
+};
+
+/**
+    Optional protocol features, as bits of OSENS_REGMAP_FEATURES. The mote
+    only uses the features both sides support. Boards without the register
+    are probed: each optional register is tried once and not used again
+    when refused.
+*/
+enum osens_feature_e
+{
+	OSENS_FEATURE_LINK_SPEED  = 0x0001, /**< Link rate negotiation (OSENS_REGMAP_LINK_RATES, OSENS_REGMAP_LINK_SPEED) */
+	OSENS_FEATURE_EXT_FRAMES  = 0x0002, /**< Frames longer than OSENS_MAX_FRAME_SIZE (OSENS_REGMAP_FRAME_SIZE) */
+	OSENS_FEATURE_STREAM      = 0x0004, /**< Pushed samples (OSENS_REGMAP_STREAM, OSENS_REGMAP_STREAM_DATA) */
+	OSENS_FEATURE_WRITE_BLOCK = 0x0008, /**< Several writes per frame (OSENS_REGMAP_WRITE_BLOCK) */
+	OSENS_FEATURE_AGGREGATE   = 0x0010, /**< Windowed aggregates (OSENS_REGMAP_AGGREGATE) */
+	OSENS_FEATURE_TIMESTAMPS  = 0x0020, /**< Clock synchronization and stamped samples (OSENS_REGMAP_TIME_SYNC) */
+	OSENS_FEATURE_FEC         = 0x0040, /**< Frames protected by forward error correction (OSENS_FRAME_FEC), not probed */
+};
+
+/** Every feature of this protocol revision */
+#define OSENS_FEATURES_ALL 0x007F
+/** Features a board on a shared bus can not use: the line speed is common and only the mote starts a transmission */
+#define OSENS_FEATURES_NOT_ON_BUS (OSENS_FEATURE_LINK_SPEED | OSENS_FEATURE_STREAM)
+
+/** Flag of the type byte of a stamped OSENS_REGMAP_READ_POINT_DATA answer, see osens_sample_time_t */
+#define OSENS_DT_TIMESTAMPED 0x80
+/** Bytes of the sample time after a stamped value */
+#define OSENS_SAMPLE_TIME_SIZE 6
+
+/** Flags of osens_time_sync_t */
+enum osens_time_sync_flags_e
+{
+	OSENS_TIME_SYNC_STAMP = 0x01, /**< stamp the answers of OSENS_REGMAP_READ_POINT_DATA registers */
+};
+
 enum osens_bat_status_e
 {
 	OSENS_BAT_STATUS_CHARGED = 0x00,
@@ -253,6 +347,125 @@ typedef struct osens_brd_status_s
 	uint8_t status;
 } osens_brd_status_t;
 
+typedef struct osens_link_rates_s
+{
+	uint16_t rates;   /**< supported rates, bit n is rate n (osens_link_rate_e) */
+	uint8_t current;  /**< rate in use */
+} osens_link_rates_t;
+
+typedef struct osens_link_speed_s
+{
+	uint8_t rate;     /**< new rate (osens_link_rate_e) */
+} osens_link_speed_t;
+
+/**
+    Frame size negotiation. The request carries the longest frame the mote
+    accepts, the answer the longest frame the sensor accepts. Frames up to
+    the smallest of both may then be sent by either side. Frames longer than
+    OSENS_MAX_FRAME_SIZE use the extended header: OSENS_FRAME_EXT_SIZE
+    followed by the 16 bits size (little endian), which counts these three
+    bytes like the one byte size does.
+*/
+typedef struct osens_frame_size_s
+{
+	uint16_t max_size;
+} osens_frame_size_t;
+
+/** Features supported by the board, bits of osens_feature_e (unknown bits are ignored) */
+typedef struct osens_features_s
+{
+	uint32_t features;
+} osens_features_t;
+
+/**
+    Streaming subscription. The sensor samples the points of mask (bit n for
+    point n) every period_ms and pushes a OSENS_REGMAP_STREAM_DATA frame
+    every batch samples, until a subscription with an empty mask is received.
+*/
+typedef struct osens_stream_s
+{
+	uint32_t mask;
+	uint16_t period_ms;
+	uint8_t batch;
+} osens_stream_t;
+
+/**
+    Pushed samples: frame sequence number (0 for the first frame of a
+    subscription) and num_samples samples, each one the values (without
+    type) of the subscribed points in index order. Samples are not copied:
+    unpack points samples into the frame, pack copies size bytes from samples.
+*/
+typedef struct osens_stream_data_s
+{
+	uint16_t seq;
+	uint8_t num_samples;
+	uint16_t size;
+	uint8_t *samples;
+} osens_stream_data_t;
+
+/**
+    Several point writes in one frame. The request carries num_points
+    (index, type, value) entries, applied in order; the answer carries one
+    status (osens_ans_status_e) per entry, in the same order. The answer
+    status itself is OK as long as the register is supported.
+*/
+typedef struct osens_write_block_s
+{
+	uint8_t num_points;
+	uint8_t index[OSENS_MAX_POINTS];
+	osens_point_t values[OSENS_MAX_POINTS];
+	uint8_t status[OSENS_MAX_POINTS];
+} osens_write_block_t;
+
+/**
+    Aggregates of a point over the acquisitions of a window (see
+    osens_sensor.h): the request carries the point index, the answer repeats
+    it followed by the number of acquisitions and the minimum, maximum, mean
+    and population variance of their values, as floats. The sensor starts a
+    new window when it answers, all values are zero for an empty window.
+*/
+typedef struct osens_aggregate_s
+{
+	uint8_t index;
+	uint32_t count;
+	float min;
+	float max;
+	float mean;
+	float variance;
+} osens_aggregate_t;
+
+/**
+    Clock synchronization. The request carries the mote clock when it is
+    sent (mote_ms) and flags (osens_time_sync_flags_e); the answer echoes
+    mote_ms, followed by the sensor clock when the request was received
+    (rx_ms) and when the answer was sent (tx_ms), and the flags the sensor
+    applied. With the mote clock at the answer reception, the offset between
+    both clocks is known within half the round trip, sensor processing time
+    excluded. Clocks count milliseconds and wrap around. Flags stay in
+    effect until the next discovery.
+*/
+typedef struct osens_time_sync_s
+{
+	uint32_t mote_ms;
+	uint32_t rx_ms;
+	uint32_t tx_ms;
+	uint8_t flags;
+} osens_time_sync_t;
+
+/**
+    Time of a point sample, in the sensor clock. Stamped answers (see
+    OSENS_TIME_SYNC_STAMP) flag their type with OSENS_DT_TIMESTAMPED and
+    carry, after the value, the sensor clock when the frame was built
+    (base_ms) and the age of the sample at that moment (age_ms, saturated):
+    the sample was taken at base_ms - age_ms.
+*/
+typedef struct osens_sample_time_s
+{
+	uint8_t valid;
+	uint32_t base_ms;
+	uint16_t age_ms;
+} osens_sample_time_t;
+
 typedef struct osens_point_ctrl_s
 {
 	uint8_t num_of_points;
@@ -277,19 +490,30 @@ union osens_cmds_u
 	osens_brd_status_t brd_status_cmd;
 	osens_point_desc_t point_desc_cmd;
 	osens_point_t point_value_cmd;
+	osens_link_rates_t link_rates_cmd;
+	osens_link_speed_t link_speed_cmd;
+	osens_frame_size_t frame_size_cmd;
+	osens_stream_t stream_cmd;
+	osens_stream_data_t stream_data_cmd;
+	osens_write_block_t write_block_cmd;
+	osens_aggregate_t aggregate_cmd;
+	osens_features_t features_cmd;
+	osens_time_sync_t time_sync_cmd;
 };
 
 typedef struct osens_cmd_req_hdr_s
 {
-	uint8_t size;
+	uint16_t size;
 	uint8_t addr;
+	uint8_t bus; /**< board address on a shared bus, OSENS_BUS_ADDR_NONE when the frame has none */
 } osens_cmd_req_hdr_t;
 
 typedef struct osens_cmd_res_hdr_s
 {
-	uint8_t size;
+	uint16_t size;
 	uint8_t status;
     uint8_t addr;
+	uint8_t bus; /**< address of the answering board, OSENS_BUS_ADDR_NONE when the frame has none */
 } osens_cmd_res_hdr_t;
 
 typedef struct osens_cmd_req_s
@@ -303,6 +527,7 @@ typedef struct osens_cmd_res_s
 {
 	osens_cmd_res_hdr_t hdr;
 	union osens_cmds_u payload;
+	osens_sample_time_t time; /**< sample time of point reads */
 	uint16_t crc;
 } osens_cmd_res_t;
 
@@ -314,13 +539,169 @@ typedef struct osens_cmd_res_s
 //uint8_t osens_sensor_init(void);
 //void osens_mote_main(void);
 
-uint8_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf);
-uint8_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf);
+/**
+    Point values are packed without their type, little endian. Arrays are a
+    16 bits element count followed by the elements. Unpacked arrays are not
+    copied: array.data points to the little endian elements in buf (maybe
+    unaligned), use buf_io_get16_fl_n()/buf_io_get32_fl_n() to copy them.
+
+    @retval bytes read or written, 0 for unknown types
+*/
+uint16_t osens_unpack_point_value(osens_point_t *point, uint8_t *buf);
+uint16_t osens_pack_point_value(const osens_point_t *point, uint8_t *buf);
+
+/** Bytes of a packed point value, element count included for arrays */
+uint32_t osens_point_value_len(const osens_point_t *point);
+
+/** Size of an array element (osens_datatypes_e), 0 for scalar and unknown types */
+uint8_t osens_array_elem_size(uint8_t type);
+
+/** Scalar point value as a double, 0 for arrays and unknown types */
+double osens_point_to_double(const osens_point_t *point);
+
+/** Feature (osens_feature_e) a register belongs to, 0 for registers every board has */
+uint32_t osens_register_feature(uint8_t addr);
+
+/** Bit rate of a link rate (osens_link_rate_e), 0 for unknown rates */
+uint32_t osens_link_rate_to_bps(uint8_t rate);
+
+/** Size of a point value (osens_datatypes_e), 0 for arrays and unknown types */
+uint8_t osens_point_value_size(uint8_t type);
+
+/**
+    Decodes the size field of a frame.
 
-uint8_t osens_unpack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame, uint8_t frame_size);
-uint8_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint8_t frame_size);
-uint8_t osens_pack_cmd_res  (osens_cmd_res_t *cmd, uint8_t *frame);
-uint8_t osens_pack_cmd_req  (osens_cmd_req_t *cmd, uint8_t *frame);
+    @param frame Received bytes
+    @param len   Number of received bytes
+    @param size  Frame size without CRC (set when the size field is complete)
+    @retval header length (1, or 3 for extended headers, plus OSENS_FRAME_BUS_FRAMING
+            with a bus address), 0 while incomplete
+*/
+uint8_t osens_frame_size(const uint8_t *frame, uint16_t len, uint16_t *size);
+
+/**
+    Bus address byte of a frame (OSENS_BUS_ADDR_ANSWER set in answers).
+
+    @param frame Received bytes
+    @param len   Number of received bytes
+    @retval address byte, OSENS_BUS_ADDR_NONE when the frame has none or it was not received yet
+*/
+uint8_t osens_frame_bus_addr(const uint8_t *frame, uint16_t len);
+
+/** Frames osens_frame_check() looks for */
+enum osens_frame_kind_e
+{
+	OSENS_FRAME_KIND_REQ = 0x01,
+	OSENS_FRAME_KIND_RES = 0x02,
+	OSENS_FRAME_KIND_ANY = 0x03,
+};
+
+/** Result of osens_frame_check() */
+enum osens_frame_check_e
+{
+	OSENS_FRAME_INCOMPLETE = 0, /**< plausible start of a frame, more bytes needed */
+	OSENS_FRAME_VALID = 1,      /**< complete frame, valid CRC */
+	OSENS_FRAME_BAD_CRC = 2,    /**< complete frame with a plausible header and a bad CRC */
+	OSENS_FRAME_INVALID = 3,    /**< not the start of a frame */
+};
+
+/**
+    Checks whether received bytes start with a frame, to find frames behind
+    garbage. The size field must use the shortest encoding and fit max_size,
+    the register must have the length its payload requires (checked as soon
+    as the bytes are received, so most garbage is rejected early), then the
+    CRC must match. Protected frames (OSENS_FRAME_FEC) are not recognized.
+
+    @param frame    Received bytes
+    @param len      Number of received bytes
+    @param kinds    Frames accepted (osens_frame_kind_e), frames with a bus address
+                    are requests or answers according to OSENS_BUS_ADDR_ANSWER
+    @param max_size Longest frame, CRC included
+    @param size     Frame length, CRC included (set for OSENS_FRAME_VALID and OSENS_FRAME_BAD_CRC)
+    @retval check result (osens_frame_check_e)
+*/
+uint8_t osens_frame_check(const uint8_t *frame, uint16_t len, uint8_t kinds, uint16_t max_size, uint16_t *size);
+
+/**
+    Looks for the first valid frame (osens_frame_check()), sliding over the
+    received bytes one at a time.
+
+    @param frame    Received bytes
+    @param len      Number of received bytes
+    @param kinds    Frames accepted (osens_frame_kind_e)
+    @param max_size Longest frame, CRC included
+    @param size     Frame length, CRC included (set when a frame is found)
+    @retval offset of the frame, len when there is none
+*/
+uint16_t osens_frame_find(const uint8_t *frame, uint16_t len, uint8_t kinds, uint16_t max_size, uint16_t *size);
+
+/** Forward error correction counters */
+typedef struct osens_fec_stats_s
+{
+    uint32_t frames;         /**< protected frames received */
+    uint32_t corrected;      /**< frames with bad bytes, all of them corrected */
+    uint32_t bytes;          /**< bad bytes corrected */
+    uint32_t uncorrectable;  /**< frames with more bad bytes than the code corrects */
+} osens_fec_stats_t;
+
+/**
+    Length of a frame once protected by osens_fec_encode().
+
+    @param size  Frame length, CRC included
+    @param roots Parity bytes per code word (up to OSENS_FEC_MAX_ROOTS), 0 for none
+*/
+uint16_t osens_fec_size(uint16_t size, uint8_t roots);
+
+/**
+    Protects a frame in place with a Reed-Solomon code: the header goes ahead
+    of the frame and the parity after it. Frames longer than a code word are
+    split in several code words, interleaved byte by byte, so a burst of bad
+    bytes is shared between them.
+
+    @param frame Frame, with room for osens_fec_size(size, roots) bytes
+    @param size  Frame length, CRC included
+    @param roots Parity bytes per code word (1 to OSENS_FEC_MAX_ROOTS)
+    @retval protected length
+*/
+uint16_t osens_fec_encode(uint8_t *frame, uint16_t size, uint8_t roots);
+
+/**
+    Decodes the header of a protected frame (starting with OSENS_FRAME_FEC),
+    one bad header byte is corrected.
+
+    @param frame Received bytes
+    @param len   Number of received bytes
+    @param size  Protected length (set when the header is complete), 0 for an invalid header
+    @retval OSENS_FEC_HDR_SIZE, 0 while incomplete
+*/
+uint8_t osens_fec_frame_size(const uint8_t *frame, uint16_t len, uint16_t *size);
+
+/**
+    Corrects a protected frame in place and moves the frame to the start of
+    the buffer. The CRC of the frame is still checked when unpacking it.
+
+    @param frame Received bytes
+    @param len   Number of received bytes
+    @param roots Code of the frame, set on success
+    @param stats Counters to update, may be null
+    @retval frame length, CRC included, 0 when the frame can not be corrected
+*/
+uint16_t osens_fec_decode(uint8_t *frame, uint16_t len, uint8_t *roots, osens_fec_stats_t *stats);
+
+/*
+    Unpack functions check the size field and the register payload against
+    frame_size, the number of valid bytes in frame, and return 0 when the
+    frame does not hold them. Pack functions use the extended header when the
+    frame is longer than OSENS_MAX_FRAME_SIZE: frame must have room for the
+    payload plus 6 (requests) or 7 (responses) bytes, and
+    OSENS_FRAME_BUS_FRAMING more when hdr.bus is set. Requests unpacked from an
+    answer of the bus, and the other way round, are rejected.
+    All return the frame length, CRC included.
+*/
+uint16_t osens_unpack_cmd_res(osens_cmd_res_t *cmd, uint8_t *frame, uint16_t frame_size);
+uint16_t osens_unpack_cmd_req(osens_cmd_req_t *cmd, uint8_t *frame, uint16_t frame_size);
+uint16_t osens_pack_cmd_res  (osens_cmd_res_t *cmd, uint8_t *frame);
+uint16_t osens_pack_cmd_req  (osens_cmd_req_t *cmd, uint8_t *frame);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <string.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "../os/os_defs.h"
+#include "../os/os_kernel.h"
+#include "../os/os_serial.h"
+#include "../os/os_transport.h"
+#include "../os/os_util.h"
+#include "osens_stats.h"
+#include "osens_mote.h"
+
+/*
+    Multi board driver.
+
+    One I/O thread moves received bytes from every serial port to the
+    corresponding board context, with one bulk read per port and pass.
+    When a pass finds no data it blocks on all ports at once.
+    State machines are spread over a small pool of workers: worker w ticks boards w, w + num_workers, ...
+*/
+
+#define OSENS_DBG_MULTI 0
+
+static osens_mote_ctx_t boards[OSENS_MOTE_MAX_BOARDS];
+static os_transport_t transports[OSENS_MOTE_MAX_BOARDS];
+static uint8_t num_boards = 0;
+static uint8_t num_transports = 0;
+static uint8_t num_workers = 0;
+static uint8_t worker_ids[OSENS_MOTE_MAX_WORKERS];
+static os_thread_t worker_threads[OSENS_MOTE_MAX_WORKERS];
+static os_thread_t io_thread;
+
+static void* osens_mote_multi_io(void *param)
+{
+    uint8_t n;
+    int num_active;
+    int num_errors;
+    int ret;
+
+    while (1)
+    {
+        num_active = 0;
+        num_errors = 0;
+
+        for (n = 0; n < num_boards; n++)
+        {
+            if (boards[n] == 0)
+                continue;
+
+            ret = osens_mote_ctx_rx(boards[n]);
+            if (ret > 0)
+                num_active++;
+            else if (ret < 0)
+                num_errors++;
+        }
+
+        if (num_active > 0)
+            continue;
+
+        // a failed port stays readable, back off instead of spinning on it
+        if ((num_errors > 0) ||
+            (os_transport_wait_any(transports, num_transports, OSENS_MOTE_RX_GAP_MS) == OS_ERROR))
+        {
+            os_kernel_sleep(OSENS_MOTE_RX_ERROR_MS);
+        }
+    }
+
+    return 0;
+}
+
+static void* osens_mote_multi_worker(void *param)
+{
+    uint8_t first = *((uint8_t *) param);
+    uint8_t n;
+
+    while (1)
+    {
+        for (n = first; n < num_boards; n += num_workers)
+        {
+            if (boards[n])
+                osens_mote_ctx_sm(boards[n]);
+        }
+
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    }
+
+    return 0;
+}
+
+uint8_t osens_mote_multi_start(const os_serial_options_t *options, uint8_t nboards, uint8_t nworkers)
+{
+    uint8_t n;
+    uint8_t num_opened = 0;
+    os_transport_t transport;
+
+    OS_UTIL_ASSERT(options);
+    OS_UTIL_ASSERT(num_boards == 0);
+
+    if (nboards > OSENS_MOTE_MAX_BOARDS)
+        nboards = OSENS_MOTE_MAX_BOARDS;
+
+    if (nworkers > OSENS_MOTE_MAX_WORKERS)
+        nworkers = OSENS_MOTE_MAX_WORKERS;
+
+    if (nworkers > nboards)
+        nworkers = nboards;
+
+    if (nworkers == 0)
+        return 0;
+
+    memset(boards, 0, sizeof(boards));
+
+    for (n = 0; n < nboards; n++)
+    {
+        transport = os_transport_serial_open(options[n]);
+
+        if (transport)
+        {
+            boards[n] = osens_mote_ctx_create_transport(n, transport);
+            transports[num_opened++] = transport;
+        }
+        else
+            OS_UTIL_LOG(OSENS_DBG_MULTI, ("Board %u: could not open port %d\n", n, options[n].port));
+    }
+
+    num_boards = nboards;
+    num_transports = num_opened;
+    num_workers = nworkers;
+
+    io_thread = os_kernel_create(osens_mote_multi_io, "IO_THREAD", (os_thread_arg) 0,
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+
+    for (n = 0; n < num_workers; n++)
+    {
+        worker_ids[n] = n;
+        worker_threads[n] = os_kernel_create(osens_mote_multi_worker, "SM_WORKER", (os_thread_arg) &worker_ids[n],
+            os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    }
+
+    return num_opened;
+}
+
+osens_mote_ctx_t osens_mote_multi_get_ctx(uint8_t id)
+{
+    if (id < num_boards)
+        return boards[id];
+    else
+        return 0;
+}
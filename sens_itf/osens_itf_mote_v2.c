@@ -1,832 +1,2676 @@
-#include <stdint.h>
-#include <string.h>
-#include <stdio.h>
-#include "osens.h"
-#include "osens_itf.h"
-#include "../os/os_kernel.h"
-#include "../os/os_serial.h"
-#include "../os/os_util.h"
-
-#define TRACE_ON 1
-
-// minimum tick time is 1
-#define OSENS_SM_TICK_MS 250
-
-#define MS2TICK(ms) (ms) > OSENS_SM_TICK_MS ? (ms) / OSENS_SM_TICK_MS : 1
-
-enum {
-    OSENS_STATE_INIT = 0,
-    OSENS_STATE_SEND_ITF_VER = 1,
-    OSENS_STATE_WAIT_ITF_VER_ANS = 2,
-    OSENS_STATE_PROC_ITF_VER = 3,
-    OSENS_STATE_SEND_BRD_ID = 4,
-    OSENS_STATE_WAIT_BRD_ID_ANS = 5,
-    OSENS_STATE_PROC_BRD_ID = 6,
-    OSENS_STATE_SEND_PT_DESC = 7,
-    OSENS_STATE_WAIT_PT_DESC_ANS = 8,
-    OSENS_STATE_PROC_PT_DESC = 9,
-    OSENS_STATE_BUILD_SCH = 10,
-    OSENS_STATE_RUN_SCH = 11,
-    OSENS_STATE_SEND_PT_VAL = 12,
-    OSENS_STATE_WAIT_PT_VAL_ANS = 13,
-    OSENS_STATE_PROC_PT_VAL = 14,
-    OSENS_STATE_WR_PT = 15,
-    OSENS_STATE_WAIT_WR_PT_ANS = 16,
-    OSENS_STATE_PROC_WR_PT_ANS = 17
-};
-
-#if TRACE_ON == 1
-uint8_t *sm_states_str[] = {
-    "INIT",
-    "SEND_ITF_VER",
-    "WAIT_ITF_VER_ANS",
-    "PROC_ITF_VER",
-    "SEND_BRD_ID",
-    "WAIT_BRD_ID_ANS",
-    "PROC_BRD_ID",
-    "SEND_PT_DESC",
-    "WAIT_PT_DESC_ANS",
-    "PROC_PT_DESC",
-    "BUILD_SCH",
-    "RUN_SCH",
-    "SEND_PT_VAL",
-    "WAIT_PT_VAL_ANS",
-    "PROC_PT_VAL",
-    "WR_PT",
-    "WAIT_WR_PT_ANS",
-    "PROC_WR_PT_ANS"
-};
-#endif
-
-enum {
-    OSENS_STATE_EXEC_OK = 0,
-    OSENS_STATE_EXEC_WAIT_OK,
-    OSENS_STATE_EXEC_WAIT_STOP,
-    OSENS_STATE_EXEC_WAIT_ABORT,
-    OSENS_STATE_EXEC_ERROR
-};
-
-typedef struct osens_mote_sm_state_s
-{
-    volatile uint16_t trmout_counter;
-    volatile uint16_t trmout;
-    volatile uint8_t point_index;
-    volatile uint8_t frame_arrived;
-    volatile uint8_t state;
-    volatile uint8_t retries;
-} osens_mote_sm_state_t;
-
-typedef uint8_t(*osens_mote_sm_func_t)(osens_mote_sm_state_t *st);
-
-typedef struct osens_mote_sm_table_s
-{
-    osens_mote_sm_func_t func;
-    uint8_t next_state;
-    uint8_t abort_state; // for indicating timeout or end of cyclic operation
-    uint8_t error_state;
-} osens_mote_sm_table_t;
-
-typedef struct osens_acq_schedule_s
-{
-    uint8_t num_of_points;
-    struct points_e
-    {
-        uint8_t index;
-        uint32_t sampling_time_x250ms;
-        uint32_t counter;
-    } points[OSENS_MAX_POINTS];
-
-    struct scan_e
-    {
-        uint8_t num_of_points;
-        uint8_t index[OSENS_MAX_POINTS];
-    } scan;
-
-    struct write_e
-    {
-        uint8_t prod;
-        uint8_t cons;
-        uint8_t index[OSENS_MAX_POINTS];
-    } write;
-} osens_acq_schedule_t;
-
-#define PC_INC_QUEUE(v,mv) (((v) + 1) >= (mv)) ? 0 : (v) + 1
-
-static uint8_t osens_mote_sm_func_build_sch(osens_mote_sm_state_t *st);
-static uint8_t osens_mote_sm_func_pt_desc_ans(osens_mote_sm_state_t *st);
-static uint8_t osens_mote_sm_func_req_pt_desc(osens_mote_sm_state_t *st);
-static uint8_t osens_mote_sm_func_run_sch(osens_mote_sm_state_t *st);
-
-const osens_mote_sm_table_t osens_mote_sm_table[];
-const uint8_t datatype_sizes[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 }; // check osens_datatypes_e order
-
-uint8_t num_rx_bytes;
-uint8_t tx_data_len;
-uint32_t flagErrorOccurred;
-
-uint8_t frame[OSENS_MAX_FRAME_SIZE];
-
-osens_cmd_req_t cmd;
-osens_cmd_res_t ans;
-
-osens_mote_sm_state_t sm_state;
-osens_point_ctrl_t sensor_points;
-osens_brd_id_t board_info;
-osens_acq_schedule_t schedule;
-
-static os_thread_t sm_thread;
-static os_thread_t rx_thread;
-static os_serial_t serial = 0;
-static volatile uint64_t tick_counter;
-
-//=========================== prototypes =======================================
-//=========================== public ==========================================
-void sensor_timer(void);
-static void buBufFlush(void);
-void bspLedToggle(uint8_t ui8Leds);
-void osens_mote_sm(void);
-
-static void* osens_mote_tick(void* param)
-{
-    //scheduler_push_task(osens_mote_sm, TASKPRIO_OSENS_MAIN);
-    while (1)
-    {
-        tick_counter++;
-        osens_mote_sm();
-        os_kernel_sleep(OSENS_SM_TICK_MS);
-    }
-    return 0;
-}
-
-uint8_t osens_mote_send_frame(uint8_t *frame, uint8_t size)
-{
-    int16_t sent;
-#if OSENS_DBG_FRAME == 1
-    os_util_dump_frame(frame, size);
-#endif
-    os_serial_flush(serial);
-    sent = os_serial_write(serial, frame, size);
-    return (sent < 0 ? 0 : (uint8_t) sent); // CHECK AGAIN
-}
-
-#if TRACE_ON == 1
-static void osens_mote_show_values(void)
-{
-    uint8_t n;
-    OS_UTIL_LOG(1, ("\n"));
-    for (n = 0; n < sensor_points.num_of_points; n++)
-    {
-        switch (sensor_points.points[n].value.type)
-        {
-        case OSENS_DT_U8:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.u8));
-            break;
-        case OSENS_DT_S8:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.s8));
-            break;
-        case OSENS_DT_U16:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.u16));
-            break;
-        case OSENS_DT_S16:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.s16));
-            break;
-        case OSENS_DT_U32:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.u32));
-            break;
-        case OSENS_DT_S32:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.s32));
-            break;
-        case OSENS_DT_U64:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.u64));
-            break;
-        case OSENS_DT_S64:
-            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points.points[n].value.value.s64));
-            break;
-        case OSENS_DT_FLOAT:
-            OS_UTIL_LOG(1, ("Point %02d: %f\n", n, sensor_points.points[n].value.value.fp32));
-            break;
-        case OSENS_DT_DOUBLE:
-            OS_UTIL_LOG(1, ("Point %02d: %f\n", n, sensor_points.points[n].value.value.fp64));
-            break;
-        default:
-            break;
-        }
-    }
-}
-#endif
-
-void* osens_mote_rx_serial(void *p)
-{
-    unsigned char data;
-    while (1)
-    {
-        if (os_serial_read_byte(serial, &data))
-        {
-            if (num_rx_bytes < OSENS_MAX_FRAME_SIZE)
-                frame[num_rx_bytes] = (uint8_t) data;
-
-            num_rx_bytes++;
-
-            if (num_rx_bytes >= OSENS_MAX_FRAME_SIZE)
-                num_rx_bytes = 0;
-        }
-        else
-        {
-            os_kernel_sleep(5);
-        }
-    }
-}
-
-uint8_t osens_mote_init_v2(void)
-{
-    os_serial_options_t serial_options = { OS_SERIAL_BR_115200, OS_SERIAL_PR_NONE, OS_SERIAL_PB_1, 27 };
-
-    serial = os_serial_open(serial_options);
-
-    memset(&sm_state, 0, sizeof(osens_mote_sm_state_t));
-    sm_state.state = OSENS_STATE_INIT;
-    tick_counter = 0;
-
-    sm_thread = os_kernel_create(osens_mote_tick, "SM_THREAD", (os_thread_arg) 0, os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
-    rx_thread = os_kernel_create(osens_mote_rx_serial, "RX_THREAD", (os_thread_arg) 0, os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
-
-
-    while (1)
-    {
-        os_kernel_sleep(100);
-    };
-    return 0;
-}
-
-
-static uint8_t osens_mote_pack_send_frame(osens_cmd_req_t *cmd, uint8_t cmd_size)
-{
-    uint8_t size;
-
-    size = osens_pack_cmd_req(cmd, frame);
-
-    if (size != cmd_size)
-        return OSENS_STATE_EXEC_ERROR;
-
-    if (osens_mote_send_frame(frame, cmd_size) != cmd_size)
-        return OSENS_STATE_EXEC_ERROR;
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_pt_val_ans(osens_mote_sm_state_t *st)
-{
-    uint8_t point;
-    uint8_t size;
-    uint8_t ans_size;
-
-    point = schedule.scan.index[st->point_index];
-    ans_size = 6 + datatype_sizes[sensor_points.points[point].desc.type];
-
-    size = osens_unpack_cmd_res(&ans, frame, ans_size);
-
-    // retry ?
-    if (size != ans_size || ans.hdr.addr != (OSENS_REGMAP_READ_POINT_DATA_1 + point))
-        return OSENS_STATE_EXEC_OK;
-
-    // ok, save and go to the next
-    memcpy(&sensor_points.points[point].value, &ans.payload.point_value_cmd, sizeof(osens_point_t));
-
-    st->retries = 0;
-    st->point_index++;
-
-#if TRACE_ON == 1
-    osens_mote_show_values();
-#endif
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_req_pt_val(osens_mote_sm_state_t *st)
-{
-    uint8_t point;
-
-    // end of point reading
-    if (st->point_index >= schedule.scan.num_of_points)
-        return OSENS_STATE_EXEC_WAIT_ABORT;
-
-    // error condition after 3 retries
-    st->retries++;
-    if (st->retries > 3)
-        return OSENS_STATE_EXEC_ERROR;
-
-    point = schedule.scan.index[st->point_index];
-    cmd.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1 + point;
-    st->trmout_counter = 0;
-    st->trmout = MS2TICK(5000);
-    return osens_mote_pack_send_frame(&cmd, 4);
-
-}
-
-static uint8_t osens_mote_sm_func_proc_wr_pt(osens_mote_sm_state_t *st)
-{
-    uint8_t point;
-    uint8_t size;
-    uint8_t ans_size = 5;
-
-    point = schedule.write.index[st->point_index];
-
-    size = osens_unpack_cmd_res(&ans, frame, ans_size);
-
-    // retry ?
-    if (size != ans_size || ans.hdr.addr != (OSENS_REGMAP_WRITE_POINT_DATA_1 + point))
-        return OSENS_STATE_EXEC_OK;
-
-    // ok,  go to the next
-    schedule.write.cons = PC_INC_QUEUE(schedule.write.cons, OSENS_MAX_POINTS);
-    st->retries = 0;
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_wr_pt(osens_mote_sm_state_t *st)
-{
-    uint8_t point;
-    uint8_t c = schedule.write.cons;
-    uint8_t p = schedule.write.prod;
-    uint8_t size;
-
-    // end of point writing
-    if (c == p)
-        return OSENS_STATE_EXEC_WAIT_ABORT;
-
-    // error condition after 3 retries
-    st->retries++;
-    if (st->retries > 3)
-        return OSENS_STATE_EXEC_ERROR;
-
-#if TRACE_ON == 1
-    printf("==> Consuming at position %d\n", c);
-#endif
-
-    st->point_index = c;
-    point = schedule.write.index[st->point_index];
-    cmd.hdr.addr = OSENS_REGMAP_WRITE_POINT_DATA_1 + point;
-    st->trmout_counter = 0;
-    st->trmout = MS2TICK(5000);
-
-    size = 5 + datatype_sizes[sensor_points.points[point].desc.type];
-    memcpy(&cmd.payload.point_value_cmd, &sensor_points.points[point].value, sizeof(osens_point_t));
-
-    return osens_mote_pack_send_frame(&cmd, size);
-}
-
-static uint8_t osens_mote_sm_func_run_sch(osens_mote_sm_state_t *st)
-{
-    uint8_t n;
-
-    //leds_error_toggle();
-
-    // priorize writings over data scan/schedule execution
-    if (schedule.write.prod != schedule.write.cons)
-    {
-#if TRACE_ON == 1
-        printf("==> New writing item to be consumed (P: %d <> C: d%)\n", schedule.write.prod, schedule.write.cons);
-#endif
-        st->retries = 0;
-        return OSENS_STATE_EXEC_ERROR;
-    }
-
-    schedule.scan.num_of_points = 0;
-
-    for (n = 0; n < schedule.num_of_points; n++)
-    {
-
-        if (schedule.points[n].counter > 0)
-            schedule.points[n].counter--;
-
-        if (schedule.points[n].counter == 0)
-        {
-            // n: point index in the schedule database
-            // index: point index in the points database
-            uint8_t index = schedule.points[n].index;
-
-            schedule.scan.index[schedule.scan.num_of_points] = index;
-            schedule.scan.num_of_points++;
-            // restore counter value for next cycle
-            schedule.points[n].counter = schedule.points[n].sampling_time_x250ms;
-        }
-
-    }
-
-    if (schedule.scan.num_of_points > 0)
-    {
-        st->point_index = 0;
-        st->retries = 0;
-
-#if TRACE_ON == 1
-        {
-            OS_UTIL_LOG(1, ("\n"));
-            OS_UTIL_LOG(1, ("Next Scan\n"));
-            OS_UTIL_LOG(1, ("=========\n"));
-            for (n = 0; n < schedule.scan.num_of_points; n++)
-            {
-                OS_UTIL_LOG(1, ("--> %u [%u]\n", n, schedule.scan.index[n]));
-            }
-        }
-#endif
-
-        return OSENS_STATE_EXEC_WAIT_ABORT;
-    }
-    else
-        return OSENS_STATE_EXEC_WAIT_OK;
-}
-
-static uint8_t osens_mote_sm_func_build_sch(osens_mote_sm_state_t *st)
-{
-    uint8_t n, m;
-
-    schedule.num_of_points = 0;
-
-    for (n = 0, m = 0; n < board_info.num_of_points; n++)
-    {
-        if ((sensor_points.points[n].desc.access_rights & OSENS_ACCESS_READ_ONLY) &&
-            (sensor_points.points[n].desc.sampling_time_x250ms > 0))
-        {
-            schedule.points[m].index = n;
-            schedule.points[m].counter = sensor_points.points[n].desc.sampling_time_x250ms;
-            schedule.points[m].sampling_time_x250ms = sensor_points.points[n].desc.sampling_time_x250ms;
-
-            m++;
-            schedule.num_of_points++;
-        }
-    }
-
-#if TRACE_ON == 1
-    OS_UTIL_LOG(1, ("\n"));
-    OS_UTIL_LOG(1, ("Schedule\n"));
-    OS_UTIL_LOG(1, ("========\n"));
-    for (n = 0; n < schedule.num_of_points; n++)
-    {
-        OS_UTIL_LOG(1, ("[%d] point %02d at %dms\n", n, schedule.points[n].index, schedule.points[n].sampling_time_x250ms * 250));
-    }
-#endif
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_pt_desc_ans(osens_mote_sm_state_t *st)
-{
-    uint8_t size;
-    uint8_t ans_size = 20;
-
-    size = osens_unpack_cmd_res(&ans, frame, ans_size);
-
-    if (size != ans_size || (ans.hdr.addr != OSENS_REGMAP_POINT_DESC_1 + st->point_index))
-        return OSENS_STATE_EXEC_ERROR;
-
-    // save description and type, value is not available yet
-    memcpy(&sensor_points.points[st->point_index].desc, &ans.payload.point_desc_cmd, sizeof(osens_point_desc_t));
-    sensor_points.points[st->point_index].value.type = sensor_points.points[st->point_index].desc.type;
-
-#if TRACE_ON == 1
-    {
-        uint8_t n = st->point_index;
-        OS_UTIL_LOG(1, ("\n"));
-        OS_UTIL_LOG(1, ("Point %02d info\n", n));
-        OS_UTIL_LOG(1, ("=============\n"));
-        OS_UTIL_LOG(1, ("Name     : %-8s\n", sensor_points.points[n].desc.name));
-        OS_UTIL_LOG(1, ("Type     : %d\n", sensor_points.points[n].desc.type));
-        OS_UTIL_LOG(1, ("Unit     : %d\n", sensor_points.points[n].desc.unit));
-        OS_UTIL_LOG(1, ("Rights   : %02X\n", sensor_points.points[n].desc.access_rights));
-        OS_UTIL_LOG(1, ("Sampling : %d\n\n", sensor_points.points[n].desc.sampling_time_x250ms));
-    }
-#endif
-
-    st->retries = 0;
-    st->point_index++;
-    sensor_points.num_of_points = st->point_index;
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_req_pt_desc(osens_mote_sm_state_t *st)
-{
-    if (st->point_index >= board_info.num_of_points)
-        return OSENS_STATE_EXEC_WAIT_ABORT;
-
-    // error condition after 3 retries
-    st->retries++;
-    if (st->retries > 3)
-        return OSENS_STATE_EXEC_ERROR;
-
-    cmd.hdr.addr = OSENS_REGMAP_POINT_DESC_1 + st->point_index;
-    st->trmout_counter = 0;
-    st->trmout = MS2TICK(5000);
-    return osens_mote_pack_send_frame(&cmd, 4);
-}
-
-static uint8_t osens_mote_sm_func_proc_brd_id_ans(osens_mote_sm_state_t *st)
-{
-    uint8_t size;
-    uint8_t ans_size = 28;
-
-    st->point_index = 0;
-
-    size = osens_unpack_cmd_res(&ans, frame, ans_size);
-
-    if (size != ans_size)
-        return OSENS_STATE_EXEC_ERROR;
-
-    memcpy(&board_info, &ans.payload.brd_id_cmd, sizeof(osens_brd_id_t));
-
-    if ((board_info.num_of_points == 0) || (board_info.num_of_points > OSENS_MAX_POINTS))
-        return OSENS_STATE_EXEC_ERROR;
-
-#if TRACE_ON == 1
-    OS_UTIL_LOG(1, ("\n"));
-    OS_UTIL_LOG(1, ("Board info\n"));
-    OS_UTIL_LOG(1, ("==========\n"));
-    OS_UTIL_LOG(1, ("Manufactor : %-8s\n", board_info.manufactor));
-    OS_UTIL_LOG(1, ("Model      : %-8s\n", board_info.model));
-    OS_UTIL_LOG(1, ("ID         : %08X\n", board_info.sensor_id));
-    OS_UTIL_LOG(1, ("HW REV     : %02X\n", board_info.hardware_revision));
-    OS_UTIL_LOG(1, ("Capabilties: %02X\n", board_info.cabalities));
-    OS_UTIL_LOG(1, ("Points     : %d\n\n", board_info.num_of_points));
-#endif
-
-    sensor_points.num_of_points = 0;
-    st->retries = 0;
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-static uint8_t osens_mote_sm_func_req_brd_id(osens_mote_sm_state_t *st)
-{
-    cmd.hdr.size = 4;
-    cmd.hdr.addr = OSENS_REGMAP_BRD_ID;
-    st->trmout_counter = 0;
-    st->trmout = MS2TICK(5000);
-    return osens_mote_pack_send_frame(&cmd, 4);
-}
-
-
-static uint8_t osens_mote_sm_func_proc_itf_ver_ans(osens_mote_sm_state_t *st)
-{
-    uint8_t size;
-    uint8_t ans_size = 6;
-
-    size = osens_unpack_cmd_res(&ans, frame, ans_size);
-
-    if (size != ans_size)
-        return OSENS_STATE_EXEC_ERROR;
-
-    if ((OSENS_ANS_OK != ans.hdr.status) || (OSENS_LATEST_VERSION != ans.payload.itf_version_cmd.version))
-        return OSENS_STATE_EXEC_ERROR;
-
-    return OSENS_STATE_EXEC_OK;
-}
-
-
-static uint8_t osens_mote_sm_func_wait_ans(osens_mote_sm_state_t *st)
-{
-
-    /* TODO!!!! MELHORAR O Tratamento do final de frame
-    * Devido ao problema da UART nao estar reconhecendo o final do frame
-    * a rotina esperar um ciclo de scan (250ms) entao se recebeu algum dado ele diz
-    * que recebeu o frame. Posteriormente sera tratado o frame e verificado se recebeu tudo
-    */
-    if ((st->trmout_counter > 0) && (num_rx_bytes > 3))
-    {
-        st->frame_arrived = 1;
-        num_rx_bytes = 0;
-    }
-
-    if (st->frame_arrived)
-    {
-        st->frame_arrived = 0;
-        return OSENS_STATE_EXEC_WAIT_STOP;
-    }
-
-    st->trmout_counter++;
-
-    if (st->trmout_counter > st->trmout)
-    {
-        //se ocorreu timeout e existe bytes no buffer rx considero que recebeu msg
-        if (num_rx_bytes > 0)
-        {
-            return OSENS_STATE_EXEC_WAIT_STOP;
-        }
-        else
-        {
-            return OSENS_STATE_EXEC_WAIT_ABORT;
-        }
-    }
-
-    return OSENS_STATE_EXEC_WAIT_OK;
-}
-
-
-static uint8_t osens_mote_sm_func_req_ver(osens_mote_sm_state_t *st)
-{
-    cmd.hdr.addr = OSENS_REGMAP_ITF_VERSION;
-    st->trmout_counter = 0;
-    st->trmout = MS2TICK(5000);
-    return osens_mote_pack_send_frame(&cmd, 4);
-}
-
-
-static uint8_t osens_mote_sm_func_init(osens_mote_sm_state_t *st)
-{
-    uint8_t ret = OSENS_STATE_EXEC_OK;
-
-    //leds_error_on();
-
-    memset(&cmd, 0, sizeof(cmd));
-    memset(&ans, 0, sizeof(ans));
-    memset(&sensor_points, 0, sizeof(sensor_points));
-    memset(&board_info, 0, sizeof(board_info));
-    memset(&schedule, 0, sizeof(schedule));
-    memset(st, 0, sizeof(osens_mote_sm_state_t));
-
-    num_rx_bytes = 0;
-
-    return ret;
-}
-
-void osens_mote_sm(void)
-{
-    uint8_t ret;
-
-#if TRACE_ON == 1
-    uint8_t ls = sm_state.state;
-#endif
-
-    ret = osens_mote_sm_table[sm_state.state].func(&sm_state);
-
-    /*
-    if (flagErrorOccurred)
-    {
-    //reset uart
-    uart1_clearTxInterrupts();
-    uart1_clearRxInterrupts();      // clear possible pending interrupts
-    uart1_enableInterrupts();       // Enable USCI_A1 TX & RX interrupt
-
-    flagErrorOccurred = 0;
-    }
-    */
-
-    switch (ret)
-    {
-    case OSENS_STATE_EXEC_OK:
-    case OSENS_STATE_EXEC_WAIT_STOP:
-        sm_state.state = osens_mote_sm_table[sm_state.state].next_state;
-        break;
-    case OSENS_STATE_EXEC_WAIT_OK:
-        // still waiting
-        break;
-    case OSENS_STATE_EXEC_WAIT_ABORT:
-        // wait timeout
-        sm_state.state = osens_mote_sm_table[sm_state.state].abort_state;
-        break;
-    case OSENS_STATE_EXEC_ERROR:
-    default:
-        sm_state.state = osens_mote_sm_table[sm_state.state].error_state;
-        break;
-    }
-
-#if TRACE_ON == 1
-    printf("[SM]  %llu    (%02d) %-16s -> (%02d) %-16s\n", tick_counter, ls, sm_states_str[ls], sm_state.state, sm_states_str[sm_state.state]);
-
-    {
-        uint8_t index = 1;
-        osens_point_t point;
-
-        if (sensor_points.points[0].value.value.u8 >= 90 && sensor_points.points[1].value.value.u8 == 0)
-        {
-            point.value.u8 = 1;
-            osens_set_pvalue(index, &point);
-        }
-        if (sensor_points.points[0].value.value.u8 < 90 && sensor_points.points[1].value.value.u8 == 1)
-        {
-            point.value.u8 = 0;
-            osens_set_pvalue(index, &point);
-        }
-    }
-#endif
-
-}
-
-const osens_mote_sm_table_t osens_mote_sm_table[] =
-{     //{ func,                                   next_state,                      abort_state,                error_state         }
-    { osens_mote_sm_func_init, OSENS_STATE_SEND_ITF_VER, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_INIT
-    { osens_mote_sm_func_req_ver, OSENS_STATE_WAIT_ITF_VER_ANS, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_SEND_ITF_VER
-    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_ITF_VER, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_ITF_VER_ANS
-    { osens_mote_sm_func_proc_itf_ver_ans, OSENS_STATE_SEND_BRD_ID, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_ITF_VER
-    { osens_mote_sm_func_req_brd_id, OSENS_STATE_WAIT_BRD_ID_ANS, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_SEND_BRD_ID
-    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_BRD_ID, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_BRD_ID_ANS
-    { osens_mote_sm_func_proc_brd_id_ans, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_BRD_ID
-    { osens_mote_sm_func_req_pt_desc, OSENS_STATE_WAIT_PT_DESC_ANS, OSENS_STATE_BUILD_SCH, OSENS_STATE_INIT }, // OSENS_STATE_SEND_PT_DESC
-    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_PT_DESC, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_PT_DESC_ANS
-    { osens_mote_sm_func_pt_desc_ans, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_PT_DESC
-    { osens_mote_sm_func_build_sch, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_BUILD_SCH
-    { osens_mote_sm_func_run_sch, OSENS_STATE_RUN_SCH, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_WR_PT }, // OSENS_STATE_RUN_SCH
-    { osens_mote_sm_func_req_pt_val, OSENS_STATE_WAIT_PT_VAL_ANS, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT }, // OSENS_STATE_SEND_PT_VAL
-    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_PT_VAL, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_PT_VAL_ANS
-    { osens_mote_sm_func_pt_val_ans, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_PT_VAL
-    { osens_mote_sm_func_wr_pt, OSENS_STATE_WAIT_WR_PT_ANS, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT }, // OSENS_STATE_WR_PT
-    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_WR_PT_ANS, OSENS_STATE_WR_PT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_WR_PT_ANS
-    { osens_mote_sm_func_proc_wr_pt, OSENS_STATE_WR_PT, OSENS_STATE_INIT, OSENS_STATE_INIT } // OSENS_STATE_PROC_WR_PT_ANS
-};
-
-uint8_t osens_init(void)
-{
-    osens_mote_init_v2();
-    return 0;
-}
-
-uint8_t osens_get_num_points(void)
-{
-    if (sm_state.state >= OSENS_STATE_SEND_PT_DESC)
-    {
-        return board_info.num_of_points;
-    }
-    else
-        return 0;
-}
-
-uint8_t osens_get_brd_desc(osens_brd_id_t *brd)
-{
-    if (sm_state.state >= OSENS_STATE_SEND_PT_DESC)
-    {
-        memcpy(brd, &board_info, sizeof(osens_brd_id_t));
-        return 1;
-    }
-    else
-        return 0;
-}
-
-uint8_t osens_get_pdesc(uint8_t index, osens_point_desc_t *desc)
-{
-    if ((sm_state.state >= OSENS_STATE_RUN_SCH) && (index < sensor_points.num_of_points))
-    {
-        memcpy(desc, &sensor_points.points[index].desc, sizeof(osens_point_desc_t));
-        return 1;
-    }
-    else
-        return 0;
-}
-
-int8_t osens_get_ptype(uint8_t index)
-{
-    if ((sm_state.state >= OSENS_STATE_RUN_SCH) && (index < sensor_points.num_of_points))
-    {
-        return sensor_points.points[index].value.type;
-    }
-    else
-        return -1;
-}
-
-uint8_t osens_get_point(uint8_t index, osens_point_t *point)
-{
-    if ((sm_state.state >= OSENS_STATE_RUN_SCH) && (index < sensor_points.num_of_points))
-    {
-        memcpy(point, &sensor_points.points[index].value, sizeof(osens_point_t));
-        return 1;
-    }
-    else
-        return 0;
-}
-
-uint8_t osens_set_pvalue(uint8_t index, osens_point_t *point)
-{
-    if ((sm_state.state >= OSENS_STATE_RUN_SCH) && (index < sensor_points.num_of_points))
-    {
-        if (sensor_points.points[index].desc.access_rights & OSENS_ACCESS_WRITE_ONLY)
-        {
-            uint8_t pn;
-            uint8_t p = schedule.write.prod;
-            uint8_t c = schedule.write.cons;
-
-            pn = PC_INC_QUEUE(p, OSENS_MAX_POINTS);
-
-            // no space in prod/cons queue (check next)
-            if (pn == c)
-            {
-#if TRACE_ON == 1
-                printf("==> No space in writing queue (P: %d->%d, C: %d)\n",p,pn,c);
-#endif
-                return 0;
-            }
-
-#if TRACE_ON == 1
-            printf("==> Producing at position %d\n", p);
-#endif
-            // schedule point for writing and update value
-            schedule.write.index[p] = index;
-            sensor_points.points[index].value.value = point->value;
-            schedule.write.prod = pn;
-
-            return 1;
-        }
-        else
-            return 0;
-    }
-    else
-        return 0;
-}
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "../os/os_defs.h"
+#include "../os/os_atomic.h"
+#include "../os/os_kernel.h"
+#include "../os/os_serial.h"
+#include "../os/os_transport.h"
+#include "../os/os_util.h"
+#include "../util/buf_io.h"
+#include "osens_stats.h"
+#include "osens_mote.h"
+#include "osens_capture.h"
+
+#define TRACE_ON 1
+
+#define MS2TICK(ms) (ms) > OSENS_SM_TICK_MS ? (ms) / OSENS_SM_TICK_MS : 1
+
+/* framing bytes: size, address and CRC (requests), plus status (responses) */
+#define OSENS_MOTE_REQ_FRAMING 4
+#define OSENS_MOTE_RES_FRAMING 5
+/* extended size field bytes (frames longer than OSENS_MAX_FRAME_SIZE) */
+#define OSENS_MOTE_EXT_FRAMING(size) ((size) > OSENS_MAX_FRAME_SIZE ? 2 : 0)
+/* most bytes a bus address adds to a frame, it may also need the extended size field */
+#define OSENS_MOTE_BUS_FRAMING(ctx) ((ctx)->bus ? OSENS_FRAME_BUS_FRAMING + 2 : 0)
+/* frames a context receives: answers, and requests echoed by a shared line */
+#define OSENS_MOTE_RX_KINDS(ctx) ((ctx)->bus ? OSENS_FRAME_KIND_ANY : OSENS_FRAME_KIND_RES)
+/* parity bytes per code word of the frames exchanged with the board, 0 when not protected */
+#define OSENS_MOTE_FEC_ROOTS(ctx) (((ctx)->features & OSENS_FEATURE_FEC) ? (ctx)->fec_roots : 0)
+
+/* owner of an idle bus */
+#define OSENS_MOTE_BUS_IDLE 0xFF
+
+#define OSENS_MOTE_LINK_REPORT_TICKS (OSENS_MOTE_LINK_REPORT_MS / OSENS_SM_TICK_MS)
+
+#define OSENS_MOTE_LINK_RATES_ALL ((1 << OSENS_LINK_NUM_RATES) - 1)
+
+/* shortest time between two scan overrun warnings of a board */
+#define OSENS_MOTE_SCAN_LOG_MS OSENS_MOTE_LINK_REPORT_MS
+
+/* boards refusing the interface version register are asked again after this time */
+#define OSENS_MOTE_VERSION_RETRY_MS 30000
+
+/* aggregate flags of a point: read with OSENS_REGMAP_AGGREGATE, aggregates received */
+#define OSENS_MOTE_AGGR_ON   0x01
+#define OSENS_MOTE_AGGR_READ 0x02
+/* aggregate payload: index, count and four floats */
+#define OSENS_MOTE_AGGR_SIZE (1 + 4 + 4 * 4)
+
+/* clock synchronizations kept, the one with the shortest round trip gives the offset */
+#define OSENS_MOTE_TIME_SYNC_SAMPLES 4
+/* time sync payloads: mote clock and flags, plus both sensor clocks in the answer */
+#define OSENS_MOTE_TIME_SYNC_REQ_SIZE (4 + 1)
+#define OSENS_MOTE_TIME_SYNC_RES_SIZE (4 + 4 + 4 + 1)
+
+enum {
+    OSENS_STATE_INIT = 0,
+    OSENS_STATE_SEND_ITF_VER = 1,
+    OSENS_STATE_WAIT_ITF_VER_ANS = 2,
+    OSENS_STATE_PROC_ITF_VER = 3,
+    OSENS_STATE_SEND_BRD_ID = 4,
+    OSENS_STATE_WAIT_BRD_ID_ANS = 5,
+    OSENS_STATE_PROC_BRD_ID = 6,
+    OSENS_STATE_SEND_FEATURES = 7,
+    OSENS_STATE_WAIT_FEATURES_ANS = 8,
+    OSENS_STATE_PROC_FEATURES = 9,
+    OSENS_STATE_SEND_FRAME_SIZE = 10,
+    OSENS_STATE_WAIT_FRAME_SIZE_ANS = 11,
+    OSENS_STATE_PROC_FRAME_SIZE = 12,
+    OSENS_STATE_SEND_LINK_RATES = 13,
+    OSENS_STATE_WAIT_LINK_RATES_ANS = 14,
+    OSENS_STATE_PROC_LINK_RATES = 15,
+    OSENS_STATE_SEND_LINK_SPEED = 16,
+    OSENS_STATE_WAIT_LINK_SPEED_ANS = 17,
+    OSENS_STATE_PROC_LINK_SPEED = 18,
+    OSENS_STATE_SEND_PT_DESC = 19,
+    OSENS_STATE_WAIT_PT_DESC_ANS = 20,
+    OSENS_STATE_PROC_PT_DESC = 21,
+    OSENS_STATE_BUILD_SCH = 22,
+    OSENS_STATE_RUN_SCH = 23,
+    OSENS_STATE_SEND_PT_VAL = 24,
+    OSENS_STATE_WAIT_PT_VAL_ANS = 25,
+    OSENS_STATE_PROC_PT_VAL = 26,
+    OSENS_STATE_WR_PT = 27,
+    OSENS_STATE_WAIT_WR_PT_ANS = 28,
+    OSENS_STATE_PROC_WR_PT_ANS = 29,
+    OSENS_STATE_SEND_STREAM = 30,
+    OSENS_STATE_WAIT_STREAM_ANS = 31,
+    OSENS_STATE_PROC_STREAM = 32,
+    OSENS_STATE_SEND_TIME_SYNC = 33,
+    OSENS_STATE_WAIT_TIME_SYNC_ANS = 34,
+    OSENS_STATE_PROC_TIME_SYNC = 35
+};
+
+#if TRACE_ON == 1
+uint8_t *sm_states_str[] = {
+    "INIT",
+    "SEND_ITF_VER",
+    "WAIT_ITF_VER_ANS",
+    "PROC_ITF_VER",
+    "SEND_BRD_ID",
+    "WAIT_BRD_ID_ANS",
+    "PROC_BRD_ID",
+    "SEND_FEATURES",
+    "WAIT_FEATURES_ANS",
+    "PROC_FEATURES",
+    "SEND_FRAME_SIZE",
+    "WAIT_FRAME_SIZE_ANS",
+    "PROC_FRAME_SIZE",
+    "SEND_LINK_RATES",
+    "WAIT_LINK_RATES_ANS",
+    "PROC_LINK_RATES",
+    "SEND_LINK_SPEED",
+    "WAIT_LINK_SPEED_ANS",
+    "PROC_LINK_SPEED",
+    "SEND_PT_DESC",
+    "WAIT_PT_DESC_ANS",
+    "PROC_PT_DESC",
+    "BUILD_SCH",
+    "RUN_SCH",
+    "SEND_PT_VAL",
+    "WAIT_PT_VAL_ANS",
+    "PROC_PT_VAL",
+    "WR_PT",
+    "WAIT_WR_PT_ANS",
+    "PROC_WR_PT_ANS",
+    "SEND_STREAM",
+    "WAIT_STREAM_ANS",
+    "PROC_STREAM",
+    "SEND_TIME_SYNC",
+    "WAIT_TIME_SYNC_ANS",
+    "PROC_TIME_SYNC"
+};
+#endif
+
+enum {
+    OSENS_STATE_EXEC_OK = 0,
+    OSENS_STATE_EXEC_WAIT_OK,
+    OSENS_STATE_EXEC_WAIT_STOP,
+    OSENS_STATE_EXEC_WAIT_ABORT,
+    OSENS_STATE_EXEC_ERROR
+};
+
+typedef struct osens_mote_sm_state_s
+{
+    volatile uint16_t trmout_counter;
+    volatile uint16_t trmout;
+    volatile uint8_t point_index;
+    volatile uint8_t frame_arrived;
+    volatile uint8_t state;
+    volatile uint8_t retries;
+} osens_mote_sm_state_t;
+
+typedef struct osens_mote_rx_slot_s
+{
+    uint16_t size;
+    uint8_t frame[OSENS_MOTE_FRAME_SIZE];
+    uint64_t rx_us;
+} osens_mote_rx_slot_t;
+
+// link accounting, written by the state machine (rx counters by the RX thread)
+typedef struct osens_mote_link_s
+{
+    uint64_t start_us;
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint32_t tx_payload;
+    uint32_t rx_payload;
+    uint32_t gaps;
+    uint32_t gap_max_us;
+    uint64_t gap_sum_us;
+    uint8_t gap_pending;
+    uint32_t rx_skipped;
+    osens_fec_stats_t fec;
+} osens_mote_link_t;
+
+// sampling timing of a point, written by the state machine only
+typedef struct osens_mote_point_timing_s
+{
+    uint64_t due_us;
+    uint64_t last_us;
+    osens_stats_point_t stats;
+} osens_mote_point_timing_t;
+
+// decoding of the pushed samples, copied by the RX thread for each frame
+typedef struct osens_mote_stream_cfg_s
+{
+    osens_mote_stream_func_t func;
+    void *arg;
+    uint32_t mask;
+    uint8_t num_values;
+    uint16_t sample_size;
+    // type of each value, the points may be discovered again meanwhile
+    uint8_t types[OSENS_MAX_POINTS];
+} osens_mote_stream_cfg_t;
+
+// streaming subscription
+typedef struct osens_mote_stream_s
+{
+    // requested by the application, written under app_seq
+    volatile uint32_t app_seq;
+    osens_stream_t app_req;
+    osens_mote_stream_func_t app_func;
+    void *app_arg;
+    volatile uint8_t pending;
+    // snapshot sent by the state machine
+    osens_stream_t req;
+    uint32_t req_seq;
+    // requested subscription, written by the state machine under cfg_seq
+    volatile uint32_t cfg_seq;
+    osens_mote_stream_cfg_t cfg;
+    volatile uint8_t active;
+    volatile uint8_t accepted;
+    // RX thread only
+    uint16_t next_seq;
+    uint32_t frames;
+    uint32_t samples;
+    uint32_t lost_frames;
+    uint32_t bad_frames;
+    osens_point_t values[OSENS_MAX_POINTS];
+} osens_mote_stream_t;
+
+// clock synchronization, written by the state machine
+typedef struct osens_mote_clock_s
+{
+    uint8_t pending;
+    uint64_t next_us;
+    uint8_t num_samples;
+    uint8_t next_sample;
+    struct clock_sample_e
+    {
+        int32_t offset_ms;
+        uint32_t delay_us;
+    } samples[OSENS_MOTE_TIME_SYNC_SAMPLES];
+    // in use, read by the API
+    volatile uint8_t synced;
+    volatile uint8_t stamping;
+    int32_t offset_ms;
+    uint32_t delay_us;
+    uint32_t syncs;
+} osens_mote_clock_t;
+
+typedef uint8_t(*osens_mote_sm_func_t)(osens_mote_ctx_t ctx);
+
+typedef struct osens_mote_sm_table_s
+{
+    osens_mote_sm_func_t func;
+    uint8_t next_state;
+    uint8_t abort_state; // for indicating timeout or end of cyclic operation
+    uint8_t error_state;
+} osens_mote_sm_table_t;
+
+typedef struct osens_acq_schedule_s
+{
+    uint8_t num_of_points;
+    struct points_e
+    {
+        uint8_t index;
+        uint32_t sampling_time_x250ms;
+        uint32_t counter;
+    } points[OSENS_MAX_POINTS];
+
+    struct scan_e
+    {
+        uint8_t num_of_points;
+        uint8_t index[OSENS_MAX_POINTS];
+    } scan;
+
+    struct write_e
+    {
+        uint8_t prod;
+        uint8_t cons;
+        uint8_t index[OSENS_MAX_POINTS];
+    } write;
+} osens_acq_schedule_t;
+
+struct osens_mote_ctx_s
+{
+    uint8_t id;
+    os_transport_t transport;
+    // shared bus (null for a point to point link) and address of the board on it
+    osens_mote_bus_t bus;
+    uint8_t bus_addr;
+    os_thread_t sm_thread;
+    os_thread_t rx_thread;
+    // state machine thread only
+    uint8_t tx_frame[OSENS_MOTE_FRAME_SIZE];
+    uint8_t ans_frame[OSENS_MOTE_FRAME_SIZE];
+    uint16_t ans_size;
+    // longest frame accepted by both sides (OSENS_REGMAP_FRAME_SIZE)
+    uint16_t frame_max;
+    uint64_t tx_us;
+    uint64_t ans_us;
+    // RX thread only: bytes read from the transport and the frame being assembled
+    uint32_t rx_head;
+    uint32_t rx_tail;
+    uint8_t rx_ring[OSENS_MOTE_RX_RING_SIZE];
+    uint16_t num_rx_bytes;
+    uint8_t rx_frame[OSENS_MOTE_FRAME_SIZE];
+    uint64_t rx_last_us;
+    // complete frames, produced by the RX thread and consumed by the state machine
+    volatile uint32_t rx_slot_prod;
+    volatile uint32_t rx_slot_cons;
+    volatile uint32_t rx_slot_dropped;
+    osens_mote_rx_slot_t rx_slots[OSENS_MOTE_RX_SLOTS];
+    osens_mote_link_t link;
+    // link rate negotiation, state machine only
+    uint16_t link_rates;
+    uint16_t link_bad_rates;
+    uint8_t link_rate;
+    uint8_t link_base_rate;
+    uint8_t link_next_rate;
+    uint8_t link_crc_errors;
+    uint8_t link_fallback;
+    // features (osens_feature_e) the mote may use and the ones both sides support,
+    // bits are cleared when a board without OSENS_REGMAP_FEATURES refuses a register
+    uint32_t features_local;
+    volatile uint32_t features;
+    // parity bytes per code word of protected frames, used when OSENS_FEATURE_FEC is negotiated
+    uint8_t fec_roots;
+    // ticks to wait before the next discovery
+    uint16_t init_backoff;
+    osens_mote_stream_t stream;
+    osens_mote_clock_t clock;
+    osens_cmd_req_t cmd;
+    osens_cmd_res_t ans;
+    osens_mote_sm_state_t sm_state;
+    osens_point_ctrl_t sensor_points;
+    // elements of array points, allocated on their first read. Two blocks per
+    // point, the last read one is block (seq & 1) with count elements
+    void *point_arrays[OSENS_MAX_POINTS];
+    uint16_t point_array_count[OSENS_MAX_POINTS][2];
+    volatile uint32_t point_array_seq[OSENS_MAX_POINTS];
+    volatile uint8_t aggregate[OSENS_MAX_POINTS];
+    osens_aggregate_t aggregates[OSENS_MAX_POINTS];
+    osens_brd_id_t board_info;
+    osens_acq_schedule_t schedule;
+    osens_mote_point_timing_t timing[OSENS_MAX_POINTS];
+    // sample time of the last value of each point (mote clock), 0 before the first read
+    uint64_t point_time_us[OSENS_MAX_POINTS];
+    uint8_t point_stamped[OSENS_MAX_POINTS];
+    uint64_t scan_start_us;
+    uint32_t scan_min_period_us;
+    // overruns not logged yet and time of the last warning
+    uint32_t scan_overruns;
+    uint64_t scan_log_us;
+    volatile uint64_t tick_counter;
+};
+
+// boards sharing a transport, their state machines run in one thread and the first board reads for all
+struct osens_mote_bus_s
+{
+    os_transport_t transport;
+    os_thread_t sm_thread;
+    os_thread_t rx_thread;
+    uint8_t num_boards;
+    osens_mote_ctx_t boards[OSENS_MOTE_BUS_MAX_BOARDS];
+    // board holding the bus from its request to the answer (or timeout), state machine thread only
+    uint8_t owner;
+    // board served first on the next tick
+    uint8_t next;
+    uint32_t grants;
+    uint32_t holds;
+    // written by the RX thread
+    volatile uint64_t rx_last_us;
+    volatile uint32_t unknown_frames;
+};
+
+#define PC_INC_QUEUE(v,mv) (((v) + 1) >= (mv)) ? 0 : (v) + 1
+
+static uint8_t osens_mote_sm_func_build_sch(osens_mote_ctx_t ctx);
+static uint8_t osens_mote_sm_func_pt_desc_ans(osens_mote_ctx_t ctx);
+static uint8_t osens_mote_sm_func_req_pt_desc(osens_mote_ctx_t ctx);
+static uint8_t osens_mote_sm_func_run_sch(osens_mote_ctx_t ctx);
+static uint8_t osens_mote_sm_func_wait_ans(osens_mote_ctx_t ctx);
+static osens_mote_ctx_t osens_mote_bus_find(osens_mote_bus_t bus, uint8_t addr);
+
+const osens_mote_sm_table_t osens_mote_sm_table[];
+
+// context used by the single board API (osens.h)
+static osens_mote_ctx_t mote_ctx = 0;
+
+//=========================== prototypes =======================================
+//=========================== public ==========================================
+void sensor_timer(void);
+void bspLedToggle(uint8_t ui8Leds);
+
+static void* osens_mote_tick(void* param)
+{
+    osens_mote_ctx_t ctx = (osens_mote_ctx_t) param;
+
+    //scheduler_push_task(osens_mote_sm, TASKPRIO_OSENS_MAIN);
+    while (1)
+    {
+        osens_mote_ctx_sm(ctx);
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    }
+    return 0;
+}
+
+// length of a frame on the line, compared with frame_max
+static uint16_t osens_mote_wire_size(osens_mote_ctx_t ctx, uint16_t size)
+{
+    return osens_fec_size(size, OSENS_MOTE_FEC_ROOTS(ctx));
+}
+
+// frame is protected in place, it must have room for osens_mote_wire_size() bytes
+static uint16_t osens_mote_send_frame(osens_mote_ctx_t ctx, uint8_t *frame, uint16_t size)
+{
+    uint16_t wire_size = size;
+    int16_t sent;
+
+    // captured unprotected, like the answers
+    OSENS_CAPTURE(ctx->id, OSENS_CAPTURE_DIR_REQ, frame, size);
+
+    if (OSENS_MOTE_FEC_ROOTS(ctx))
+        wire_size = osens_fec_encode(frame, size, OSENS_MOTE_FEC_ROOTS(ctx));
+#if OSENS_DBG_FRAME == 1
+    os_util_dump_frame(frame, wire_size);
+#endif
+    sent = os_transport_send(ctx->transport, frame, wire_size);
+    return (sent == (int16_t) wire_size ? size : 0);
+}
+
+#if TRACE_ON == 1
+static void osens_mote_show_values(osens_mote_ctx_t ctx)
+{
+    uint8_t n;
+    osens_point_ctrl_t *sensor_points = &ctx->sensor_points;
+
+    OS_UTIL_LOG(1, ("\n"));
+    for (n = 0; n < sensor_points->num_of_points; n++)
+    {
+        switch (sensor_points->points[n].value.type)
+        {
+        case OSENS_DT_U8:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.u8));
+            break;
+        case OSENS_DT_S8:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.s8));
+            break;
+        case OSENS_DT_U16:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.u16));
+            break;
+        case OSENS_DT_S16:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.s16));
+            break;
+        case OSENS_DT_U32:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.u32));
+            break;
+        case OSENS_DT_S32:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.s32));
+            break;
+        case OSENS_DT_U64:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.u64));
+            break;
+        case OSENS_DT_S64:
+            OS_UTIL_LOG(1, ("Point %02d: %d\n", n, sensor_points->points[n].value.value.s64));
+            break;
+        case OSENS_DT_FLOAT:
+            OS_UTIL_LOG(1, ("Point %02d: %f\n", n, sensor_points->points[n].value.value.fp32));
+            break;
+        case OSENS_DT_DOUBLE:
+            OS_UTIL_LOG(1, ("Point %02d: %f\n", n, sensor_points->points[n].value.value.fp64));
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
+
+static void osens_mote_rx_slot_push(osens_mote_ctx_t ctx)
+{
+    uint32_t prod = ctx->rx_slot_prod;
+    osens_mote_rx_slot_t *slot;
+
+    if ((prod - OS_ATOMIC_LOAD_ACQ(&ctx->rx_slot_cons)) >= OSENS_MOTE_RX_SLOTS)
+    {
+        ctx->rx_slot_dropped++;
+        return;
+    }
+
+    slot = &ctx->rx_slots[prod & (OSENS_MOTE_RX_SLOTS - 1)];
+    memcpy(slot->frame, ctx->rx_frame, ctx->num_rx_bytes);
+    slot->size = ctx->num_rx_bytes;
+    slot->rx_us = os_kernel_get_time_us();
+
+    // the slot belongs to the state machine from now on
+    OS_ATOMIC_STORE_REL(&ctx->rx_slot_prod, prod + 1);
+}
+
+// moves the oldest received frame to ans_frame, returns its size or 0 if there is none
+static uint16_t osens_mote_rx_slot_pop(osens_mote_ctx_t ctx)
+{
+    uint32_t cons = ctx->rx_slot_cons;
+    osens_mote_rx_slot_t *slot;
+
+    if (cons == OS_ATOMIC_LOAD_ACQ(&ctx->rx_slot_prod))
+        return 0;
+
+    slot = &ctx->rx_slots[cons & (OSENS_MOTE_RX_SLOTS - 1)];
+    memcpy(ctx->ans_frame, slot->frame, slot->size);
+    ctx->ans_size = slot->size;
+    ctx->ans_us = slot->rx_us;
+
+    // give the slot back to the RX thread
+    OS_ATOMIC_STORE_REL(&ctx->rx_slot_cons, cons + 1);
+
+    return ctx->ans_size;
+}
+
+// discards responses that arrived too late (after a timeout)
+static void osens_mote_rx_slot_drain(osens_mote_ctx_t ctx)
+{
+    OS_ATOMIC_STORE_REL(&ctx->rx_slot_cons, OS_ATOMIC_LOAD_ACQ(&ctx->rx_slot_prod));
+}
+
+// pushed samples, decoded by the RX thread and given to the stream callback
+static void osens_mote_stream_rx(osens_mote_ctx_t ctx)
+{
+    osens_mote_stream_t *s = &ctx->stream;
+    osens_mote_stream_cfg_t cfg;
+    osens_cmd_res_t ans;
+    osens_stream_data_t *data = &ans.payload.stream_data_cmd;
+    uint32_t seq;
+    uint8_t *buf;
+    uint8_t n, m, k;
+
+    OSENS_CAPTURE(ctx->id, OSENS_CAPTURE_DIR_RES, ctx->rx_frame, ctx->num_rx_bytes);
+
+    if (!OS_ATOMIC_LOAD_ACQ(&s->active))
+    {
+        s->bad_frames++;
+        return;
+    }
+
+    // the state machine may change the subscription at any time
+    do
+    {
+        seq = os_atomic_seq_read_begin(&s->cfg_seq);
+        cfg = s->cfg;
+    } while (os_atomic_seq_read_retry(&s->cfg_seq, seq));
+
+    if ((osens_unpack_cmd_res(&ans, ctx->rx_frame, ctx->num_rx_bytes) == 0) ||
+        ((uint32_t) data->num_samples * cfg.sample_size != data->size))
+    {
+        s->bad_frames++;
+        return;
+    }
+
+    // sequence restarts with each subscription
+    if ((s->frames > 0) && (data->seq != 0) && (data->seq != s->next_seq))
+        s->lost_frames += (uint16_t) (data->seq - s->next_seq);
+
+    s->next_seq = data->seq + 1;
+    s->frames++;
+
+    for (n = 0, buf = data->samples; n < data->num_samples; n++)
+    {
+        for (m = 0, k = 0; m < OSENS_MAX_POINTS; m++)
+        {
+            if ((cfg.mask & (1UL << m)) == 0)
+                continue;
+
+            s->values[k].type = cfg.types[k];
+            buf += osens_unpack_point_value(&s->values[k], buf);
+            k++;
+        }
+
+        s->samples++;
+        if (cfg.func)
+            cfg.func(ctx, data->seq, s->values, cfg.num_values, cfg.arg);
+    }
+}
+
+// length of a frame without its bus address, the one expected sizes refer to
+static uint16_t osens_mote_unaddressed_size(const uint8_t *frame, uint16_t size)
+{
+    uint16_t frame_size;
+    uint8_t hdr_len;
+
+    if ((size == 0) || (osens_frame_bus_addr(frame, size) == OSENS_BUS_ADDR_NONE))
+        return size;
+
+    // bytes after the header (CRC included), plus a one byte or an extended size field
+    hdr_len = osens_frame_size(frame, size, &frame_size);
+    size -= hdr_len;
+
+    return size + 1 > OSENS_MAX_FRAME_SIZE ? size + 3 : size + 1;
+}
+
+// a complete frame, handed to the board of the bus that sent it
+static void osens_mote_ctx_frame(osens_mote_ctx_t ctx, uint8_t hdr_len)
+{
+    osens_mote_ctx_t dst = ctx;
+    uint16_t size = ctx->num_rx_bytes;
+    uint8_t addr;
+
+    if (ctx->bus)
+    {
+        // requests echoed by the line are not answers
+        addr = osens_frame_bus_addr(ctx->rx_frame, size);
+        dst = (addr & OSENS_BUS_ADDR_ANSWER) ? osens_mote_bus_find(ctx->bus, addr & OSENS_BUS_ADDR_MAX) : 0;
+
+        if (dst == 0)
+        {
+            ctx->bus->unknown_frames++;
+            return;
+        }
+
+        if (dst != ctx)
+        {
+            memcpy(dst->rx_frame, ctx->rx_frame, size);
+            dst->num_rx_bytes = size;
+        }
+    }
+
+    // counted on arrival, like the transport counts bytes
+    size = osens_mote_unaddressed_size(dst->rx_frame, size);
+    dst->link.rx_frames++;
+    dst->link.rx_payload += size > OSENS_MOTE_RES_FRAMING ? size - OSENS_MOTE_RES_FRAMING - OSENS_MOTE_EXT_FRAMING(size) : 0;
+
+    // pushed samples do not answer any request
+    if (dst->rx_frame[hdr_len] == OSENS_REGMAP_STREAM_DATA)
+        osens_mote_stream_rx(dst);
+    else
+        osens_mote_rx_slot_push(dst);
+
+    // only the reader assembles frames
+    if (dst != ctx)
+        dst->num_rx_bytes = 0;
+}
+
+// bytes at the start of rx_frame that are not a frame
+static void osens_mote_ctx_rx_skip(osens_mote_ctx_t ctx, uint16_t num)
+{
+    ctx->num_rx_bytes -= num;
+    memmove(ctx->rx_frame, &ctx->rx_frame[num], ctx->num_rx_bytes);
+    ctx->link.rx_skipped += num;
+}
+
+// a complete frame at the start of rx_frame, the bytes after it are kept
+static void osens_mote_ctx_rx_frame(osens_mote_ctx_t ctx, uint16_t size)
+{
+    uint16_t rest = ctx->num_rx_bytes - size;
+    uint16_t frame_size;
+    uint8_t roots;
+    uint8_t hdr_len;
+
+    ctx->num_rx_bytes = size;
+
+    // protected frames are corrected and handled like plain ones
+    if (ctx->rx_frame[0] == OSENS_FRAME_FEC)
+        ctx->num_rx_bytes = osens_fec_decode(ctx->rx_frame, size, &roots, &ctx->link.fec);
+
+    // the CRC is checked when unpacking, a frame too short for it is dropped here
+    hdr_len = osens_frame_size(ctx->rx_frame, ctx->num_rx_bytes, &frame_size);
+    if ((hdr_len > 0) && (frame_size >= hdr_len + 2) && ((uint32_t) frame_size + 2 == ctx->num_rx_bytes))
+        osens_mote_ctx_frame(ctx, hdr_len);
+
+    memmove(ctx->rx_frame, &ctx->rx_frame[size], rest);
+    ctx->num_rx_bytes = rest;
+}
+
+// like osens_frame_check(), protected frames included once negotiated (always on a bus)
+static uint8_t osens_mote_ctx_rx_check(osens_mote_ctx_t ctx, uint16_t pos, uint16_t *size)
+{
+    const uint8_t *frame = &ctx->rx_frame[pos];
+    uint16_t len = ctx->num_rx_bytes - pos;
+
+    if ((frame[0] == OSENS_FRAME_FEC) && (ctx->bus || (ctx->features & OSENS_FEATURE_FEC)))
+    {
+        if (osens_fec_frame_size(frame, len, size) == 0)
+            return OSENS_FRAME_INCOMPLETE;
+        if ((*size == 0) || (*size > OSENS_MOTE_FRAME_SIZE))
+            return OSENS_FRAME_INVALID;
+        return len >= *size ? OSENS_FRAME_VALID : OSENS_FRAME_INCOMPLETE;
+    }
+
+    return osens_frame_check(frame, len, OSENS_MOTE_RX_KINDS(ctx), OSENS_MOTE_FRAME_SIZE, size);
+}
+
+// offset of a plain frame ending with the last byte received, 0 if there is none
+static uint16_t osens_mote_ctx_rx_find_end(osens_mote_ctx_t ctx, uint16_t *size)
+{
+    uint16_t pos;
+    uint16_t len;
+
+    // the CRC is only computed for candidates of the right length
+    for (pos = 1; pos < ctx->num_rx_bytes; pos++)
+    {
+        len = ctx->num_rx_bytes - pos;
+        if ((osens_frame_size(&ctx->rx_frame[pos], len, size) > 0) && ((uint32_t) *size + 2 == len) &&
+            (osens_mote_ctx_rx_check(ctx, pos, size) == OSENS_FRAME_VALID))
+            return pos;
+    }
+
+    return 0;
+}
+
+// a frame may have started after the first byte, complete or not
+static uint8_t osens_mote_ctx_rx_pending(osens_mote_ctx_t ctx)
+{
+    uint16_t size;
+    uint16_t pos;
+    uint8_t ret;
+
+    for (pos = 1; pos < ctx->num_rx_bytes; pos++)
+    {
+        ret = osens_mote_ctx_rx_check(ctx, pos, &size);
+        if ((ret == OSENS_FRAME_INCOMPLETE) || (ret == OSENS_FRAME_VALID))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+    Frames are looked for byte by byte, so garbage on the line costs the bytes
+    it spans instead of a timeout: a byte that can not start a frame is
+    skipped, and a valid frame ending behind a plausible but incomplete one is
+    taken at once. A complete frame with a bad CRC is handed over (the state
+    machine counts the CRC error) unless a frame may have started inside it.
+*/
+static void osens_mote_ctx_parse(osens_mote_ctx_t ctx)
+{
+    uint16_t size;
+    uint16_t pos;
+    uint8_t ret;
+
+    while (ctx->rx_tail != ctx->rx_head)
+    {
+        ctx->rx_frame[ctx->num_rx_bytes++] = ctx->rx_ring[ctx->rx_tail & (OSENS_MOTE_RX_RING_SIZE - 1)];
+        ctx->rx_tail++;
+
+        while (ctx->num_rx_bytes > 0)
+        {
+            ret = osens_mote_ctx_rx_check(ctx, 0, &size);
+
+            // protected frames hold a plain frame, it is not taken for one ending early
+            if (ret == OSENS_FRAME_INCOMPLETE)
+            {
+                if ((ctx->rx_frame[0] == OSENS_FRAME_FEC) || ((pos = osens_mote_ctx_rx_find_end(ctx, &size)) == 0))
+                    break;
+
+                osens_mote_ctx_rx_skip(ctx, pos);
+                ret = OSENS_FRAME_VALID;
+            }
+            else if ((ret == OSENS_FRAME_BAD_CRC) && !osens_mote_ctx_rx_pending(ctx))
+            {
+                ret = OSENS_FRAME_VALID;
+            }
+
+            if (ret == OSENS_FRAME_VALID)
+                osens_mote_ctx_rx_frame(ctx, size);
+            else
+                osens_mote_ctx_rx_skip(ctx, 1);
+        }
+    }
+}
+
+int osens_mote_ctx_rx(osens_mote_ctx_t ctx)
+{
+    uint32_t pos;
+    uint32_t space;
+    int num_bytes = 0;
+    int n;
+
+    // a partial frame followed by silence will never complete
+    if ((ctx->num_rx_bytes > 0) && ((os_kernel_get_time_us() - ctx->rx_last_us) > OSENS_MOTE_RX_GAP_MS * 1000))
+        ctx->num_rx_bytes = 0;
+
+    // bulk reads of whatever is available, at most one ring per call so other boards are not starved
+    do
+    {
+        pos = ctx->rx_head & (OSENS_MOTE_RX_RING_SIZE - 1);
+        space = OSENS_MOTE_RX_RING_SIZE - pos;
+        n = os_transport_recv(ctx->transport, &ctx->rx_ring[pos], (int) space);
+
+        if (n > 0)
+        {
+            ctx->rx_head += n;
+            num_bytes += n;
+            osens_mote_ctx_parse(ctx);
+        }
+    } while ((n == (int) space) && (num_bytes < OSENS_MOTE_RX_RING_SIZE));
+
+    if (num_bytes > 0)
+    {
+        ctx->rx_last_us = os_kernel_get_time_us();
+        if (ctx->bus)
+            ctx->bus->rx_last_us = ctx->rx_last_us;
+    }
+
+    if ((n < 0) && (num_bytes == 0))
+        return -1;
+
+    return num_bytes;
+}
+
+void* osens_mote_rx_serial(void *p)
+{
+    osens_mote_ctx_t ctx = (osens_mote_ctx_t) p;
+
+    while (1)
+    {
+        // block until the transport has data, then read all of it
+        if ((os_transport_wait_readable(ctx->transport, OS_INFINTE_TMROUT) != OS_SUCCESS) ||
+            (osens_mote_ctx_rx(ctx) < 0))
+        {
+            os_kernel_sleep(OSENS_MOTE_RX_ERROR_MS);
+        }
+    }
+}
+
+osens_mote_ctx_t osens_mote_ctx_create(uint8_t id, os_serial_options_t options)
+{
+    os_transport_t transport;
+
+    transport = os_transport_serial_open(options);
+    if (transport == 0)
+        return 0;
+
+    return osens_mote_ctx_create_transport(id, transport);
+}
+
+// boards start at the rate the transport was opened with
+static uint8_t osens_mote_link_rate_of(os_transport_t transport)
+{
+    os_transport_stats_t ts;
+    uint8_t rate;
+
+    os_transport_get_stats(transport, &ts);
+
+    for (rate = 0; rate < OSENS_LINK_NUM_RATES; rate++)
+    {
+        if (osens_link_rate_to_bps(rate) == ts.bps)
+            return rate;
+    }
+
+    return OSENS_LINK_RATE_DEFAULT;
+}
+
+osens_mote_ctx_t osens_mote_ctx_create_transport(uint8_t id, os_transport_t transport)
+{
+    osens_mote_ctx_t ctx;
+
+    OS_UTIL_ASSERT(transport);
+
+    ctx = (osens_mote_ctx_t) calloc(1, sizeof(struct osens_mote_ctx_s));
+    OS_UTIL_ASSERT(ctx);
+
+    ctx->transport = transport;
+    ctx->id = id;
+    ctx->sm_state.state = OSENS_STATE_INIT;
+    ctx->tick_counter = 0;
+    ctx->link.start_us = os_kernel_get_time_us();
+    ctx->link_rates = OSENS_MOTE_LINK_RATES_ALL;
+    ctx->link_base_rate = osens_mote_link_rate_of(transport);
+    ctx->link_rate = ctx->link_base_rate;
+    ctx->features_local = OSENS_FEATURES_ALL;
+
+    return ctx;
+}
+
+static void osens_mote_ctx_free(osens_mote_ctx_t ctx)
+{
+    uint8_t n;
+
+    for (n = 0; n < OSENS_MAX_POINTS; n++)
+        free(ctx->point_arrays[n]);
+    free(ctx);
+}
+
+void osens_mote_ctx_destroy(osens_mote_ctx_t ctx)
+{
+    OS_UTIL_ASSERT(ctx);
+    OS_UTIL_ASSERT(ctx->bus == 0);
+
+    os_transport_close(ctx->transport);
+    osens_mote_ctx_free(ctx);
+}
+
+void osens_mote_ctx_start(osens_mote_ctx_t ctx)
+{
+    OS_UTIL_ASSERT(ctx);
+    OS_UTIL_ASSERT(ctx->bus == 0);
+
+    ctx->sm_thread = os_kernel_create(osens_mote_tick, "SM_THREAD", (os_thread_arg) ctx, os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    ctx->rx_thread = os_kernel_create(osens_mote_rx_serial, "RX_THREAD", (os_thread_arg) ctx, os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+}
+
+uint8_t osens_mote_ctx_get_id(osens_mote_ctx_t ctx)
+{
+    return ctx->id;
+}
+
+void osens_mote_ctx_set_link_rates(osens_mote_ctx_t ctx, uint16_t rates)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    ctx->link_rates = rates;
+    ctx->link_bad_rates = 0;
+}
+
+void osens_mote_ctx_set_features(osens_mote_ctx_t ctx, uint32_t features)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    ctx->features_local = features & OSENS_FEATURES_ALL;
+    if (ctx->bus)
+        ctx->features_local &= ~OSENS_FEATURES_NOT_ON_BUS;
+}
+
+uint8_t osens_mote_ctx_set_fec(osens_mote_ctx_t ctx, uint8_t roots)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    if ((roots & 1) || (roots > OSENS_FEC_MAX_ROOTS))
+        return 0;
+
+    ctx->fec_roots = roots;
+
+    return 1;
+}
+
+uint32_t osens_mote_get_features(osens_mote_ctx_t ctx)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    return ctx->features;
+}
+
+static osens_mote_ctx_t osens_mote_bus_find(osens_mote_bus_t bus, uint8_t addr)
+{
+    uint8_t n;
+
+    for (n = 0; n < bus->num_boards; n++)
+    {
+        if (bus->boards[n]->bus_addr == addr)
+            return bus->boards[n];
+    }
+
+    return 0;
+}
+
+// the state sends a request, the next one waits for its answer
+static uint8_t osens_mote_state_sends(uint8_t state)
+{
+    return osens_mote_sm_table[osens_mote_sm_table[state].next_state].func == osens_mote_sm_func_wait_ans;
+}
+
+/*
+    One transaction at a time: a board about to send a request is held while
+    another one waits for its answer. The board served first moves past the
+    last owner on each release, so every board gets its turn (round robin).
+*/
+void osens_mote_bus_sm(osens_mote_bus_t bus)
+{
+    uint8_t first = bus->next;
+    uint8_t k, n;
+    osens_mote_ctx_t ctx;
+
+    for (k = 0; k < bus->num_boards; k++)
+    {
+        n = (uint8_t) ((first + k) % bus->num_boards);
+        ctx = bus->boards[n];
+
+        if ((bus->owner != n) && osens_mote_state_sends(ctx->sm_state.state))
+        {
+            // every board must see the silence that ends the last frame
+            if ((bus->owner != OSENS_MOTE_BUS_IDLE) ||
+                ((os_kernel_get_time_us() - bus->rx_last_us) < OSENS_MOTE_BUS_GAP_MS * 1000))
+            {
+                bus->holds++;
+                continue;
+            }
+
+            bus->owner = n;
+            bus->grants++;
+        }
+
+        osens_mote_ctx_sm(ctx);
+
+        // answered, timed out or nothing sent
+        if ((bus->owner == n) && (osens_mote_sm_table[ctx->sm_state.state].func != osens_mote_sm_func_wait_ans))
+        {
+            bus->owner = OSENS_MOTE_BUS_IDLE;
+            bus->next = (uint8_t) ((n + 1) % bus->num_boards);
+        }
+    }
+}
+
+int osens_mote_bus_rx(osens_mote_bus_t bus)
+{
+    OS_UTIL_ASSERT(bus);
+    OS_UTIL_ASSERT(bus->num_boards > 0);
+
+    return osens_mote_ctx_rx(bus->boards[0]);
+}
+
+static void* osens_mote_bus_tick(void *param)
+{
+    osens_mote_bus_t bus = (osens_mote_bus_t) param;
+
+    while (1)
+    {
+        osens_mote_bus_sm(bus);
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    }
+
+    return 0;
+}
+
+osens_mote_bus_t osens_mote_bus_create(os_transport_t transport)
+{
+    osens_mote_bus_t bus;
+
+    OS_UTIL_ASSERT(transport);
+
+    bus = (osens_mote_bus_t) calloc(1, sizeof(struct osens_mote_bus_s));
+    OS_UTIL_ASSERT(bus);
+
+    bus->transport = transport;
+    bus->owner = OSENS_MOTE_BUS_IDLE;
+
+    return bus;
+}
+
+osens_mote_ctx_t osens_mote_bus_add(osens_mote_bus_t bus, uint8_t id, uint8_t addr)
+{
+    osens_mote_ctx_t ctx;
+
+    OS_UTIL_ASSERT(bus);
+    OS_UTIL_ASSERT(bus->sm_thread == 0);
+
+    if ((bus->num_boards >= OSENS_MOTE_BUS_MAX_BOARDS) || (addr == OSENS_BUS_ADDR_NONE) ||
+        (addr > OSENS_BUS_ADDR_MAX) || osens_mote_bus_find(bus, addr))
+        return 0;
+
+    ctx = osens_mote_ctx_create_transport(id, bus->transport);
+    ctx->bus = bus;
+    ctx->bus_addr = addr;
+    ctx->features_local &= ~OSENS_FEATURES_NOT_ON_BUS;
+    bus->boards[bus->num_boards++] = ctx;
+
+    return ctx;
+}
+
+void osens_mote_bus_destroy(osens_mote_bus_t bus)
+{
+    uint8_t n;
+
+    OS_UTIL_ASSERT(bus);
+
+    for (n = 0; n < bus->num_boards; n++)
+        osens_mote_ctx_free(bus->boards[n]);
+
+    os_transport_close(bus->transport);
+    free(bus);
+}
+
+void osens_mote_bus_start(osens_mote_bus_t bus)
+{
+    OS_UTIL_ASSERT(bus);
+    OS_UTIL_ASSERT(bus->num_boards > 0);
+
+    bus->sm_thread = os_kernel_create(osens_mote_bus_tick, "BUS_SM", (os_thread_arg) bus, os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    bus->rx_thread = os_kernel_create(osens_mote_rx_serial, "BUS_RX", (os_thread_arg) bus->boards[0], os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+}
+
+void osens_mote_bus_get_stats(osens_mote_bus_t bus, osens_mote_bus_stats_t *stats)
+{
+    OS_UTIL_ASSERT(bus);
+
+    stats->num_boards = bus->num_boards;
+    stats->grants = bus->grants;
+    stats->holds = bus->holds;
+    stats->unknown_frames = bus->unknown_frames;
+}
+
+uint8_t osens_mote_init_v2(void)
+{
+    os_serial_options_t serial_options = { OS_SERIAL_BR_115200, OS_SERIAL_PR_NONE, OS_SERIAL_PB_1, 27 };
+
+    mote_ctx = osens_mote_ctx_create(0, serial_options);
+    OS_UTIL_ASSERT(mote_ctx);
+
+    osens_mote_ctx_start(mote_ctx);
+
+    while (1)
+    {
+        os_kernel_sleep(100);
+    };
+    return 0;
+}
+
+
+static uint8_t osens_mote_pack_send_frame(osens_mote_ctx_t ctx, osens_cmd_req_t *cmd, uint16_t cmd_size)
+{
+    uint16_t size;
+
+    cmd->hdr.bus = ctx->bus_addr;
+    size = osens_pack_cmd_req(cmd, ctx->tx_frame);
+
+    if ((osens_mote_unaddressed_size(ctx->tx_frame, size) != cmd_size) || (osens_mote_wire_size(ctx, size) > ctx->frame_max))
+        return OSENS_STATE_EXEC_ERROR;
+
+    osens_mote_rx_slot_drain(ctx);
+
+    if (osens_mote_send_frame(ctx, ctx->tx_frame, size) != size)
+        return OSENS_STATE_EXEC_ERROR;
+
+    ctx->tx_us = os_kernel_get_time_us();
+    osens_stats_request(ctx->id, cmd->hdr.addr, ctx->sm_state.retries > 1);
+
+    ctx->link.tx_frames++;
+    ctx->link.tx_payload += cmd_size - OSENS_MOTE_REQ_FRAMING - OSENS_MOTE_EXT_FRAMING(cmd_size);
+
+    // bus idle since the last response
+    if (ctx->link.gap_pending)
+    {
+        uint32_t gap = (uint32_t) (ctx->tx_us - ctx->ans_us);
+
+        ctx->link.gap_pending = 0;
+        ctx->link.gaps++;
+        ctx->link.gap_sum_us += gap;
+        if (gap > ctx->link.gap_max_us)
+            ctx->link.gap_max_us = gap;
+    }
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+// unpacks the answer of the last request and counts it
+static uint16_t osens_mote_unpack_ans(osens_mote_ctx_t ctx, uint16_t ans_size)
+{
+    uint16_t size;
+    uint8_t valid;
+
+    // bounded by the received frame, ans_size is the expected one
+    size = osens_unpack_cmd_res(&ctx->ans, ctx->ans_frame, ctx->ans_size);
+    size = osens_mote_unaddressed_size(ctx->ans_frame, size);
+
+    // answers with error status are valid, they are counted by status
+    valid = (ctx->ans.hdr.status != OSENS_ANS_OK) || ((size == ans_size) && (ctx->ans.hdr.addr == ctx->cmd.hdr.addr));
+    osens_stats_response(ctx->id, ctx->cmd.hdr.addr, ctx->ans.hdr.status, valid, (uint32_t) (ctx->ans_us - ctx->tx_us));
+
+    // a negotiated rate the wire can not carry, see osens_mote_ctx_sm()
+    if (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR)
+        ctx->link_crc_errors = 0;
+    else if ((++ctx->link_crc_errors >= OSENS_MOTE_LINK_MAX_CRC_ERRORS) && (ctx->link_rate != ctx->link_base_rate))
+        ctx->link_fallback = 1;
+
+    return size;
+}
+
+// reads of a point are due every sampling period, the first read sets the phase
+static void osens_mote_point_sampled(osens_mote_ctx_t ctx, uint8_t point)
+{
+    osens_mote_point_timing_t *timing = &ctx->timing[point];
+    uint64_t period_us = (uint64_t) ctx->sensor_points.points[point].desc.sampling_time_x250ms * 250000;
+    uint64_t now = ctx->ans_us;
+    uint32_t misses = 0;
+    uint32_t lateness = 0;
+
+    if (timing->stats.samples == 0)
+        timing->due_us = now;
+
+    // a read is missed when the next one is already due
+    while (now >= timing->due_us + period_us)
+    {
+        timing->due_us += period_us;
+        misses++;
+    }
+
+    if (now > timing->due_us)
+        lateness = (uint32_t) (now - timing->due_us);
+
+    osens_stats_point_sample(&timing->stats, (uint32_t) (now - timing->last_us), lateness, misses);
+
+    timing->due_us += period_us;
+    timing->last_us = now;
+}
+
+// stamped values were sampled base_ms - age_ms in the sensor clock, others when the answer arrived
+static void osens_mote_point_time(osens_mote_ctx_t ctx, uint8_t point)
+{
+    osens_mote_clock_t *clock = &ctx->clock;
+    const osens_sample_time_t *time = &ctx->ans.time;
+    uint32_t sample_ms;
+    int32_t before_ms;
+
+    if (time->valid && clock->synced)
+    {
+        // relative to the answer reception, the millisecond clocks wrap around
+        sample_ms = time->base_ms - time->age_ms - (uint32_t) clock->offset_ms;
+        before_ms = (int32_t) ((uint32_t) (ctx->ans_us / 1000) - sample_ms);
+        ctx->point_time_us[point] = ctx->ans_us - (int64_t) before_ms * 1000;
+        ctx->point_stamped[point] = 1;
+    }
+    else
+    {
+        ctx->point_time_us[point] = ctx->ans_us;
+        ctx->point_stamped[point] = 0;
+    }
+}
+
+// array elements are copied from the answer frame to the block spans do not point to
+static uint8_t osens_mote_save_array(osens_mote_ctx_t ctx, uint8_t point)
+{
+    osens_point_t *value = &ctx->sensor_points.points[point].value;
+    const osens_point_t *ans = &ctx->ans.payload.point_value_cmd;
+    uint32_t seq = ctx->point_array_seq[point] + 1;
+    uint8_t *block;
+
+    // the elements fit in the answer frame, so in blocks of the same size
+    if ((ctx->point_arrays[point] == 0) &&
+        ((ctx->point_arrays[point] = calloc(2, OSENS_MOTE_FRAME_SIZE)) == 0))
+        return 0;
+
+    block = (uint8_t *) ctx->point_arrays[point] + (seq & 1) * OSENS_MOTE_FRAME_SIZE;
+    if (osens_array_elem_size(ans->type) == 2)
+        buf_io_get16_fl_n(block, (uint8_t *) ans->value.array.data, ans->value.array.count);
+    else
+        buf_io_get32_fl_n(block, (uint8_t *) ans->value.array.data, ans->value.array.count);
+
+    ctx->point_array_count[point][seq & 1] = ans->value.array.count;
+    value->value.array.data = block;
+    value->value.array.count = ans->value.array.count;
+    OS_ATOMIC_STORE_REL(&ctx->point_array_seq[point], seq);
+
+    return 1;
+}
+
+static uint8_t osens_mote_aggregate_ans(osens_mote_ctx_t ctx, uint8_t point)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint16_t ans_size = OSENS_MOTE_RES_FRAMING + OSENS_MOTE_AGGR_SIZE;
+    uint16_t size;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // not supported, the point value is read from now on
+    if ((ctx->ans.hdr.addr == OSENS_REGMAP_AGGREGATE) &&
+        (ctx->ans.hdr.status != OSENS_ANS_OK) && (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR))
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Aggregates of point %u (board %u) refused, reading its value\n", point, ctx->id));
+        ctx->aggregate[point] = 0;
+        st->retries = 0;
+        return OSENS_STATE_EXEC_OK;
+    }
+
+    // retry ?
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_AGGREGATE) ||
+        (ctx->ans.payload.aggregate_cmd.index != point))
+        return OSENS_STATE_EXEC_OK;
+
+    ctx->aggregates[point] = ctx->ans.payload.aggregate_cmd;
+    ctx->aggregate[point] |= OSENS_MOTE_AGGR_READ;
+    osens_mote_point_sampled(ctx, point);
+
+    st->retries = 0;
+    st->point_index++;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_pt_val_ans(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint8_t point;
+    uint8_t type;
+    uint16_t size;
+    uint16_t ans_size;
+
+    point = ctx->schedule.scan.index[st->point_index];
+    type = ctx->sensor_points.points[point].desc.type;
+
+    if (ctx->cmd.hdr.addr == OSENS_REGMAP_AGGREGATE)
+        return osens_mote_aggregate_ans(ctx, point);
+
+    // arrays have a variable length, checked against the frame when unpacking
+    if (osens_array_elem_size(type))
+        ans_size = osens_mote_unaddressed_size(ctx->ans_frame, ctx->ans_size);
+    else if (osens_point_value_size(type))
+        ans_size = 6 + osens_point_value_size(type) + (ctx->clock.stamping ? OSENS_SAMPLE_TIME_SIZE : 0);
+    else
+    {
+        // unknown type, not scheduled (defensive)
+        st->retries = 0;
+        st->point_index++;
+        return OSENS_STATE_EXEC_OK;
+    }
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // retry ?
+    if (size != ans_size || ctx->ans.hdr.addr != (OSENS_REGMAP_READ_POINT_DATA_1 + point) ||
+        ctx->ans.payload.point_value_cmd.type != type)
+        return OSENS_STATE_EXEC_OK;
+
+    // ok, save and go to the next
+    if (osens_array_elem_size(type))
+        osens_mote_save_array(ctx, point);
+    else
+        memcpy(&ctx->sensor_points.points[point].value, &ctx->ans.payload.point_value_cmd, sizeof(osens_point_t));
+    osens_mote_point_sampled(ctx, point);
+    osens_mote_point_time(ctx, point);
+
+    st->retries = 0;
+    st->point_index++;
+
+#if TRACE_ON == 1
+    osens_mote_show_values(ctx);
+#endif
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_pt_val(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint8_t point;
+
+    // end of point reading
+    if (st->point_index >= ctx->schedule.scan.num_of_points)
+    {
+        uint64_t now = os_kernel_get_time_us();
+        uint32_t scan_us = (uint32_t) (now - ctx->scan_start_us);
+
+        // the end of the scan is only seen on the tick after the last answer
+        if (scan_us > (uint64_t) ctx->scan_min_period_us + OSENS_SM_TICK_MS * 1000)
+        {
+            osens_stats_scan_overrun(ctx->id);
+            ctx->scan_overruns++;
+
+            if ((ctx->scan_log_us == 0) || (now - ctx->scan_log_us >= (uint64_t) OSENS_MOTE_SCAN_LOG_MS * 1000))
+            {
+                OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Scan overrun (board %u): %u points in %u ms, shortest period %u ms (%u overruns)\n",
+                    ctx->id, ctx->schedule.scan.num_of_points, scan_us / 1000, ctx->scan_min_period_us / 1000, ctx->scan_overruns));
+                ctx->scan_overruns = 0;
+                ctx->scan_log_us = now;
+            }
+        }
+
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+    point = ctx->schedule.scan.index[st->point_index];
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+
+    if (ctx->aggregate[point] & OSENS_MOTE_AGGR_ON)
+    {
+        ctx->cmd.hdr.addr = OSENS_REGMAP_AGGREGATE;
+        ctx->cmd.payload.aggregate_cmd.index = point;
+        return osens_mote_pack_send_frame(ctx, &ctx->cmd, OSENS_MOTE_REQ_FRAMING + 1);
+    }
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1 + point;
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+
+}
+
+static uint8_t osens_mote_sm_func_proc_stream(osens_mote_ctx_t ctx)
+{
+    osens_mote_stream_t *s = &ctx->stream;
+    uint16_t size;
+    uint16_t ans_size = 5;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // refused, not requested again until the application does
+    if ((ctx->ans.hdr.addr == OSENS_REGMAP_STREAM) &&
+        (ctx->ans.hdr.status != OSENS_ANS_OK) && (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR))
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Stream (board %u): points %08X every %u ms refused\n",
+            ctx->id, ctx->cmd.payload.stream_cmd.mask, ctx->cmd.payload.stream_cmd.period_ms));
+        OS_ATOMIC_STORE_REL(&s->active, 0);
+        if (OS_ATOMIC_LOAD_ACQ(&s->app_seq) == s->req_seq)
+            OS_ATOMIC_STORE_REL(&s->pending, 0);
+        return OSENS_STATE_EXEC_OK;
+    }
+
+    // retry ?
+    if (size != ans_size || ctx->ans.hdr.addr != OSENS_REGMAP_STREAM)
+        return OSENS_STATE_EXEC_OK;
+
+    OS_ATOMIC_STORE_REL(&s->accepted, s->cfg.mask != 0);
+
+    // a newer request may have arrived in the meantime
+    if (OS_ATOMIC_LOAD_ACQ(&s->app_seq) == s->req_seq)
+        OS_ATOMIC_STORE_REL(&s->pending, 0);
+
+    ctx->sm_state.retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_stream(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    osens_mote_stream_t *s = &ctx->stream;
+    osens_mote_stream_func_t func;
+    void *arg;
+    uint8_t type;
+    uint8_t size;
+    uint8_t n;
+
+    if (!OS_ATOMIC_LOAD_ACQ(&s->pending))
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+    // one consistent request, the application may change it meanwhile
+    do
+    {
+        s->req_seq = os_atomic_seq_read_begin(&s->app_seq);
+        s->req = s->app_req;
+        func = s->app_func;
+        arg = s->app_arg;
+    } while (os_atomic_seq_read_retry(&s->app_seq, s->req_seq));
+
+    // the sensor may push samples before its answer is processed, so they
+    // are decoded with the requested point list from now on
+    OS_ATOMIC_STORE_REL(&s->active, 0);
+    OS_ATOMIC_STORE_REL(&s->accepted, 0);
+    os_atomic_seq_write_begin(&s->cfg_seq);
+    s->cfg.func = func;
+    s->cfg.arg = arg;
+    s->cfg.mask = s->req.mask;
+    s->cfg.num_values = 0;
+    s->cfg.sample_size = 0;
+    for (n = 0; n < OSENS_MAX_POINTS; n++)
+    {
+        if ((s->cfg.mask & (1UL << n)) == 0)
+            continue;
+
+        // types may have changed on rediscovery, points without a fixed size are not requested
+        type = ctx->sensor_points.points[n].desc.type;
+        size = osens_point_value_size(type);
+        if (size == 0)
+        {
+            s->cfg.mask &= ~(1UL << n);
+            continue;
+        }
+
+        s->cfg.types[s->cfg.num_values++] = type;
+        s->cfg.sample_size += size;
+    }
+    os_atomic_seq_write_end(&s->cfg_seq);
+    OS_ATOMIC_STORE_REL(&s->active, s->cfg.mask != 0);
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_STREAM;
+    ctx->cmd.payload.stream_cmd = s->req;
+    ctx->cmd.payload.stream_cmd.mask = s->cfg.mask;
+
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 11);
+}
+
+static uint8_t osens_mote_sm_func_proc_time_sync(osens_mote_ctx_t ctx)
+{
+    osens_mote_clock_t *clock = &ctx->clock;
+    const osens_time_sync_t *sync = &ctx->ans.payload.time_sync_cmd;
+    uint16_t ans_size = OSENS_MOTE_RES_FRAMING + OSENS_MOTE_TIME_SYNC_RES_SIZE;
+    uint16_t size;
+    uint32_t tx_ms;
+    uint32_t rx_ms;
+    int64_t delay_us;
+    uint8_t best;
+    uint8_t n;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // boards without the register (probed) keep the reception time of their values
+    if ((ctx->ans.hdr.addr == OSENS_REGMAP_TIME_SYNC) &&
+        (ctx->ans.hdr.status != OSENS_ANS_OK) && (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR))
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Board %u: time sync refused, values are not stamped\n", ctx->id));
+        ctx->features &= ~OSENS_FEATURE_TIMESTAMPS;
+        clock->pending = 0;
+        return OSENS_STATE_EXEC_OK;
+    }
+
+    // retry ?
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_TIME_SYNC) ||
+        (sync->mote_ms != ctx->cmd.payload.time_sync_cmd.mote_ms))
+        return OSENS_STATE_EXEC_OK;
+
+    // request sent at tx_ms and answer received at rx_ms, in the mote clock
+    tx_ms = (uint32_t) (ctx->tx_us / 1000);
+    rx_ms = (uint32_t) (ctx->ans_us / 1000);
+    delay_us = (int64_t) (ctx->ans_us - ctx->tx_us) - (int64_t) (uint32_t) (sync->tx_ms - sync->rx_ms) * 1000;
+
+    n = clock->next_sample;
+    clock->samples[n].offset_ms = ((int32_t) (sync->rx_ms - tx_ms) + (int32_t) (sync->tx_ms - rx_ms)) / 2;
+    clock->samples[n].delay_us = delay_us > 0 ? (uint32_t) delay_us : 0;
+    clock->next_sample = (n + 1) % OSENS_MOTE_TIME_SYNC_SAMPLES;
+    if (clock->num_samples < OSENS_MOTE_TIME_SYNC_SAMPLES)
+        clock->num_samples++;
+
+    // queueing only makes round trips longer, the shortest one is the most accurate
+    for (n = 1, best = 0; n < clock->num_samples; n++)
+    {
+        if (clock->samples[n].delay_us < clock->samples[best].delay_us)
+            best = n;
+    }
+
+    clock->offset_ms = clock->samples[best].offset_ms;
+    clock->delay_us = clock->samples[best].delay_us;
+    clock->syncs++;
+    clock->synced = 1;
+    clock->stamping = (sync->flags & OSENS_TIME_SYNC_STAMP) != 0;
+    clock->pending = 0;
+    clock->next_us = ctx->ans_us + (uint64_t) OSENS_MOTE_TIME_SYNC_MS * 1000;
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("Board %u: clock offset %d ms, round trip %u us\n", ctx->id,
+        clock->offset_ms, clock->delay_us));
+
+    ctx->sm_state.retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_time_sync(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    if (!ctx->clock.pending)
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_TIME_SYNC;
+    ctx->cmd.payload.time_sync_cmd.mote_ms = (uint32_t) (os_kernel_get_time_us() / 1000);
+    ctx->cmd.payload.time_sync_cmd.flags = OSENS_TIME_SYNC_STAMP;
+
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, OSENS_MOTE_REQ_FRAMING + OSENS_MOTE_TIME_SYNC_REQ_SIZE);
+}
+
+// pending writes from the queue head, as many as the negotiated frame size allows
+static uint16_t osens_mote_build_write_block(osens_mote_ctx_t ctx)
+{
+    osens_write_block_t *blk = &ctx->cmd.payload.write_block_cmd;
+    uint8_t c = ctx->schedule.write.cons;
+    uint8_t p = ctx->schedule.write.prod;
+    uint16_t size = OSENS_MOTE_REQ_FRAMING + 1;
+    uint16_t entry;
+    uint8_t point;
+
+    blk->num_points = 0;
+    while (c != p)
+    {
+        // index, type and value
+        point = ctx->schedule.write.index[c];
+        entry = osens_point_value_size(ctx->sensor_points.points[point].desc.type);
+        if (entry == 0)
+            break;
+
+        entry += 2;
+        if (osens_mote_wire_size(ctx, size + entry + OSENS_MOTE_EXT_FRAMING(size + entry) + OSENS_MOTE_BUS_FRAMING(ctx)) > ctx->frame_max)
+            break;
+
+        blk->index[blk->num_points] = point;
+        blk->values[blk->num_points] = ctx->sensor_points.points[point].value;
+        blk->num_points++;
+        size += entry;
+        c = PC_INC_QUEUE(c, OSENS_MAX_POINTS);
+    }
+
+    return size + OSENS_MOTE_EXT_FRAMING(size);
+}
+
+static uint8_t osens_mote_proc_write_block(osens_mote_ctx_t ctx)
+{
+    const osens_write_block_t *blk = &ctx->cmd.payload.write_block_cmd;
+    const osens_write_block_t *res = &ctx->ans.payload.write_block_cmd;
+    uint16_t ans_size = 6 + blk->num_points;
+    uint16_t size;
+    uint8_t n;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // not supported, pending points are written one by one from now on
+    if ((ctx->ans.hdr.addr == OSENS_REGMAP_WRITE_BLOCK) &&
+        (ctx->ans.hdr.status != OSENS_ANS_OK) && (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR))
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Write block (board %u) refused, writing points one by one\n", ctx->id));
+        ctx->features &= ~OSENS_FEATURE_WRITE_BLOCK;
+        ctx->sm_state.retries = 0;
+        return OSENS_STATE_EXEC_OK;
+    }
+
+    // retry ?
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_WRITE_BLOCK) || (res->num_points != blk->num_points))
+        return OSENS_STATE_EXEC_OK;
+
+    // a refused point is not written again
+    for (n = 0; n < blk->num_points; n++)
+    {
+        if (res->status[n] != OSENS_ANS_OK)
+            OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Write of point %u (board %u) refused, status %u\n",
+                blk->index[n], ctx->id, res->status[n]));
+
+        ctx->schedule.write.cons = PC_INC_QUEUE(ctx->schedule.write.cons, OSENS_MAX_POINTS);
+    }
+
+    ctx->sm_state.retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_proc_wr_pt(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint8_t point;
+    uint16_t size;
+    uint16_t ans_size = 5;
+
+    if (ctx->cmd.hdr.addr == OSENS_REGMAP_WRITE_BLOCK)
+        return osens_mote_proc_write_block(ctx);
+
+    point = ctx->schedule.write.index[st->point_index];
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // retry ?
+    if (size != ans_size || ctx->ans.hdr.addr != (OSENS_REGMAP_WRITE_POINT_DATA_1 + point))
+        return OSENS_STATE_EXEC_OK;
+
+    // ok,  go to the next
+    ctx->schedule.write.cons = PC_INC_QUEUE(ctx->schedule.write.cons, OSENS_MAX_POINTS);
+    st->retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_wr_pt(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint8_t point;
+    uint8_t c = ctx->schedule.write.cons;
+    uint8_t p = ctx->schedule.write.prod;
+    uint8_t cn = PC_INC_QUEUE(c, OSENS_MAX_POINTS);
+    uint16_t size;
+
+    // points without a fixed size can not be written, they are dropped
+    while ((c != p) && (osens_point_value_size(ctx->sensor_points.points[ctx->schedule.write.index[c]].desc.type) == 0))
+        c = PC_INC_QUEUE(c, OSENS_MAX_POINTS);
+    ctx->schedule.write.cons = c;
+    cn = PC_INC_QUEUE(c, OSENS_MAX_POINTS);
+
+    // end of point writing
+    if (c == p)
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+#if TRACE_ON == 1
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("==> [%u] Consuming at position %d\n", ctx->id, c));
+#endif
+
+    st->point_index = c;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+
+    // several pending writes, one transaction
+    if ((ctx->features & OSENS_FEATURE_WRITE_BLOCK) && (cn != p))
+    {
+        ctx->cmd.hdr.addr = OSENS_REGMAP_WRITE_BLOCK;
+        size = osens_mote_build_write_block(ctx);
+        return osens_mote_pack_send_frame(ctx, &ctx->cmd, size);
+    }
+
+    point = ctx->schedule.write.index[st->point_index];
+    ctx->cmd.hdr.addr = OSENS_REGMAP_WRITE_POINT_DATA_1 + point;
+
+    size = 5 + osens_point_value_size(ctx->sensor_points.points[point].desc.type);
+    memcpy(&ctx->cmd.payload.point_value_cmd, &ctx->sensor_points.points[point].value, sizeof(osens_point_t));
+
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, size);
+}
+
+static uint8_t osens_mote_sm_func_run_sch(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    osens_acq_schedule_t *schedule = &ctx->schedule;
+    uint8_t n;
+
+    //leds_error_toggle();
+
+    if ((ctx->features & OSENS_FEATURE_TIMESTAMPS) && (os_kernel_get_time_us() >= ctx->clock.next_us))
+        ctx->clock.pending = 1;
+
+    // priorize writings, stream requests and clock synchronization over data scan/schedule execution
+    if ((schedule->write.prod != schedule->write.cons) || OS_ATOMIC_LOAD_ACQ(&ctx->stream.pending) || ctx->clock.pending)
+    {
+#if TRACE_ON == 1
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("==> [%u] New writing item to be consumed (P: %d <> C: %d)\n", ctx->id, schedule->write.prod, schedule->write.cons));
+#endif
+        st->retries = 0;
+        return OSENS_STATE_EXEC_ERROR;
+    }
+
+    schedule->scan.num_of_points = 0;
+
+    for (n = 0; n < schedule->num_of_points; n++)
+    {
+
+        if (schedule->points[n].counter > 0)
+            schedule->points[n].counter--;
+
+        if (schedule->points[n].counter == 0)
+        {
+            // n: point index in the schedule database
+            // index: point index in the points database
+            uint8_t index = schedule->points[n].index;
+
+            schedule->scan.index[schedule->scan.num_of_points] = index;
+            schedule->scan.num_of_points++;
+            // restore counter value for next cycle
+            schedule->points[n].counter = schedule->points[n].sampling_time_x250ms;
+        }
+
+    }
+
+    if (schedule->scan.num_of_points > 0)
+    {
+        st->point_index = 0;
+        st->retries = 0;
+        ctx->scan_start_us = os_kernel_get_time_us();
+
+#if TRACE_ON == 1
+        {
+            OS_UTIL_LOG(1, ("\n"));
+            OS_UTIL_LOG(1, ("Next Scan\n"));
+            OS_UTIL_LOG(1, ("=========\n"));
+            for (n = 0; n < schedule->scan.num_of_points; n++)
+            {
+                OS_UTIL_LOG(1, ("--> %u [%u]\n", n, schedule->scan.index[n]));
+            }
+        }
+#endif
+
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+    else
+        return OSENS_STATE_EXEC_WAIT_OK;
+}
+
+static uint8_t osens_mote_sm_func_build_sch(osens_mote_ctx_t ctx)
+{
+    osens_acq_schedule_t *schedule = &ctx->schedule;
+    osens_point_ctrl_t *sensor_points = &ctx->sensor_points;
+    uint8_t n, m;
+
+    schedule->num_of_points = 0;
+    ctx->scan_min_period_us = 0xFFFFFFFF;
+
+    // the sensor ends subscriptions on discovery
+    if (ctx->stream.req.mask)
+        OS_ATOMIC_STORE_REL(&ctx->stream.pending, 1);
+    memset(ctx->timing, 0, sizeof(ctx->timing));
+
+    for (n = 0, m = 0; n < ctx->board_info.num_of_points; n++)
+    {
+        // points of unknown types are not read
+        if ((sensor_points->points[n].desc.access_rights & OSENS_ACCESS_READ_ONLY) &&
+            (sensor_points->points[n].desc.sampling_time_x250ms > 0) &&
+            (osens_point_value_size(sensor_points->points[n].desc.type) || osens_array_elem_size(sensor_points->points[n].desc.type)))
+        {
+            schedule->points[m].index = n;
+            schedule->points[m].counter = sensor_points->points[n].desc.sampling_time_x250ms;
+            schedule->points[m].sampling_time_x250ms = sensor_points->points[n].desc.sampling_time_x250ms;
+
+            if (schedule->points[m].sampling_time_x250ms * 250000 < ctx->scan_min_period_us)
+                ctx->scan_min_period_us = schedule->points[m].sampling_time_x250ms * 250000;
+
+            m++;
+            schedule->num_of_points++;
+        }
+    }
+
+#if TRACE_ON == 1
+    OS_UTIL_LOG(1, ("\n"));
+    OS_UTIL_LOG(1, ("Schedule (board %u)\n", ctx->id));
+    OS_UTIL_LOG(1, ("========\n"));
+    for (n = 0; n < schedule->num_of_points; n++)
+    {
+        OS_UTIL_LOG(1, ("[%d] point %02d at %dms\n", n, schedule->points[n].index, schedule->points[n].sampling_time_x250ms * 250));
+    }
+#endif
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_pt_desc_ans(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    osens_point_ctrl_t *sensor_points = &ctx->sensor_points;
+    uint16_t size;
+    uint16_t ans_size = 20;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    if (size != ans_size || (ctx->ans.hdr.addr != OSENS_REGMAP_POINT_DESC_1 + st->point_index))
+        return OSENS_STATE_EXEC_ERROR;
+
+    // save description and type, value is not available yet
+    memcpy(&sensor_points->points[st->point_index].desc, &ctx->ans.payload.point_desc_cmd, sizeof(osens_point_desc_t));
+    sensor_points->points[st->point_index].value.type = sensor_points->points[st->point_index].desc.type;
+
+#if TRACE_ON == 1
+    {
+        uint8_t n = st->point_index;
+        OS_UTIL_LOG(1, ("\n"));
+        OS_UTIL_LOG(1, ("Point %02d info\n", n));
+        OS_UTIL_LOG(1, ("=============\n"));
+        OS_UTIL_LOG(1, ("Name     : %-8s\n", sensor_points->points[n].desc.name));
+        OS_UTIL_LOG(1, ("Type     : %d\n", sensor_points->points[n].desc.type));
+        OS_UTIL_LOG(1, ("Unit     : %d\n", sensor_points->points[n].desc.unit));
+        OS_UTIL_LOG(1, ("Rights   : %02X\n", sensor_points->points[n].desc.access_rights));
+        OS_UTIL_LOG(1, ("Sampling : %d\n\n", sensor_points->points[n].desc.sampling_time_x250ms));
+    }
+#endif
+
+    st->retries = 0;
+    st->point_index++;
+    sensor_points->num_of_points = st->point_index;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_pt_desc(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    if (st->point_index >= ctx->board_info.num_of_points)
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_POINT_DESC_1 + st->point_index;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+}
+
+static uint8_t osens_mote_sm_func_proc_frame_size(osens_mote_ctx_t ctx)
+{
+    uint16_t size;
+    uint16_t ans_size = 7;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // boards without the register keep the one byte size field
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_FRAME_SIZE))
+    {
+        ctx->features &= ~OSENS_FEATURE_EXT_FRAMES;
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+
+    // frames up to OSENS_MAX_FRAME_SIZE are always accepted, a smaller answer is bogus
+    ctx->frame_max = ctx->ans.payload.frame_size_cmd.max_size < OSENS_MOTE_FRAME_SIZE ?
+        ctx->ans.payload.frame_size_cmd.max_size : OSENS_MOTE_FRAME_SIZE;
+    if (ctx->frame_max < OSENS_MAX_FRAME_SIZE)
+        ctx->frame_max = OSENS_MAX_FRAME_SIZE;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_frame_size(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    // nothing to negotiate with small buffers
+    if ((OSENS_MOTE_FRAME_SIZE <= OSENS_MAX_FRAME_SIZE) || ((ctx->features & OSENS_FEATURE_EXT_FRAMES) == 0))
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_FRAME_SIZE;
+    ctx->cmd.payload.frame_size_cmd.max_size = OSENS_MOTE_FRAME_SIZE;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 6);
+}
+
+static uint8_t osens_mote_sm_func_proc_link_speed(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    uint32_t bps = osens_link_rate_to_bps(ctx->link_next_rate);
+    uint16_t size;
+    uint16_t ans_size = 5;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // refused, do not ask for it again
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_LINK_SPEED))
+    {
+        ctx->link_bad_rates |= 1 << ctx->link_next_rate;
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+
+    // the sensor has switched, it waits for a frame at the new rate
+    if (os_transport_set_speed(ctx->transport, bps) != OS_SUCCESS)
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Link (board %u): %u bps not supported by the port\n", ctx->id, bps));
+        ctx->link_bad_rates |= 1 << ctx->link_next_rate;
+        return OSENS_STATE_EXEC_ERROR;
+    }
+
+    ctx->link_rate = ctx->link_next_rate;
+    ctx->link_crc_errors = 0;
+    st->retries = 0;
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("Link (board %u): switched to %u bps\n", ctx->id, bps));
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_link_speed(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    // error condition after 3 retries
+    st->retries++;
+    if (st->retries > 3)
+        return OSENS_STATE_EXEC_ERROR;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_LINK_SPEED;
+    ctx->cmd.payload.link_speed_cmd.rate = ctx->link_next_rate;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 5);
+}
+
+static uint8_t osens_mote_sm_func_proc_link_rates(osens_mote_ctx_t ctx)
+{
+    uint16_t common;
+    uint16_t size;
+    uint16_t ans_size = 8;
+    int8_t rate;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // boards without the register stay at the base rate
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_LINK_RATES))
+    {
+        ctx->features &= ~OSENS_FEATURE_LINK_SPEED;
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+
+    common = ctx->ans.payload.link_rates_cmd.rates & ctx->link_rates & ~ctx->link_bad_rates;
+
+    // highest common rate
+    for (rate = OSENS_LINK_NUM_RATES - 1; rate > (int8_t) ctx->link_rate; rate--)
+    {
+        if (common & (1 << rate))
+            break;
+    }
+
+    if (rate <= (int8_t) ctx->link_rate)
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    ctx->link_next_rate = (uint8_t) rate;
+    ctx->sm_state.retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_link_rates(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    // negotiation disabled
+    if ((ctx->link_rates == 0) || ((ctx->features & OSENS_FEATURE_LINK_SPEED) == 0))
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_LINK_RATES;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+}
+
+static uint8_t osens_mote_sm_func_proc_brd_id_ans(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+    osens_brd_id_t *board_info = &ctx->board_info;
+    uint16_t size;
+    uint16_t ans_size = 28;
+
+    st->point_index = 0;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    if (size != ans_size)
+        return OSENS_STATE_EXEC_ERROR;
+
+    memcpy(board_info, &ctx->ans.payload.brd_id_cmd, sizeof(osens_brd_id_t));
+
+    if ((board_info->num_of_points == 0) || (board_info->num_of_points > OSENS_MAX_POINTS))
+        return OSENS_STATE_EXEC_ERROR;
+
+#if TRACE_ON == 1
+    OS_UTIL_LOG(1, ("\n"));
+    OS_UTIL_LOG(1, ("Board info (board %u)\n", ctx->id));
+    OS_UTIL_LOG(1, ("==========\n"));
+    OS_UTIL_LOG(1, ("Manufactor : %-8s\n", board_info->manufactor));
+    OS_UTIL_LOG(1, ("Model      : %-8s\n", board_info->model));
+    OS_UTIL_LOG(1, ("ID         : %08X\n", board_info->sensor_id));
+    OS_UTIL_LOG(1, ("HW REV     : %02X\n", board_info->hardware_revision));
+    OS_UTIL_LOG(1, ("Capabilties: %02X\n", board_info->cabalities));
+    OS_UTIL_LOG(1, ("Points     : %d\n\n", board_info->num_of_points));
+#endif
+
+    ctx->sensor_points.num_of_points = 0;
+    st->retries = 0;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_brd_id(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    ctx->cmd.hdr.size = 4;
+    ctx->cmd.hdr.addr = OSENS_REGMAP_BRD_ID;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+}
+
+
+static uint8_t osens_mote_sm_func_proc_itf_ver_ans(osens_mote_ctx_t ctx)
+{
+    uint16_t size;
+    uint16_t ans_size = 6;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // the board would answer the same on the next discovery, do not flood it
+    if ((ctx->ans.hdr.addr == OSENS_REGMAP_ITF_VERSION) &&
+        (ctx->ans.hdr.status != OSENS_ANS_OK) && (ctx->ans.hdr.status != OSENS_ANS_CRC_ERROR))
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Board %u: interface version refused (status %u), next try in %u s\n",
+            ctx->id, ctx->ans.hdr.status, OSENS_MOTE_VERSION_RETRY_MS / 1000));
+        ctx->init_backoff = MS2TICK(OSENS_MOTE_VERSION_RETRY_MS);
+        return OSENS_STATE_EXEC_ERROR;
+    }
+
+    // any version is accepted, see OSENS_LATEST_VERSION
+    if (size != ans_size)
+        return OSENS_STATE_EXEC_ERROR;
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_proc_features(osens_mote_ctx_t ctx)
+{
+    uint16_t size;
+    uint16_t ans_size = 9;
+
+    size = osens_mote_unpack_ans(ctx, ans_size);
+
+    // older boards: optional registers are probed
+    if ((size != ans_size) || (ctx->ans.hdr.addr != OSENS_REGMAP_FEATURES))
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+
+    ctx->features = ctx->features_local & ctx->ans.payload.features_cmd.features;
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("Board %u: features %04X (board %04X)\n", ctx->id,
+        ctx->features, ctx->ans.payload.features_cmd.features));
+
+    return OSENS_STATE_EXEC_OK;
+}
+
+static uint8_t osens_mote_sm_func_req_features(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_FEATURES;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+}
+
+
+static uint8_t osens_mote_sm_func_wait_ans(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    // frames are delimited by the RX thread using the size byte
+    if ((st->trmout_counter > 0) && osens_mote_rx_slot_pop(ctx))
+    {
+        OSENS_CAPTURE(ctx->id, OSENS_CAPTURE_DIR_RES, ctx->ans_frame, ctx->ans_size);
+        st->frame_arrived = 1;
+        ctx->link.gap_pending = 1;
+    }
+
+    if (st->frame_arrived)
+    {
+        st->frame_arrived = 0;
+        return OSENS_STATE_EXEC_WAIT_STOP;
+    }
+
+    st->trmout_counter++;
+
+    if (st->trmout_counter > st->trmout)
+    {
+        osens_stats_timeout(ctx->id, ctx->cmd.hdr.addr);
+        return OSENS_STATE_EXEC_WAIT_ABORT;
+    }
+
+    return OSENS_STATE_EXEC_WAIT_OK;
+}
+
+
+static uint8_t osens_mote_sm_func_req_ver(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *st = &ctx->sm_state;
+
+    ctx->cmd.hdr.addr = OSENS_REGMAP_ITF_VERSION;
+    st->trmout_counter = 0;
+    st->trmout = MS2TICK(5000);
+    return osens_mote_pack_send_frame(ctx, &ctx->cmd, 4);
+}
+
+
+static uint8_t osens_mote_sm_func_init(osens_mote_ctx_t ctx)
+{
+    uint8_t ret = OSENS_STATE_EXEC_OK;
+
+    //leds_error_on();
+
+    if (ctx->init_backoff > 0)
+    {
+        ctx->init_backoff--;
+        return OSENS_STATE_EXEC_WAIT_OK;
+    }
+
+    memset(&ctx->cmd, 0, sizeof(ctx->cmd));
+    memset(&ctx->ans, 0, sizeof(ctx->ans));
+    memset(&ctx->sensor_points, 0, sizeof(ctx->sensor_points));
+    memset(&ctx->board_info, 0, sizeof(ctx->board_info));
+    memset(&ctx->schedule, 0, sizeof(ctx->schedule));
+    memset(&ctx->sm_state, 0, sizeof(osens_mote_sm_state_t));
+
+    // discovery always starts at the base rate, the failed rate is not negotiated again
+    if (ctx->link_rate != ctx->link_base_rate)
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Link (board %u): fallback from %u to %u bps\n", ctx->id,
+            osens_link_rate_to_bps(ctx->link_rate), osens_link_rate_to_bps(ctx->link_base_rate)));
+
+        ctx->link_bad_rates |= 1 << ctx->link_rate;
+        ctx->link_rate = ctx->link_base_rate;
+        os_transport_set_speed(ctx->transport, osens_link_rate_to_bps(ctx->link_base_rate));
+    }
+
+    ctx->link_crc_errors = 0;
+    ctx->link_fallback = 0;
+    ctx->frame_max = OSENS_MAX_FRAME_SIZE;
+    // protected frames are garbage to boards without the feature, it is not probed
+    ctx->features = ctx->features_local & ~OSENS_FEATURE_FEC;
+    // the board may have restarted its clock, synchronized again before the first scan
+    memset(&ctx->clock, 0, sizeof(ctx->clock));
+    memset(ctx->point_time_us, 0, sizeof(ctx->point_time_us));
+    OS_ATOMIC_STORE_REL(&ctx->stream.active, 0);
+    OS_ATOMIC_STORE_REL(&ctx->stream.accepted, 0);
+
+    osens_mote_rx_slot_drain(ctx);
+
+    return ret;
+}
+
+void osens_mote_ctx_sm(osens_mote_ctx_t ctx)
+{
+    osens_mote_sm_state_t *sm_state = &ctx->sm_state;
+    uint8_t prev_state = sm_state->state;
+    uint8_t ret;
+
+#if TRACE_ON == 1
+    uint8_t ls = sm_state->state;
+#endif
+
+    ctx->tick_counter++;
+
+    ret = osens_mote_sm_table[sm_state->state].func(ctx);
+
+    /*
+    if (flagErrorOccurred)
+    {
+    //reset uart
+    uart1_clearTxInterrupts();
+    uart1_clearRxInterrupts();      // clear possible pending interrupts
+    uart1_enableInterrupts();       // Enable USCI_A1 TX & RX interrupt
+
+    flagErrorOccurred = 0;
+    }
+    */
+
+    switch (ret)
+    {
+    case OSENS_STATE_EXEC_OK:
+    case OSENS_STATE_EXEC_WAIT_STOP:
+        sm_state->state = osens_mote_sm_table[sm_state->state].next_state;
+        break;
+    case OSENS_STATE_EXEC_WAIT_OK:
+        // still waiting
+        break;
+    case OSENS_STATE_EXEC_WAIT_ABORT:
+        // wait timeout
+        sm_state->state = osens_mote_sm_table[sm_state->state].abort_state;
+        break;
+    case OSENS_STATE_EXEC_ERROR:
+    default:
+        sm_state->state = osens_mote_sm_table[sm_state->state].error_state;
+        break;
+    }
+
+    if (ctx->link_fallback)
+        sm_state->state = OSENS_STATE_INIT;
+
+    if ((sm_state->state == OSENS_STATE_INIT) && (prev_state != OSENS_STATE_INIT))
+        osens_stats_rediscovery(ctx->id);
+
+#if TRACE_ON == 1
+    if ((ctx->tick_counter % OSENS_MOTE_LINK_REPORT_TICKS) == 0)
+        osens_mote_show_link(ctx);
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("[SM%u]  %llu    (%02d) %-16s -> (%02d) %-16s\n", ctx->id, (unsigned long long) ctx->tick_counter, ls, sm_states_str[ls], sm_state->state, sm_states_str[sm_state->state]));
+#endif
+
+}
+
+const osens_mote_sm_table_t osens_mote_sm_table[] =
+{     //{ func,                                   next_state,                      abort_state,                error_state         }
+    { osens_mote_sm_func_init, OSENS_STATE_SEND_ITF_VER, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_INIT
+    { osens_mote_sm_func_req_ver, OSENS_STATE_WAIT_ITF_VER_ANS, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_SEND_ITF_VER
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_ITF_VER, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_ITF_VER_ANS
+    { osens_mote_sm_func_proc_itf_ver_ans, OSENS_STATE_SEND_BRD_ID, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_ITF_VER
+    { osens_mote_sm_func_req_brd_id, OSENS_STATE_WAIT_BRD_ID_ANS, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_SEND_BRD_ID
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_BRD_ID, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_BRD_ID_ANS
+    { osens_mote_sm_func_proc_brd_id_ans, OSENS_STATE_SEND_FEATURES, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_BRD_ID
+    { osens_mote_sm_func_req_features, OSENS_STATE_WAIT_FEATURES_ANS, OSENS_STATE_SEND_FRAME_SIZE, OSENS_STATE_INIT }, // OSENS_STATE_SEND_FEATURES
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_FEATURES, OSENS_STATE_SEND_FRAME_SIZE, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_FEATURES_ANS
+    { osens_mote_sm_func_proc_features, OSENS_STATE_SEND_FRAME_SIZE, OSENS_STATE_SEND_FRAME_SIZE, OSENS_STATE_INIT }, // OSENS_STATE_PROC_FEATURES
+    { osens_mote_sm_func_req_frame_size, OSENS_STATE_WAIT_FRAME_SIZE_ANS, OSENS_STATE_SEND_LINK_RATES, OSENS_STATE_INIT }, // OSENS_STATE_SEND_FRAME_SIZE
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_FRAME_SIZE, OSENS_STATE_SEND_LINK_RATES, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_FRAME_SIZE_ANS
+    { osens_mote_sm_func_proc_frame_size, OSENS_STATE_SEND_LINK_RATES, OSENS_STATE_SEND_LINK_RATES, OSENS_STATE_INIT }, // OSENS_STATE_PROC_FRAME_SIZE
+    { osens_mote_sm_func_req_link_rates, OSENS_STATE_WAIT_LINK_RATES_ANS, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_SEND_LINK_RATES
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_LINK_RATES, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_LINK_RATES_ANS
+    { osens_mote_sm_func_proc_link_rates, OSENS_STATE_SEND_LINK_SPEED, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_PROC_LINK_RATES
+    { osens_mote_sm_func_req_link_speed, OSENS_STATE_WAIT_LINK_SPEED_ANS, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_SEND_LINK_SPEED
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_LINK_SPEED, OSENS_STATE_SEND_LINK_SPEED, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_LINK_SPEED_ANS
+    { osens_mote_sm_func_proc_link_speed, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_PROC_LINK_SPEED
+    { osens_mote_sm_func_req_pt_desc, OSENS_STATE_WAIT_PT_DESC_ANS, OSENS_STATE_BUILD_SCH, OSENS_STATE_INIT }, // OSENS_STATE_SEND_PT_DESC
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_PT_DESC, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_PT_DESC_ANS
+    { osens_mote_sm_func_pt_desc_ans, OSENS_STATE_SEND_PT_DESC, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_PT_DESC
+    { osens_mote_sm_func_build_sch, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_BUILD_SCH
+    { osens_mote_sm_func_run_sch, OSENS_STATE_RUN_SCH, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_WR_PT }, // OSENS_STATE_RUN_SCH
+    { osens_mote_sm_func_req_pt_val, OSENS_STATE_WAIT_PT_VAL_ANS, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT }, // OSENS_STATE_SEND_PT_VAL
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_PT_VAL, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_PT_VAL_ANS
+    { osens_mote_sm_func_pt_val_ans, OSENS_STATE_SEND_PT_VAL, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_PT_VAL
+    { osens_mote_sm_func_wr_pt, OSENS_STATE_WAIT_WR_PT_ANS, OSENS_STATE_SEND_STREAM, OSENS_STATE_INIT }, // OSENS_STATE_WR_PT
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_WR_PT_ANS, OSENS_STATE_WR_PT, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_WR_PT_ANS
+    { osens_mote_sm_func_proc_wr_pt, OSENS_STATE_WR_PT, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_WR_PT_ANS
+    { osens_mote_sm_func_req_stream, OSENS_STATE_WAIT_STREAM_ANS, OSENS_STATE_SEND_TIME_SYNC, OSENS_STATE_INIT }, // OSENS_STATE_SEND_STREAM
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_STREAM, OSENS_STATE_SEND_STREAM, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_STREAM_ANS
+    { osens_mote_sm_func_proc_stream, OSENS_STATE_SEND_STREAM, OSENS_STATE_INIT, OSENS_STATE_INIT }, // OSENS_STATE_PROC_STREAM
+    { osens_mote_sm_func_req_time_sync, OSENS_STATE_WAIT_TIME_SYNC_ANS, OSENS_STATE_RUN_SCH, OSENS_STATE_INIT }, // OSENS_STATE_SEND_TIME_SYNC
+    { osens_mote_sm_func_wait_ans, OSENS_STATE_PROC_TIME_SYNC, OSENS_STATE_SEND_TIME_SYNC, OSENS_STATE_INIT }, // OSENS_STATE_WAIT_TIME_SYNC_ANS
+    { osens_mote_sm_func_proc_time_sync, OSENS_STATE_SEND_TIME_SYNC, OSENS_STATE_INIT, OSENS_STATE_INIT } // OSENS_STATE_PROC_TIME_SYNC
+};
+
+uint8_t osens_mote_get_num_points(osens_mote_ctx_t ctx)
+{
+    if (ctx->sm_state.state >= OSENS_STATE_SEND_PT_DESC)
+    {
+        return ctx->board_info.num_of_points;
+    }
+    else
+        return 0;
+}
+
+uint8_t osens_mote_get_brd_desc(osens_mote_ctx_t ctx, osens_brd_id_t *brd)
+{
+    if (ctx->sm_state.state >= OSENS_STATE_SEND_PT_DESC)
+    {
+        memcpy(brd, &ctx->board_info, sizeof(osens_brd_id_t));
+        return 1;
+    }
+    else
+        return 0;
+}
+
+uint8_t osens_mote_get_pdesc(osens_mote_ctx_t ctx, uint8_t index, osens_point_desc_t *desc)
+{
+    if ((ctx->sm_state.state >= OSENS_STATE_RUN_SCH) && (index < ctx->sensor_points.num_of_points))
+    {
+        memcpy(desc, &ctx->sensor_points.points[index].desc, sizeof(osens_point_desc_t));
+        return 1;
+    }
+    else
+        return 0;
+}
+
+int8_t osens_mote_get_ptype(osens_mote_ctx_t ctx, uint8_t index)
+{
+    if ((ctx->sm_state.state >= OSENS_STATE_RUN_SCH) && (index < ctx->sensor_points.num_of_points))
+    {
+        return ctx->sensor_points.points[index].value.type;
+    }
+    else
+        return -1;
+}
+
+uint8_t osens_mote_get_point(osens_mote_ctx_t ctx, uint8_t index, osens_point_t *point)
+{
+    if ((ctx->sm_state.state >= OSENS_STATE_RUN_SCH) && (index < ctx->sensor_points.num_of_points))
+    {
+        memcpy(point, &ctx->sensor_points.points[index].value, sizeof(osens_point_t));
+        return 1;
+    }
+    else
+        return 0;
+}
+
+uint8_t osens_mote_get_span(osens_mote_ctx_t ctx, uint8_t index, osens_mote_span_t *span)
+{
+    const osens_point_t *value;
+
+    if ((ctx->sm_state.state < OSENS_STATE_RUN_SCH) || (index >= ctx->sensor_points.num_of_points))
+        return 0;
+
+    value = &ctx->sensor_points.points[index].value;
+    if (osens_array_elem_size(value->type) == 0)
+        return 0;
+
+    // the block of the last read is not written by the next one
+    span->type = value->type;
+    span->seq = OS_ATOMIC_LOAD_ACQ(&ctx->point_array_seq[index]);
+    span->count = span->seq ? ctx->point_array_count[index][span->seq & 1] : 0;
+    span->data = span->count ? (uint8_t *) ctx->point_arrays[index] + (span->seq & 1) * OSENS_MOTE_FRAME_SIZE : 0;
+
+    return 1;
+}
+
+uint8_t osens_mote_span_valid(osens_mote_ctx_t ctx, uint8_t index, const osens_mote_span_t *span)
+{
+    if (index >= OSENS_MAX_POINTS)
+        return 0;
+
+    // elements read before the sequence
+    OS_ATOMIC_FENCE();
+
+    return OS_ATOMIC_LOAD_ACQ(&ctx->point_array_seq[index]) - span->seq <= 1;
+}
+
+uint8_t osens_mote_set_aggregate(osens_mote_ctx_t ctx, uint8_t index, uint8_t enable)
+{
+    if ((ctx->sm_state.state < OSENS_STATE_RUN_SCH) || (index >= ctx->sensor_points.num_of_points) ||
+        ((ctx->features & OSENS_FEATURE_AGGREGATE) == 0))
+        return 0;
+
+    if (((ctx->sensor_points.points[index].desc.access_rights & OSENS_ACCESS_READ_ONLY) == 0) ||
+        osens_array_elem_size(ctx->sensor_points.points[index].desc.type))
+        return 0;
+
+    ctx->aggregate[index] = enable ? OSENS_MOTE_AGGR_ON : 0;
+
+    return 1;
+}
+
+uint8_t osens_mote_get_aggregate(osens_mote_ctx_t ctx, uint8_t index, osens_aggregate_t *aggr)
+{
+    if ((index >= OSENS_MAX_POINTS) || ((ctx->aggregate[index] & OSENS_MOTE_AGGR_READ) == 0))
+        return 0;
+
+    *aggr = ctx->aggregates[index];
+
+    return 1;
+}
+
+uint8_t osens_mote_get_point_time(osens_mote_ctx_t ctx, uint8_t index, uint64_t *time_us, uint8_t *stamped)
+{
+    if ((ctx->sm_state.state < OSENS_STATE_RUN_SCH) || (index >= ctx->sensor_points.num_of_points) ||
+        (ctx->point_time_us[index] == 0))
+        return 0;
+
+    *time_us = ctx->point_time_us[index];
+    if (stamped)
+        *stamped = ctx->point_stamped[index];
+
+    return 1;
+}
+
+void osens_mote_get_time_sync(osens_mote_ctx_t ctx, osens_mote_time_sync_t *sync)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    sync->synced = ctx->clock.synced;
+    sync->stamping = ctx->clock.stamping;
+    sync->offset_ms = ctx->clock.offset_ms;
+    sync->delay_us = ctx->clock.delay_us;
+    sync->syncs = ctx->clock.syncs;
+}
+
+uint8_t osens_mote_set_pvalue(osens_mote_ctx_t ctx, uint8_t index, osens_point_t *point)
+{
+    osens_acq_schedule_t *schedule = &ctx->schedule;
+
+    if ((ctx->sm_state.state >= OSENS_STATE_RUN_SCH) && (index < ctx->sensor_points.num_of_points))
+    {
+        if ((ctx->sensor_points.points[index].desc.access_rights & OSENS_ACCESS_WRITE_ONLY) &&
+            osens_point_value_size(ctx->sensor_points.points[index].desc.type))
+        {
+            uint8_t pn;
+            uint8_t p = schedule->write.prod;
+            uint8_t c = schedule->write.cons;
+
+            pn = PC_INC_QUEUE(p, OSENS_MAX_POINTS);
+
+            // no space in prod/cons queue (check next)
+            if (pn == c)
+            {
+#if TRACE_ON == 1
+                OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("==> [%u] No space in writing queue (P: %d->%d, C: %d)\n", ctx->id, p, pn, c));
+#endif
+                return 0;
+            }
+
+#if TRACE_ON == 1
+            OS_UTIL_LOG_LVL(OS_UTIL_LOG_TRACE, 1, ("==> [%u] Producing at position %d\n", ctx->id, p));
+#endif
+            // schedule point for writing and update value
+            schedule->write.index[p] = index;
+            ctx->sensor_points.points[index].value.value = point->value;
+            schedule->write.prod = pn;
+
+            return 1;
+        }
+        else
+            return 0;
+    }
+    else
+        return 0;
+}
+
+// request and response bytes of one read of a point
+static uint32_t osens_mote_point_read_bytes(osens_mote_ctx_t ctx, uint8_t point)
+{
+    // arrays as long as their last read
+    uint32_t size = 1 + osens_point_value_len(&ctx->sensor_points.points[point].value);
+
+    if (ctx->aggregate[point] & OSENS_MOTE_AGGR_ON)
+        return osens_mote_wire_size(ctx, OSENS_MOTE_REQ_FRAMING + 1) + osens_mote_wire_size(ctx, OSENS_MOTE_RES_FRAMING + OSENS_MOTE_AGGR_SIZE);
+
+    return osens_mote_wire_size(ctx, OSENS_MOTE_REQ_FRAMING) +
+        osens_mote_wire_size(ctx, (uint16_t) (OSENS_MOTE_RES_FRAMING + size + OSENS_MOTE_EXT_FRAMING(OSENS_MOTE_RES_FRAMING + size)));
+}
+
+static double osens_mote_wire_pct(uint64_t bytes, uint32_t char_bits, uint32_t bps, uint64_t period_us)
+{
+    if ((bps == 0) || (period_us == 0))
+        return 0;
+
+    return 100.0 * (double) (bytes * char_bits) * 1000000.0 / ((double) bps * (double) period_us);
+}
+
+void osens_mote_get_link_stats(osens_mote_ctx_t ctx, osens_mote_link_stats_t *stats)
+{
+    os_transport_stats_t ts;
+    uint64_t elapsed_us = os_kernel_get_time_us() - ctx->link.start_us;
+    double sch_bytes_per_s = 0;
+    uint32_t frame_bytes;
+    uint8_t n;
+
+    memset(stats, 0, sizeof(osens_mote_link_stats_t));
+    os_transport_get_stats(ctx->transport, &ts);
+
+    stats->elapsed_ms = (uint32_t) (elapsed_us / 1000);
+    stats->tx_bytes = ts.tx_bytes;
+    stats->rx_bytes = ts.rx_bytes;
+    stats->tx_frames = ctx->link.tx_frames;
+    stats->rx_frames = ctx->link.rx_frames;
+    stats->tx_payload = ctx->link.tx_payload;
+    stats->rx_payload = ctx->link.rx_payload;
+    stats->idle_gaps = ctx->link.gaps;
+    stats->idle_gap_avg_us = ctx->link.gaps ? (uint32_t) (ctx->link.gap_sum_us / ctx->link.gaps) : 0;
+    stats->idle_gap_max_us = ctx->link.gap_max_us;
+    stats->bps = ts.bps;
+    stats->frame_max = ctx->frame_max;
+    stats->rx_skipped = ctx->link.rx_skipped;
+    stats->fec = ctx->link.fec;
+
+    if (elapsed_us > 0)
+    {
+        stats->tx_bytes_per_s = (uint32_t) ((uint64_t) ts.tx_bytes * 1000000 / elapsed_us);
+        stats->rx_bytes_per_s = (uint32_t) ((uint64_t) ts.rx_bytes * 1000000 / elapsed_us);
+    }
+
+    frame_bytes = stats->tx_frames * OSENS_MOTE_REQ_FRAMING + stats->rx_frames * OSENS_MOTE_RES_FRAMING;
+    if (frame_bytes + stats->tx_payload + stats->rx_payload > 0)
+        stats->overhead_pct = 100.0 * frame_bytes / (frame_bytes + stats->tx_payload + stats->rx_payload);
+
+    stats->busy_pct = osens_mote_wire_pct((uint64_t) ts.tx_bytes + ts.rx_bytes, ts.char_bits, ts.bps, elapsed_us);
+
+    // each scheduled point is read once per sampling period (sampling_time_x250ms)
+    if (ctx->sm_state.state >= OSENS_STATE_RUN_SCH)
+    {
+        for (n = 0; n < ctx->schedule.num_of_points; n++)
+            sch_bytes_per_s += osens_mote_point_read_bytes(ctx, ctx->schedule.points[n].index) * 4.0 /
+                ctx->schedule.points[n].sampling_time_x250ms;
+    }
+
+    stats->sch_bytes_per_s = (uint32_t) (sch_bytes_per_s + 0.5);
+    stats->sch_busy_pct = osens_mote_wire_pct((uint64_t) (sch_bytes_per_s * 1000), ts.char_bits, ts.bps, 1000000000);
+}
+
+void osens_mote_show_link(osens_mote_ctx_t ctx)
+{
+    osens_mote_link_stats_t stats;
+    uint8_t n;
+
+    osens_mote_get_link_stats(ctx, &stats);
+
+    if (ctx->sm_state.state >= OSENS_STATE_RUN_SCH)
+    {
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("Schedule (board %u): %u points, %u bytes/s, %.2f%% of the wire\n",
+            ctx->id, ctx->schedule.num_of_points, stats.sch_bytes_per_s, stats.sch_busy_pct));
+
+        for (n = 0; n < ctx->schedule.num_of_points; n++)
+        {
+            uint8_t index = ctx->schedule.points[n].index;
+            const osens_stats_point_t *ps = &ctx->timing[index].stats;
+
+            OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("  point %02u every %u ms, %u bytes per read, %u reads, interval avg %u max %u ms, late avg %u max %u ms, %u missed\n",
+                index, ctx->schedule.points[n].sampling_time_x250ms * 250, osens_mote_point_read_bytes(ctx, index), ps->samples,
+                ps->samples > 1 ? (uint32_t) (ps->interval_sum_us / (ps->samples - 1) / 1000) : 0, ps->interval_max_us / 1000,
+                ps->samples ? (uint32_t) (ps->lateness_sum_us / ps->samples / 1000) : 0, ps->lateness_max_us / 1000, ps->deadline_misses));
+        }
+    }
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("Link (board %u): tx %u B/s rx %u B/s, %u/%u frames, overhead %.1f%%, idle gap avg %u max %u us, busy %.2f%% at %u bps\n",
+        ctx->id, stats.tx_bytes_per_s, stats.rx_bytes_per_s, stats.tx_frames, stats.rx_frames, stats.overhead_pct,
+        stats.idle_gap_avg_us, stats.idle_gap_max_us, stats.busy_pct, stats.bps));
+}
+
+uint8_t osens_mote_stream_start(osens_mote_ctx_t ctx, uint32_t mask, uint16_t period_ms, uint8_t batch,
+    osens_mote_stream_func_t func, void *arg)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    uint8_t n;
+
+    // points must be known and readable
+    if ((ctx->sm_state.state < OSENS_STATE_RUN_SCH) || (batch == 0) || ((ctx->features & OSENS_FEATURE_STREAM) == 0) ||
+        ((ctx->board_info.num_of_points < 32) && (mask >> ctx->board_info.num_of_points)))
+        return 0;
+
+    // samples have a fixed size
+    for (n = 0; n < OSENS_MAX_POINTS; n++)
+    {
+        if ((mask & (1UL << n)) && (osens_point_value_size(ctx->sensor_points.points[n].desc.type) == 0))
+            return 0;
+    }
+
+    os_atomic_seq_write_begin(&ctx->stream.app_seq);
+    ctx->stream.app_func = func;
+    ctx->stream.app_arg = arg;
+    ctx->stream.app_req.mask = mask;
+    ctx->stream.app_req.period_ms = period_ms;
+    ctx->stream.app_req.batch = batch;
+    os_atomic_seq_write_end(&ctx->stream.app_seq);
+    OS_ATOMIC_STORE_REL(&ctx->stream.pending, 1);
+
+    return 1;
+}
+
+void osens_mote_stream_stop(osens_mote_ctx_t ctx)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    os_atomic_seq_write_begin(&ctx->stream.app_seq);
+    memset(&ctx->stream.app_req, 0, sizeof(osens_stream_t));
+    ctx->stream.app_func = 0;
+    ctx->stream.app_arg = 0;
+    os_atomic_seq_write_end(&ctx->stream.app_seq);
+    OS_ATOMIC_STORE_REL(&ctx->stream.pending, 1);
+}
+
+void osens_mote_get_stream_stats(osens_mote_ctx_t ctx, osens_mote_stream_stats_t *stats)
+{
+    OS_UTIL_ASSERT(ctx);
+
+    stats->active = OS_ATOMIC_LOAD_ACQ(&ctx->stream.accepted);
+    stats->mask = stats->active ? ctx->stream.cfg.mask : 0;
+    stats->frames = ctx->stream.frames;
+    stats->samples = ctx->stream.samples;
+    stats->lost_frames = ctx->stream.lost_frames;
+    stats->bad_frames = ctx->stream.bad_frames;
+}
+
+uint8_t osens_mote_get_point_stats(osens_mote_ctx_t ctx, uint8_t index, osens_stats_point_t *stats)
+{
+    if ((ctx->sm_state.state >= OSENS_STATE_RUN_SCH) && (index < ctx->sensor_points.num_of_points))
+    {
+        memcpy(stats, &ctx->timing[index].stats, sizeof(osens_stats_point_t));
+        return 1;
+    }
+    else
+        return 0;
+}
+
+// single board API (osens.h), operating over the default context
+
+uint8_t osens_init(void)
+{
+    osens_mote_init_v2();
+    return 0;
+}
+
+uint8_t osens_get_num_points(void)
+{
+    return mote_ctx ? osens_mote_get_num_points(mote_ctx) : 0;
+}
+
+uint8_t osens_get_brd_desc(osens_brd_id_t *brd)
+{
+    return mote_ctx ? osens_mote_get_brd_desc(mote_ctx, brd) : 0;
+}
+
+uint8_t osens_get_pdesc(uint8_t index, osens_point_desc_t *desc)
+{
+    return mote_ctx ? osens_mote_get_pdesc(mote_ctx, index, desc) : 0;
+}
+
+int8_t osens_get_ptype(uint8_t index)
+{
+    return mote_ctx ? osens_mote_get_ptype(mote_ctx, index) : -1;
+}
+
+uint8_t osens_get_point(uint8_t index, osens_point_t *point)
+{
+    return mote_ctx ? osens_mote_get_point(mote_ctx, index, point) : 0;
+}
+
+uint8_t osens_set_pvalue(uint8_t index, osens_point_t *point)
+{
+    return mote_ctx ? osens_mote_set_pvalue(mote_ctx, index, point) : 0;
+}
@@ -2,32 +2,101 @@
 #include <stdint.h>
 #include "osens.h"
 #include "osens_itf.h"
+#include "osens_capture.h"
 #include "../os/os_defs.h"
 #include "../os/os_timer.h"
 #include "../os/os_kernel.h"
+#include "../os/os_serial.h"
+#include "../os/os_transport.h"
 #include "../os/os_util.h"
 #include "../util/buf_io.h"
 #include "../util/crc16.h"
 #include "../pt/pt.h"
+#include "../os/os_pt_sched.h"
+#include "osens_sensor.h"
 
 // TODO: create fake function for SPI
 
 #define SENS_ITF_SENSOR_DBG_FRAME     1
 #define OSENS_DBG_FRAME 1
-#define SENS_ITF_SENSOR_NUM_OF_POINTS 5
+#define SENS_ITF_SENSOR_NUM_OF_POINTS 6
+#define SENS_ITF_SENSOR_WAVE_SAMPLES  48
 
 static uint8_t main_svr_addr[OSENS_SERVER_ADDR_SIZE];
 static uint8_t secon_svr_addr[OSENS_SERVER_ADDR_SIZE];
-static uint8_t rx_frame[OSENS_MAX_FRAME_SIZE];
-static volatile uint8_t num_rx_bytes;
+static uint8_t rx_frame[OSENS_SENSOR_FRAME_SIZE];
+static volatile uint16_t num_rx_bytes;
+static uint16_t frame_max = OSENS_MAX_FRAME_SIZE;
 static os_timer_t rx_trmout_timer ;
 static os_timer_t acq_data_timer;
 static osens_point_ctrl_t sensor_points;
 static osens_brd_id_t board_info;
-static struct pt pt_acq;
-static struct pt pt_data;
+static int16_t wave[SENS_ITF_SENSOR_WAVE_SAMPLES];
+static uint16_t acq_count;
+static os_pt_task_t pt_acq;
+static os_pt_task_t pt_data;
 static volatile uint8_t frame_timeout;
 static volatile uint8_t acq_data ;
+static volatile uint8_t sensor_ready = 0;
+static os_transport_t sensor_transport = 0;
+static os_thread_t rx_thread = 0;
+static os_timer_t link_confirm_timer;
+static uint16_t link_rates = OSENS_SENSOR_LINK_RATES_ALL;
+static uint32_t features = OSENS_FEATURES_ALL;
+static uint8_t bus_addr = OSENS_BUS_ADDR_NONE;
+// code of the last request, answers and pushed samples use the same one (0: none)
+static uint8_t fec_roots = 0;
+static osens_fec_stats_t fec_stats;
+static uint8_t link_rate = OSENS_LINK_RATE_DEFAULT;
+static uint8_t link_next_rate;
+static uint8_t link_bad_frames;
+static volatile uint8_t link_confirm;
+static volatile uint8_t link_confirm_timeout;
+static os_pt_task_t pt_stream;
+static os_timer_t stream_timer;
+static volatile uint8_t stream_tick;
+static osens_stream_t stream;
+static uint16_t stream_seq;
+static uint8_t stream_count;
+static uint16_t stream_len;
+static uint8_t stream_samples[OSENS_SENSOR_FRAME_SIZE];
+static uint8_t stream_frame[OSENS_SENSOR_FRAME_SIZE];
+
+// running aggregates of a point, m2 is the sum of squared differences from the mean
+typedef struct osens_sensor_aggr_s
+{
+    uint32_t count;
+    double min;
+    double max;
+    double mean;
+    double m2;
+} osens_sensor_aggr_t;
+
+// acquisitions and answers run in the same protothread scheduler, no lock needed
+static osens_sensor_aggr_t aggr[SENS_ITF_SENSOR_NUM_OF_POINTS];
+static osens_sensor_aggr_t aggr_done[SENS_ITF_SENSOR_NUM_OF_POINTS];
+static uint16_t aggr_window = 0;
+
+// sensor clock, the host clock moved by an offset like a board started at another time
+static int32_t clock_offset_ms = 0;
+// sensor clock at the last received byte, the reception time of a request
+static volatile uint32_t rx_last_ms;
+// OSENS_REGMAP_TIME_SYNC flags and the acquisition time of each point
+static uint8_t time_flags;
+static uint32_t acq_ms[SENS_ITF_SENSOR_NUM_OF_POINTS];
+
+static void osens_sensor_rx_byte(uint8_t value);
+
+static uint32_t osens_sensor_clock_ms(void)
+{
+    return (uint32_t) (os_kernel_get_time_us() / 1000) + (uint32_t) clock_offset_ms;
+}
+
+// a board on a shared bus can not use every feature
+static uint32_t osens_sensor_features(void)
+{
+    return bus_addr != OSENS_BUS_ADDR_NONE ? features & ~OSENS_FEATURES_NOT_ON_BUS : features;
+}
 
 static uint8_t osens_get_point_type(uint8_t point)
 {
@@ -61,11 +130,24 @@ static osens_point_t *osens_get_point_value(uint8_t point)
 
 static uint8_t osens_set_point_value(uint8_t point, osens_point_t *v)
 {
+    osens_point_t *cur = osens_get_point_value(point);
     uint8_t ret = 0;
 
-    if (point < osens_get_number_of_points())
+    if (cur && osens_array_elem_size(cur->type))
     {
-        sensor_points.points[point].value = *v;
+        // unpacked elements are copied into the point storage, same length only
+        if ((v->type == cur->type) && (v->value.array.count == cur->value.array.count))
+        {
+            if (osens_array_elem_size(cur->type) == 2)
+                buf_io_get16_fl_n(cur->value.array.data, v->value.array.data, cur->value.array.count);
+            else
+                buf_io_get32_fl_n(cur->value.array.data, v->value.array.data, cur->value.array.count);
+            ret = 1;
+        }
+    }
+    else if (cur)
+    {
+        *cur = *v;
         ret = 1;
     }
     else
@@ -73,27 +155,173 @@ static uint8_t osens_set_point_value(uint8_t point, osens_point_t *v)
         ret = 0;
     }
 
+    if (ret)
+        acq_ms[point] = osens_sensor_clock_ms();
+
     return ret;
 }
 
+static void osens_sensor_aggr_add(uint8_t point, double value)
+{
+    osens_sensor_aggr_t *a = &aggr[point];
+    double delta = value - a->mean;
+
+    if ((a->count == 0) || (value < a->min))
+        a->min = value;
+    if ((a->count == 0) || (value > a->max))
+        a->max = value;
+
+    a->count++;
+    a->mean += delta / a->count;
+    a->m2 += delta * (value - a->mean);
+
+    // complete window, kept until read
+    if (aggr_window && (a->count >= aggr_window))
+    {
+        aggr_done[point] = *a;
+        memset(a, 0, sizeof(osens_sensor_aggr_t));
+    }
+}
+
+// last complete window first, otherwise the acquisitions since the previous read
+static void osens_sensor_aggr_take(uint8_t point, osens_aggregate_t *res)
+{
+    osens_sensor_aggr_t *a = aggr_done[point].count ? &aggr_done[point] : &aggr[point];
+
+    res->index = point;
+    res->count = a->count;
+    res->min = (float) a->min;
+    res->max = (float) a->max;
+    res->mean = (float) a->mean;
+    res->variance = a->count ? (float) (a->m2 / a->count) : 0;
+
+    memset(a, 0, sizeof(osens_sensor_aggr_t));
+}
+
 static osens_brd_id_t *osens_get_board_info(void)
 {
     return &board_info;
 }
 
-static uint8_t osens_sensor_send_frame(uint8_t *frame, uint8_t size)
+// frame must have room for the parity, see osens_sensor_wire_size()
+static uint16_t osens_sensor_send_frame(uint8_t *frame, uint16_t size)
 {
+    OSENS_CAPTURE(0, OSENS_CAPTURE_DIR_RES, frame, size);
+
+    if (fec_roots)
+        size = osens_fec_encode(frame, size, fec_roots);
+
+    if (sensor_transport)
+        return (uint16_t) os_transport_send(sensor_transport, frame, size);
+
     os_util_dump_frame(frame, size);
     return size;
 }
 
-static uint8_t osens_sensor_check_register_map(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
+// length of a frame on the line, compared with frame_max
+static uint16_t osens_sensor_wire_size(uint16_t size)
 {
-    uint8_t size = 0;
+    return osens_fec_size(size, fec_roots);
+}
+
+static uint8_t osens_sensor_link_set_rate(uint8_t rate)
+{
+    if (sensor_transport && (os_transport_set_speed(sensor_transport, osens_link_rate_to_bps(rate)) != OS_SUCCESS))
+    {
+        OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Link rate %u bps not supported\n", osens_link_rate_to_bps(rate)));
+        return 0;
+    }
+
+    link_rate = rate;
+    link_bad_frames = 0;
+
+    return 1;
+}
+
+// back to the default rate, the mote does the same after its own errors
+static void osens_sensor_link_fallback(void)
+{
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("Link fallback from %u to %u bps\n",
+        osens_link_rate_to_bps(link_rate), osens_link_rate_to_bps(OSENS_LINK_RATE_DEFAULT)));
+
+    link_confirm = 0;
+    os_timer_deactivate(link_confirm_timer);
+    osens_sensor_link_set_rate(OSENS_LINK_RATE_DEFAULT);
+}
+
+// bytes of one sample of the points in mask, 0 when a point can not be streamed
+static uint16_t osens_sensor_stream_sample_size(uint32_t mask)
+{
+    uint16_t size = 0;
+    uint8_t value_size;
+    uint8_t n;
+
+    for (n = 0; n < OSENS_MAX_POINTS; n++)
+    {
+        if ((mask & (1UL << n)) == 0)
+            continue;
+
+        if ((n >= osens_get_number_of_points()) ||
+            ((osens_get_point_desc(n)->access_rights & OSENS_ACCESS_READ_ONLY) == 0))
+            return 0;
+
+        // arrays have no fixed size
+        value_size = osens_point_value_size(osens_get_point_type(n));
+        if (value_size == 0)
+            return 0;
+
+        size += value_size;
+    }
+
+    return size;
+}
+
+static void osens_sensor_stream_stop(void)
+{
+    os_timer_deactivate(stream_timer);
+    stream.mask = 0;
+    stream_tick = 0;
+}
+
+static uint8_t osens_sensor_stream_start(const osens_stream_t *req)
+{
+    uint32_t size;
+
+    if (req->mask == 0)
+    {
+        osens_sensor_stream_stop();
+        return 1;
+    }
+
+    // header, address, status, sequence, number of samples and CRC
+    size = 8 + (uint32_t) req->batch * osens_sensor_stream_sample_size(req->mask);
+    if (size > OSENS_MAX_FRAME_SIZE)
+        size += 2;
+
+    if ((req->batch == 0) || (req->period_ms < OSENS_SENSOR_STREAM_MIN_MS) ||
+        (osens_sensor_stream_sample_size(req->mask) == 0) || (size > frame_max) ||
+        (osens_sensor_wire_size((uint16_t) size) > frame_max))
+        return 0;
+
+    stream = *req;
+    stream_seq = 0;
+    stream_count = 0;
+    stream_len = 0;
+    stream_tick = 0;
+    os_timer_change(stream_timer, stream.period_ms, stream.period_ms);
+
+    return 1;
+}
+
+static uint16_t osens_sensor_check_register_map(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
+{
+    uint16_t size = 0;
     if ( // check global register map for valid address ranges
                 ((cmd->hdr.addr > OSENS_REGMAP_SVR_SEC_ADDR) && 
                 (cmd->hdr.addr < OSENS_REGMAP_POINT_DESC_1)) ||
-                (cmd->hdr.addr > OSENS_REGMAP_WRITE_POINT_DATA_32) ||
+                (cmd->hdr.addr > OSENS_REGMAP_TIME_SYNC) ||
+                // optional registers of disabled features
+                (osens_register_feature(cmd->hdr.addr) & ~osens_sensor_features()) ||
                 // check local register map - reading
                 ((cmd->hdr.addr >= OSENS_REGMAP_READ_POINT_DATA_1) && 
                 (cmd->hdr.addr <= OSENS_REGMAP_READ_POINT_DATA_32) &&
@@ -110,9 +338,81 @@ static uint8_t osens_sensor_check_register_map(osens_cmd_req_t *cmd, osens_cmd_r
     return size;
 }
 
-static uint8_t osens_sensor_writings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
+static uint16_t osens_sensor_writings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
 {
-    uint8_t size = 0;
+    uint16_t size = 0;
+
+    // new rate is applied after the answer is sent
+    if (cmd->hdr.addr == OSENS_REGMAP_LINK_SPEED)
+    {
+        uint8_t rate = cmd->payload.link_speed_cmd.rate;
+
+        if ((rate < OSENS_LINK_NUM_RATES) && (link_rates & (1 << rate)))
+        {
+            ans->hdr.status = OSENS_ANS_OK;
+            link_next_rate = rate;
+        }
+        else
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Link rate %u not supported", rate));
+            ans->hdr.status = OSENS_ANS_ERROR;
+        }
+        size = osens_pack_cmd_res(ans, frame);
+    }
+
+    if (cmd->hdr.addr == OSENS_REGMAP_STREAM)
+    {
+        if (osens_sensor_stream_start(&cmd->payload.stream_cmd))
+        {
+            ans->hdr.status = OSENS_ANS_OK;
+        }
+        else
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Stream of points %08X every %u ms not supported",
+                cmd->payload.stream_cmd.mask, cmd->payload.stream_cmd.period_ms));
+            ans->hdr.status = OSENS_ANS_ERROR;
+        }
+        size = osens_pack_cmd_res(ans, frame);
+    }
+
+    // the answer carries its own sending time, taken last
+    if (cmd->hdr.addr == OSENS_REGMAP_TIME_SYNC)
+    {
+        time_flags = cmd->payload.time_sync_cmd.flags & OSENS_TIME_SYNC_STAMP;
+        ans->payload.time_sync_cmd.mote_ms = cmd->payload.time_sync_cmd.mote_ms;
+        ans->payload.time_sync_cmd.rx_ms = rx_last_ms;
+        ans->payload.time_sync_cmd.flags = time_flags;
+        ans->payload.time_sync_cmd.tx_ms = osens_sensor_clock_ms();
+        ans->hdr.status = OSENS_ANS_OK;
+        size = osens_pack_cmd_res(ans, frame);
+    }
+
+    // each point gets its own status, in request order
+    if (cmd->hdr.addr == OSENS_REGMAP_WRITE_BLOCK)
+    {
+        osens_write_block_t *blk = &cmd->payload.write_block_cmd;
+        uint8_t n;
+
+        for (n = 0; n < blk->num_points; n++)
+        {
+            uint8_t point = blk->index[n];
+
+            if (point >= osens_get_number_of_points())
+                ans->payload.write_block_cmd.status[n] = OSENS_ANS_REGISTER_NOT_IMPLEMENTED;
+            else if ((osens_get_point_desc(point)->access_rights & OSENS_ACCESS_WRITE_ONLY) == 0)
+                ans->payload.write_block_cmd.status[n] = OSENS_ANS_READY_ONLY;
+            else if ((blk->values[n].type == osens_get_point_type(point)) &&
+                osens_set_point_value(point, &blk->values[n]))
+                ans->payload.write_block_cmd.status[n] = OSENS_ANS_OK;
+            else
+                ans->payload.write_block_cmd.status[n] = OSENS_ANS_ERROR;
+        }
+
+        ans->payload.write_block_cmd.num_points = blk->num_points;
+        ans->hdr.status = OSENS_ANS_OK;
+        size = osens_pack_cmd_res(ans, frame);
+    }
+
     if ((cmd->hdr.addr >= OSENS_REGMAP_WRITE_POINT_DATA_1) && 
         (cmd->hdr.addr <= OSENS_REGMAP_WRITE_POINT_DATA_32))
     {
@@ -121,8 +421,7 @@ static uint8_t osens_sensor_writings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans,
             
         if (acr)
         {
-            ans->hdr.status = OSENS_ANS_OK;
-            osens_set_point_value(point,&cmd->payload.point_value_cmd);
+            ans->hdr.status = osens_set_point_value(point, &cmd->payload.point_value_cmd) ? OSENS_ANS_OK : OSENS_ANS_ERROR;
         }
         else
         {
@@ -134,9 +433,9 @@ static uint8_t osens_sensor_writings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans,
     return size;
 }
 
-static uint8_t osens_sensor_readings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
+static uint16_t osens_sensor_readings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
 {
-    uint8_t size = 0;
+    uint16_t size = 0;
     if ((cmd->hdr.addr >= OSENS_REGMAP_READ_POINT_DATA_1) &&
         (cmd->hdr.addr <= OSENS_REGMAP_READ_POINT_DATA_32))
     {
@@ -147,6 +446,15 @@ static uint8_t osens_sensor_readings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans,
         {
             ans->hdr.status = OSENS_ANS_OK;
             ans->payload.point_value_cmd = *osens_get_point_value(point);
+
+            if (time_flags & OSENS_TIME_SYNC_STAMP)
+            {
+                uint32_t now = osens_sensor_clock_ms();
+
+                ans->time.valid = 1;
+                ans->time.base_ms = now;
+                ans->time.age_ms = now - acq_ms[point] > 0xFFFF ? 0xFFFF : (uint16_t) (now - acq_ms[point]);
+            }
         }
         else
         {
@@ -155,16 +463,47 @@ static uint8_t osens_sensor_readings(osens_cmd_req_t *cmd, osens_cmd_res_t *ans,
         }
         size = osens_pack_cmd_res(ans, frame);
     }
+
+    if (cmd->hdr.addr == OSENS_REGMAP_AGGREGATE)
+    {
+        uint8_t point = cmd->payload.aggregate_cmd.index;
+
+        if (point >= osens_get_number_of_points())
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Invalid point %d", point));
+            ans->hdr.status = OSENS_ANS_REGISTER_NOT_IMPLEMENTED;
+        }
+        else if ((osens_get_point_desc(point)->access_rights & OSENS_ACCESS_READ_ONLY) == 0)
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Point %d does not allow readings", point));
+            ans->hdr.status = OSENS_ANS_WRITE_ONLY;
+        }
+        else if (osens_array_elem_size(osens_get_point_type(point)))
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Point %d is not aggregated", point));
+            ans->hdr.status = OSENS_ANS_ERROR;
+        }
+        else
+        {
+            osens_sensor_aggr_take(point, &ans->payload.aggregate_cmd);
+            ans->hdr.status = OSENS_ANS_OK;
+        }
+        size = osens_pack_cmd_res(ans, frame);
+    }
     return size;
 }
 
-static uint8_t osens_check_other_cmds(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
+static uint16_t osens_check_other_cmds(osens_cmd_req_t *cmd, osens_cmd_res_t *ans, uint8_t *frame)
 {
-    uint8_t size = 0;
+    uint16_t size = 0;
     switch (cmd->hdr.addr)
     {
         case OSENS_REGMAP_ITF_VERSION:
             ans->payload.itf_version_cmd.version = OSENS_LATEST_VERSION;
+            // new discovery, the mote may not know about longer frames, streams or stamps
+            frame_max = OSENS_MAX_FRAME_SIZE;
+            time_flags = 0;
+            osens_sensor_stream_stop();
             break;
         case OSENS_REGMAP_BRD_ID:
             memcpy(&ans->payload.brd_id_cmd,osens_get_board_info(),sizeof(osens_brd_id_t));
@@ -187,6 +526,21 @@ static uint8_t osens_check_other_cmds(osens_cmd_req_t *cmd, osens_cmd_res_t *ans
         case OSENS_REGMAP_SVR_SEC_ADDR:
             memcpy(ans->payload.svr_addr_cmd.addr,secon_svr_addr, OSENS_SERVER_ADDR_SIZE);
             break;
+        case OSENS_REGMAP_LINK_RATES:
+            ans->payload.link_rates_cmd.rates = link_rates;
+            ans->payload.link_rates_cmd.current = link_rate;
+            break;
+        case OSENS_REGMAP_FEATURES:
+            ans->payload.features_cmd.features = osens_sensor_features();
+            break;
+        case OSENS_REGMAP_FRAME_SIZE:
+            // never below the frames every mote accepts
+            frame_max = cmd->payload.frame_size_cmd.max_size < OSENS_SENSOR_FRAME_SIZE ?
+                cmd->payload.frame_size_cmd.max_size : OSENS_SENSOR_FRAME_SIZE;
+            if (frame_max < OSENS_MAX_FRAME_SIZE)
+                frame_max = OSENS_MAX_FRAME_SIZE;
+            ans->payload.frame_size_cmd.max_size = OSENS_SENSOR_FRAME_SIZE;
+            break;
         default:
             break;
     }
@@ -201,18 +555,63 @@ static uint8_t osens_check_other_cmds(osens_cmd_req_t *cmd, osens_cmd_res_t *ans
     size = osens_pack_cmd_res(ans, frame);
     return size;
 }
-static void osens_process_cmd(uint8_t *frame, uint8_t num_rx_bytes)
+static void osens_process_cmd(uint8_t *frame, uint16_t num_rx_bytes)
 {
-    uint8_t ret;
-    uint8_t size = 0;
+    uint16_t ret;
+    uint16_t size = 0;
     osens_cmd_req_t cmd;
     osens_cmd_res_t ans;
+    uint8_t roots = 0;
+    uint16_t pos;
+
+    // corrected in place, protected frames are garbage when the feature is disabled
+    if ((num_rx_bytes > 0) && (frame[0] == OSENS_FRAME_FEC) && (osens_sensor_features() & OSENS_FEATURE_FEC))
+    {
+        num_rx_bytes = osens_fec_decode(frame, num_rx_bytes, &roots, &fec_stats);
+    }
+    else if (num_rx_bytes > 0)
+    {
+        // bytes ahead of the request (line noise, a truncated frame) are skipped
+        pos = osens_frame_find(frame, num_rx_bytes, OSENS_FRAME_KIND_REQ, OSENS_SENSOR_FRAME_SIZE, &size);
+        if ((pos > 0) && (pos < num_rx_bytes))
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Request found after %u bytes\n", pos));
+            memmove(frame, &frame[pos], size);
+            num_rx_bytes = size;
+        }
+    }
+
+    OSENS_CAPTURE(0, OSENS_CAPTURE_DIR_REQ, frame, num_rx_bytes);
 
     ret = osens_unpack_cmd_req(&cmd, frame, num_rx_bytes);
 
+    // requests for other boards of the bus are not answered
+    if ((ret > 0) && (cmd.hdr.bus != bus_addr))
+        return;
+
+    if (ret > 0)
+        fec_roots = roots;
+
+    // garbage at a negotiated rate: the mote has probably fallen back already
+    if ((ret == 0) && (link_rate != OSENS_LINK_RATE_DEFAULT) && (++link_bad_frames >= OSENS_SENSOR_LINK_MAX_ERRORS))
+        osens_sensor_link_fallback();
+
     if (ret > 0)
     {
+        link_bad_frames = 0;
+
+        // first valid frame at the new rate
+        if (link_confirm)
+        {
+            link_confirm = 0;
+            os_timer_deactivate(link_confirm_timer);
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Link at %u bps\n", osens_link_rate_to_bps(link_rate)));
+        }
+
+        link_next_rate = link_rate;
         ans.hdr.addr = cmd.hdr.addr;
+        ans.hdr.bus = bus_addr;
+        ans.time.valid = 0;
         size = osens_sensor_check_register_map(&cmd, &ans,frame);
         if (size == 0)
             size = osens_sensor_writings(&cmd, &ans,frame);
@@ -225,19 +624,32 @@ static void osens_process_cmd(uint8_t *frame, uint8_t num_rx_bytes)
             ans.hdr.status = OSENS_ANS_ERROR;
         }
         size = osens_pack_cmd_res(&ans,frame);
+        if (osens_sensor_wire_size(size) > frame_max)
+        {
+            OS_UTIL_LOG(SENS_ITF_SENSOR_DBG_FRAME, ("Answer of %u bytes longer than %u\n", osens_sensor_wire_size(size), frame_max));
+            ans.hdr.status = OSENS_ANS_ERROR;
+            size = osens_pack_cmd_res(&ans,frame);
+        }
         osens_sensor_send_frame(frame, size);
+
+        if ((link_next_rate != link_rate) && osens_sensor_link_set_rate(link_next_rate))
+        {
+            link_confirm_timeout = 0;
+            link_confirm = 1;
+            os_timer_change(link_confirm_timer, OSENS_SENSOR_LINK_CONFIRM_MS, 0);
+        }
     }
 }
 
 void osens_init_point_db(void)
 {
     uint8_t n;
-    uint8_t *point_names[OSENS_POINT_NAME_SIZE] = { "TEMP", "HUMID", "FIRE", "ALARM", "OPENCNT" };
+    uint8_t *point_names[OSENS_POINT_NAME_SIZE] = { "TEMP", "HUMID", "FIRE", "ALARM", "OPENCNT", "WAVE" };
     uint8_t data_types[OSENS_POINT_NAME_SIZE] = {OSENS_DT_FLOAT, OSENS_DT_FLOAT, OSENS_DT_U8, 
-        OSENS_DT_U8, OSENS_DT_U32};
+        OSENS_DT_U8, OSENS_DT_U32, OSENS_DT_ARRAY_S16};
     uint8_t access_rights[OSENS_POINT_NAME_SIZE] = { OSENS_ACCESS_READ_ONLY, OSENS_ACCESS_READ_ONLY, 
-        OSENS_ACCESS_READ_ONLY, OSENS_ACCESS_WRITE_ONLY, OSENS_ACCESS_READ_WRITE};
-    uint32_t sampling_time[OSENS_POINT_NAME_SIZE] = {4*10, 4*30, 4*1, 0, 0};
+        OSENS_ACCESS_READ_ONLY, OSENS_ACCESS_WRITE_ONLY, OSENS_ACCESS_READ_WRITE, OSENS_ACCESS_READ_ONLY};
+    uint32_t sampling_time[OSENS_POINT_NAME_SIZE] = {4*10, 4*30, 4*1, 0, 0, 4*5};
 
 	memset(&sensor_points, 0, sizeof(sensor_points));
 	memset(&board_info, 0, sizeof(board_info));
@@ -262,6 +674,11 @@ void osens_init_point_db(void)
         sensor_points.points[n].desc.sampling_time_x250ms = sampling_time[n];
         sensor_points.points[n].value.type = data_types[n];
     }
+
+    // waveform, refreshed by each acquisition
+    memset(wave, 0, sizeof(wave));
+    sensor_points.points[5].value.value.array.count = SENS_ITF_SENSOR_WAVE_SAMPLES;
+    sensor_points.points[5].value.value.array.data = wave;
 }
 
 static void osens_rx_tmrout_timer_func(void)
@@ -278,28 +695,118 @@ static void osens_rx_tmrout_timer_func(void)
     //    num_rx_bytes = 4;
     //}
     frame_timeout = 1;
+    os_pt_sched_signal(&pt_data);
+}
+
+static void osens_link_confirm_timer_func(void)
+{
+    link_confirm_timeout = 1;
+    os_pt_sched_signal(&pt_data);
+}
+
+static void osens_stream_timer_func(void)
+{
+    stream_tick = 1;
+    os_pt_sched_signal(&pt_stream);
 }
 
 static void osens_acq_data_timer_func(void)
 {
     acq_data = 1;
+    os_pt_sched_signal(&pt_acq);
 }
 
 uint8_t osens_sensor_init(void)
 {
+    uint8_t n;
 
     osens_init_point_db();
     memcpy(main_svr_addr,"1212121212121212",OSENS_SERVER_ADDR_SIZE);
     memcpy(secon_svr_addr,"aabbccddeeff1122",OSENS_SERVER_ADDR_SIZE);
     num_rx_bytes = 0;
+    frame_max = OSENS_MAX_FRAME_SIZE;
     acq_data = 0;
     frame_timeout = 0;
     rx_trmout_timer = os_timer_create((os_timer_func) osens_rx_tmrout_timer_func, 0, 50, 0, 1);
-    acq_data_timer = os_timer_create((os_timer_func) osens_acq_data_timer_func, 0, 1000, 0, 1);
+    acq_data_timer = os_timer_create((os_timer_func) osens_acq_data_timer_func, 0, 1000, 1000, 1);
+    acq_count = 0;
+    memset(aggr, 0, sizeof(aggr));
+    memset(aggr_done, 0, sizeof(aggr_done));
+    time_flags = 0;
+    for (n = 0; n < SENS_ITF_SENSOR_NUM_OF_POINTS; n++)
+        acq_ms[n] = osens_sensor_clock_ms();
+    link_confirm_timer = os_timer_create((os_timer_func) osens_link_confirm_timer_func, 0, OSENS_SENSOR_LINK_CONFIRM_MS, 0, 0);
+    stream_timer = os_timer_create((os_timer_func) osens_stream_timer_func, 0, OSENS_SENSOR_STREAM_MIN_MS, OSENS_SENSOR_STREAM_MIN_MS, 0);
+    stream.mask = 0;
+    link_rate = OSENS_LINK_RATE_DEFAULT;
+    link_confirm = 0;
+    link_confirm_timeout = 0;
+    sensor_ready = 1;
 
     return 1;
 }
 
+// plays the serial interrupt role when a transport is attached
+static void* osens_sensor_rx_thread(void *param)
+{
+    uint8_t buf[OSENS_MAX_FRAME_SIZE];
+    int num_bytes;
+    int n;
+
+    while (1)
+    {
+        if (os_transport_wait_readable(sensor_transport, OS_INFINTE_TMROUT) != OS_SUCCESS)
+            continue;
+
+        num_bytes = os_transport_recv(sensor_transport, buf, sizeof(buf));
+
+        // bytes received before initialization are discarded
+        for (n = 0; (n < num_bytes) && sensor_ready; n++)
+            osens_sensor_rx_byte(buf[n]);
+    }
+
+    return 0;
+}
+
+void osens_sensor_set_link_rates(uint16_t rates)
+{
+    link_rates = rates | (1 << OSENS_LINK_RATE_DEFAULT);
+}
+
+void osens_sensor_set_features(uint32_t mask)
+{
+    features = mask & OSENS_FEATURES_ALL;
+}
+
+void osens_sensor_set_bus_address(uint8_t addr)
+{
+    bus_addr = addr & OSENS_BUS_ADDR_MAX;
+}
+
+void osens_sensor_get_fec_stats(osens_fec_stats_t *stats)
+{
+    *stats = fec_stats;
+}
+
+void osens_sensor_set_aggregate_window(uint16_t acquisitions)
+{
+    aggr_window = acquisitions;
+}
+
+void osens_sensor_set_clock_offset(int32_t offset_ms)
+{
+    clock_offset_ms = offset_ms;
+}
+
+void osens_sensor_set_transport(os_transport_t transport)
+{
+    sensor_transport = transport;
+
+    if (rx_thread == 0)
+        rx_thread = os_kernel_create(osens_sensor_rx_thread, "SENSOR_RX", (os_thread_arg) 0,
+            os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+}
+
 // Serial or SPI interrupt, called when a new byte is received
 static void osens_sensor_rx_byte(uint8_t value)
 {
@@ -307,17 +814,25 @@ static void osens_sensor_rx_byte(uint8_t value)
     if (frame_timeout)
         return;
 
-    if (num_rx_bytes < OSENS_MAX_FRAME_SIZE)
+    if (num_rx_bytes < OSENS_SENSOR_FRAME_SIZE)
         rx_frame[num_rx_bytes] = value;
     
     num_rx_bytes++;
-    if (num_rx_bytes >= OSENS_MAX_FRAME_SIZE)
+    if (num_rx_bytes >= OSENS_SENSOR_FRAME_SIZE)
         num_rx_bytes = 0;
 
+    rx_last_ms = osens_sensor_clock_ms();
+
     os_timer_change(rx_trmout_timer, 50, 0);
     // ENABLE INTERRUPTS
 }
 
+// protothreads that never yield leave the PT_YIELD_FLAG of PT_BEGIN() unused
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+
 static int pt_data_func(struct pt *pt)
 {
     PT_BEGIN(pt);
@@ -325,7 +840,17 @@ static int pt_data_func(struct pt *pt)
     while (1)
     {
         // wait a frame timeout
-        PT_WAIT_UNTIL(pt, frame_timeout == 1);
+        PT_WAIT_UNTIL(pt, (frame_timeout == 1) || (link_confirm_timeout == 1));
+
+        // nothing valid received since the rate was switched
+        if (link_confirm_timeout)
+        {
+            link_confirm_timeout = 0;
+            if (link_confirm)
+                osens_sensor_link_fallback();
+            if (frame_timeout == 0)
+                continue;
+        }
 
         if (num_rx_bytes > 0)
         {
@@ -334,9 +859,59 @@ static int pt_data_func(struct pt *pt)
             num_rx_bytes = 0;
         }
 
-        // restart reception
+        // restart reception, the timer is started again by the next byte
         frame_timeout = 0;
-        os_timer_change(rx_trmout_timer, 50, 0);
+    }
+
+    PT_END(pt);
+}
+
+// samples the subscribed points, a frame is pushed every batch samples
+static int pt_stream_func(struct pt *pt)
+{
+    osens_cmd_res_t ans;
+    uint16_t size;
+    uint8_t n;
+
+    PT_BEGIN(pt);
+
+    while (1)
+    {
+        PT_WAIT_UNTIL(pt, stream_tick == 1);
+        stream_tick = 0;
+
+        if (stream.mask == 0)
+            continue;
+
+        // checked when the subscription started, never overflow the samples
+        size = osens_sensor_stream_sample_size(stream.mask);
+        if ((size == 0) || (stream_len + size > sizeof(stream_samples)))
+        {
+            osens_sensor_stream_stop();
+            continue;
+        }
+
+        for (n = 0; n < osens_get_number_of_points(); n++)
+        {
+            if (stream.mask & (1UL << n))
+                stream_len += osens_pack_point_value(osens_get_point_value(n), &stream_samples[stream_len]);
+        }
+
+        if (++stream_count < stream.batch)
+            continue;
+
+        ans.hdr.addr = OSENS_REGMAP_STREAM_DATA;
+        ans.hdr.bus = bus_addr;
+        ans.hdr.status = OSENS_ANS_OK;
+        ans.payload.stream_data_cmd.seq = stream_seq++;
+        ans.payload.stream_data_cmd.num_samples = stream_count;
+        ans.payload.stream_data_cmd.size = stream_len;
+        ans.payload.stream_data_cmd.samples = stream_samples;
+        size = osens_pack_cmd_res(&ans, stream_frame);
+        osens_sensor_send_frame(stream_frame, size);
+
+        stream_count = 0;
+        stream_len = 0;
     }
 
     PT_END(pt);
@@ -344,6 +919,8 @@ static int pt_data_func(struct pt *pt)
 
 static int pt_acq_func(struct pt *pt)
 {
+    uint8_t n;
+
     PT_BEGIN(pt);
 
     while (1)
@@ -351,29 +928,43 @@ static int pt_acq_func(struct pt *pt)
         // wait job
         PT_WAIT_UNTIL(pt, acq_data == 1);
         // read data from sensor and update points
-        // {}
         acq_data = 0;
+        acq_count++;
+        // sawtooth shifted by one sample per acquisition
+        for (n = 0; n < SENS_ITF_SENSOR_WAVE_SAMPLES; n++)
+            wave[n] = (int16_t) (((n + acq_count) % SENS_ITF_SENSOR_WAVE_SAMPLES) * 256 - 6144);
+        // temperature steps of 0.5 from 20.0 to 21.5
+        osens_get_point_value(0)->value.fp32 = 20.0f + (float) (acq_count % 4) * 0.5f;
+
+        for (n = 0; n < osens_get_number_of_points(); n++)
+        {
+            acq_ms[n] = osens_sensor_clock_ms();
+            if (osens_array_elem_size(osens_get_point_type(n)) == 0)
+                osens_sensor_aggr_add(n, osens_point_to_double(osens_get_point_value(n)));
+        }
     }
 
     PT_END(pt);
 }
 
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
 void osens_sensor_main(void)
 {
 
-    osens_sensor_init();
+    os_pt_sched_init();
 
-    PT_INIT(&pt_data);
-    PT_INIT(&pt_acq);
+    // timers created by osens_sensor_init() signal these protothreads
+    os_pt_sched_add(&pt_data, pt_data_func, "DATA");
+    os_pt_sched_add(&pt_acq, pt_acq_func, "ACQ");
+    os_pt_sched_add(&pt_stream, pt_stream_func, "STREAM");
 
-    frame_timeout = 0;
-    acq_data = 0;
+    osens_sensor_init();
 
-    while(1)
-    {
-        pt_data_func(&pt_data);
-        pt_acq_func(&pt_acq);
-    }    
+    // sleeps until a timer or the receiver signals a protothread
+    os_pt_sched_run();
 
     //while (1)
     //{
@@ -0,0 +1,474 @@
+/**
+@file osens_mote.h
+@brief Mote side engine: per board context and multi board driver
+
+Each sensor board handled by the mote has its own context (serial port,
+frame buffers, state machine, points database and schedule). A single board
+can be driven by osens_mote_init_v2() (osens.h API) or several boards
+can be driven by the multi board driver (osens_mote_multi_start()).
+
+Boards are reached through a transport (os_transport.h): a serial port
+or, for tests and benchmarks, an in-process pipe or a pty.
+
+Several boards may also share one transport, an RS-485 style multi-drop
+line (osens_mote_bus_create()). Each board has a bus address carried by
+every frame, and the bus lets one transaction at a time on the line,
+serving the boards waiting for it in turn.
+
+On noisy lines, frames can be protected by a Reed-Solomon code
+(osens_mote_ctx_set_fec()) when the board announces OSENS_FEATURE_FEC: bad
+bytes are corrected on reception instead of costing a timeout and a retry.
+Garbage ahead of a frame is skipped byte by byte (osens_frame_check()).
+
+Include os_serial.h, os_transport.h, osens.h, osens_itf.h and osens_stats.h
+before this file.
+*/
+
+#ifndef __OSENS_MOTE_H__
+#define __OSENS_MOTE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** State machine tick (minimum tick time is 1) */
+#define OSENS_SM_TICK_MS          250
+/** Maximum number of boards handled by the multi board driver */
+#define OSENS_MOTE_MAX_BOARDS      64
+/** Maximum number of state machine workers in the multi board driver */
+#define OSENS_MOTE_MAX_WORKERS      8
+/** Receive back off after a transport error (RX thread and multi board I/O loop) */
+#define OSENS_MOTE_RX_ERROR_MS    100
+/** Receive ring size per board (power of 2) */
+#define OSENS_MOTE_RX_RING_SIZE   256
+/** Received frames waiting for the state machine, per board (power of 2) */
+#define OSENS_MOTE_RX_SLOTS         4
+/** Silence that discards a partially received frame */
+#define OSENS_MOTE_RX_GAP_MS       50
+/** Period of the schedule and link utilization report (trace) */
+#define OSENS_MOTE_LINK_REPORT_MS 60000
+/** Clock synchronization period (OSENS_REGMAP_TIME_SYNC) */
+#define OSENS_MOTE_TIME_SYNC_MS   60000
+/** Consecutive CRC errors at a negotiated rate that restart discovery at the base rate */
+#define OSENS_MOTE_LINK_MAX_CRC_ERRORS 3
+/** Maximum number of boards on a bus */
+#define OSENS_MOTE_BUS_MAX_BOARDS  16
+/** Silence on a bus before a request, longer than the frame timeout of the boards (50 ms) */
+#define OSENS_MOTE_BUS_GAP_MS      60
+#ifndef OSENS_MOTE_FRAME_SIZE
+/** Frame buffers per board, the longest frame the mote accepts (OSENS_REGMAP_FRAME_SIZE) */
+#define OSENS_MOTE_FRAME_SIZE     512
+#endif
+
+/** Board context handler */
+typedef struct osens_mote_ctx_s * osens_mote_ctx_t;
+
+/** Bus handler, see osens_mote_bus_create() */
+typedef struct osens_mote_bus_s * osens_mote_bus_t;
+
+/**
+    Link utilization since the context was created.
+    Framing overhead is the size, address, status and CRC bytes of each frame.
+    Idle gaps go from a response to the next request. Wire occupation needs
+    the line speed of the transport (see os_transport_set_line()).
+*/
+typedef struct osens_mote_link_stats_s
+{
+    uint32_t elapsed_ms;
+    uint32_t tx_bytes;          /**< bytes sent */
+    uint32_t rx_bytes;          /**< bytes received, including discarded ones */
+    uint32_t tx_frames;         /**< requests sent */
+    uint32_t rx_frames;         /**< responses and streamed frames received */
+    uint32_t tx_payload;        /**< request bytes besides framing */
+    uint32_t rx_payload;        /**< received bytes besides framing */
+    uint32_t rx_skipped;        /**< received bytes skipped while looking for the start of a frame */
+    uint32_t idle_gaps;         /**< number of response to request gaps */
+    uint32_t idle_gap_avg_us;
+    uint32_t idle_gap_max_us;
+    uint32_t tx_bytes_per_s;
+    uint32_t rx_bytes_per_s;
+    uint32_t bps;               /**< line speed, 0 if unknown */
+    uint16_t frame_max;         /**< longest frame accepted by both sides */
+    double overhead_pct;        /**< framing bytes over frame bytes */
+    double busy_pct;            /**< time the wire was busy */
+    uint32_t sch_bytes_per_s;   /**< bytes per second the current schedule needs */
+    double sch_busy_pct;        /**< wire occupation the current schedule needs */
+    osens_fec_stats_t fec;      /**< forward error correction of the received frames */
+} osens_mote_link_stats_t;
+
+/** Streaming counters, see osens_mote_stream_start() */
+typedef struct osens_mote_stream_stats_s
+{
+    uint8_t active;             /**< subscription accepted by the sensor */
+    uint32_t mask;              /**< streamed points */
+    uint32_t frames;            /**< sample frames received */
+    uint32_t samples;
+    uint32_t lost_frames;       /**< gaps in the frame sequence numbers */
+    uint32_t bad_frames;        /**< invalid or unexpected sample frames */
+} osens_mote_stream_stats_t;
+
+/** Clock synchronization with a board, see osens_mote_get_time_sync() */
+typedef struct osens_mote_time_sync_s
+{
+    uint8_t synced;             /**< clock offset known */
+    uint8_t stamping;           /**< the board stamps its point values */
+    int32_t offset_ms;          /**< sensor clock minus mote clock */
+    uint32_t delay_us;          /**< round trip of the synchronization used, sensor processing excluded */
+    uint32_t syncs;             /**< synchronizations since the last discovery */
+} osens_mote_time_sync_t;
+
+/** Bus arbitration counters, see osens_mote_bus_get_stats() */
+typedef struct osens_mote_bus_stats_s
+{
+    uint8_t num_boards;
+    uint32_t grants;            /**< transactions started */
+    uint32_t holds;             /**< state machine steps delayed while the bus was busy */
+    uint32_t unknown_frames;    /**< received frames that are not an answer of a board of the bus */
+} osens_mote_bus_stats_t;
+
+/** Elements of an array point, see osens_mote_get_span() */
+typedef struct osens_mote_span_s
+{
+    uint8_t type;               /**< OSENS_DT_ARRAY_S16 or OSENS_DT_ARRAY_FLOAT */
+    uint16_t count;             /**< number of elements */
+    const void *data;           /**< elements in host byte order, aligned */
+    uint32_t seq;               /**< reads of the point when the span was taken */
+} osens_mote_span_t;
+
+/**
+    Streamed sample handler, called by the receive thread of the context.
+
+    @param ctx        Board context
+    @param seq        Sequence number of the frame carrying the sample
+    @param values     Values of the streamed points, in point index order
+    @param num_values Number of values
+    @param arg        Argument given to osens_mote_stream_start()
+*/
+typedef void (*osens_mote_stream_func_t)(osens_mote_ctx_t ctx, uint16_t seq, const osens_point_t *values,
+    uint8_t num_values, void *arg);
+
+/**
+    Creates a new board context and opens its serial port.
+
+    @param id      Board identifier (used only for tracing and statistics)
+    @param options Serial port options
+    @retval a valid context or null pointer when the port can not be opened
+*/
+osens_mote_ctx_t osens_mote_ctx_create(uint8_t id, os_serial_options_t options);
+
+/**
+    Creates a new board context using an already opened transport.
+    The context owns the transport, it is closed by osens_mote_ctx_destroy().
+
+    @param id        Board identifier (used only for tracing and statistics)
+    @param transport Transport connected to the sensor board
+    @retval a valid context
+*/
+osens_mote_ctx_t osens_mote_ctx_create_transport(uint8_t id, os_transport_t transport);
+
+/**
+    Starts the state machine and receive threads of a single context.
+*/
+void osens_mote_ctx_start(osens_mote_ctx_t ctx);
+
+/**
+    Closes the transport and releases the context.
+    State machine and I/O must not be running for this context.
+*/
+void osens_mote_ctx_destroy(osens_mote_ctx_t ctx);
+
+/**
+    Runs one state machine step (call it every OSENS_SM_TICK_MS).
+*/
+void osens_mote_ctx_sm(osens_mote_ctx_t ctx);
+
+/**
+    Reads all pending bytes from the transport (non-blocking) into the
+    context receive ring and assembles them into frames. Complete frames
+    are queued for the state machine. Call it from a single thread.
+
+    @retval number of bytes read, 0 if none or -1 on transport error
+*/
+int osens_mote_ctx_rx(osens_mote_ctx_t ctx);
+
+/**
+    Sets the link rates the mote port supports (all by default). After the
+    board identification, the mote reads the rates of the sensor
+    (OSENS_REGMAP_LINK_RATES) and switches both ends to the highest common one.
+    The base rate is the one the transport was opened with. A negotiated rate
+    that fails (CRC errors, timeouts) restarts the discovery at the base rate
+    and is not negotiated again until this function is called.
+
+    @param ctx   Board context
+    @param rates Bit n set for rate n (osens_link_rate_e), 0 disables negotiation
+*/
+void osens_mote_ctx_set_link_rates(osens_mote_ctx_t ctx, uint16_t rates);
+
+/**
+    Sets the optional protocol features the context may use (all by default),
+    applied on the next discovery. The board announces its own features in
+    OSENS_REGMAP_FEATURES and only the common ones are used; boards without
+    the register are probed.
+
+    @param ctx      Board context
+    @param features Bits of osens_feature_e
+*/
+void osens_mote_ctx_set_features(osens_mote_ctx_t ctx, uint32_t features);
+
+/**
+    Protects the frames sent to the board with forward error correction,
+    once the board announced OSENS_FEATURE_FEC in OSENS_REGMAP_FEATURES
+    (boards without the register are never sent protected frames). The
+    board answers with the same code. Discovery frames are not protected.
+
+    @param ctx   Board context
+    @param roots Parity bytes per code word of up to 255 bytes, roots / 2 bad
+                 bytes are corrected per code word: even, up to
+                 OSENS_FEC_MAX_ROOTS, 0 (default) for none
+    @retval 1 code set (used from the next request), 0 invalid code
+*/
+uint8_t osens_mote_ctx_set_fec(osens_mote_ctx_t ctx, uint8_t roots);
+
+/**
+    Features in use with the board (osens_feature_e), meaningful once the
+    board is discovered.
+*/
+uint32_t osens_mote_get_features(osens_mote_ctx_t ctx);
+
+uint8_t osens_mote_ctx_get_id(osens_mote_ctx_t ctx);
+uint8_t osens_mote_get_num_points(osens_mote_ctx_t ctx);
+uint8_t osens_mote_get_brd_desc(osens_mote_ctx_t ctx, osens_brd_id_t *brd);
+uint8_t osens_mote_get_point(osens_mote_ctx_t ctx, uint8_t index, osens_point_t *point);
+uint8_t osens_mote_get_pdesc(osens_mote_ctx_t ctx, uint8_t index, osens_point_desc_t *desc);
+int8_t osens_mote_get_ptype(osens_mote_ctx_t ctx, uint8_t index);
+uint8_t osens_mote_set_pvalue(osens_mote_ctx_t ctx, uint8_t index, osens_point_t *point);
+
+/**
+    Last block read from an array point, without copying it. The elements
+    belong to the context. Reads alternate between two blocks, so the
+    elements are complete and stay unchanged until the second next read of
+    the point (two sampling periods later). A reader that may be slower
+    checks osens_mote_span_valid() once it is done with them, or copies them.
+    Array points can not be written or streamed.
+
+    @param ctx   Board context
+    @param index Point index
+    @param span  Destination
+    @retval 1 span set (count is 0 until the first read)
+    @retval 0 board not discovered yet or not an array point
+*/
+uint8_t osens_mote_get_span(osens_mote_ctx_t ctx, uint8_t index, osens_mote_span_t *span);
+
+/**
+    Checks the elements of a span were not overwritten meanwhile.
+
+    @param ctx   Board context
+    @param index Point index given to osens_mote_get_span()
+    @param span  Span set by osens_mote_get_span()
+    @retval 1 elements read from the span so far are valid
+    @retval 0 a newer read overwrote them, take the span again
+*/
+uint8_t osens_mote_span_valid(osens_mote_ctx_t ctx, uint8_t index, const osens_mote_span_t *span);
+
+/**
+    Reads the aggregates of a point (OSENS_REGMAP_AGGREGATE) instead of its
+    value: each scheduled read gets the count, minimum, maximum, mean and
+    variance of the sensor acquisitions since the previous read, so the
+    changes between two reads are not lost. The point value is not updated
+    while enabled. Boards refusing the register get the value read again.
+
+    @param ctx    Board context
+    @param index  Point index
+    @param enable 1 to read aggregates, 0 to read the value
+    @retval 1 done
+    @retval 0 board not discovered yet or not a readable scalar point
+*/
+uint8_t osens_mote_set_aggregate(osens_mote_ctx_t ctx, uint8_t index, uint8_t enable);
+
+/**
+    Aggregates of the last read of a point, see osens_mote_set_aggregate().
+
+    @param ctx   Board context
+    @param index Point index
+    @param aggr  Destination
+    @retval 1 aggregates set
+    @retval 0 aggregates never read
+*/
+uint8_t osens_mote_get_aggregate(osens_mote_ctx_t ctx, uint8_t index, osens_aggregate_t *aggr);
+
+/**
+    Sample time of the last value read from a point, in the mote clock
+    (os_kernel_get_time_us()). Boards with OSENS_FEATURE_TIMESTAMPS stamp
+    each value with its acquisition time, converted with the clock offset
+    of the last synchronizations (osens_mote_get_time_sync()); values of
+    other boards get the reception time of the answer.
+
+    @param ctx     Board context
+    @param index   Point index
+    @param time_us Destination
+    @param stamped Set to 1 when the time comes from the board, may be null
+    @retval 1 time set
+    @retval 0 board not discovered yet or value never read
+*/
+uint8_t osens_mote_get_point_time(osens_mote_ctx_t ctx, uint8_t index, uint64_t *time_us, uint8_t *stamped);
+
+/**
+    Clock synchronization state of a board. The mote writes its clock to
+    OSENS_REGMAP_TIME_SYNC after the discovery and then every
+    OSENS_MOTE_TIME_SYNC_MS, between two scans, and keeps the offset
+    measured with the shortest round trip among the last ones.
+
+    @param ctx  Board context
+    @param sync Destination
+*/
+void osens_mote_get_time_sync(osens_mote_ctx_t ctx, osens_mote_time_sync_t *sync);
+
+/**
+    Link utilization of a board.
+
+    @param ctx   Board context
+    @param stats Destination
+*/
+void osens_mote_get_link_stats(osens_mote_ctx_t ctx, osens_mote_link_stats_t *stats);
+
+/**
+    Subscribes to a stream of points. The state machine sends the subscription
+    (OSENS_REGMAP_STREAM) between two scans, then the sensor samples the
+    points every period_ms and pushes them batch samples per frame. Pushed
+    frames are decoded by the receive thread, outside the request state
+    machine, and each sample is given to func. The subscription is sent again
+    after a rediscovery. Check osens_mote_get_stream_stats() to know whether
+    the sensor accepted it. It may be called from any thread: func and arg
+    are only used once the state machine has sent the new subscription.
+
+    @param ctx       Board context
+    @param mask      Bit n set to stream point n (readable points only)
+    @param period_ms Sampling period
+    @param batch     Samples per frame (the frame must fit the negotiated frame size)
+    @param func      Sample handler, may be null
+    @param arg       Handler argument
+    @retval 1 subscription queued
+    @retval 0 board not discovered yet or invalid points
+*/
+uint8_t osens_mote_stream_start(osens_mote_ctx_t ctx, uint32_t mask, uint16_t period_ms, uint8_t batch,
+    osens_mote_stream_func_t func, void *arg);
+
+/**
+    Ends the stream subscription.
+
+    @param ctx Board context
+*/
+void osens_mote_stream_stop(osens_mote_ctx_t ctx);
+
+/**
+    Streaming counters since the context was created.
+
+    @param ctx   Board context
+    @param stats Destination
+*/
+void osens_mote_get_stream_stats(osens_mote_ctx_t ctx, osens_mote_stream_stats_t *stats);
+
+/**
+    Sampling timing of a point (see osens_stats.h).
+
+    @param ctx   Board context
+    @param index Point index
+    @param stats Destination
+    @retval 1 when the point exists and the schedule is running
+*/
+uint8_t osens_mote_get_point_stats(osens_mote_ctx_t ctx, uint8_t index, osens_stats_point_t *stats);
+
+/**
+    Logs the schedule with the load and the sampling timing of each point, followed by
+    the measured link utilization (OS_UTIL_LOG_INFO level).
+*/
+void osens_mote_show_link(osens_mote_ctx_t ctx);
+
+/**
+    Starts the multi board driver: one I/O thread moving bytes from all serial
+    ports to their contexts and a small pool of workers running the state machines
+    (board n is handled by worker n % num_workers).
+
+    @param options     Serial options, one entry per board
+    @param num_boards  Number of boards (up to OSENS_MOTE_MAX_BOARDS)
+    @param num_workers Number of state machine workers (up to OSENS_MOTE_MAX_WORKERS)
+    @retval number of boards successfully opened
+*/
+uint8_t osens_mote_multi_start(const os_serial_options_t *options, uint8_t num_boards, uint8_t num_workers);
+
+/**
+    Returns the context for a board handled by the multi board driver.
+
+    @param id Board index, as used in osens_mote_multi_start()
+    @retval a valid context or null pointer
+*/
+osens_mote_ctx_t osens_mote_multi_get_ctx(uint8_t id);
+
+/**
+    Creates a bus: boards sharing one transport, each with its own bus
+    address (see osens_sensor_set_bus_address()). The bus owns the transport.
+
+    @param transport Transport connected to the line
+    @retval a valid bus
+*/
+osens_mote_bus_t osens_mote_bus_create(os_transport_t transport);
+
+/**
+    Adds a board to a bus, before osens_mote_bus_start(). The context is used
+    like any other one, but it belongs to the bus: it is not started nor
+    destroyed on its own. Features a shared line can not carry
+    (OSENS_FEATURES_NOT_ON_BUS) are not used and the link utilization of
+    its boards is the one of the whole line.
+
+    @param bus  Bus
+    @param id   Board identifier (used only for tracing and statistics)
+    @param addr Bus address of the board (1 to OSENS_BUS_ADDR_MAX)
+    @retval a valid context, or null pointer when the bus is full or the address invalid or in use
+*/
+osens_mote_ctx_t osens_mote_bus_add(osens_mote_bus_t bus, uint8_t id, uint8_t addr);
+
+/**
+    Starts the bus: one thread runs the state machines of all its boards,
+    one transaction on the line at a time, and a receive thread gives each
+    answer to the board it comes from. A board waiting for the bus is served
+    before the board that used it last (round robin), and a request is only
+    sent after OSENS_MOTE_BUS_GAP_MS of silence.
+
+    @param bus Bus with at least one board
+*/
+void osens_mote_bus_start(osens_mote_bus_t bus);
+
+/**
+    Runs one state machine step of every board of the bus, granting the line
+    to one transaction at a time (call it every OSENS_SM_TICK_MS). Used by
+    osens_mote_bus_start(), or by drivers running the bus themselves.
+*/
+void osens_mote_bus_sm(osens_mote_bus_t bus);
+
+/**
+    Reads the line like osens_mote_ctx_rx() and gives each answer to the
+    board it comes from. Call it from a single thread.
+
+    @retval number of bytes read, 0 if none or -1 on transport error
+*/
+int osens_mote_bus_rx(osens_mote_bus_t bus);
+
+/**
+    Closes the transport and releases the bus and its boards.
+    The bus must not be running.
+*/
+void osens_mote_bus_destroy(osens_mote_bus_t bus);
+
+/**
+    Bus arbitration counters.
+
+    @param bus   Bus
+    @param stats Destination
+*/
+void osens_mote_bus_get_stats(osens_mote_bus_t bus, osens_mote_bus_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OSENS_MOTE_H__ */
@@ -0,0 +1,139 @@
+/**
+@file osens_sensor.h
+@brief Sensor side engine
+
+The sensor answers requests received from the mote. Received bytes are fed
+by the serial (or SPI) interrupt; on a host, a transport can be attached
+and a receive thread plays the interrupt role.
+
+The link starts at OSENS_LINK_RATE_DEFAULT and the mote may switch it to a
+faster rate (OSENS_REGMAP_LINK_SPEED). The answer is sent at the old rate,
+then the new rate must be confirmed by a valid frame within
+OSENS_SENSOR_LINK_CONFIRM_MS. The sensor goes back to the default rate when
+it is not, or after OSENS_SENSOR_LINK_MAX_ERRORS consecutive invalid frames.
+
+Frames up to OSENS_MAX_FRAME_SIZE are always accepted. Longer frames (see
+OSENS_REGMAP_FRAME_SIZE) are received up to OSENS_SENSOR_FRAME_SIZE and
+answers are limited to the size negotiated with the mote.
+
+The mote may subscribe to a stream of points (OSENS_REGMAP_STREAM): they are
+then sampled every period by a timer and pushed, batch samples per frame
+(OSENS_REGMAP_STREAM_DATA), without further requests. A new discovery (the
+interface version is read again) ends the subscription.
+
+Each acquisition also adds the value of every scalar point to its running
+aggregates (count, minimum, maximum, and mean and variance by Welford's
+method), so a point polled slowly is still summarized faithfully. Reading
+OSENS_REGMAP_AGGREGATE returns the aggregates and starts a new window in the
+same step. With a window of n acquisitions (osens_sensor_set_aggregate_window())
+a complete window is kept until it is read, and replaced by the next one.
+
+The sensor keeps the time of the last acquisition (or write) of each point.
+Once the mote asks for it in OSENS_REGMAP_TIME_SYNC, point reads are
+stamped with it, so the mote knows when a value was sampled instead of when
+it was read. The sensor clock is the host clock in milliseconds, shifted by
+osens_sensor_set_clock_offset() to simulate an unsynchronized board.
+
+Several boards may share one line (RS-485 multi-drop), each with its own bus
+address (osens_sensor_set_bus_address()). A board then only answers the
+requests carrying its address, and does not offer the features a shared
+line can not carry (OSENS_FEATURES_NOT_ON_BUS).
+
+Requests protected by forward error correction (OSENS_FRAME_FEC) are
+corrected before being processed, and answered with the same code; pushed
+samples use the code of the last request. Plain requests get plain answers.
+
+Include os_serial.h, os_transport.h and osens_itf.h before this file.
+*/
+
+#ifndef __OSENS_SENSOR_H__
+#define __OSENS_SENSOR_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** All link rates (osens_link_rate_e) */
+#define OSENS_SENSOR_LINK_RATES_ALL   ((1 << OSENS_LINK_NUM_RATES) - 1)
+/** Time for the first valid frame after a rate switch (a few mote ticks, less than its answer timeout) */
+#define OSENS_SENSOR_LINK_CONFIRM_MS  2500
+/** Consecutive invalid frames that make the sensor go back to the default rate */
+#define OSENS_SENSOR_LINK_MAX_ERRORS     3
+/** Shortest streaming period */
+#define OSENS_SENSOR_STREAM_MIN_MS       5
+#ifndef OSENS_SENSOR_FRAME_SIZE
+/** Receive buffer, the longest frame the sensor accepts (at least OSENS_MAX_FRAME_SIZE) */
+#define OSENS_SENSOR_FRAME_SIZE        512
+#endif
+
+/**
+    Initializes points database, timers and reception.
+    Called by osens_sensor_main().
+*/
+uint8_t osens_sensor_init(void);
+
+/**
+    Sensor main loop (never returns).
+*/
+void osens_sensor_main(void);
+
+/**
+    Attaches a transport to the sensor: answers are sent through it and a
+    receive thread feeds the received bytes to the frame reception.
+    Call it before osens_sensor_main(), the transport must stay open.
+
+    @param transport Transport connected to the mote
+*/
+void osens_sensor_set_transport(os_transport_t transport);
+
+/**
+    Sets the link rates the sensor hardware supports, as answered in
+    OSENS_REGMAP_LINK_RATES (all rates by default).
+
+    @param rates Bit n set for rate n (osens_link_rate_e), the default rate is always supported
+*/
+void osens_sensor_set_link_rates(uint16_t rates);
+
+/**
+    Sets the optional features the sensor supports, as answered in
+    OSENS_REGMAP_FEATURES (all by default). Registers of the other features
+    are answered as not implemented, like a board of an older revision.
+
+    @param mask Bits of osens_feature_e
+*/
+void osens_sensor_set_features(uint32_t mask);
+
+/**
+    Sets the address of the board on a shared bus. Requests without this
+    address are ignored and answers carry it.
+
+    @param addr Bus address (1 to OSENS_BUS_ADDR_MAX), OSENS_BUS_ADDR_NONE (default) for a point to point link
+*/
+void osens_sensor_set_bus_address(uint8_t addr);
+
+/**
+    Reads the forward error correction counters of the received requests.
+
+    @param stats Destination
+*/
+void osens_sensor_get_fec_stats(osens_fec_stats_t *stats);
+
+/**
+    Sets the aggregation window of all points.
+
+    @param acquisitions Acquisitions per window, 0 (default) for windows ending when read
+*/
+void osens_sensor_set_aggregate_window(uint16_t acquisitions);
+
+/**
+    Shifts the sensor clock used in OSENS_REGMAP_TIME_SYNC and sample times.
+
+    @param offset_ms Sensor clock minus host clock, in milliseconds
+*/
+void osens_sensor_set_clock_offset(int32_t offset_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OSENS_SENSOR_H__ */
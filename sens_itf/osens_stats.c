@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "osens_stats.h"
+#include "../os/os_defs.h"
+#include "../os/os_atomic.h"
+#include "../os/os_timer.h"
+#include "../os/os_util.h"
+
+/*
+    One counter block per thread, only written by its owner. Blocks are
+    never freed, counters of finished threads are still part of the sums.
+*/
+typedef struct osens_stats_block_s
+{
+    osens_stats_counters_t boards[OSENS_STATS_MAX_BOARDS];
+    osens_stats_counters_t regs[OSENS_STATS_MAX_REGS];
+} osens_stats_block_t;
+
+static osens_stats_block_t * volatile stats_blocks[OSENS_STATS_MAX_THREADS];
+static volatile uint32_t stats_num_blocks = 0;
+static volatile uint32_t stats_lost_threads = 0;
+static OS_TLS osens_stats_block_t *stats_block = 0;
+static OS_TLS uint8_t stats_block_lost = 0;
+static os_timer_t stats_dump_timer = 0;
+
+// called once per thread
+static osens_stats_block_t *osens_stats_register(void)
+{
+    osens_stats_block_t *block = 0;
+    uint32_t idx;
+
+    idx = OS_ATOMIC_FETCH_INC(&stats_num_blocks);
+    if (idx < OSENS_STATS_MAX_THREADS)
+        block = (osens_stats_block_t *) calloc(1, sizeof(osens_stats_block_t));
+
+    if (block == 0)
+    {
+        OS_ATOMIC_FETCH_INC(&stats_lost_threads);
+        stats_block_lost = 1;
+        return 0;
+    }
+
+    OS_ATOMIC_STORE_REL(&stats_blocks[idx], block);
+
+    return block;
+}
+
+static osens_stats_block_t *osens_stats_get_block(void)
+{
+    if ((stats_block == 0) && !stats_block_lost)
+        stats_block = osens_stats_register();
+
+    return stats_block;
+}
+
+static void osens_stats_add_rtt(osens_stats_counters_t *c, uint32_t rtt_us, uint8_t bucket)
+{
+    c->rtt_sum_us += rtt_us;
+    if (rtt_us > c->rtt_max_us)
+        c->rtt_max_us = rtt_us;
+    c->rtt_hist[bucket]++;
+}
+
+static void osens_stats_sum(osens_stats_counters_t *dst, const osens_stats_counters_t *src)
+{
+    uint8_t n;
+
+    dst->requests += src->requests;
+    for (n = 0; n < OSENS_STATS_NUM_STATUS; n++)
+        dst->responses[n] += src->responses[n];
+    dst->bad_frames += src->bad_frames;
+    dst->timeouts += src->timeouts;
+    dst->retries += src->retries;
+    dst->rediscoveries += src->rediscoveries;
+    dst->scan_overruns += src->scan_overruns;
+    dst->rtt_sum_us += src->rtt_sum_us;
+    if (src->rtt_max_us > dst->rtt_max_us)
+        dst->rtt_max_us = src->rtt_max_us;
+    for (n = 0; n < OSENS_STATS_RTT_BUCKETS; n++)
+        dst->rtt_hist[n] += src->rtt_hist[n];
+}
+
+static uint8_t osens_stats_log2_bucket(uint32_t value, uint32_t base, uint8_t num_buckets)
+{
+    uint8_t bucket = 0;
+
+    while ((bucket < num_buckets - 1) && (value >= (base << bucket)))
+        bucket++;
+
+    return bucket;
+}
+
+uint8_t osens_stats_rtt_bucket(uint32_t rtt_us)
+{
+    return osens_stats_log2_bucket(rtt_us, OSENS_STATS_RTT_BASE_US, OSENS_STATS_RTT_BUCKETS);
+}
+
+uint8_t osens_stats_time_bucket(uint32_t time_us)
+{
+    return osens_stats_log2_bucket(time_us, OSENS_STATS_TIME_BASE_US, OSENS_STATS_TIME_BUCKETS);
+}
+
+void osens_stats_request(uint8_t board, uint8_t reg, uint8_t retry)
+{
+    osens_stats_block_t *block = osens_stats_get_block();
+
+    if (block == 0)
+        return;
+
+    block->regs[reg].requests++;
+    block->regs[reg].retries += retry ? 1 : 0;
+
+    if (board < OSENS_STATS_MAX_BOARDS)
+    {
+        block->boards[board].requests++;
+        block->boards[board].retries += retry ? 1 : 0;
+    }
+}
+
+void osens_stats_response(uint8_t board, uint8_t reg, uint8_t status, uint8_t valid, uint32_t rtt_us)
+{
+    osens_stats_block_t *block = osens_stats_get_block();
+    uint8_t bucket = osens_stats_rtt_bucket(rtt_us);
+
+    if (block == 0)
+        return;
+
+    if (status >= OSENS_STATS_NUM_STATUS)
+        status = OSENS_ANS_ERROR;
+
+    block->regs[reg].responses[status]++;
+    block->regs[reg].bad_frames += valid ? 0 : 1;
+    osens_stats_add_rtt(&block->regs[reg], rtt_us, bucket);
+
+    if (board < OSENS_STATS_MAX_BOARDS)
+    {
+        block->boards[board].responses[status]++;
+        block->boards[board].bad_frames += valid ? 0 : 1;
+        osens_stats_add_rtt(&block->boards[board], rtt_us, bucket);
+    }
+}
+
+void osens_stats_timeout(uint8_t board, uint8_t reg)
+{
+    osens_stats_block_t *block = osens_stats_get_block();
+
+    if (block == 0)
+        return;
+
+    block->regs[reg].timeouts++;
+
+    if (board < OSENS_STATS_MAX_BOARDS)
+        block->boards[board].timeouts++;
+}
+
+void osens_stats_rediscovery(uint8_t board)
+{
+    osens_stats_block_t *block = osens_stats_get_block();
+
+    if ((block == 0) || (board >= OSENS_STATS_MAX_BOARDS))
+        return;
+
+    block->boards[board].rediscoveries++;
+}
+
+void osens_stats_scan_overrun(uint8_t board)
+{
+    osens_stats_block_t *block = osens_stats_get_block();
+
+    if ((block == 0) || (board >= OSENS_STATS_MAX_BOARDS))
+        return;
+
+    block->boards[board].scan_overruns++;
+}
+
+void osens_stats_point_sample(osens_stats_point_t *point, uint32_t interval_us, uint32_t lateness_us, uint32_t misses)
+{
+    if (point->samples > 0)
+    {
+        if ((point->samples == 1) || (interval_us < point->interval_min_us))
+            point->interval_min_us = interval_us;
+        if (interval_us > point->interval_max_us)
+            point->interval_max_us = interval_us;
+        point->interval_sum_us += interval_us;
+        point->interval_hist[osens_stats_time_bucket(interval_us)]++;
+    }
+
+    if (lateness_us > point->lateness_max_us)
+        point->lateness_max_us = lateness_us;
+    point->lateness_sum_us += lateness_us;
+    point->lateness_hist[osens_stats_time_bucket(lateness_us)]++;
+
+    point->deadline_misses += misses;
+    point->samples++;
+}
+
+void osens_get_stats(osens_stats_t *stats)
+{
+    uint32_t num_blocks;
+    uint32_t n, m;
+
+    OS_UTIL_ASSERT(stats);
+
+    memset(stats, 0, sizeof(osens_stats_t));
+
+    num_blocks = OS_ATOMIC_LOAD_ACQ(&stats_num_blocks);
+    if (num_blocks > OSENS_STATS_MAX_THREADS)
+        num_blocks = OSENS_STATS_MAX_THREADS;
+
+    for (n = 0; n < num_blocks; n++)
+    {
+        const osens_stats_block_t *block = OS_ATOMIC_LOAD_ACQ(&stats_blocks[n]);
+
+        // registered but not published yet
+        if (block == 0)
+            continue;
+
+        for (m = 0; m < OSENS_STATS_MAX_BOARDS; m++)
+            osens_stats_sum(&stats->boards[m], &block->boards[m]);
+
+        for (m = 0; m < OSENS_STATS_MAX_REGS; m++)
+        {
+            osens_stats_sum(&stats->regs[m], &block->regs[m]);
+            osens_stats_sum(&stats->total, &block->regs[m]);
+        }
+
+        // rediscoveries and scan overruns are not related to a register
+        for (m = 0; m < OSENS_STATS_MAX_BOARDS; m++)
+        {
+            stats->total.rediscoveries += block->boards[m].rediscoveries;
+            stats->total.scan_overruns += block->boards[m].scan_overruns;
+        }
+    }
+
+    stats->lost_threads = stats_lost_threads;
+}
+
+static void osens_stats_dump_counters(const char *name, uint32_t id, const osens_stats_counters_t *c)
+{
+    uint32_t num_res = 0;
+    uint8_t n;
+
+    for (n = 0; n < OSENS_STATS_NUM_STATUS; n++)
+        num_res += c->responses[n];
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("%s %02X: req %u ok %u crc %u err %u bad %u tmout %u retry %u rediscovery %u overrun %u rtt avg %u max %u us\n",
+        name, id, c->requests, c->responses[OSENS_ANS_OK], c->responses[OSENS_ANS_CRC_ERROR],
+        num_res - c->responses[OSENS_ANS_OK] - c->responses[OSENS_ANS_CRC_ERROR], c->bad_frames,
+        c->timeouts, c->retries, c->rediscoveries, c->scan_overruns,
+        num_res ? (uint32_t) (c->rtt_sum_us / num_res) : 0, c->rtt_max_us));
+}
+
+void osens_stats_dump(void)
+{
+    osens_stats_t *stats;
+    // OSENS_STATS_RTT_BUCKETS counters, up to 10 digits each
+    char hist[OSENS_STATS_RTT_BUCKETS * 11 + 1];
+    int pos;
+    uint32_t n;
+
+    stats = (osens_stats_t *) malloc(sizeof(osens_stats_t));
+    if (stats == 0)
+        return;
+
+    osens_get_stats(stats);
+
+    osens_stats_dump_counters("total", 0, &stats->total);
+    if (stats->lost_threads)
+        OS_UTIL_LOG_LVL(OS_UTIL_LOG_WARN, 1, ("%u threads without counters (more than %u)\n", stats->lost_threads, OSENS_STATS_MAX_THREADS));
+
+    for (n = 0, pos = 0; n < OSENS_STATS_RTT_BUCKETS; n++)
+        pos += snprintf(&hist[pos], sizeof(hist) - pos, " %u", stats->total.rtt_hist[n]);
+
+    OS_UTIL_LOG_LVL(OS_UTIL_LOG_INFO, 1, ("rtt histogram (<%u us, x2 per bucket):%s\n", OSENS_STATS_RTT_BASE_US, hist));
+
+    for (n = 0; n < OSENS_STATS_MAX_BOARDS; n++)
+    {
+        if (stats->boards[n].requests)
+            osens_stats_dump_counters("board", n, &stats->boards[n]);
+    }
+
+    for (n = 0; n < OSENS_STATS_MAX_REGS; n++)
+    {
+        if (stats->regs[n].requests)
+            osens_stats_dump_counters("reg", n, &stats->regs[n]);
+    }
+
+    free(stats);
+}
+
+static void osens_stats_dump_timer_func(void *arg)
+{
+    osens_stats_dump();
+}
+
+uint8_t osens_stats_dump_periodic(uint32_t period_ms)
+{
+    if (period_ms == 0)
+        return (stats_dump_timer == 0) || (os_timer_deactivate(stats_dump_timer) == OS_SUCCESS);
+
+    if (stats_dump_timer == 0)
+    {
+        stats_dump_timer = os_timer_create(osens_stats_dump_timer_func, 0, period_ms, period_ms, 1);
+        return stats_dump_timer != 0;
+    }
+
+    return os_timer_change(stats_dump_timer, period_ms, period_ms) == OS_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/**
+@file osens_stats.h
+@brief Sensor interface transaction metrics
+
+Every transaction of the mote state machine is counted per register and per
+board: requests sent, responses by status, timeouts, retries and full
+rediscoveries (state machine back to INIT), plus a round trip time histogram.
+
+Counters are written without locks: each thread owns a counter block
+(allocated on its first event) and only increments its own block.
+osens_get_stats() sums the blocks of all threads, so readers never stop the
+state machines. Values read while a transaction is being recorded may be one
+event behind.
+
+RTT histogram bucket 0 counts round trips shorter than
+OSENS_STATS_RTT_BASE_US, bucket n (n > 0) the ones in
+[OSENS_STATS_RTT_BASE_US << (n - 1), OSENS_STATS_RTT_BASE_US << n) and the
+last bucket everything longer.
+
+Sampling of each scheduled point is measured by the mote context that reads
+it (osens_mote_get_point_stats()): the interval between two reads and the
+lateness of each read. Read k of a point with period T is due at t0 + k.T
+and must happen before the next one is due, otherwise it counts as a
+deadline miss. Interval and lateness histograms use the same log2 buckets
+as RTT, starting at OSENS_STATS_TIME_BASE_US. A scan cycle longer than the
+shortest period of the schedule is a scan overrun, counted per board.
+*/
+
+#ifndef __OSENS_STATS_H__
+#define __OSENS_STATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of registers (one address byte) */
+#define OSENS_STATS_MAX_REGS        256
+/** Boards with their own counters (same as OSENS_MOTE_MAX_BOARDS), others are only counted per register */
+#define OSENS_STATS_MAX_BOARDS       64
+/** Threads with their own counter block: receive and state machine threads of every board, plus some application threads. Events of further threads are lost */
+#define OSENS_STATS_MAX_THREADS      (2 * OSENS_STATS_MAX_BOARDS + 16)
+/** Response status codes counted (osens_ans_status_e) */
+#define OSENS_STATS_NUM_STATUS        6
+/** RTT histogram buckets */
+#define OSENS_STATS_RTT_BUCKETS      16
+/** Upper limit of the first RTT bucket */
+#define OSENS_STATS_RTT_BASE_US     128
+/** Sampling interval and lateness histogram buckets */
+#define OSENS_STATS_TIME_BUCKETS     16
+/** Upper limit of the first sampling interval and lateness bucket */
+#define OSENS_STATS_TIME_BASE_US   4000
+
+/** Transaction counters */
+typedef struct osens_stats_counters_s
+{
+    uint32_t requests;                           /**< requests sent */
+    uint32_t responses[OSENS_STATS_NUM_STATUS];  /**< responses by status (osens_ans_status_e), CRC errors included */
+    uint32_t bad_frames;                         /**< valid responses with unexpected size or register */
+    uint32_t timeouts;                           /**< requests without response */
+    uint32_t retries;                            /**< requests sent again */
+    uint32_t rediscoveries;                      /**< state machine restarts (board counters only) */
+    uint32_t scan_overruns;                      /**< scans longer than the shortest period plus one tick (board counters only) */
+    uint32_t rtt_max_us;                         /**< longest round trip */
+    uint64_t rtt_sum_us;                         /**< sum of round trips, for the average */
+    uint32_t rtt_hist[OSENS_STATS_RTT_BUCKETS];  /**< round trip histogram */
+} osens_stats_counters_t;
+
+/** Sampling timing of a point */
+typedef struct osens_stats_point_s
+{
+    uint32_t samples;                                 /**< successful reads */
+    uint32_t deadline_misses;                         /**< periods without a read */
+    uint32_t interval_min_us;
+    uint32_t interval_max_us;
+    uint64_t interval_sum_us;                         /**< sum of samples - 1 intervals */
+    uint32_t lateness_max_us;
+    uint64_t lateness_sum_us;
+    uint32_t interval_hist[OSENS_STATS_TIME_BUCKETS];
+    uint32_t lateness_hist[OSENS_STATS_TIME_BUCKETS];
+} osens_stats_point_t;
+
+/** Aggregated metrics */
+typedef struct osens_stats_s
+{
+    osens_stats_counters_t total;
+    osens_stats_counters_t boards[OSENS_STATS_MAX_BOARDS];
+    osens_stats_counters_t regs[OSENS_STATS_MAX_REGS];
+    uint32_t lost_threads;                       /**< threads without counter block (each one counted once) */
+} osens_stats_t;
+
+/**
+    Count a request sent to a board.
+
+    @param board board identifier
+    @param reg   register address
+    @param retry non zero when the request is a retry
+*/
+void osens_stats_request(uint8_t board, uint8_t reg, uint8_t retry);
+
+/**
+    Count a response.
+
+    @param board  board identifier
+    @param reg    register address of the request
+    @param status response status (osens_ans_status_e), OSENS_ANS_CRC_ERROR for CRC errors
+    @param valid  zero when the response has an unexpected size or register
+    @param rtt_us time between the request and the response
+*/
+void osens_stats_response(uint8_t board, uint8_t reg, uint8_t status, uint8_t valid, uint32_t rtt_us);
+
+/**
+    Count a request without response.
+
+    @param board board identifier
+    @param reg   register address
+*/
+void osens_stats_timeout(uint8_t board, uint8_t reg);
+
+/**
+    Count a full rediscovery of a board.
+
+    @param board board identifier
+*/
+void osens_stats_rediscovery(uint8_t board);
+
+/**
+    Count a scan cycle longer than the shortest sampling period.
+
+    @param board board identifier
+*/
+void osens_stats_scan_overrun(uint8_t board);
+
+/**
+    Add a read to the sampling timing of a point.
+
+    @param point       point timing
+    @param interval_us time since the previous read (ignored for the first read)
+    @param lateness_us time since the read was due
+    @param misses      deadlines missed before this read
+*/
+void osens_stats_point_sample(osens_stats_point_t *point, uint32_t interval_us, uint32_t lateness_us, uint32_t misses);
+
+/**
+    Sum the counters of all threads.
+
+    @param stats destination (large, better not on the stack of small threads)
+*/
+void osens_get_stats(osens_stats_t *stats);
+
+/**
+    Log the totals and the counters of each active board and register
+    (OS_UTIL_LOG_INFO level).
+*/
+void osens_stats_dump(void);
+
+/**
+    Call osens_stats_dump() periodically.
+
+    @param period_ms dump period, 0 stops the periodic dump
+    @retval 1 periodic dump started or stopped
+    @retval 0 timer could not be created
+*/
+uint8_t osens_stats_dump_periodic(uint32_t period_ms);
+
+/**
+    Bucket of a round trip time in the RTT histogram.
+*/
+uint8_t osens_stats_rtt_bucket(uint32_t rtt_us);
+
+/**
+    Bucket of a sampling interval or lateness in the point histograms.
+*/
+uint8_t osens_stats_time_bucket(uint32_t time_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OSENS_STATS_H__ */
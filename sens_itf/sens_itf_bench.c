@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "../os/os_timer.h"
+#include "../os/os_util.h"
+#include "../util/buf_io.h"
+#include "../util/crc16.h"
+#include "../owsn/scheduler.h"
+
+/*
+    Host benchmarks for the frame codec.
+    Each benchmark runs a fixed number of iterations and reports ns/op.
+*/
+
+#define BENCH_ITERATIONS 1000000UL
+
+typedef void (*bench_func_t)(unsigned long iterations);
+
+static volatile uint32_t bench_sink;
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static void bench_run(const char *name, bench_func_t func, unsigned long iterations)
+{
+    double start, stop;
+
+    func(iterations / 100); // warm up
+    start = bench_now_ns();
+    func(iterations);
+    stop = bench_now_ns();
+
+    printf("%-32s %10lu ops %10.1f ns/op\n", name, iterations, (stop - start) / iterations);
+}
+
+static void bench_crc16(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    unsigned long n;
+
+    memset(frame, 0x5A, sizeof(frame));
+    for (n = 0; n < iterations; n++)
+        bench_sink += crc16_calc(frame, sizeof(frame) - 2);
+}
+
+static void bench_pack_req(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    osens_cmd_req_t cmd;
+    unsigned long n;
+
+    memset(&cmd, 0, sizeof(cmd));
+    for (n = 0; n < iterations; n++)
+    {
+        cmd.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1 + (n & 0x1F);
+        bench_sink += osens_pack_cmd_req(&cmd, frame);
+    }
+}
+
+static void bench_unpack_req(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    osens_cmd_req_t cmd;
+    uint8_t size;
+    unsigned long n;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.hdr.addr = OSENS_REGMAP_WRITE_POINT_DATA_1;
+    cmd.payload.point_value_cmd.type = OSENS_DT_DOUBLE;
+    cmd.payload.point_value_cmd.value.fp64 = 3.1415;
+    size = osens_pack_cmd_req(&cmd, frame);
+
+    for (n = 0; n < iterations; n++)
+        bench_sink += osens_unpack_cmd_req(&cmd, frame, size);
+}
+
+static void bench_pack_res(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    osens_cmd_res_t ans;
+    unsigned long n;
+
+    memset(&ans, 0, sizeof(ans));
+    ans.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans.hdr.status = OSENS_ANS_OK;
+    ans.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+
+    for (n = 0; n < iterations; n++)
+    {
+        ans.payload.point_value_cmd.value.fp32 = (float) n;
+        bench_sink += osens_pack_cmd_res(&ans, frame);
+    }
+}
+
+static void bench_unpack_res(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    osens_cmd_res_t ans;
+    uint8_t size;
+    unsigned long n;
+
+    memset(&ans, 0, sizeof(ans));
+    ans.hdr.addr = OSENS_REGMAP_POINT_DESC_1;
+    ans.hdr.status = OSENS_ANS_OK;
+    strcpy((char *) ans.payload.point_desc_cmd.name, "TEMP");
+    ans.payload.point_desc_cmd.type = OSENS_DT_FLOAT;
+    ans.payload.point_desc_cmd.sampling_time_x250ms = 40;
+    size = osens_pack_cmd_res(&ans, frame);
+
+    for (n = 0; n < iterations; n++)
+        bench_sink += osens_unpack_cmd_res(&ans, frame, size);
+}
+
+// an answer behind 16 bytes of line noise
+static void bench_frame_find(unsigned long iterations)
+{
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    osens_cmd_res_t ans;
+    uint16_t len;
+    uint16_t size;
+    uint32_t seed = 1;
+    unsigned long n;
+
+    for (n = 0; n < 16; n++)
+    {
+        seed = seed * 1103515245UL + 12345UL;
+        frame[n] = (uint8_t) (seed >> 16);
+    }
+
+    memset(&ans, 0, sizeof(ans));
+    ans.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans.hdr.status = OSENS_ANS_OK;
+    ans.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+    len = 16 + osens_pack_cmd_res(&ans, &frame[16]);
+
+    for (n = 0; n < iterations; n++)
+        bench_sink += osens_frame_find(frame, len, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size);
+}
+
+static void bench_timer_func(void *arg)
+{
+    bench_sink++;
+}
+
+static void bench_timer_postpone(unsigned long iterations)
+{
+    static os_timer_t tmr = 0;
+    unsigned long n;
+
+    if (tmr == 0)
+        tmr = os_timer_create(bench_timer_func, 0, 50, 0, 1);
+
+    // same pattern as the sensor inter-byte timeout
+    for (n = 0; n < iterations; n++)
+        os_timer_change(tmr, 50, 0);
+}
+
+static void bench_sched_task(void)
+{
+    bench_sink++;
+}
+
+static void bench_sched_push_pop(unsigned long iterations)
+{
+    unsigned long n;
+
+    // bursts of 8 tasks over all priorities, then the queue is drained
+    for (n = 0; n < iterations; n++)
+    {
+        scheduler_push_task(bench_sched_task, (task_prio_t) (TASKPRIO_RESNOTIF_RX + (n % (TASKPRIO_MAX - 1))));
+
+        if ((n & 7) == 7)
+            scheduler_run_pending();
+    }
+
+    scheduler_run_pending();
+}
+
+static void bench_log(unsigned long iterations)
+{
+    unsigned long n;
+
+    // caller side cost only, records beyond the ring size are dropped
+    for (n = 0; n < iterations; n++)
+        OS_UTIL_LOG(1, ("Point %02d: %f (%s)\n", (int) (n & 0x1F), 3.1415, "TEMP"));
+}
+
+int main(void)
+{
+    FILE *log_fp;
+
+    bench_run("crc16 (126 bytes)", bench_crc16, BENCH_ITERATIONS);
+    bench_run("pack req (read point)", bench_pack_req, BENCH_ITERATIONS);
+    bench_run("unpack req (write point)", bench_unpack_req, BENCH_ITERATIONS);
+    bench_run("pack res (point value)", bench_pack_res, BENCH_ITERATIONS);
+    bench_run("unpack res (point desc)", bench_unpack_res, BENCH_ITERATIONS);
+    bench_run("frame find (16 garbage bytes)", bench_frame_find, BENCH_ITERATIONS);
+    bench_run("timer postpone", bench_timer_postpone, BENCH_ITERATIONS);
+
+    scheduler_init();
+    bench_run("owsn task push + pop", bench_sched_push_pop, BENCH_ITERATIONS);
+    bench_run("log (disabled)", bench_log, BENCH_ITERATIONS);
+
+    log_fp = fopen("/dev/null", "w");
+    if (log_fp)
+    {
+        os_util_log_set_output(log_fp);
+        os_util_log_start();
+        bench_run("log (enabled)", bench_log, BENCH_ITERATIONS);
+        os_util_log_stop();
+        os_util_log_set_output(stdout);
+        fclose(log_fp);
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "osens.h"
+#include "osens_itf.h"
+#include "../os/os_defs.h"
+#include "../os/os_kernel.h"
+#include "../os/os_serial.h"
+#include "../os/os_transport.h"
+#include "../os/os_util.h"
+#include "osens_stats.h"
+#include "osens_mote.h"
+#include "osens_sensor.h"
+#include "osens_capture.h"
+
+/*
+    Mote and sensor in one process, connected by an in-process pipe
+    (default) or by a pty pair.
+
+    usage: sens_itf_loopback [-t seconds] [-p] [-s] [-v] [-c file] [-f roots]
+        -t  run time (default 10s)
+        -p  use a pty pair instead of the in-process pipe
+        -s  virtual time: the run time elapses as fast as possible (pipe only)
+        -v  enable log
+        -c  capture frames into file (see osens_capdec)
+        -f  protect frames with roots parity bytes per code word
+
+    The mote end emulates the 115200 bps 8N1 line of a real board, for the
+    link utilization report, and follows the negotiated link rate.
+
+    Exit code is 0 when the mote discovered the sensor board.
+*/
+
+#define LOOPBACK_DEF_TIME_S     10
+#define LOOPBACK_SENSOR_INIT_MS 100
+#define LOOPBACK_LINE_BPS       115200
+#define LOOPBACK_LINE_CHAR_BITS 10
+
+static osens_stats_t stats;
+
+static void* loopback_sensor(void *param)
+{
+    osens_sensor_set_transport((os_transport_t) param);
+    osens_sensor_main();
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    os_transport_t mote_end = 0;
+    os_transport_t sensor_end = 0;
+    osens_mote_ctx_t ctx;
+    osens_mote_link_stats_t link;
+    osens_brd_id_t brd;
+    osens_point_desc_t desc;
+    osens_point_t point;
+    osens_stats_point_t timing;
+    uint32_t run_time_s = LOOPBACK_DEF_TIME_S;
+    int use_pty = 0;
+    int use_sim = 0;
+    int use_log = 0;
+    const char *cap_file = 0;
+    uint8_t fec_roots = 0;
+    int ok = 0;
+    int n;
+
+    for (n = 1; n < argc; n++)
+    {
+        if ((strcmp(argv[n], "-t") == 0) && (n + 1 < argc))
+            run_time_s = (uint32_t) atoi(argv[++n]);
+        else if (strcmp(argv[n], "-p") == 0)
+            use_pty = 1;
+        else if (strcmp(argv[n], "-s") == 0)
+            use_sim = 1;
+        else if (strcmp(argv[n], "-v") == 0)
+            use_log = 1;
+        else if ((strcmp(argv[n], "-c") == 0) && (n + 1 < argc))
+            cap_file = argv[++n];
+        else if ((strcmp(argv[n], "-f") == 0) && (n + 1 < argc))
+            fec_roots = (uint8_t) atoi(argv[++n]);
+        else
+        {
+            printf("usage: %s [-t seconds] [-p] [-s] [-v] [-c file] [-f roots]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // a pty is read with poll(), which does not advance the virtual clock
+    if (use_sim && (use_pty || (os_kernel_sim_enable() != OS_SUCCESS)))
+    {
+        printf("Virtual time requires the pipe transport\n");
+        return 1;
+    }
+
+    if (use_log)
+        os_util_log_start();
+
+    if (cap_file)
+        osens_capture_start(cap_file);
+
+    if (use_pty)
+        ok = os_transport_pty_create(&mote_end, &sensor_end, 0, 0);
+    else
+        ok = os_transport_pipe_create(&mote_end, &sensor_end, 0);
+
+    if (ok != OS_SUCCESS)
+    {
+        printf("Could not create the %s transport\n", use_pty ? "pty" : "pipe");
+        return 1;
+    }
+
+    os_kernel_create(loopback_sensor, "SENSOR", (os_thread_arg) sensor_end,
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+
+    // requests sent before the sensor initialization would be lost
+    os_kernel_sleep(LOOPBACK_SENSOR_INIT_MS);
+
+    os_transport_set_line(mote_end, LOOPBACK_LINE_BPS, LOOPBACK_LINE_CHAR_BITS);
+    ctx = osens_mote_ctx_create_transport(0, mote_end);
+    if (!osens_mote_ctx_set_fec(ctx, fec_roots))
+    {
+        printf("Invalid number of parity bytes %u\n", fec_roots);
+        return 1;
+    }
+    osens_mote_ctx_start(ctx);
+
+    os_kernel_sleep(run_time_s * 1000);
+
+    os_util_log_stop();
+    osens_capture_stop();
+
+    ok = osens_mote_get_brd_desc(ctx, &brd) && (osens_mote_get_num_points(ctx) > 0);
+
+    if (ok)
+    {
+        printf("Board %.8s/%.8s, %u points\n", brd.manufactor, brd.model, osens_mote_get_num_points(ctx));
+
+        for (n = 0; n < osens_mote_get_num_points(ctx); n++)
+        {
+            osens_mote_get_pdesc(ctx, (uint8_t) n, &desc);
+            osens_mote_get_point(ctx, (uint8_t) n, &point);
+            osens_mote_get_point_stats(ctx, (uint8_t) n, &timing);
+            printf("  %-8.8s type %u value %g, %u reads, %u deadlines missed, late max %u ms\n", desc.name, desc.type,
+                osens_point_to_double(&point), timing.samples, timing.deadline_misses, timing.lateness_max_us / 1000);
+        }
+    }
+    else
+    {
+        printf("Sensor board not discovered\n");
+    }
+
+    osens_get_stats(&stats);
+    printf("%u requests, %u ok, %u timeouts, %u retries, %u rediscoveries, %u scan overruns, rtt max %u us\n",
+        stats.total.requests, stats.total.responses[OSENS_ANS_OK], stats.total.timeouts,
+        stats.total.retries, stats.total.rediscoveries, stats.total.scan_overruns, stats.total.rtt_max_us);
+
+    osens_mote_get_link_stats(ctx, &link);
+    printf("link: tx %u B/s, rx %u B/s, overhead %.1f%%, idle gap avg %u us, busy %.3f%% (schedule needs %.3f%%) at %u bps\n",
+        link.tx_bytes_per_s, link.rx_bytes_per_s, link.overhead_pct, link.idle_gap_avg_us,
+        link.busy_pct, link.sch_busy_pct, link.bps);
+
+    if (fec_roots)
+        printf("fec: %u frames, %u corrected (%u bytes), %u uncorrectable\n",
+            link.fec.frames, link.fec.corrected, link.fec.bytes, link.fec.uncorrectable);
+
+    return ok ? 0 : 1;
+}
@@ -1,9 +1,21 @@
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include "osens.h"
 #include "osens_itf.h"
+#include "osens_capture.h"
 #include "../os/os_defs.h"
+#include "../os/os_atomic.h"
 #include "../os/os_timer.h"
+#include "../os/os_kernel.h"
+#include "../os/os_serial.h"
+#include "../os/os_transport.h"
+#include "osens_stats.h"
+#include "osens_mote.h"
+#include "osens_sensor.h"
+#include "../pt/pt.h"
+#include "../os/os_pt_sched.h"
+#include "../owsn/scheduler.h"
 #include "../os/os_util.h"
 #include "../util/buf_io.h"
 #include "../util/crc16.h"
@@ -89,7 +101,7 @@ static void validate_point_value(osens_point_t *req, osens_point_t *ans)
         TEST_ASSERT_EQUAL_FLOAT(req->value.fp32, ans->value.fp32);
         break;
     case OSENS_DT_DOUBLE:
-        TEST_ASSERT_EQUAL_DOUBLE(req->value.fp64, ans->.value.fp64);
+        TEST_ASSERT_EQUAL_DOUBLE(req->value.fp64, ans->value.fp64);
         break;
     default:
         break;
@@ -600,6 +612,51 @@ void test_OSENS_REGMAP_READ_POINT_DATA_1(void)
     validate_point_value(&ans_sensor.payload.point_value_cmd, &ans_mote.payload.point_value_cmd);
 }
 
+static void test_OSENS_REGMAP_READ_POINT_ARRAY(void)
+{
+    float wave[20];
+    float copy[20];
+    uint8_t n;
+
+    setUp();
+
+    cmd_res_size = 8 + sizeof(wave);
+    cmd_number = OSENS_REGMAP_READ_POINT_DATA_1;
+
+    for (n = 0; n < 20; n++)
+        wave[n] = n * 0.5f - 3.0f;
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_ARRAY_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.array.count = 20;
+    ans_sensor.payload.point_value_cmd.value.array.data = wave;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res, elements stay in the frame
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    test_decode_ans(cmd_res_size, size_mote,&ans_sensor,&ans_mote);
+    TEST_ASSERT_EQUAL_UINT16(20, ans_mote.payload.point_value_cmd.value.array.count);
+    TEST_ASSERT_EQUAL_PTR(&frame[6], ans_mote.payload.point_value_cmd.value.array.data);
+    buf_io_get32_fl_n(copy, ans_mote.payload.point_value_cmd.value.array.data, 20);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(wave, copy, 20);
+
+    // count larger than the frame
+    buf_io_put16_tl(21, &frame[4]);
+    buf_io_put16_tl(crc16_calc(frame, size_sensor - 2), &frame[size_sensor - 2]);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_res(&ans_mote, frame, size_sensor));
+
+    // arrays and unknown types have no fixed value size
+    TEST_ASSERT_EQUAL_UINT8(8, osens_point_value_size(OSENS_DT_DOUBLE));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_point_value_size(OSENS_DT_ARRAY_S16));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_point_value_size(OSENS_DT_ARRAY_FLOAT));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_point_value_size(0xFF));
+    TEST_ASSERT_EQUAL_UINT8(4, osens_array_elem_size(OSENS_DT_ARRAY_FLOAT));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_array_elem_size(0xFF));
+}
+
 void test_OSENS_REGMAP_WRITE_POINT_DATA_5(void)
 {
     cmd_req_size = 9;
@@ -629,6 +686,570 @@ void test_OSENS_REGMAP_WRITE_POINT_DATA_5(void)
     test_decode_ans(cmd_res_size, size_mote,&ans_sensor,&ans_mote);
 }
 
+static void test_OSENS_REGMAP_LINK_RATES(void)
+{
+    cmd_req_size = 4;
+    cmd_res_size = 8;
+    cmd_number = OSENS_REGMAP_LINK_RATES;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.link_rates_cmd.rates = (1 << OSENS_LINK_RATE_115200) | (1 << OSENS_LINK_RATE_921600);
+    ans_sensor.payload.link_rates_cmd.current = OSENS_LINK_RATE_115200;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    test_decode_ans(cmd_res_size, size_mote,&ans_sensor,&ans_mote);
+    TEST_ASSERT_EQUAL_UINT16(ans_sensor.payload.link_rates_cmd.rates, ans_mote.payload.link_rates_cmd.rates);
+    TEST_ASSERT_EQUAL_UINT8(ans_sensor.payload.link_rates_cmd.current, ans_mote.payload.link_rates_cmd.current);
+
+    TEST_ASSERT_EQUAL_UINT32(115200, osens_link_rate_to_bps(OSENS_LINK_RATE_DEFAULT));
+    TEST_ASSERT_EQUAL_UINT32(921600, osens_link_rate_to_bps(OSENS_LINK_RATE_921600));
+    TEST_ASSERT_EQUAL_UINT32(0, osens_link_rate_to_bps(OSENS_LINK_NUM_RATES));
+}
+
+static void test_OSENS_REGMAP_LINK_SPEED(void)
+{
+    setUp();
+
+    cmd_req_size = 5;
+    cmd_res_size = 5;
+    cmd_number = OSENS_REGMAP_LINK_SPEED;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    cmd_mote.payload.link_speed_cmd.rate = OSENS_LINK_RATE_3M;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_mote.payload.link_speed_cmd.rate, cmd_sensor.payload.link_speed_cmd.rate);
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    test_decode_ans(cmd_res_size, size_mote,&ans_sensor,&ans_mote);
+}
+
+static void test_OSENS_REGMAP_FRAME_SIZE(void)
+{
+    setUp();
+
+    cmd_req_size = 6;
+    cmd_res_size = 7;
+    cmd_number = OSENS_REGMAP_FRAME_SIZE;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    cmd_mote.payload.frame_size_cmd.max_size = 512;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_UINT16(512, cmd_sensor.payload.frame_size_cmd.max_size);
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.frame_size_cmd.max_size = 1024;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    test_decode_ans(cmd_res_size, size_mote,&ans_sensor,&ans_mote);
+    TEST_ASSERT_EQUAL_UINT16(1024, ans_mote.payload.frame_size_cmd.max_size);
+}
+
+static void test_OSENS_REGMAP_STREAM(void)
+{
+    uint8_t samples[4] = { 0x11, 0x22, 0x33, 0x44 };
+
+    setUp();
+
+    cmd_req_size = 11;
+    cmd_res_size = 8 + sizeof(samples);
+    cmd_number = OSENS_REGMAP_STREAM;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    cmd_mote.payload.stream_cmd.mask = 0x80000005;
+    cmd_mote.payload.stream_cmd.period_ms = 250;
+    cmd_mote.payload.stream_cmd.batch = 8;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_UINT32(0x80000005, cmd_sensor.payload.stream_cmd.mask);
+    TEST_ASSERT_EQUAL_UINT16(250, cmd_sensor.payload.stream_cmd.period_ms);
+    TEST_ASSERT_EQUAL_UINT8(8, cmd_sensor.payload.stream_cmd.batch);
+
+    // pushed samples, response format with the STREAM_DATA register
+    ans_sensor.hdr.addr = OSENS_REGMAP_STREAM_DATA;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.stream_data_cmd.seq = 0xABCD;
+    ans_sensor.payload.stream_data_cmd.num_samples = 2;
+    ans_sensor.payload.stream_data_cmd.size = sizeof(samples);
+    ans_sensor.payload.stream_data_cmd.samples = samples;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // samples are not copied on decoding
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_mote);
+    TEST_ASSERT_EQUAL_UINT16(0xABCD, ans_mote.payload.stream_data_cmd.seq);
+    TEST_ASSERT_EQUAL_UINT8(2, ans_mote.payload.stream_data_cmd.num_samples);
+    TEST_ASSERT_EQUAL_UINT16(sizeof(samples), ans_mote.payload.stream_data_cmd.size);
+    TEST_ASSERT_EQUAL_PTR(&frame[6], ans_mote.payload.stream_data_cmd.samples);
+    TEST_ASSERT_EQUAL_MEMORY(samples, ans_mote.payload.stream_data_cmd.samples, sizeof(samples));
+}
+
+static void test_OSENS_REGMAP_WRITE_BLOCK(void)
+{
+    osens_write_block_t *blk = &cmd_mote.payload.write_block_cmd;
+
+    setUp();
+
+    cmd_req_size = 14;
+    cmd_res_size = 8;
+    cmd_number = OSENS_REGMAP_WRITE_BLOCK;
+
+    // enconde command req, an U8 and an U32 point
+    cmd_mote.hdr.addr = cmd_number;
+    blk->num_points = 2;
+    blk->index[0] = 3;
+    blk->values[0].type = OSENS_DT_U8;
+    blk->values[0].value.u8 = 0x5A;
+    blk->index[1] = 4;
+    blk->values[1].type = OSENS_DT_U32;
+    blk->values[1].value.u32 = 0x12345678;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_UINT8(2, cmd_sensor.payload.write_block_cmd.num_points);
+    TEST_ASSERT_EQUAL_UINT8(3, cmd_sensor.payload.write_block_cmd.index[0]);
+    TEST_ASSERT_EQUAL_UINT8(4, cmd_sensor.payload.write_block_cmd.index[1]);
+    validate_point_value(&blk->values[0], &cmd_sensor.payload.write_block_cmd.values[0]);
+    validate_point_value(&blk->values[1], &cmd_sensor.payload.write_block_cmd.values[1]);
+
+    // one status per point
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.write_block_cmd.num_points = 2;
+    ans_sensor.payload.write_block_cmd.status[0] = OSENS_ANS_OK;
+    ans_sensor.payload.write_block_cmd.status[1] = OSENS_ANS_READY_ONLY;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_mote);
+    TEST_ASSERT_EQUAL_UINT8(2, ans_mote.payload.write_block_cmd.num_points);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, ans_mote.payload.write_block_cmd.status[0]);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_READY_ONLY, ans_mote.payload.write_block_cmd.status[1]);
+
+    // more entries than points
+    frame[1] = 33;
+    TEST_ASSERT_EQUAL_UINT8(0, osens_unpack_cmd_req(&cmd_sensor, frame, size_mote));
+}
+
+static void test_OSENS_REGMAP_AGGREGATE(void)
+{
+    setUp();
+
+    cmd_req_size = 5;
+    cmd_res_size = 26;
+    cmd_number = OSENS_REGMAP_AGGREGATE;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    cmd_mote.payload.aggregate_cmd.index = 2;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_UINT8(2, cmd_sensor.payload.aggregate_cmd.index);
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.aggregate_cmd.index = 2;
+    ans_sensor.payload.aggregate_cmd.count = 100000;
+    ans_sensor.payload.aggregate_cmd.min = -1.5f;
+    ans_sensor.payload.aggregate_cmd.max = 40.25f;
+    ans_sensor.payload.aggregate_cmd.mean = 20.125f;
+    ans_sensor.payload.aggregate_cmd.variance = 3.5f;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_mote);
+    TEST_ASSERT_EQUAL_UINT8(2, ans_mote.payload.aggregate_cmd.index);
+    TEST_ASSERT_EQUAL_UINT32(100000, ans_mote.payload.aggregate_cmd.count);
+    TEST_ASSERT_EQUAL_FLOAT(-1.5f, ans_mote.payload.aggregate_cmd.min);
+    TEST_ASSERT_EQUAL_FLOAT(40.25f, ans_mote.payload.aggregate_cmd.max);
+    TEST_ASSERT_EQUAL_FLOAT(20.125f, ans_mote.payload.aggregate_cmd.mean);
+    TEST_ASSERT_EQUAL_FLOAT(3.5f, ans_mote.payload.aggregate_cmd.variance);
+}
+
+static void test_OSENS_REGMAP_FEATURES(void)
+{
+    setUp();
+
+    cmd_req_size = 4;
+    cmd_res_size = 9;
+    cmd_number = OSENS_REGMAP_FEATURES;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+
+    // encode command res, unknown bits are carried
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.features_cmd.features = 0x80000000 | OSENS_FEATURE_STREAM | OSENS_FEATURE_AGGREGATE;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_mote);
+    TEST_ASSERT_EQUAL_HEX32(0x80000000 | OSENS_FEATURE_STREAM | OSENS_FEATURE_AGGREGATE, ans_mote.payload.features_cmd.features);
+
+    // optional registers and the feature they belong to
+    TEST_ASSERT_EQUAL_HEX32(0, osens_register_feature(OSENS_REGMAP_ITF_VERSION));
+    TEST_ASSERT_EQUAL_HEX32(0, osens_register_feature(OSENS_REGMAP_FEATURES));
+    TEST_ASSERT_EQUAL_HEX32(0, osens_register_feature(OSENS_REGMAP_READ_POINT_DATA_1));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_LINK_SPEED, osens_register_feature(OSENS_REGMAP_LINK_RATES));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_LINK_SPEED, osens_register_feature(OSENS_REGMAP_LINK_SPEED));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_EXT_FRAMES, osens_register_feature(OSENS_REGMAP_FRAME_SIZE));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_STREAM, osens_register_feature(OSENS_REGMAP_STREAM_DATA));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_WRITE_BLOCK, osens_register_feature(OSENS_REGMAP_WRITE_BLOCK));
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_AGGREGATE, osens_register_feature(OSENS_REGMAP_AGGREGATE));
+}
+
+static void test_OSENS_REGMAP_TIME_SYNC(void)
+{
+    setUp();
+
+    cmd_req_size = 9;
+    cmd_res_size = 18;
+    cmd_number = OSENS_REGMAP_TIME_SYNC;
+
+    // enconde command req
+    cmd_mote.hdr.addr = cmd_number;
+    cmd_mote.payload.time_sync_cmd.mote_ms = 0xFFFFFF00;
+    cmd_mote.payload.time_sync_cmd.flags = OSENS_TIME_SYNC_STAMP;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_req_size, size_mote);
+
+    // decode command req
+    size_sensor = osens_unpack_cmd_req(&cmd_sensor, frame, size_mote);
+    test_decode_req(cmd_req_size, size_sensor,&cmd_mote, &cmd_sensor);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFF00, cmd_sensor.payload.time_sync_cmd.mote_ms);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_TIME_SYNC_STAMP, cmd_sensor.payload.time_sync_cmd.flags);
+
+    // encode command res
+    ans_sensor.hdr.addr = cmd_number;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.time_sync_cmd.mote_ms = 0xFFFFFF00;
+    ans_sensor.payload.time_sync_cmd.rx_ms = 1000;
+    ans_sensor.payload.time_sync_cmd.tx_ms = 1050;
+    ans_sensor.payload.time_sync_cmd.flags = OSENS_TIME_SYNC_STAMP;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_sensor);
+
+    // decode command res
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(cmd_res_size, size_mote);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFF00, ans_mote.payload.time_sync_cmd.mote_ms);
+    TEST_ASSERT_EQUAL_UINT32(1000, ans_mote.payload.time_sync_cmd.rx_ms);
+    TEST_ASSERT_EQUAL_UINT32(1050, ans_mote.payload.time_sync_cmd.tx_ms);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_TIME_SYNC_STAMP, ans_mote.payload.time_sync_cmd.flags);
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURE_TIMESTAMPS, osens_register_feature(OSENS_REGMAP_TIME_SYNC));
+
+    // stamped read: flagged type, value, frame time and sample age
+    ans_sensor.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.fp32 = 21.5f;
+    ans_sensor.time.valid = 1;
+    ans_sensor.time.base_ms = 70000;
+    ans_sensor.time.age_ms = 250;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(10 + OSENS_SAMPLE_TIME_SIZE, size_sensor);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_DT_FLOAT | OSENS_DT_TIMESTAMPED, frame[3]);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_res(&ans_mote, frame, size_sensor - 1));
+
+    size_mote = osens_unpack_cmd_res(&ans_mote, frame, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(size_sensor, size_mote);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_DT_FLOAT, ans_mote.payload.point_value_cmd.type);
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, ans_mote.payload.point_value_cmd.value.fp32);
+    TEST_ASSERT_EQUAL_UINT8(1, ans_mote.time.valid);
+    TEST_ASSERT_EQUAL_UINT32(70000, ans_mote.time.base_ms);
+    TEST_ASSERT_EQUAL_UINT16(250, ans_mote.time.age_ms);
+
+    // unstamped answers clear the previous time
+    ans_sensor.time.valid = 0;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(10, size_sensor);
+    TEST_ASSERT_EQUAL_UINT8(10, osens_unpack_cmd_res(&ans_mote, frame, size_sensor));
+    TEST_ASSERT_EQUAL_UINT8(0, ans_mote.time.valid);
+}
+
+static void test_osens_frame_bounds(void)
+{
+    // extended header: escape byte and 16 bits size, counting the 3 header bytes
+    uint8_t ext[6] = { OSENS_FRAME_EXT_SIZE, 4, 0, OSENS_REGMAP_ITF_VERSION, 0, 0 };
+    uint8_t res[6] = { 4, OSENS_REGMAP_ITF_VERSION, OSENS_ANS_OK, OSENS_LATEST_VERSION, 0, 0 };
+    uint8_t req[4] = { 2, OSENS_REGMAP_LINK_SPEED, 0, 0 };
+    uint16_t size;
+
+    setUp();
+
+    buf_io_put16_tl(crc16_calc(ext, 4), &ext[4]);
+    TEST_ASSERT_EQUAL_UINT8(0, osens_frame_size(ext, 2, &size));
+    TEST_ASSERT_EQUAL_UINT8(3, osens_frame_size(ext, 3, &size));
+    TEST_ASSERT_EQUAL_UINT16(4, size);
+    TEST_ASSERT_EQUAL_UINT16(6, osens_unpack_cmd_req(&cmd_sensor, ext, sizeof(ext)));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_REGMAP_ITF_VERSION, cmd_sensor.hdr.addr);
+    TEST_ASSERT_EQUAL_UINT16(4, cmd_sensor.hdr.size);
+
+    // size field beyond the received bytes
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_req(&cmd_sensor, ext, sizeof(ext) - 1));
+    buf_io_put16_tl(crc16_calc(res, 4), &res[4]);
+    res[0] = 40;
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_res(&ans_mote, res, sizeof(res)));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_ERROR, ans_mote.hdr.status);
+
+    // valid CRC, but no room for the register payload
+    buf_io_put16_tl(crc16_calc(req, 2), &req[2]);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_req(&cmd_sensor, req, sizeof(req)));
+    res[0] = 3;
+    buf_io_put16_tl(crc16_calc(res, 3), &res[3]);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_res(&ans_mote, res, 5));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_ERROR, ans_mote.hdr.status);
+}
+
+static void test_osens_frame_bus(void)
+{
+    float wave[30];
+    uint8_t ext[OSENS_MAX_FRAME_SIZE + 8];
+    uint16_t size;
+
+    setUp();
+
+    // bus prefix ahead of the size field, covered by the CRC
+    cmd_mote.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    cmd_mote.hdr.bus = 5;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    TEST_ASSERT_EQUAL_UINT8(6, size_mote);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_FRAME_BUS_ADDR, frame[0]);
+    TEST_ASSERT_EQUAL_HEX8(5, frame[1]);
+    TEST_ASSERT_EQUAL_UINT8(4, frame[2]);
+    TEST_ASSERT_EQUAL_UINT8(3, osens_frame_size(frame, size_mote, &size));
+    TEST_ASSERT_EQUAL_UINT16(4, size);
+    TEST_ASSERT_EQUAL_HEX8(5, osens_frame_bus_addr(frame, size_mote));
+    TEST_ASSERT_EQUAL_UINT16(6, osens_unpack_cmd_req(&cmd_sensor, frame, size_mote));
+    TEST_ASSERT_EQUAL_UINT8(5, cmd_sensor.hdr.bus);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_REGMAP_READ_POINT_DATA_1, cmd_sensor.hdr.addr);
+
+    // a request is never taken for an answer
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_res(&ans_mote, frame, size_mote));
+
+    // answers carry the address of the board with the answer bit
+    ans_sensor.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.hdr.bus = 5;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.fp32 = 3.141592f;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    TEST_ASSERT_EQUAL_UINT8(12, size_sensor);
+    TEST_ASSERT_EQUAL_HEX8(5 | OSENS_BUS_ADDR_ANSWER, frame[1]);
+    TEST_ASSERT_EQUAL_UINT16(12, osens_unpack_cmd_res(&ans_mote, frame, size_sensor));
+    TEST_ASSERT_EQUAL_UINT8(5, ans_mote.hdr.bus);
+    validate_point_value(&ans_sensor.payload.point_value_cmd, &ans_mote.payload.point_value_cmd);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_unpack_cmd_req(&cmd_sensor, frame, size_sensor));
+
+    // 128 bytes without prefix, extended size field with it
+    memset(wave, 0, sizeof(wave));
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_ARRAY_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.array.count = 30;
+    ans_sensor.payload.point_value_cmd.value.array.data = wave;
+    ans_sensor.hdr.bus = OSENS_BUS_ADDR_NONE;
+    TEST_ASSERT_EQUAL_UINT16(128, osens_pack_cmd_res(&ans_sensor, frame));
+    ans_sensor.hdr.bus = 5;
+    size = osens_pack_cmd_res(&ans_sensor, ext);
+    TEST_ASSERT_EQUAL_UINT16(132, size);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_FRAME_EXT_SIZE, ext[2]);
+    TEST_ASSERT_EQUAL_UINT16(132, osens_unpack_cmd_res(&ans_mote, ext, size));
+    TEST_ASSERT_EQUAL_UINT16(30, ans_mote.payload.point_value_cmd.value.array.count);
+}
+
+static void test_osens_fec(void)
+{
+    uint8_t wire[OSENS_MOTE_FRAME_SIZE];
+    uint8_t plain[300];
+    osens_fec_stats_t stats;
+    uint16_t size;
+    uint16_t n;
+    uint8_t roots;
+
+    setUp();
+    memset(&stats, 0, sizeof(stats));
+
+    ans_sensor.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.fp32 = 3.141592f;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, wire);
+    memcpy(plain, wire, size_sensor);
+
+    // one code word of 8 parity bytes, a burst of 4 bad bytes is corrected
+    size = osens_fec_encode(wire, size_sensor, 8);
+    TEST_ASSERT_EQUAL_UINT16(osens_fec_size(size_sensor, 8), size);
+    TEST_ASSERT_EQUAL_UINT16(OSENS_FEC_HDR_SIZE + size_sensor + 8, size);
+    TEST_ASSERT_EQUAL_HEX8(OSENS_FRAME_FEC, wire[0]);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FEC_HDR_SIZE, osens_fec_frame_size(wire, size, &n));
+    TEST_ASSERT_EQUAL_UINT16(size, n);
+    TEST_ASSERT_EQUAL_UINT8(0, osens_fec_frame_size(wire, OSENS_FEC_HDR_SIZE - 1, &n));
+
+    for (n = 0; n < 4; n++)
+        wire[OSENS_FEC_HDR_SIZE + 3 + n] ^= 0x5A;
+    TEST_ASSERT_EQUAL_UINT16(size_sensor, osens_fec_decode(wire, size, &roots, &stats));
+    TEST_ASSERT_EQUAL_UINT8(8, roots);
+    TEST_ASSERT_EQUAL_MEMORY(plain, wire, size_sensor);
+    TEST_ASSERT_EQUAL_UINT16(size_sensor, osens_unpack_cmd_res(&ans_mote, wire, size_sensor));
+    validate_point_value(&ans_sensor.payload.point_value_cmd, &ans_mote.payload.point_value_cmd);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.frames);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.corrected);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.bytes);
+
+    // a bad byte of the header is corrected too
+    size = osens_fec_encode(wire, size_sensor, 8);
+    wire[2] ^= 0xFF;
+    TEST_ASSERT_EQUAL_UINT16(size_sensor, osens_fec_decode(wire, size, &roots, &stats));
+    TEST_ASSERT_EQUAL_MEMORY(plain, wire, size_sensor);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.corrected);
+
+    // one bad byte too many
+    size = osens_fec_encode(wire, size_sensor, 8);
+    for (n = 0; n < 5; n++)
+        wire[OSENS_FEC_HDR_SIZE + n] ^= 0x33;
+    TEST_ASSERT_EQUAL_UINT16(0, osens_fec_decode(wire, size, &roots, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.uncorrectable);
+
+    // longer frames are split in interleaved code words: a burst is shared between them
+    for (n = 0; n < sizeof(plain); n++)
+        plain[n] = (uint8_t) (n * 7);
+    memcpy(wire, plain, sizeof(plain));
+    size = osens_fec_encode(wire, sizeof(plain), 4);
+    TEST_ASSERT_EQUAL_UINT16(OSENS_FEC_HDR_SIZE + sizeof(plain) + 2 * 4, size);
+    for (n = 0; n < 4; n++)
+        wire[OSENS_FEC_HDR_SIZE + 100 + n] ^= 0xA5;
+    TEST_ASSERT_EQUAL_UINT16(sizeof(plain), osens_fec_decode(wire, size, &roots, &stats));
+    TEST_ASSERT_EQUAL_MEMORY(plain, wire, sizeof(plain));
+    TEST_ASSERT_EQUAL_UINT32(3, stats.corrected);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.uncorrectable);
+
+    // truncated frame
+    size = osens_fec_encode(wire, sizeof(plain), 4);
+    TEST_ASSERT_EQUAL_UINT16(0, osens_fec_decode(wire, size - 1, &roots, &stats));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.uncorrectable);
+}
+
+static void test_osens_frame_resync(void)
+{
+    uint8_t buf[OSENS_MAX_FRAME_SIZE + 8] = { 0x03, 0x55, 0x07 };
+    uint16_t size;
+
+    setUp();
+
+    ans_sensor.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+    ans_sensor.payload.point_value_cmd.value.fp32 = 3.141592f;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_VALID, osens_frame_check(frame, size_sensor, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT16(size_sensor, size);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_VALID, osens_frame_check(frame, size_sensor, OSENS_FRAME_KIND_ANY, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INCOMPLETE, osens_frame_check(frame, size_sensor - 1, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(frame, size_sensor, OSENS_FRAME_KIND_REQ, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(frame, size_sensor, OSENS_FRAME_KIND_RES, size_sensor - 1, &size));
+
+    // register lengths reject a bad size field, before the CRC
+    memcpy(&buf[3], frame, size_sensor);
+    buf[3]++;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(&buf[3], size_sensor - 1, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    buf[3] -= 2;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(&buf[3], size_sensor - 1, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    buf[3]++;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INCOMPLETE, osens_frame_check(&buf[3], 6, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+
+    // errors carry no payload, statuses are known, as soon as they are received
+    buf[4] = OSENS_REGMAP_BRD_ID;
+    buf[5] = OSENS_ANS_ERROR;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(&buf[3], 6, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    buf[5] = OSENS_ANS_REGISTER_NOT_IMPLEMENTED + 1;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(&buf[3], 6, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+
+    // bad CRC, found after garbage
+    memcpy(&buf[3], frame, size_sensor);
+    buf[3 + size_sensor - 1] ^= 0x01;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_BAD_CRC, osens_frame_check(&buf[3], size_sensor, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT16(size_sensor + 3, osens_frame_find(buf, size_sensor + 3, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    buf[3 + size_sensor - 1] ^= 0x01;
+    TEST_ASSERT_EQUAL_UINT16(3, osens_frame_find(buf, size_sensor + 3, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT16(size_sensor, size);
+
+    // the extended size field is not used for short frames
+    buf[0] = OSENS_FRAME_EXT_SIZE;
+    buf[1] = 0x00;
+    buf[2] = 0x10;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_FRAME_INVALID, osens_frame_check(buf, 3, OSENS_FRAME_KIND_ANY, OSENS_MOTE_FRAME_SIZE, &size));
+
+    // requests, and the answer bit of the bus address
+    cmd_mote.hdr.addr = OSENS_REGMAP_BRD_CMD;
+    cmd_mote.hdr.bus = 5;
+    cmd_mote.payload.command_cmd.cmd = OSENS_SENSOR_CMD_RESET;
+    size_mote = osens_pack_cmd_req(&cmd_mote, &buf[2]);
+    TEST_ASSERT_EQUAL_UINT16(2, osens_frame_find(buf, size_mote + 2, OSENS_FRAME_KIND_ANY, OSENS_MAX_FRAME_SIZE, &size));
+    TEST_ASSERT_EQUAL_UINT16(size_mote + 2, osens_frame_find(buf, size_mote + 2, OSENS_FRAME_KIND_RES, OSENS_MAX_FRAME_SIZE, &size));
+}
+
 void test_OSENS_REGMAP_READ_POINT_DATA_32(void)
 {
     cmd_req_size = 4;
@@ -658,7 +1279,1288 @@ void test_OSENS_REGMAP_READ_POINT_DATA_32(void)
     validate_point_value(&ans_sensor.payload.point_value_cmd, &ans_mote.payload.point_value_cmd);
 }
 
-void test_main(void)
+void test_os_util_log_deferred(void)
+{
+    FILE *fp = tmpfile();
+    char name[8] = "TEMP";
+    char line[128];
+    char *msg;
+
+    TEST_ASSERT_NOT_NULL(fp);
+    os_util_log_set_output(fp);
+
+    os_util_log("%s %d %5.2f %hhx %*u %c%%\n", name, -512, 3.14159, 0x1AB, 4, 7u, 'z');
+    strcpy(name, "XXXX"); // strings are copied at log time
+    os_util_log_flush();
+
+    rewind(fp);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    msg = strstr(line, "] ");
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL_STRING("TEMP -512  3.14 ab    7 z%\n", msg + 2);
+
+    os_util_log_set_output(stdout);
+    fclose(fp);
+}
+
+#define TEST_LOG_THREADS 40
+
+static volatile uint32_t test_log_done = 0;
+static os_event_t test_log_event = 0;
+
+static void* test_log_thread(void *param)
+{
+    os_util_log("thread %u\n", (unsigned int) (uintptr_t) param);
+    OS_ATOMIC_FETCH_INC(&test_log_done);
+    os_kernel_event_signal(test_log_event);
+
+    return 0;
+}
+
+// more threads than rings, the last ones share one
+void test_os_util_log_threads(void)
+{
+    FILE *fp = tmpfile();
+    char line[128];
+    int lines = 0;
+    int shared = 0;
+    int n;
+
+    TEST_ASSERT_NOT_NULL(fp);
+    os_util_log_set_output(fp);
+    test_log_event = os_kernel_event_create();
+
+    for (n = 0; n < TEST_LOG_THREADS; n++)
+        os_kernel_create(test_log_thread, "LOG", (os_thread_arg) (uintptr_t) n,
+            os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+
+    while (OS_ATOMIC_LOAD_ACQ(&test_log_done) < TEST_LOG_THREADS)
+        TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_kernel_event_wait(test_log_event, 1000));
+
+    os_util_log_flush();
+
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (strstr(line, "] thread "))
+            lines++;
+        else if (strstr(line, "shared ring"))
+            shared++;
+    }
+
+    TEST_ASSERT_EQUAL_INT(TEST_LOG_THREADS, lines);
+    TEST_ASSERT_EQUAL_INT(1, shared);
+
+    os_util_log_set_output(stdout);
+    os_kernel_event_delete(test_log_event);
+    fclose(fp);
+}
+
+void test_osens_capture_file(void)
+{
+    const char *filename = "sens_itf_unity_test.cap";
+    osens_capture_stats_t stats;
+    uint8_t file[64];
+    size_t size;
+    FILE *fp;
+
+    cmd_mote.hdr.addr = OSENS_REGMAP_ITF_VERSION;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+
+    TEST_ASSERT_EQUAL_UINT8(1, osens_capture_start(filename));
+    OSENS_CAPTURE(7, OSENS_CAPTURE_DIR_REQ, frame, size_mote);
+    osens_capture_stop();
+    OSENS_CAPTURE(7, OSENS_CAPTURE_DIR_REQ, frame, size_mote); // not captured
+
+    osens_capture_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.captured);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+
+    fp = fopen(filename, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+    size = fread(file, 1, sizeof(file), fp);
+    fclose(fp);
+    remove(filename);
+
+    // header, then record: varint delta, direction, board, size, frame
+    TEST_ASSERT_EQUAL_MEMORY(OSENS_CAPTURE_MAGIC, file, 4);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_CAPTURE_VERSION, file[4]);
+    TEST_ASSERT_TRUE(size > OSENS_CAPTURE_HEADER_SIZE);
+    size -= OSENS_CAPTURE_HEADER_SIZE;
+    TEST_ASSERT_EQUAL_UINT8(size_mote, file[size + OSENS_CAPTURE_HEADER_SIZE - size_mote - 1]);
+    TEST_ASSERT_EQUAL_UINT8(7, file[size + OSENS_CAPTURE_HEADER_SIZE - size_mote - 2]);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_CAPTURE_DIR_REQ, file[size + OSENS_CAPTURE_HEADER_SIZE - size_mote - 3]);
+    TEST_ASSERT_EQUAL_MEMORY(frame, &file[size + OSENS_CAPTURE_HEADER_SIZE - size_mote], size_mote);
+}
+
+void test_os_transport_pipe(void)
+{
+    os_transport_t mote_end;
+    os_transport_t sensor_end;
+    uint8_t rx[OSENS_MAX_FRAME_SIZE];
+
+    // odd sizes are rejected
+    TEST_ASSERT_EQUAL_INT(OS_ERROR, os_transport_pipe_create(&mote_end, &sensor_end, 100));
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &sensor_end, 16));
+
+    TEST_ASSERT_EQUAL_INT(OS_TIMEOUT, os_transport_wait_readable(sensor_end, 10));
+    TEST_ASSERT_EQUAL_INT(0, os_transport_recv(sensor_end, rx, sizeof(rx)));
+
+    cmd_mote.hdr.addr = OSENS_REGMAP_BRD_ID;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+
+    // three frames wrap around the 16 bytes ring
+    for (cmd_number = 0; cmd_number < 3; cmd_number++)
+    {
+        TEST_ASSERT_EQUAL_INT(size_mote, os_transport_send(mote_end, frame, size_mote));
+        TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_readable(sensor_end, 10));
+        TEST_ASSERT_EQUAL_INT(size_mote, os_transport_recv(sensor_end, rx, sizeof(rx)));
+        TEST_ASSERT_EQUAL_MEMORY(frame, rx, size_mote);
+    }
+
+    // flush discards pending bytes, other direction is independent
+    os_transport_send(sensor_end, frame, size_mote);
+    os_transport_send(mote_end, frame, size_mote);
+    os_transport_flush(sensor_end);
+    TEST_ASSERT_EQUAL_INT(0, os_transport_recv(sensor_end, rx, sizeof(rx)));
+    TEST_ASSERT_EQUAL_INT(size_mote, os_transport_recv(mote_end, rx, sizeof(rx)));
+
+    os_transport_close(mote_end);
+    os_transport_close(sensor_end);
+}
+
+static void* test_wait_any_thread(void *param)
+{
+    os_transport_t t = (os_transport_t) param;
+    uint8_t data = 0xAA;
+
+    os_kernel_sleep(20);
+    os_transport_send(t, &data, 1);
+
+    return 0;
+}
+
+void test_os_transport_wait_any(void)
+{
+    os_transport_t motes[2];
+    os_transport_t sensors[2];
+    os_transport_t masters[2];
+    os_transport_t slaves[2];
+    os_transport_t mixed[2];
+    char name[64];
+    uint8_t rx[4];
+    uint8_t data = 0x55;
+    uint8_t n;
+
+    for (n = 0; n < 2; n++)
+        TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&motes[n], &sensors[n], 16));
+
+    TEST_ASSERT_EQUAL_INT(OS_ERROR, os_transport_wait_any(motes, 0, 10));
+    TEST_ASSERT_EQUAL_INT(OS_TIMEOUT, os_transport_wait_any(motes, 2, 10));
+
+    // data on any pipe of the set wakes the waiter
+    os_transport_send(sensors[1], &data, 1);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_any(motes, 2, 10));
+    TEST_ASSERT_EQUAL_INT(1, os_transport_recv(motes[1], rx, sizeof(rx)));
+    TEST_ASSERT_EQUAL_INT(OS_TIMEOUT, os_transport_wait_any(motes, 2, 10));
+
+    os_kernel_create(test_wait_any_thread, "WAIT_ANY", (os_thread_arg) sensors[0],
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_any(motes, 2, 1000));
+    TEST_ASSERT_EQUAL_INT(1, os_transport_recv(motes[0], rx, sizeof(rx)));
+    TEST_ASSERT_EQUAL_UINT8(0xAA, rx[0]);
+
+    // the senders no longer signal the waiter
+    os_transport_send(sensors[0], &data, 1);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_readable(motes[0], 10));
+    os_transport_recv(motes[0], rx, sizeof(rx));
+
+    // same with pseudo terminals, polled together
+    for (n = 0; n < 2; n++)
+        TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pty_create(&masters[n], &slaves[n], name, sizeof(name)));
+
+    TEST_ASSERT_EQUAL_INT(OS_TIMEOUT, os_transport_wait_any(masters, 2, 10));
+    os_transport_send(slaves[1], &data, 1);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_any(masters, 2, 1000));
+    TEST_ASSERT_EQUAL_INT(1, os_transport_recv(masters[1], rx, sizeof(rx)));
+
+    // transports of different kinds can not be waited for together
+    mixed[0] = motes[0];
+    mixed[1] = masters[0];
+    TEST_ASSERT_EQUAL_INT(OS_ERROR, os_transport_wait_any(mixed, 2, 10));
+
+    for (n = 0; n < 2; n++)
+    {
+        os_transport_close(motes[n]);
+        os_transport_close(sensors[n]);
+        os_transport_close(slaves[n]);
+        os_transport_close(masters[n]);
+    }
+}
+
+void test_osens_mote_ctx_rx_bulk(void)
+{
+    os_transport_t mote_end;
+    os_transport_t sensor_end;
+    osens_mote_ctx_t ctx;
+    uint8_t data[OSENS_MOTE_RX_RING_SIZE + 44];
+
+    memset(data, 0x55, sizeof(data));
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &sensor_end, 0));
+    ctx = osens_mote_ctx_create_transport(0, mote_end);
+
+    TEST_ASSERT_EQUAL_INT(0, osens_mote_ctx_rx(ctx));
+
+    // at most one ring per call
+    os_transport_send(sensor_end, data, sizeof(data));
+    TEST_ASSERT_EQUAL_INT(OSENS_MOTE_RX_RING_SIZE, osens_mote_ctx_rx(ctx));
+    TEST_ASSERT_EQUAL_INT(44, osens_mote_ctx_rx(ctx));
+    TEST_ASSERT_EQUAL_INT(0, osens_mote_ctx_rx(ctx));
+
+    osens_mote_ctx_destroy(ctx);
+    os_transport_close(sensor_end);
+}
+
+#define TEST_NOISE_FRAMES 1000
+
+static uint32_t test_noise_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 16) & 0x7FFF;
+}
+
+/*
+    Answers streamed to a mote context over a noisy line: garbage_pct of the
+    frames are preceded by 1 to 4 random bytes, corrupt_pct have a bad byte.
+    Returns the frames received, every intact frame must be among them.
+*/
+static uint32_t test_mote_rx_noise(uint8_t garbage_pct, uint8_t corrupt_pct)
+{
+    os_transport_t mote_end;
+    os_transport_t sensor_end;
+    osens_mote_ctx_t ctx;
+    osens_mote_link_stats_t link;
+    uint8_t data[OSENS_MAX_FRAME_SIZE + 4];
+    uint32_t seed = 1;
+    uint32_t garbage = 0;
+    uint32_t intact = 0;
+    uint16_t len;
+    uint16_t size;
+    uint16_t n;
+    uint8_t m;
+
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &sensor_end, 0));
+    ctx = osens_mote_ctx_create_transport(0, mote_end);
+
+    ans_sensor.hdr.addr = OSENS_REGMAP_READ_POINT_DATA_1;
+    ans_sensor.hdr.status = OSENS_ANS_OK;
+    ans_sensor.hdr.bus = OSENS_BUS_ADDR_NONE;
+    ans_sensor.time.valid = 0;
+    ans_sensor.payload.point_value_cmd.type = OSENS_DT_FLOAT;
+
+    for (n = 0; n < TEST_NOISE_FRAMES; n++)
+    {
+        len = 0;
+        if (test_noise_rand(&seed) % 100 < garbage_pct)
+        {
+            for (m = (uint8_t) (1 + test_noise_rand(&seed) % 4); m > 0; m--)
+                data[len++] = (uint8_t) test_noise_rand(&seed);
+            garbage += len;
+        }
+
+        ans_sensor.payload.point_value_cmd.value.fp32 = (float) n;
+        size = osens_pack_cmd_res(&ans_sensor, &data[len]);
+        if (test_noise_rand(&seed) % 100 < corrupt_pct)
+            data[len + test_noise_rand(&seed) % size] ^= (uint8_t) (1 + test_noise_rand(&seed) % 255);
+        else
+            intact++;
+
+        os_transport_send(sensor_end, data, len + size);
+        while (osens_mote_ctx_rx(ctx) > 0)
+            ;
+    }
+
+    osens_mote_get_link_stats(ctx, &link);
+    TEST_ASSERT_TRUE(link.rx_frames >= intact);
+    TEST_ASSERT_TRUE(link.rx_frames <= TEST_NOISE_FRAMES);
+
+    // garbage between intact frames costs its own bytes only
+    if (corrupt_pct == 0)
+    {
+        TEST_ASSERT_EQUAL_UINT32(TEST_NOISE_FRAMES, link.rx_frames);
+        TEST_ASSERT_EQUAL_UINT32(garbage, link.rx_skipped);
+    }
+
+    osens_mote_ctx_destroy(ctx);
+    os_transport_close(sensor_end);
+
+    return link.rx_frames;
+}
+
+void test_osens_mote_rx_noise(void)
+{
+    setUp();
+
+    TEST_ASSERT_EQUAL_UINT32(TEST_NOISE_FRAMES, test_mote_rx_noise(0, 0));
+    test_mote_rx_noise(1, 0);
+    test_mote_rx_noise(10, 0);
+    test_mote_rx_noise(50, 0);
+    test_mote_rx_noise(100, 0);
+    test_mote_rx_noise(0, 10);
+    test_mote_rx_noise(20, 20);
+    test_mote_rx_noise(50, 50);
+}
+
+// steps the bus until one of its boards sends a request
+static uint32_t test_bus_request(osens_mote_bus_t bus, os_transport_t line, uint8_t *addr)
+{
+    uint8_t rx[OSENS_MAX_FRAME_SIZE];
+    uint32_t ticks;
+    int len = 0;
+
+    for (ticks = 1; ticks < 100; ticks++)
+    {
+        osens_mote_bus_sm(bus);
+        len = os_transport_recv(line, rx, sizeof(rx));
+        if (len > 0)
+            break;
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    }
+
+    // never two requests on the line at once
+    TEST_ASSERT_TRUE(len > 0);
+    TEST_ASSERT_EQUAL_UINT16(len, osens_unpack_cmd_req(&cmd_sensor, rx, (uint16_t) len));
+    *addr = cmd_sensor.hdr.bus;
+
+    return ticks;
+}
+
+void test_osens_mote_bus(void)
+{
+    static osens_stats_t before, after;
+    os_transport_t mote_end;
+    os_transport_t line_end;
+    osens_mote_bus_t bus;
+    osens_mote_bus_stats_t bus_stats;
+    uint8_t addr;
+
+    setUp();
+
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &line_end, 0));
+    bus = osens_mote_bus_create(mote_end);
+    TEST_ASSERT_NOT_NULL(osens_mote_bus_add(bus, 10, 3));
+    TEST_ASSERT_NOT_NULL(osens_mote_bus_add(bus, 11, 5));
+    TEST_ASSERT_NULL(osens_mote_bus_add(bus, 12, 3));
+    TEST_ASSERT_NULL(osens_mote_bus_add(bus, 12, OSENS_BUS_ADDR_NONE));
+    TEST_ASSERT_NULL(osens_mote_bus_add(bus, 12, OSENS_BUS_ADDR_ANSWER));
+
+    osens_get_stats(&before);
+
+    // the second board waits for the timeout of the first one
+    test_bus_request(bus, line_end, &addr);
+    TEST_ASSERT_EQUAL_UINT8(3, addr);
+    TEST_ASSERT_TRUE(test_bus_request(bus, line_end, &addr) > 10);
+    TEST_ASSERT_EQUAL_UINT8(5, addr);
+    TEST_ASSERT_TRUE(test_bus_request(bus, line_end, &addr) > 10);
+    TEST_ASSERT_EQUAL_UINT8(3, addr);
+
+    // an answer releases the bus at once (a CRC error, a refused version would hold the board back)
+    ans_sensor.hdr.addr = cmd_sensor.hdr.addr;
+    ans_sensor.hdr.status = OSENS_ANS_CRC_ERROR;
+    ans_sensor.hdr.bus = 3;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    os_transport_send(line_end, frame, size_sensor);
+    osens_mote_bus_rx(bus);
+    TEST_ASSERT_TRUE(test_bus_request(bus, line_end, &addr) < 5);
+    TEST_ASSERT_EQUAL_UINT8(5, addr);
+
+    // answers of unknown boards and requests are dropped
+    ans_sensor.hdr.bus = 9;
+    size_sensor = osens_pack_cmd_res(&ans_sensor, frame);
+    os_transport_send(line_end, frame, size_sensor);
+    os_kernel_sleep(OSENS_MOTE_BUS_GAP_MS);
+    osens_mote_bus_rx(bus);
+    cmd_mote.hdr.addr = OSENS_REGMAP_BRD_CMD;
+    cmd_mote.hdr.bus = 3;
+    size_mote = osens_pack_cmd_req(&cmd_mote, frame);
+    os_transport_send(line_end, frame, size_mote);
+    os_kernel_sleep(OSENS_MOTE_BUS_GAP_MS);
+    osens_mote_bus_rx(bus);
+
+    TEST_ASSERT_TRUE(test_bus_request(bus, line_end, &addr) > 10);
+    TEST_ASSERT_EQUAL_UINT8(3, addr);
+
+    osens_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[10].responses[OSENS_ANS_CRC_ERROR] -
+        before.boards[10].responses[OSENS_ANS_CRC_ERROR]);
+    TEST_ASSERT_EQUAL_UINT32(0, after.boards[11].responses[OSENS_ANS_CRC_ERROR] -
+        before.boards[11].responses[OSENS_ANS_CRC_ERROR]);
+    TEST_ASSERT_EQUAL_UINT32(3, after.boards[10].requests - before.boards[10].requests);
+    TEST_ASSERT_EQUAL_UINT32(2, after.boards[11].requests - before.boards[11].requests);
+
+    osens_mote_bus_get_stats(bus, &bus_stats);
+    TEST_ASSERT_EQUAL_UINT8(2, bus_stats.num_boards);
+    TEST_ASSERT_EQUAL_UINT32(5, bus_stats.grants);
+    TEST_ASSERT_TRUE(bus_stats.holds > 0);
+    TEST_ASSERT_EQUAL_UINT32(2, bus_stats.unknown_frames);
+
+    osens_mote_bus_destroy(bus);
+    os_transport_close(line_end);
+}
+
+/*
+    Minimal board answering the discovery and point reads of a mote context,
+    polled by the test thread (no sensor thread). Requests may be lost and
+    answers delayed or corrupted, from a seeded generator. Boards with link
+    rates offer the rate negotiation and switch after answering.
+*/
+typedef struct test_board_s
+{
+    os_transport_t line;
+    uint8_t num_points;
+    uint32_t period_x250ms;
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    uint8_t drop_pct;
+    uint8_t corrupt_pct;
+    uint8_t refuse_version;
+    uint16_t link_rates;
+    uint8_t link_rate;
+    uint8_t link_next_rate;
+    uint32_t seed;
+    uint8_t ans[OSENS_MAX_FRAME_SIZE];
+    uint16_t ans_size;
+    uint64_t ans_due_us;
+} test_board_t;
+
+static void test_board_answer(test_board_t *b, const osens_cmd_req_t *cmd)
+{
+    osens_cmd_res_t ans;
+    uint8_t point;
+
+    memset(&ans, 0, sizeof(ans));
+    ans.hdr.addr = cmd->hdr.addr;
+    ans.hdr.status = OSENS_ANS_OK;
+
+    if ((cmd->hdr.addr == OSENS_REGMAP_ITF_VERSION) && b->refuse_version)
+        ans.hdr.status = OSENS_ANS_ERROR;
+    else if (cmd->hdr.addr == OSENS_REGMAP_ITF_VERSION)
+        ans.payload.itf_version_cmd.version = OSENS_LATEST_VERSION;
+    else if (cmd->hdr.addr == OSENS_REGMAP_BRD_ID)
+    {
+        memcpy(ans.payload.brd_id_cmd.model, "FAKE", 5);
+        memcpy(ans.payload.brd_id_cmd.manufactor, "TEST", 5);
+        ans.payload.brd_id_cmd.num_of_points = b->num_points;
+    }
+    else if (cmd->hdr.addr == OSENS_REGMAP_FEATURES)
+        ans.payload.features_cmd.features = b->link_rates ? OSENS_FEATURE_LINK_SPEED : 0;
+    else if ((cmd->hdr.addr == OSENS_REGMAP_LINK_RATES) && b->link_rates)
+    {
+        ans.payload.link_rates_cmd.rates = b->link_rates;
+        ans.payload.link_rates_cmd.current = b->link_rate;
+    }
+    else if ((cmd->hdr.addr == OSENS_REGMAP_LINK_SPEED) && (b->link_rates & (1 << cmd->payload.link_speed_cmd.rate)))
+        b->link_next_rate = cmd->payload.link_speed_cmd.rate;
+    else if ((cmd->hdr.addr >= OSENS_REGMAP_POINT_DESC_1) && (cmd->hdr.addr < OSENS_REGMAP_POINT_DESC_1 + b->num_points))
+    {
+        ans.payload.point_desc_cmd.type = OSENS_DT_U16;
+        ans.payload.point_desc_cmd.access_rights = OSENS_ACCESS_READ_ONLY;
+        ans.payload.point_desc_cmd.sampling_time_x250ms = b->period_x250ms;
+    }
+    else if ((cmd->hdr.addr >= OSENS_REGMAP_READ_POINT_DATA_1) && (cmd->hdr.addr < OSENS_REGMAP_READ_POINT_DATA_1 + b->num_points))
+    {
+        // each point has a fixed value, a converged mote holds all of them
+        point = cmd->hdr.addr - OSENS_REGMAP_READ_POINT_DATA_1;
+        ans.payload.point_value_cmd.type = OSENS_DT_U16;
+        ans.payload.point_value_cmd.value.u16 = 1000 + point;
+    }
+    else
+        ans.hdr.status = OSENS_ANS_REGISTER_NOT_IMPLEMENTED;
+
+    b->ans_size = osens_pack_cmd_res(&ans, b->ans);
+    b->ans_due_us = os_kernel_get_time_us() + (uint64_t) b->delay_ms * 1000;
+    if (b->jitter_ms)
+        b->ans_due_us += (uint64_t) (test_noise_rand(&b->seed) % b->jitter_ms) * 1000;
+}
+
+static void test_board_poll(test_board_t *b)
+{
+    osens_cmd_req_t cmd;
+    uint8_t rx[OSENS_MAX_FRAME_SIZE];
+    int n;
+
+    if (b->ans_size && (os_kernel_get_time_us() >= b->ans_due_us))
+    {
+        if (test_noise_rand(&b->seed) % 100 < b->corrupt_pct)
+            b->ans[test_noise_rand(&b->seed) % b->ans_size] ^= 0x10;
+        os_transport_send(b->line, b->ans, b->ans_size);
+        b->ans_size = 0;
+
+        if (b->link_next_rate != b->link_rate)
+        {
+            b->link_rate = b->link_next_rate;
+            os_transport_set_speed(b->line, osens_link_rate_to_bps(b->link_rate));
+        }
+    }
+
+    // the mote sends at most one request per tick, the board is polled faster
+    n = os_transport_recv(b->line, rx, sizeof(rx));
+    if ((n <= 0) || (test_noise_rand(&b->seed) % 100 < b->drop_pct))
+        return;
+
+    if (osens_unpack_cmd_req(&cmd, rx, (uint16_t) n) == n)
+        test_board_answer(b, &cmd);
+}
+
+// state machine ticks with the board polled five times per tick
+static void test_board_run(osens_mote_ctx_t ctx, test_board_t *b, uint32_t ms)
+{
+    uint32_t t;
+
+    for (t = 0; t < ms; t += OSENS_SM_TICK_MS / 5)
+    {
+        if ((t % OSENS_SM_TICK_MS) == 0)
+            osens_mote_ctx_sm(ctx);
+        test_board_poll(b);
+        osens_mote_ctx_rx(ctx);
+        os_kernel_sleep(OSENS_SM_TICK_MS / 5);
+    }
+}
+
+// one 1 s point: a scan takes a few ticks, answers delayed by 1 s make it overrun
+void test_osens_mote_scan_overrun(void)
+{
+    static osens_stats_t before, after;
+    os_transport_t mote_end;
+    test_board_t board;
+    osens_mote_ctx_t ctx;
+    osens_point_t point;
+
+    memset(&board, 0, sizeof(board));
+    board.num_points = 1;
+    board.period_x250ms = 4;
+    board.seed = 1;
+
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &board.line, 0));
+    ctx = osens_mote_ctx_create_transport(20, mote_end);
+
+    test_board_run(ctx, &board, 15000);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point(ctx, 0, &point));
+
+    osens_get_stats(&before);
+    test_board_run(ctx, &board, 10000);
+    osens_get_stats(&after);
+    TEST_ASSERT_TRUE(after.boards[20].responses[OSENS_ANS_OK] - before.boards[20].responses[OSENS_ANS_OK] >= 3);
+    TEST_ASSERT_EQUAL_UINT32(0, after.boards[20].scan_overruns - before.boards[20].scan_overruns);
+    TEST_ASSERT_EQUAL_UINT16(1000, point.value.u16);
+
+    board.delay_ms = 1000;
+    osens_get_stats(&before);
+    test_board_run(ctx, &board, 10000);
+    osens_get_stats(&after);
+    TEST_ASSERT_TRUE(after.boards[20].scan_overruns - before.boards[20].scan_overruns >= 2);
+    TEST_ASSERT_EQUAL_UINT32(0, after.boards[20].rediscoveries - before.boards[20].rediscoveries);
+
+    osens_mote_ctx_destroy(ctx);
+    os_transport_close(board.line);
+}
+
+// a board refusing the interface version is asked again after 30 s only
+void test_osens_mote_version_refused(void)
+{
+    static osens_stats_t before, after;
+    os_transport_t mote_end;
+    test_board_t board;
+    osens_mote_ctx_t ctx;
+
+    memset(&board, 0, sizeof(board));
+    board.num_points = 1;
+    board.period_x250ms = 4;
+    board.refuse_version = 1;
+    board.seed = 1;
+
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &board.line, 0));
+    ctx = osens_mote_ctx_create_transport(22, mote_end);
+
+    osens_get_stats(&before);
+    test_board_run(ctx, &board, 20000);
+    osens_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[22].requests - before.boards[22].requests);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[22].responses[OSENS_ANS_ERROR] - before.boards[22].responses[OSENS_ANS_ERROR]);
+
+    test_board_run(ctx, &board, 20000);
+    osens_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(2, after.boards[22].requests - before.boards[22].requests);
+
+    // accepted on the next try
+    board.refuse_version = 0;
+    test_board_run(ctx, &board, 45000);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_num_points(ctx));
+
+    osens_mote_ctx_destroy(ctx);
+    os_transport_close(board.line);
+}
+
+// answers corrupted after the switch to 3 Mbps (bad CRC or lost framing) bring the mote back to the base rate for good
+void test_osens_mote_link_fallback(void)
+{
+    static osens_stats_t before, after;
+    osens_mote_link_stats_t link;
+    os_transport_t mote_end;
+    test_board_t board;
+    osens_mote_ctx_t ctx;
+    osens_point_t point;
+
+    memset(&board, 0, sizeof(board));
+    board.num_points = 1;
+    board.period_x250ms = 4;
+    board.link_rates = (1 << OSENS_LINK_RATE_DEFAULT) | (1 << OSENS_LINK_RATE_3M);
+    board.link_rate = OSENS_LINK_RATE_DEFAULT;
+    board.link_next_rate = OSENS_LINK_RATE_DEFAULT;
+    board.seed = 1;
+
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &board.line, 0));
+    os_transport_set_line(mote_end, 115200, 10);
+    ctx = osens_mote_ctx_create_transport(23, mote_end);
+
+    test_board_run(ctx, &board, 15000);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point(ctx, 0, &point));
+    osens_mote_get_link_stats(ctx, &link);
+    TEST_ASSERT_EQUAL_UINT32(3000000, link.bps);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_LINK_RATE_3M, board.link_rate);
+
+    osens_get_stats(&before);
+    board.corrupt_pct = 100;
+    test_board_run(ctx, &board, 30000);
+    osens_get_stats(&after);
+    TEST_ASSERT_TRUE(after.boards[23].responses[OSENS_ANS_CRC_ERROR] > before.boards[23].responses[OSENS_ANS_CRC_ERROR]);
+    TEST_ASSERT_TRUE(after.boards[23].rediscoveries > before.boards[23].rediscoveries);
+    osens_mote_get_link_stats(ctx, &link);
+    TEST_ASSERT_EQUAL_UINT32(115200, link.bps);
+
+    // 3 Mbps is not negotiated again
+    board.corrupt_pct = 0;
+    board.link_rate = OSENS_LINK_RATE_DEFAULT;
+    board.link_next_rate = OSENS_LINK_RATE_DEFAULT;
+    os_transport_set_speed(board.line, 115200);
+    osens_get_stats(&before);
+    test_board_run(ctx, &board, 20000);
+    osens_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point(ctx, 0, &point));
+    TEST_ASSERT_EQUAL_UINT16(1000, point.value.u16);
+    TEST_ASSERT_EQUAL_UINT32(0, after.regs[OSENS_REGMAP_LINK_SPEED].requests - before.regs[OSENS_REGMAP_LINK_SPEED].requests);
+    osens_mote_get_link_stats(ctx, &link);
+    TEST_ASSERT_EQUAL_UINT32(115200, link.bps);
+
+    osens_mote_ctx_destroy(ctx);
+    os_transport_close(board.line);
+}
+
+#define TEST_FAULT_SCENARIOS 200
+
+/*
+    Randomized faults from a seed per scenario: lost requests, corrupted and
+    late answers (some past the answer timeout). Once the faults stop, the
+    mote must find the board again and read every point.
+*/
+void test_osens_mote_fault_scenarios(void)
+{
+    static osens_stats_t before, after;
+    os_transport_t mote_end;
+    test_board_t board;
+    osens_mote_ctx_t ctx;
+    osens_point_t point;
+    char msg[64];
+    uint32_t seed;
+    uint32_t s;
+    uint8_t n;
+
+    // a few lines per scenario would flood the output
+    os_util_log_set_level(OS_UTIL_LOG_ERROR);
+    osens_get_stats(&before);
+
+    for (s = 0; s < TEST_FAULT_SCENARIOS; s++)
+    {
+        seed = 1000 + s;
+        sprintf(msg, "scenario seed %u", seed);
+
+        memset(&board, 0, sizeof(board));
+        board.seed = seed;
+        board.num_points = 1 + test_noise_rand(&seed) % 4;
+        board.period_x250ms = 4 * (1 + test_noise_rand(&seed) % 3);
+        board.drop_pct = test_noise_rand(&seed) % 40;
+        board.corrupt_pct = test_noise_rand(&seed) % 40;
+        board.delay_ms = test_noise_rand(&seed) % 500;
+        board.jitter_ms = 1 + test_noise_rand(&seed) % 7000;
+
+        TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &board.line, 0));
+        ctx = osens_mote_ctx_create_transport(21, mote_end);
+        test_board_run(ctx, &board, 30000);
+
+        board.drop_pct = 0;
+        board.corrupt_pct = 0;
+        board.delay_ms = 0;
+        board.jitter_ms = 0;
+        test_board_run(ctx, &board, 60000);
+
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(board.num_points, osens_mote_get_num_points(ctx), msg);
+        for (n = 0; n < board.num_points; n++)
+        {
+            TEST_ASSERT_EQUAL_UINT8_MESSAGE(1, osens_mote_get_point(ctx, n, &point), msg);
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(1000 + n, point.value.u16, msg);
+        }
+
+        osens_mote_ctx_destroy(ctx);
+        os_transport_close(board.line);
+    }
+
+    os_util_log_set_level(OS_UTIL_LOG_DEBUG);
+
+    // the faults were seen
+    osens_get_stats(&after);
+    TEST_ASSERT_TRUE(after.boards[21].timeouts > before.boards[21].timeouts);
+    TEST_ASSERT_TRUE(after.boards[21].responses[OSENS_ANS_CRC_ERROR] > before.boards[21].responses[OSENS_ANS_CRC_ERROR]);
+    TEST_ASSERT_TRUE(after.boards[21].rediscoveries > before.boards[21].rediscoveries);
+}
+
+static volatile uint8_t pt_test_flag;
+static uint8_t pt_test_count;
+
+// only waits, PT_YIELD_FLAG is left unused
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+
+static int pt_test_wait_func(struct pt *pt)
+{
+    PT_BEGIN(pt);
+
+    while (1)
+    {
+        PT_WAIT_UNTIL(pt, pt_test_flag == 1);
+        pt_test_flag = 0;
+        pt_test_count++;
+    }
+
+    PT_END(pt);
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+static int pt_test_yield_func(struct pt *pt)
+{
+    PT_BEGIN(pt);
+    PT_YIELD(pt);
+    PT_END(pt);
+}
+
+void test_os_pt_sched(void)
+{
+    os_pt_task_t wait_task;
+    os_pt_task_t yield_task;
+
+    pt_test_flag = 0;
+    pt_test_count = 0;
+
+    os_pt_sched_init();
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_pt_sched_add(&wait_task, pt_test_wait_func, "WAIT"));
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_pt_sched_add(&yield_task, pt_test_yield_func, "YIELD"));
+
+    // both run once after being added, then only the yielded one runs again, until it ends
+    TEST_ASSERT_EQUAL_UINT32(2, os_pt_sched_run_once());
+    TEST_ASSERT_EQUAL_UINT32(1, os_pt_sched_run_once());
+    TEST_ASSERT_EQUAL_UINT32(0, os_pt_sched_run_once());
+
+    // nothing runs without a signal, even when the condition is true
+    pt_test_flag = 1;
+    TEST_ASSERT_EQUAL_UINT32(0, os_pt_sched_run_once());
+    os_pt_sched_signal(&wait_task);
+    os_pt_sched_signal(&yield_task); // ended, not run again
+    TEST_ASSERT_EQUAL_UINT32(1, os_pt_sched_run_once());
+    TEST_ASSERT_EQUAL_UINT8(1, pt_test_count);
+
+    TEST_ASSERT_EQUAL_UINT32(2, wait_task.runs);
+    TEST_ASSERT_EQUAL_UINT32(2, wait_task.signals);
+    TEST_ASSERT_EQUAL_UINT32(2, yield_task.runs);
+}
+
+static void* test_sensor_thread(void *param)
+{
+    osens_sensor_set_transport((os_transport_t) param);
+    osens_sensor_main();
+
+    return 0;
+}
+
+static uint32_t test_stream_values;
+
+static void test_stream_func(osens_mote_ctx_t ctx, uint16_t seq, const osens_point_t *values,
+    uint8_t num_values, void *arg)
+{
+    // TEMP (float) and FIRE (u8)
+    if ((num_values == 2) && (values[0].type == OSENS_DT_FLOAT) && (values[1].type == OSENS_DT_U8))
+        test_stream_values += num_values;
+}
+
+static void* test_stats_thread(void *param)
+{
+    os_event_t done = (os_event_t) param;
+
+    osens_stats_request(63, 0xFF, 0);
+    osens_stats_response(63, 0xFF, OSENS_ANS_CRC_ERROR, 1, 300);
+    os_kernel_event_signal(done);
+
+    return 0;
+}
+
+static char test_sched_log[TASK_LIST_DEPTH * 2 + 1];
+static uint8_t test_sched_len;
+
+static void test_sched_log_task(char id)
+{
+    if (test_sched_len < sizeof(test_sched_log) - 1)
+        test_sched_log[test_sched_len++] = id;
+    test_sched_log[test_sched_len] = '\0';
+}
+
+static void test_sched_task_a(void) { test_sched_log_task('a'); }
+static void test_sched_task_b(void) { test_sched_log_task('b'); }
+static void test_sched_task_c(void) { test_sched_log_task('c'); }
+
+// pushes a more urgent task while running
+static void test_sched_task_d(void)
+{
+    test_sched_log_task('d');
+    scheduler_push_task(test_sched_task_a, TASKPRIO_RESNOTIF_RX);
+}
+
+// owsn scheduler: priority order, FIFO within a priority, full ring
+void test_owsn_scheduler(void)
+{
+    uint8_t n;
+
+    scheduler_init();
+    test_sched_len = 0;
+    test_sched_log[0] = '\0';
+
+    // nothing to run
+    TEST_ASSERT_EQUAL_UINT16(0, scheduler_run_pending());
+
+    // highest priority (lowest value) first
+    scheduler_push_task(test_sched_task_c, TASKPRIO_COAP);
+    scheduler_push_task(test_sched_task_a, TASKPRIO_RES);
+    scheduler_push_task(test_sched_task_b, TASKPRIO_RESNOTIF_RX);
+    TEST_ASSERT_EQUAL_UINT16(3, scheduler_run_pending());
+    TEST_ASSERT_EQUAL_STRING("bac", test_sched_log);
+
+    // same priority in push order, a task pushed by a task is run by the same call
+    test_sched_len = 0;
+    scheduler_push_task(test_sched_task_d, TASKPRIO_BUTTON);
+    scheduler_push_task(test_sched_task_b, TASKPRIO_BUTTON);
+    scheduler_push_task(test_sched_task_c, TASKPRIO_BUTTON);
+    TEST_ASSERT_EQUAL_UINT16(4, scheduler_run_pending());
+    TEST_ASSERT_EQUAL_STRING("dabc", test_sched_log);
+    TEST_ASSERT_EQUAL_UINT16(0, scheduler_run_pending());
+
+    // a full ring drops the new task, other priorities are not affected
+    test_sched_len = 0;
+    for (n = 0; n < TASK_LIST_DEPTH; n++)
+        scheduler_push_task(n ? test_sched_task_c : test_sched_task_b, TASKPRIO_RPL);
+    scheduler_push_task(test_sched_task_a, TASKPRIO_RPL);
+    scheduler_push_task(test_sched_task_a, TASKPRIO_COAP);
+    TEST_ASSERT_EQUAL_UINT16(TASK_LIST_DEPTH + 1, scheduler_run_pending());
+    TEST_ASSERT_EQUAL_STRING("bccccccccca", test_sched_log);
+    TEST_ASSERT_EQUAL_UINT16(0, scheduler_run_pending());
+}
+
+static uint8_t test_timer_order[8];
+static volatile uint32_t test_timer_fired = 0;
+static volatile uint8_t test_timer_done = 0;
+
+static void test_timer_func(void *arg)
+{
+    uint32_t n = OS_ATOMIC_FETCH_INC(&test_timer_fired);
+
+    if (n < sizeof(test_timer_order))
+        test_timer_order[n] = (uint8_t) (uintptr_t) arg;
+}
+
+static void test_timer_slow_func(void *arg)
+{
+    OS_ATOMIC_FETCH_INC(&test_timer_fired);
+    os_kernel_sleep(20);
+    test_timer_done = 1;
+}
+
+// timer service in virtual time
+void test_os_timer(void)
+{
+    os_timer_t tmrs[64];
+    os_timer_t tmr;
+    uint32_t fired;
+    int num;
+    int n;
+
+    // expiration order, whatever the creation order
+    test_timer_fired = 0;
+    tmrs[0] = os_timer_create(test_timer_func, (void *) 3, 30, 0, 1);
+    tmrs[1] = os_timer_create(test_timer_func, (void *) 1, 10, 0, 1);
+    tmrs[2] = os_timer_create(test_timer_func, (void *) 2, 20, 0, 1);
+    os_kernel_sleep(50);
+    TEST_ASSERT_EQUAL_UINT32(3, test_timer_fired);
+    TEST_ASSERT_EQUAL_UINT8(1, test_timer_order[0]);
+    TEST_ASSERT_EQUAL_UINT8(2, test_timer_order[1]);
+    TEST_ASSERT_EQUAL_UINT8(3, test_timer_order[2]);
+    for (n = 0; n < 3; n++)
+        TEST_ASSERT_EQUAL_UINT32(OS_SUCCESS, os_timer_delete(tmrs[n]));
+
+    // periodic timer, rearmed until deactivated
+    test_timer_fired = 0;
+    tmr = os_timer_create(test_timer_func, 0, 10, 10, 1);
+    os_kernel_sleep(55);
+    TEST_ASSERT_EQUAL_UINT32(5, test_timer_fired);
+    os_timer_deactivate(tmr);
+    fired = test_timer_fired;
+    os_kernel_sleep(50);
+    TEST_ASSERT_EQUAL_UINT32(fired, test_timer_fired);
+    os_timer_activate(tmr);
+    os_kernel_sleep(25);
+    TEST_ASSERT_EQUAL_UINT32(fired + 2, test_timer_fired);
+    os_timer_delete(tmr);
+
+    // deactivated before its expiration, then started again
+    test_timer_fired = 0;
+    tmr = os_timer_create(test_timer_func, 0, 10, 0, 1);
+    os_kernel_sleep(5);
+    os_timer_deactivate(tmr);
+    os_kernel_sleep(20);
+    TEST_ASSERT_EQUAL_UINT32(0, test_timer_fired);
+    os_timer_change(tmr, 10, 0);
+    os_kernel_sleep(15);
+    TEST_ASSERT_EQUAL_UINT32(1, test_timer_fired);
+    os_timer_delete(tmr);
+
+    // deactivating waits for the callback in progress
+    test_timer_fired = 0;
+    test_timer_done = 0;
+    tmr = os_timer_create(test_timer_slow_func, 0, 10, 0, 1);
+    os_kernel_sleep(15);
+    TEST_ASSERT_EQUAL_UINT32(1, test_timer_fired);
+    TEST_ASSERT_EQUAL_UINT8(0, test_timer_done);
+    os_timer_deactivate(tmr);
+    TEST_ASSERT_EQUAL_UINT8(1, test_timer_done);
+    os_timer_delete(tmr);
+
+    // pool exhausted, a deleted timer can be created again
+    for (num = 0; num < 64; num++)
+    {
+        if ((tmrs[num] = os_timer_create(test_timer_func, 0, 10, 0, 0)) == 0)
+            break;
+    }
+    TEST_ASSERT_TRUE((num > 0) && (num < 64));
+    os_timer_delete(tmrs[num - 1]);
+    tmrs[num - 1] = os_timer_create(test_timer_func, 0, 10, 0, 0);
+    TEST_ASSERT_NOT_NULL(tmrs[num - 1]);
+    for (n = 0; n < num; n++)
+        os_timer_delete(tmrs[n]);
+}
+
+void test_osens_stats(void)
+{
+    static osens_stats_t before, after;
+    osens_stats_point_t point;
+    os_event_t done = os_kernel_event_create();
+
+    TEST_ASSERT_EQUAL_UINT8(0, osens_stats_rtt_bucket(0));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_stats_rtt_bucket(OSENS_STATS_RTT_BASE_US - 1));
+    TEST_ASSERT_EQUAL_UINT8(1, osens_stats_rtt_bucket(OSENS_STATS_RTT_BASE_US));
+    TEST_ASSERT_EQUAL_UINT8(2, osens_stats_rtt_bucket(300));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_STATS_RTT_BUCKETS - 1, osens_stats_rtt_bucket(0xFFFFFFFF));
+
+    osens_get_stats(&before);
+
+    // counters of two threads are summed on read
+    osens_stats_request(63, 0xFF, 0);
+    osens_stats_response(63, 0xFF, OSENS_ANS_OK, 1, 1000);
+    osens_stats_request(63, 0xFF, 1);
+    osens_stats_timeout(63, 0xFF);
+    osens_stats_rediscovery(63);
+
+    os_kernel_create(test_stats_thread, "STATS", (os_thread_arg) done,
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_kernel_event_wait(done, 1000));
+
+    osens_get_stats(&after);
+
+    TEST_ASSERT_EQUAL_UINT32(3, after.regs[0xFF].requests - before.regs[0xFF].requests);
+    TEST_ASSERT_EQUAL_UINT32(3, after.boards[63].requests - before.boards[63].requests);
+    TEST_ASSERT_EQUAL_UINT32(3, after.total.requests - before.total.requests);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[63].responses[OSENS_ANS_OK] - before.boards[63].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[63].responses[OSENS_ANS_CRC_ERROR] - before.boards[63].responses[OSENS_ANS_CRC_ERROR]);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[63].retries - before.boards[63].retries);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[63].timeouts - before.boards[63].timeouts);
+    TEST_ASSERT_EQUAL_UINT32(1, after.boards[63].rediscoveries - before.boards[63].rediscoveries);
+    TEST_ASSERT_EQUAL_UINT32(1, after.regs[0xFF].rtt_hist[3] - before.regs[0xFF].rtt_hist[3]);
+    TEST_ASSERT_EQUAL_UINT32(1, after.regs[0xFF].rtt_hist[2] - before.regs[0xFF].rtt_hist[2]);
+    TEST_ASSERT_TRUE(after.regs[0xFF].rtt_max_us >= 1000);
+    TEST_ASSERT_EQUAL_UINT32(0, after.lost_threads);
+
+    // first read has no interval
+    memset(&point, 0, sizeof(point));
+    osens_stats_point_sample(&point, 0, 0, 0);
+    osens_stats_point_sample(&point, 1000000, 20000, 0);
+    osens_stats_point_sample(&point, 3000000, 0, 2);
+    TEST_ASSERT_EQUAL_UINT32(3, point.samples);
+    TEST_ASSERT_EQUAL_UINT32(2, point.deadline_misses);
+    TEST_ASSERT_EQUAL_UINT32(1000000, point.interval_min_us);
+    TEST_ASSERT_EQUAL_UINT32(3000000, point.interval_max_us);
+    TEST_ASSERT_EQUAL_UINT32(20000, point.lateness_max_us);
+    TEST_ASSERT_EQUAL_UINT32(1, point.interval_hist[osens_stats_time_bucket(1000000)]);
+    TEST_ASSERT_EQUAL_UINT32(2, point.lateness_hist[0]);
+
+    os_kernel_event_delete(done);
+}
+
+// one request to the sensor thread, returns the answer status
+static uint8_t test_sensor_request(os_transport_t t, osens_cmd_req_t *cmd)
+{
+    osens_cmd_res_t ans;
+    uint8_t buf[OSENS_MAX_FRAME_SIZE];
+    uint16_t size;
+    int n;
+
+    // the sensor drops bytes until it is done with the previous frame, leave it idle like a mote does
+    os_kernel_sleep(OSENS_SM_TICK_MS);
+
+    size = osens_pack_cmd_req(cmd, buf);
+    os_transport_send(t, buf, size);
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_wait_readable(t, 1000));
+    n = os_transport_recv(t, buf, sizeof(buf));
+    TEST_ASSERT_TRUE(n > 0);
+
+    // error answers are decoded up to the status
+    osens_unpack_cmd_res(&ans, buf, (uint16_t) n);
+    TEST_ASSERT_EQUAL_UINT8(cmd->hdr.addr, ans.hdr.addr);
+
+    return ans.hdr.status;
+}
+
+// mote and sensor over a pipe, one minute of virtual time
+void test_osens_mote_discovery_virtual_time(void)
+{
+    static osens_stats_t base;
+    static osens_stats_t stats;
+    osens_mote_link_stats_t link;
+    osens_mote_stream_stats_t stream;
+    osens_mote_span_t span, span2;
+    osens_point_t point;
+    osens_aggregate_t aggr;
+    osens_stats_point_t timing;
+    osens_mote_time_sync_t sync;
+    uint64_t sample_us;
+    uint8_t stamped;
+    uint32_t n, sum;
+    os_transport_t mote_end;
+    os_transport_t sensor_end;
+    os_transport_stats_t ts;
+    uint8_t frame[OSENS_MAX_FRAME_SIZE];
+    uint16_t size;
+    osens_mote_ctx_t ctx;
+    osens_brd_id_t brd;
+    uint64_t link_start;
+    uint64_t start;
+
+    TEST_ASSERT_EQUAL_INT(1, os_kernel_sim_is_enabled());
+    TEST_ASSERT_EQUAL_INT(OS_SUCCESS, os_transport_pipe_create(&mote_end, &sensor_end, 0));
+
+    // register counters are shared with the boards of the previous tests
+    osens_get_stats(&base);
+
+    // board clock two minutes ahead of the mote clock
+    osens_sensor_set_clock_offset(120000);
+    start = os_kernel_get_time_us();
+    os_kernel_create(test_sensor_thread, "SENSOR", (os_thread_arg) sensor_end,
+        os_kernel_get_def_pri(), os_kernel_get_def_stack(), os_kernel_get_def_time_slice(), 1);
+    os_kernel_sleep(100);
+
+    // streams of TEMP (point 0) only, WAVE (point 5) is an array without a fixed sample size
+    memset(&cmd_mote, 0, sizeof(cmd_mote));
+    cmd_mote.hdr.addr = OSENS_REGMAP_STREAM;
+    cmd_mote.payload.stream_cmd.period_ms = 1000;
+    cmd_mote.payload.stream_cmd.batch = 1;
+    cmd_mote.payload.stream_cmd.mask = 0x21;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_ERROR, test_sensor_request(mote_end, &cmd_mote));
+    cmd_mote.payload.stream_cmd.mask = 0x20;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_ERROR, test_sensor_request(mote_end, &cmd_mote));
+    cmd_mote.payload.stream_cmd.mask = 0x01;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, test_sensor_request(mote_end, &cmd_mote));
+    cmd_mote.payload.stream_cmd.mask = 0;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, test_sensor_request(mote_end, &cmd_mote));
+
+    // switched to 3 Mbps and confirmed, then back to the default rate after corrupted frames
+    link_start = os_kernel_get_time_us();
+    memset(&cmd_mote, 0, sizeof(cmd_mote));
+    cmd_mote.hdr.addr = OSENS_REGMAP_LINK_SPEED;
+    cmd_mote.payload.link_speed_cmd.rate = OSENS_LINK_RATE_3M;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, test_sensor_request(mote_end, &cmd_mote));
+    cmd_mote.hdr.addr = OSENS_REGMAP_ITF_VERSION;
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, test_sensor_request(mote_end, &cmd_mote));
+    os_transport_get_stats(sensor_end, &ts);
+    TEST_ASSERT_EQUAL_UINT32(3000000, ts.bps);
+    size = osens_pack_cmd_req(&cmd_mote, frame);
+    frame[size - 1] ^= 0x10;
+    for (n = 0; n < OSENS_SENSOR_LINK_MAX_ERRORS; n++)
+    {
+        os_transport_send(mote_end, frame, size);
+        TEST_ASSERT_EQUAL_INT(OS_TIMEOUT, os_transport_wait_readable(mote_end, 200));
+    }
+    os_transport_get_stats(sensor_end, &ts);
+    TEST_ASSERT_EQUAL_UINT32(osens_link_rate_to_bps(OSENS_LINK_RATE_DEFAULT), ts.bps);
+    TEST_ASSERT_EQUAL_UINT8(OSENS_ANS_OK, test_sensor_request(mote_end, &cmd_mote));
+
+    // whole seconds, the mote starts at the same phase of the 1 s board acquisitions
+    os_kernel_sleep(1000 - (uint32_t) ((os_kernel_get_time_us() - link_start) / 1000) % 1000);
+
+    // the link statistics below only account for the mote frames
+    mote_end->tx_bytes = 0;
+    mote_end->rx_bytes = 0;
+
+    os_transport_set_line(mote_end, 115200, 10);
+    ctx = osens_mote_ctx_create_transport(0, mote_end);
+    osens_mote_ctx_start(ctx);
+    os_kernel_sleep(60000);
+
+    TEST_ASSERT_TRUE(os_kernel_get_time_us() - start >= 60100000ULL);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_brd_desc(ctx, &brd));
+    TEST_ASSERT_EQUAL_STRING("TESLA", brd.manufactor);
+    TEST_ASSERT_EQUAL_UINT8(6, osens_mote_get_num_points(ctx));
+
+    osens_get_stats(&stats);
+    osens_stats_dump();
+    TEST_ASSERT_TRUE(stats.boards[0].responses[OSENS_ANS_OK] > 7);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.regs[OSENS_REGMAP_ITF_VERSION].responses[OSENS_ANS_OK] - base.regs[OSENS_REGMAP_ITF_VERSION].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.regs[OSENS_REGMAP_BRD_ID].responses[OSENS_ANS_OK] - base.regs[OSENS_REGMAP_BRD_ID].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.boards[0].rediscoveries);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.regs[OSENS_REGMAP_LINK_SPEED].responses[OSENS_ANS_OK] - base.regs[OSENS_REGMAP_LINK_SPEED].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.regs[OSENS_REGMAP_FEATURES].responses[OSENS_ANS_OK] - base.regs[OSENS_REGMAP_FEATURES].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_HEX32(OSENS_FEATURES_ALL, osens_mote_get_features(ctx));
+
+    // values stamped by the board, converted to the mote clock
+    TEST_ASSERT_TRUE(stats.regs[OSENS_REGMAP_TIME_SYNC].responses[OSENS_ANS_OK] >= 1);
+    osens_mote_get_time_sync(ctx, &sync);
+    TEST_ASSERT_EQUAL_UINT8(1, sync.synced);
+    TEST_ASSERT_EQUAL_UINT8(1, sync.stamping);
+    TEST_ASSERT_INT_WITHIN(2, 120000, sync.offset_ms);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point_time(ctx, 2, &sample_us, &stamped));
+    TEST_ASSERT_EQUAL_UINT8(1, stamped);
+    TEST_ASSERT_TRUE(sample_us <= os_kernel_get_time_us() + 2000);
+    TEST_ASSERT_TRUE(sample_us + 2500000 > os_kernel_get_time_us());
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_get_point_time(ctx, 3, &sample_us, &stamped));
+
+    // every frame has 4 or 5 framing bytes, the link was switched to the highest rate
+    osens_mote_get_link_stats(ctx, &link);
+    TEST_ASSERT_EQUAL_UINT32(3000000, link.bps);
+    TEST_ASSERT_EQUAL_UINT16(OSENS_MOTE_FRAME_SIZE, link.frame_max);
+    TEST_ASSERT_EQUAL_UINT32(stats.boards[0].requests, link.tx_frames);
+    TEST_ASSERT_EQUAL_UINT32(link.tx_frames * 4 + link.tx_payload, link.tx_bytes);
+    TEST_ASSERT_EQUAL_UINT32(link.rx_frames * 5 + link.rx_payload, link.rx_bytes);
+    TEST_ASSERT_TRUE(link.idle_gaps > 0);
+    TEST_ASSERT_TRUE((link.busy_pct > 0) && (link.busy_pct < 1));
+    TEST_ASSERT_TRUE(link.sch_bytes_per_s > 0);
+
+    // FIRE (point 2) has a 1 s period
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point_stats(ctx, 2, &timing));
+    TEST_ASSERT_TRUE(timing.samples > 10);
+    TEST_ASSERT_TRUE(timing.interval_min_us >= 750000);
+    TEST_ASSERT_TRUE(timing.interval_max_us >= timing.interval_min_us);
+    for (n = 0, sum = 0; n < OSENS_STATS_TIME_BUCKETS; n++)
+        sum += timing.lateness_hist[n];
+    TEST_ASSERT_EQUAL_UINT32(timing.samples, sum);
+    for (n = 0, sum = 0; n < OSENS_STATS_TIME_BUCKETS; n++)
+        sum += timing.interval_hist[n];
+    TEST_ASSERT_EQUAL_UINT32(timing.samples - 1, sum);
+
+    // WAVE (point 5) is a sawtooth of 48 samples
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_get_span(ctx, 2, &span));
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_span(ctx, 5, &span));
+    TEST_ASSERT_EQUAL_UINT8(OSENS_DT_ARRAY_S16, span.type);
+    TEST_ASSERT_EQUAL_UINT16(48, span.count);
+    for (n = 1; n < span.count; n++)
+    {
+        int16_t step = ((const int16_t *) span.data)[n] - ((const int16_t *) span.data)[n - 1];
+        TEST_ASSERT_TRUE((step == 256) || (step == -47 * 256));
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_span_valid(ctx, 5, &span));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_stream_start(ctx, 1 << 5, 10, 1, test_stream_func, 0));
+
+    // ALARM and OPENCNT written in one frame
+    point.type = OSENS_DT_U8;
+    point.value.u8 = 1;
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_set_pvalue(ctx, 3, &point));
+    point.type = OSENS_DT_U32;
+    point.value.u32 = 1234;
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_set_pvalue(ctx, 4, &point));
+    os_kernel_sleep(5000);
+    osens_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.regs[OSENS_REGMAP_WRITE_BLOCK].responses[OSENS_ANS_OK]);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.regs[OSENS_REGMAP_WRITE_POINT_DATA_1 + 3].requests);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.regs[OSENS_REGMAP_WRITE_POINT_DATA_1 + 4].requests);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_point(ctx, 4, &point));
+    TEST_ASSERT_EQUAL_UINT32(1234, point.value.u32);
+
+    // TEMP (point 0, 10 s period) summarized over the acquisitions of each second
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_set_aggregate(ctx, 3, 1));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_set_aggregate(ctx, 5, 1));
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_set_aggregate(ctx, 0, 1));
+
+    // TEMP and FIRE pushed every 10 ms, 10 samples per frame
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_stream_start(ctx, 0x05, 10, 10, test_stream_func, 0));
+    os_kernel_sleep(5000);
+    osens_mote_get_stream_stats(ctx, &stream);
+    TEST_ASSERT_EQUAL_UINT8(1, stream.active);
+    TEST_ASSERT_EQUAL_UINT32(0x05, stream.mask);
+    TEST_ASSERT_TRUE(stream.frames >= 10);
+    TEST_ASSERT_EQUAL_UINT32(stream.frames * 10, stream.samples);
+    TEST_ASSERT_EQUAL_UINT32(0, stream.lost_frames);
+    TEST_ASSERT_EQUAL_UINT32(0, stream.bad_frames);
+    TEST_ASSERT_EQUAL_UINT32(stream.samples * 2, test_stream_values);
+
+    osens_mote_stream_stop(ctx);
+    os_kernel_sleep(3000);
+    osens_mote_get_stream_stats(ctx, &stream);
+    TEST_ASSERT_EQUAL_UINT8(0, stream.active);
+    n = stream.frames;
+    os_kernel_sleep(1000);
+    osens_mote_get_stream_stats(ctx, &stream);
+    TEST_ASSERT_EQUAL_UINT32(n, stream.frames);
+
+    // a span stays valid over the next read of WAVE, not over the second one
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_span(ctx, 5, &span));
+    for (n = 0; (n < 200) && (osens_mote_get_span(ctx, 5, &span2) == 1) && (span2.seq == span.seq); n++)
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    TEST_ASSERT_EQUAL_UINT32(span.seq + 1, span2.seq);
+    TEST_ASSERT_TRUE(span2.data != span.data);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_span_valid(ctx, 5, &span));
+    for (n = 0; (n < 200) && osens_mote_span_valid(ctx, 5, &span); n++)
+        os_kernel_sleep(OSENS_SM_TICK_MS);
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_span_valid(ctx, 5, &span));
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_span_valid(ctx, 5, &span2));
+
+    os_kernel_sleep(60000);
+    TEST_ASSERT_EQUAL_UINT8(1, osens_mote_get_aggregate(ctx, 0, &aggr));
+    TEST_ASSERT_EQUAL_UINT8(0, aggr.index);
+    TEST_ASSERT_TRUE(aggr.count >= 4);
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, aggr.min);
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, aggr.max);
+    TEST_ASSERT_TRUE((aggr.mean > 20.5f) && (aggr.mean < 21.0f));
+    TEST_ASSERT_TRUE((aggr.variance > 0.2f) && (aggr.variance < 0.45f));
+    TEST_ASSERT_EQUAL_UINT8(0, osens_mote_get_aggregate(ctx, 1, &aggr));
+}
+
+int test_main(void)
 {
     UnityBegin();
 
@@ -678,23 +2580,58 @@ void test_main(void)
     RUN_TEST(test_OSENS_REGMAP_POINT_DESC_1,__LINE__);
     RUN_TEST(test_OSENS_REGMAP_POINT_DESC_2,__LINE__);
     RUN_TEST(test_OSENS_REGMAP_READ_POINT_DATA_1,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_READ_POINT_ARRAY,__LINE__);
     RUN_TEST(test_OSENS_REGMAP_WRITE_POINT_DATA_5,__LINE__);
     RUN_TEST(test_OSENS_REGMAP_READ_POINT_DATA_32,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_LINK_RATES,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_LINK_SPEED,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_FRAME_SIZE,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_STREAM,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_WRITE_BLOCK,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_AGGREGATE,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_FEATURES,__LINE__);
+    RUN_TEST(test_OSENS_REGMAP_TIME_SYNC,__LINE__);
+    RUN_TEST(test_osens_frame_bounds,__LINE__);
+    RUN_TEST(test_osens_frame_bus,__LINE__);
+    RUN_TEST(test_osens_fec,__LINE__);
+    RUN_TEST(test_osens_frame_resync,__LINE__);
+    RUN_TEST(test_os_util_log_deferred,__LINE__);
+    RUN_TEST(test_os_util_log_threads,__LINE__);
+    RUN_TEST(test_osens_capture_file,__LINE__);
+    RUN_TEST(test_os_transport_pipe,__LINE__);
+    RUN_TEST(test_os_transport_wait_any,__LINE__);
+    RUN_TEST(test_osens_mote_ctx_rx_bulk,__LINE__);
+    RUN_TEST(test_osens_mote_rx_noise,__LINE__);
+    RUN_TEST(test_osens_mote_bus,__LINE__);
+    RUN_TEST(test_osens_mote_scan_overrun,__LINE__);
+    RUN_TEST(test_osens_mote_version_refused,__LINE__);
+    RUN_TEST(test_osens_mote_link_fallback,__LINE__);
+    RUN_TEST(test_osens_mote_fault_scenarios,__LINE__);
+    RUN_TEST(test_os_pt_sched,__LINE__);
+    RUN_TEST(test_owsn_scheduler,__LINE__);
+    RUN_TEST(test_os_timer,__LINE__);
+    RUN_TEST(test_osens_stats,__LINE__);
+    // mote and sensor threads keep running after this test, keep it last
+    RUN_TEST(test_osens_mote_discovery_virtual_time,__LINE__);
     
-    UnityEnd();
+    return UnityEnd();
 }
 
 int main(void)
 {
+    int failures;
+
+    // timeouts and sleeps take no time, must be enabled before any thread is created
+    os_kernel_sim_enable();
     os_util_log_start();
     //osens_sensor_init();
     //osens_mote_init();
 
-    test_main();
+    failures = test_main();
 
     os_util_log_stop();
     
-    return 0;
+    return failures;
 }
 
 #endif
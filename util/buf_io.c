@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 #include "buf_io.h"
 
 /* --- swap functions ----------------------------  */
@@ -393,3 +394,71 @@ void buf_io_putd_tb_apr(double value, uint8_t **buf)
     buf_io_putd_tb(value,*buf);
     *buf += 8;
 }
+
+/* --- block functions ----------------------------  */
+
+#if BUF_IO_LITTLE_ENDIAN != 1
+// byte swap of each element, safe when src and dst are the same memory
+static void buf_io_swap16_n(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint8_t b0;
+
+    for (; n > 0; n--, dst += 2, src += 2)
+    {
+        b0 = src[0];
+        dst[0] = src[1];
+        dst[1] = b0;
+    }
+}
+
+static void buf_io_swap32_n(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint8_t b0, b1;
+
+    for (; n > 0; n--, dst += 4, src += 4)
+    {
+        b0 = src[0];
+        b1 = src[1];
+        dst[0] = src[3];
+        dst[1] = src[2];
+        dst[2] = b1;
+        dst[3] = b0;
+    }
+}
+#endif
+
+void buf_io_get16_fl_n(void *dst, const uint8_t *buf, uint32_t n)
+{
+#if BUF_IO_LITTLE_ENDIAN == 1
+    memmove(dst, buf, n * 2);
+#else
+    buf_io_swap16_n((uint8_t *) dst, buf, n);
+#endif
+}
+
+void buf_io_get32_fl_n(void *dst, const uint8_t *buf, uint32_t n)
+{
+#if BUF_IO_LITTLE_ENDIAN == 1
+    memmove(dst, buf, n * 4);
+#else
+    buf_io_swap32_n((uint8_t *) dst, buf, n);
+#endif
+}
+
+void buf_io_put16_tl_n(const void *src, uint8_t *buf, uint32_t n)
+{
+#if BUF_IO_LITTLE_ENDIAN == 1
+    memmove(buf, src, n * 2);
+#else
+    buf_io_swap16_n(buf, (const uint8_t *) src, n);
+#endif
+}
+
+void buf_io_put32_tl_n(const void *src, uint8_t *buf, uint32_t n)
+{
+#if BUF_IO_LITTLE_ENDIAN == 1
+    memmove(buf, src, n * 4);
+#else
+    buf_io_swap32_n(buf, (const uint8_t *) src, n);
+#endif
+}
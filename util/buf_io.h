@@ -6,6 +6,7 @@ Several functions for handling data in buffers.
 Basic functions:
 
 buf_io_[get|put][8|16|32|64|f|d]_[f|t][b|l]_ap[r]
+buf_io_[get|put][16|32]_[f|t]l_n (blocks of n elements)
 
 Notation:
 
@@ -23,6 +24,15 @@ Check buf_io.c for a proper implementation of these functions for your platform.
 extern "C" {
 #endif
 
+/** Host byte order, 1 for little endian (override for compilers without __BYTE_ORDER__) */
+#ifndef BUF_IO_LITTLE_ENDIAN
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define BUF_IO_LITTLE_ENDIAN 0
+#else
+#define BUF_IO_LITTLE_ENDIAN 1
+#endif
+#endif
+
 /** Pointer size */
 #define POINTER_SIZE (sizeof(void *)) 
 
@@ -176,6 +186,20 @@ void    buf_io_putd_tb_apr      (double value, uint8_t **buf);
 #define buf_io_putd_tb_ap(v, x) buf_io_putd_tb_apr(v, &x) 
 /** @} */
 
+/** 
+  @name block functions (little endian)
+  Copy n 16 or 32 bits elements (integers or floats) between a buffer and
+  host memory. A single copy on little endian hosts, a byte swap per
+  element otherwise. Buffers may be unaligned, host memory must be aligned
+  to the element size; both may be the same memory (in place conversion).
+  @{
+*/
+void buf_io_get16_fl_n(void *dst, const uint8_t *buf, uint32_t n);
+void buf_io_get32_fl_n(void *dst, const uint8_t *buf, uint32_t n);
+void buf_io_put16_tl_n(const void *src, uint8_t *buf, uint32_t n);
+void buf_io_put32_tl_n(const void *src, uint8_t *buf, uint32_t n);
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif
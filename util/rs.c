@@ -0,0 +1,221 @@
+#include <string.h>
+#include <stdint.h>
+#include "rs.h"
+#include "../os/os_kernel.h"
+
+// field generator polynomial x^8 + x^4 + x^3 + x^2 + 1
+#define RS_GF_POLY 0x11D
+
+// exponentials are doubled so a sum of two logarithms needs no modulo
+static uint8_t gf_exp[2 * RS_MAX_SYMBOLS];
+static uint8_t gf_log[RS_MAX_SYMBOLS + 1];
+static os_once_t gf_once = OS_KERNEL_ONCE_INIT;
+
+// built by the first encode or decode, see os_kernel_once()
+static void rs_init(void)
+{
+    uint16_t x = 1;
+    uint16_t n;
+
+    for (n = 0; n < RS_MAX_SYMBOLS; n++)
+    {
+        gf_exp[n] = (uint8_t) x;
+        gf_exp[n + RS_MAX_SYMBOLS] = (uint8_t) x;
+        gf_log[x] = (uint8_t) n;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= RS_GF_POLY;
+    }
+
+    gf_log[0] = 0;
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if ((a == 0) || (b == 0))
+        return 0;
+
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    if (a == 0)
+        return 0;
+
+    return gf_exp[gf_log[a] + RS_MAX_SYMBOLS - gf_log[b]];
+}
+
+// g(x) = (x - 1)(x - a)...(x - a^(nroots - 1)), highest degree first
+static void rs_generator(uint8_t *g, uint8_t nroots)
+{
+    uint8_t j, k;
+
+    memset(g, 0, nroots + 1);
+    g[0] = 1;
+
+    for (j = 0; j < nroots; j++)
+    {
+        for (k = j + 1; k > 0; k--)
+            g[k] ^= gf_mul(g[k - 1], gf_exp[j]);
+    }
+}
+
+// value of an ascending polynomial at x
+static uint8_t rs_poly_eval(const uint8_t *p, uint8_t deg, uint8_t x)
+{
+    uint8_t v = 0;
+    int k;
+
+    for (k = deg; k >= 0; k--)
+        v = gf_mul(v, x) ^ p[k];
+
+    return v;
+}
+
+void rs_encode(const uint8_t *data, uint16_t len, uint16_t stride, uint8_t *parity, uint8_t nroots)
+{
+    uint8_t g[RS_MAX_ROOTS + 1];
+    uint8_t fb;
+    uint16_t n;
+    uint8_t j;
+
+    os_kernel_once(&gf_once, rs_init);
+
+    rs_generator(g, nroots);
+    memset(parity, 0, nroots);
+
+    // remainder of data(x).x^nroots divided by g(x)
+    for (n = 0; n < len; n++)
+    {
+        fb = data[n * stride] ^ parity[0];
+        memmove(parity, &parity[1], nroots - 1);
+        parity[nroots - 1] = 0;
+
+        if (fb)
+        {
+            for (j = 0; j < nroots; j++)
+                parity[j] ^= gf_mul(fb, g[j + 1]);
+        }
+    }
+}
+
+int rs_decode(uint8_t *data, uint16_t len, uint16_t stride, uint8_t *parity, uint8_t nroots)
+{
+    uint8_t synd[RS_MAX_ROOTS];
+    uint8_t lambda[RS_MAX_ROOTS + 1];
+    uint8_t prev[RS_MAX_ROOTS + 1];
+    uint8_t tmp[RS_MAX_ROOTS + 1];
+    uint8_t omega[RS_MAX_ROOTS];
+    uint8_t deriv[RS_MAX_ROOTS];
+    uint16_t loc[RS_MAX_ROOTS / 2];
+    uint8_t val[RS_MAX_ROOTS / 2];
+    uint16_t num = len + nroots;
+    uint8_t errors = 0;
+    uint8_t num_err = 0;
+    uint8_t d, b, m, coef;
+    uint8_t xinv, den;
+    uint16_t n, i;
+    uint8_t j, k;
+
+    os_kernel_once(&gf_once, rs_init);
+
+    // syndromes: the received word at each root of g(x)
+    for (j = 0; j < nroots; j++)
+    {
+        uint8_t s = 0;
+
+        for (n = 0; n < num; n++)
+            s = gf_mul(s, gf_exp[j]) ^ (n < len ? data[n * stride] : parity[n - len]);
+
+        synd[j] = s;
+        errors |= s;
+    }
+
+    if (errors == 0)
+        return 0;
+
+    // Berlekamp-Massey: error locator lambda(x) of degree num_err
+    memset(lambda, 0, sizeof(lambda));
+    memset(prev, 0, sizeof(prev));
+    lambda[0] = 1;
+    prev[0] = 1;
+    b = 1;
+    m = 1;
+
+    for (k = 0; k < nroots; k++)
+    {
+        d = synd[k];
+        for (j = 1; j <= num_err; j++)
+            d ^= gf_mul(lambda[j], synd[k - j]);
+
+        if (d == 0)
+        {
+            m++;
+            continue;
+        }
+
+        coef = gf_div(d, b);
+        memcpy(tmp, lambda, nroots + 1);
+        for (j = m; j <= nroots; j++)
+            lambda[j] ^= gf_mul(coef, prev[j - m]);
+
+        if (2 * num_err <= k)
+        {
+            num_err = k + 1 - num_err;
+            memcpy(prev, tmp, nroots + 1);
+            b = d;
+            m = 1;
+        }
+        else
+        {
+            m++;
+        }
+    }
+
+    if (2 * num_err > nroots)
+        return -1;
+
+    // error evaluator omega(x) = S(x).lambda(x) mod x^nroots and lambda'(x)
+    for (j = 0; j < nroots; j++)
+    {
+        omega[j] = 0;
+        for (k = 0; k <= j; k++)
+            omega[j] ^= gf_mul(lambda[k], synd[j - k]);
+    }
+
+    for (j = 0; j < nroots; j++)
+        deriv[j] = (j & 1) ? 0 : lambda[j + 1];
+
+    // Chien search over the (shortened) code word, Forney for the values
+    for (n = 0, i = 0; n < num; n++)
+    {
+        uint16_t p = num - 1 - n;
+
+        xinv = gf_exp[(RS_MAX_SYMBOLS - p) % RS_MAX_SYMBOLS];
+        if (rs_poly_eval(lambda, num_err, xinv) != 0)
+            continue;
+
+        den = rs_poly_eval(deriv, num_err, xinv);
+        if ((den == 0) || (i >= num_err))
+            return -1;
+
+        loc[i] = n;
+        val[i] = gf_mul(gf_exp[p], gf_div(rs_poly_eval(omega, nroots - 1, xinv), den));
+        i++;
+    }
+
+    // roots outside the code word: too many errors
+    if (i != num_err)
+        return -1;
+
+    for (i = 0; i < num_err; i++)
+    {
+        if (loc[i] < len)
+            data[loc[i] * stride] ^= val[i];
+        else
+            parity[loc[i] - len] ^= val[i];
+    }
+
+    return num_err;
+}
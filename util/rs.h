@@ -0,0 +1,55 @@
+/**
+@file rs.h
+
+Reed-Solomon code over GF(2^8) (polynomial 0x11D, first consecutive root 1).
+
+A code word holds up to RS_MAX_SYMBOLS bytes: the data followed by nroots
+parity bytes (systematic code). Up to nroots / 2 bad bytes per code word
+are corrected, wherever they are. Shorter code words are shortened codes,
+there is no padding on the wire.
+
+Data bytes may be spread over a larger buffer (stride > 1), so several
+code words can be interleaved byte by byte: a burst of errors is then
+shared between the code words instead of hitting a single one.
+*/
+
+#ifndef __RS_H__
+#define __RS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Longest code word, data and parity */
+#define RS_MAX_SYMBOLS 255
+/** Most parity bytes per code word */
+#define RS_MAX_ROOTS    32
+
+/**
+    Computes the parity bytes of a code word.
+
+    @param data   first data byte
+    @param len    number of data bytes (up to RS_MAX_SYMBOLS - nroots)
+    @param stride distance between two data bytes of the code word
+    @param parity nroots bytes, written
+    @param nroots number of parity bytes (1 to RS_MAX_ROOTS)
+*/
+void rs_encode(const uint8_t *data, uint16_t len, uint16_t stride, uint8_t *parity, uint8_t nroots);
+
+/**
+    Corrects a code word in place.
+
+    @param data   first data byte
+    @param len    number of data bytes
+    @param stride distance between two data bytes of the code word
+    @param parity nroots parity bytes, corrected too
+    @param nroots number of parity bytes
+    @retval number of bytes corrected, -1 when there are more errors than the code corrects
+*/
+int rs_decode(uint8_t *data, uint16_t len, uint16_t stride, uint8_t *parity, uint8_t nroots);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RS_H__ */